@@ -0,0 +1,283 @@
+/**
+ * Key expiry index benchmark.
+ * 
+ * Compares ExpiryIndex (a hierarchical timing wheel) with the binary
+ * min-heap it replaced, here as an indexed heap (each timer knows its heap
+ * slot, so a refresh is a sift rather than a search). Two workloads:
+ * 
+ * - random: schedule N keys with TTLs drawn uniformly from 1 s to 1 h,
+ *   then run the clock forward in 100 ms ticks until all have expired
+ * - refresh: keep N keys on a 60 s TTL, refreshing a random one per
+ *   request so that each key is requested every 10 s on average, for
+ *   90 simulated seconds with an expiry tick every 100 ms
+ * 
+ * Usage: expiry_bench [keys ...]   (default: 1000000 10000000)
+ */
+
+#include "data/expiry_index.hpp"
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <chrono>
+#include <random>
+#include <cstdlib>
+#include <limits>
+#include <string>
+#include <algorithm>
+
+using namespace scuffedredis;
+
+namespace {
+
+constexpr int64_t START = 1700000000000;  // Unix ms the clock starts at
+constexpr int64_t TICK_MS = 100;          // Between expiry runs
+constexpr int64_t REFRESH_TTL_MS = 60000;
+constexpr size_t REQUEST_INTERVAL_MS = 10000;  // Mean, per key
+constexpr size_t SIMULATED_MS = 90000;
+
+template<typename Fn>
+double nanos_per_op(size_t ops, Fn&& fn) {
+    auto start = std::chrono::steady_clock::now();
+    fn();
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    return std::chrono::duration<double, std::nano>(elapsed).count() / static_cast<double>(ops);
+}
+
+// One key's TTL, as a table entry would hold it
+struct Timer {
+    int64_t deadline;
+    uint32_t position;  // In the index or heap
+};
+
+struct TimerDeadline {
+    int64_t operator()(const Timer* timer) const { return timer->deadline; }
+};
+
+/**
+ * The timing wheel, driven the way the keyspace tables drive it.
+ */
+class WheelQueue {
+public:
+    static constexpr const char* NAME = "wheel";
+    
+    void add(Timer* timer) { timer->position = index_.add(timer); }
+    
+    void refresh(Timer* timer) { index_.reschedule(timer->position); }
+    
+    template<typename Expire>
+    size_t expire(int64_t now, Expire&& on_expire) {
+        return index_.expire(now, std::numeric_limits<size_t>::max(), [&](Timer* timer) {
+            if (Timer** moved = index_.remove(timer->position)) {
+                (*moved)->position = timer->position;
+            }
+            on_expire(timer);
+        });
+    }
+    
+    size_t size() const { return index_.size(); }
+    size_t memory_usage() const { return index_.memory_usage(); }
+
+private:
+    ExpiryIndex<Timer*, TimerDeadline> index_;
+};
+
+/**
+ * Binary min-heap on deadline; each timer records its slot so it can be
+ * moved in place when refreshed.
+ */
+class HeapQueue {
+public:
+    static constexpr const char* NAME = "heap";
+    
+    void add(Timer* timer) {
+        heap_.push_back(timer);
+        sift_up(heap_.size() - 1);
+    }
+    
+    void refresh(Timer* timer) {
+        sift_up(timer->position);
+        sift_down(timer->position);
+    }
+    
+    template<typename Expire>
+    size_t expire(int64_t now, Expire&& on_expire) {
+        size_t removed = 0;
+        while (!heap_.empty() && heap_[0]->deadline <= now) {
+            Timer* timer = heap_[0];
+            heap_[0] = heap_.back();
+            heap_[0]->position = 0;
+            heap_.pop_back();
+            if (!heap_.empty()) {
+                sift_down(0);
+            }
+            on_expire(timer);
+            removed++;
+        }
+        return removed;
+    }
+    
+    size_t size() const { return heap_.size(); }
+    size_t memory_usage() const { return heap_.capacity() * sizeof(Timer*); }
+
+private:
+    std::vector<Timer*> heap_;
+    
+    void place(size_t index, Timer* timer) {
+        heap_[index] = timer;
+        timer->position = static_cast<uint32_t>(index);
+    }
+    
+    void sift_up(size_t index) {
+        Timer* timer = heap_[index];
+        while (index > 0) {
+            size_t parent = (index - 1) / 2;
+            if (heap_[parent]->deadline <= timer->deadline) {
+                break;
+            }
+            place(index, heap_[parent]);
+            index = parent;
+        }
+        place(index, timer);
+    }
+    
+    void sift_down(size_t index) {
+        Timer* timer = heap_[index];
+        size_t size = heap_.size();
+        while (true) {
+            size_t child = index * 2 + 1;
+            if (child >= size) {
+                break;
+            }
+            if (child + 1 < size && heap_[child + 1]->deadline < heap_[child]->deadline) {
+                child++;
+            }
+            if (timer->deadline <= heap_[child]->deadline) {
+                break;
+            }
+            place(index, heap_[child]);
+            index = child;
+        }
+        place(index, timer);
+    }
+};
+
+template<typename Queue>
+void report_random(size_t keys) {
+    std::vector<Timer> timers(keys);
+    std::mt19937_64 rng(keys);
+    std::uniform_int_distribution<int64_t> ttl(1000, 3600000);
+    for (Timer& timer : timers) {
+        timer.deadline = START + ttl(rng);
+    }
+    
+    Queue queue;
+    double add_ns = nanos_per_op(keys, [&]() {
+        for (Timer& timer : timers) {
+            queue.add(&timer);
+        }
+    });
+    size_t bytes = queue.memory_usage();
+    
+    // Every timer must come out once, and not before its deadline
+    size_t expired = 0;
+    size_t early = 0;
+    int64_t now = START;
+    double expire_ns = nanos_per_op(keys, [&]() {
+        while (queue.size() > 0) {
+            now += TICK_MS;
+            expired += queue.expire(now, [&](Timer* timer) {
+                early += timer->deadline > now;
+            });
+        }
+    });
+    if (expired != keys || early != 0) {
+        std::cerr << Queue::NAME << ": expired " << expired << " of " << keys
+                  << ", " << early << " early" << std::endl;
+    }
+    
+    std::cout << std::fixed << std::setprecision(1)
+              << std::setw(8) << Queue::NAME
+              << std::setw(12) << add_ns
+              << std::setw(14) << expire_ns
+              << std::setw(12) << static_cast<double>(bytes) / keys << std::endl;
+}
+
+template<typename Queue>
+void report_refresh(size_t keys) {
+    std::vector<Timer> timers(keys);
+    Queue queue;
+    int64_t now = START;
+    for (Timer& timer : timers) {
+        timer.deadline = now + REFRESH_TTL_MS;
+        queue.add(&timer);
+    }
+    
+    // Expired keys come back on their next request, as a SET EX would
+    std::vector<char> live(keys, 1);
+    std::mt19937_64 rng(keys);
+    std::uniform_int_distribution<size_t> pick(0, keys - 1);
+    size_t per_ms = std::max<size_t>(1, keys / REQUEST_INTERVAL_MS);
+    size_t requests = per_ms * SIMULATED_MS;
+    size_t expired = 0;
+    
+    double ns = nanos_per_op(requests, [&]() {
+        for (size_t i = 1; i <= requests; i++) {
+            Timer& timer = timers[pick(rng)];
+            timer.deadline = now + REFRESH_TTL_MS;
+            size_t id = static_cast<size_t>(&timer - timers.data());
+            if (live[id]) {
+                queue.refresh(&timer);
+            } else {
+                live[id] = 1;
+                queue.add(&timer);
+            }
+            
+            if (i % per_ms == 0) {
+                now++;
+                if (now % TICK_MS == 0) {
+                    expired += queue.expire(now, [&](Timer* gone) {
+                        live[static_cast<size_t>(gone - timers.data())] = 0;
+                    });
+                }
+            }
+        }
+    });
+    
+    std::cout << std::fixed << std::setprecision(1)
+              << std::setw(8) << Queue::NAME
+              << std::setw(12) << ns
+              << std::setw(12) << expired << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    std::vector<size_t> sizes;
+    for (int i = 1; i < argc; i++) {
+        sizes.push_back(std::strtoul(argv[i], nullptr, 10));
+    }
+    if (sizes.empty()) {
+        sizes = {1000000, 10000000};
+    }
+    
+    for (size_t keys : sizes) {
+        std::cout << std::endl;
+        std::cout << keys << " keys, TTL uniform in 1 s .. 1 h, expired in "
+                  << TICK_MS << " ms ticks:" << std::endl;
+        std::cout << std::setw(8) << "index" << std::setw(12) << "add ns"
+                  << std::setw(14) << "expire ns" << std::setw(12) << "B/key" << std::endl;
+        report_random<HeapQueue>(keys);
+        report_random<WheelQueue>(keys);
+        
+        std::cout << std::endl;
+        std::cout << keys << " keys refreshed with a " << REFRESH_TTL_MS / 1000
+                  << " s TTL, each requested every " << REQUEST_INTERVAL_MS / 1000
+                  << " s on average:" << std::endl;
+        std::cout << std::setw(8) << "index" << std::setw(12) << "refresh ns"
+                  << std::setw(12) << "expired" << std::endl;
+        report_refresh<HeapQueue>(keys);
+        report_refresh<WheelQueue>(keys);
+    }
+    
+    return 0;
+}
@@ -0,0 +1,237 @@
+/**
+ * ConcurrentHashTable scaling benchmark.
+ *
+ * Runs a GET/SET mix from 1 to 32 threads against a single-lock table
+ * (one segment) and a lock-striped table, and prints throughput for each.
+ * Then measures single-threaded SET latency while a table grows through
+ * many resizes, to show incremental rehashing keeps the tail flat, and
+ * compares the chained and Swiss table engines on GET latency and heap
+ * bytes per key.
+ *
+ * Usage: hashtable_bench [segments] [ops_per_thread] [set_percent] [grow_keys]
+ */
+
+#include "data/hashtable.hpp"
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <cstdlib>
+#include <algorithm>
+
+#if defined(__GLIBC__)
+    #include <malloc.h>
+#endif
+
+using namespace scuffedredis;
+
+namespace {
+
+constexpr size_t KEY_SPACE = 100000;
+
+std::vector<std::string> make_keys() {
+    std::vector<std::string> keys;
+    keys.reserve(KEY_SPACE);
+    for (size_t i = 0; i < KEY_SPACE; i++) {
+        keys.push_back("key:" + std::to_string(i));
+    }
+    return keys;
+}
+
+/**
+ * Run the workload and return operations per second.
+ */
+double run(size_t segments, size_t threads, size_t ops_per_thread, 
+           unsigned set_percent, const std::vector<std::string>& keys) {
+    ConcurrentHashTable table(16, segments);
+    for (const auto& key : keys) {
+        table.set(key, "value");
+    }
+    
+    std::atomic<size_t> ready{0};
+    std::atomic<bool> go{false};
+    std::vector<std::thread> workers;
+    
+    for (size_t t = 0; t < threads; t++) {
+        workers.emplace_back([&, t]() {
+            std::mt19937 rng(static_cast<unsigned>(t * 7919 + 1));
+            std::uniform_int_distribution<size_t> pick(0, keys.size() - 1);
+            std::uniform_int_distribution<unsigned> percent(0, 99);
+            
+            ready++;
+            while (!go.load(std::memory_order_acquire)) {
+                std::this_thread::yield();
+            }
+            
+            size_t found = 0;
+            for (size_t i = 0; i < ops_per_thread; i++) {
+                const std::string& key = keys[pick(rng)];
+                if (percent(rng) < set_percent) {
+                    table.set(key, "updated");
+                } else if (table.get(key)) {
+                    found++;
+                }
+            }
+            
+            // Keep the reads from being optimized away
+            if (found > ops_per_thread) {
+                std::cerr << "impossible" << std::endl;
+            }
+        });
+    }
+    
+    while (ready.load() < threads) {
+        std::this_thread::yield();
+    }
+    
+    auto start = std::chrono::steady_clock::now();
+    go.store(true, std::memory_order_release);
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    
+    double seconds = std::chrono::duration<double>(elapsed).count();
+    return static_cast<double>(threads * ops_per_thread) / seconds;
+}
+
+/**
+ * Insert `count` keys into an empty table, timing every SET.
+ */
+void report_growth_latency(size_t count) {
+    HashTable table;
+    std::vector<double> latencies;
+    latencies.reserve(count);
+    
+    for (size_t i = 0; i < count; i++) {
+        std::string key = "grow:" + std::to_string(i);
+        auto start = std::chrono::steady_clock::now();
+        table.set(key, "value");
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        latencies.push_back(std::chrono::duration<double, std::micro>(elapsed).count());
+    }
+    
+    std::sort(latencies.begin(), latencies.end());
+    auto percentile = [&latencies](double p) {
+        return latencies[static_cast<size_t>(p * (latencies.size() - 1))];
+    };
+    
+    std::cout << std::endl;
+    std::cout << "SET latency while growing to " << count << " keys (" 
+              << table.capacity() << " buckets):" << std::endl;
+    std::cout << std::fixed << std::setprecision(2)
+              << "  p50 " << percentile(0.50) << "us"
+              << "  p99 " << percentile(0.99) << "us"
+              << "  p99.9 " << percentile(0.999) << "us"
+              << "  max " << latencies.back() << "us" << std::endl;
+}
+
+/**
+ * Bytes currently allocated from the heap (0 if unknown).
+ */
+size_t heap_in_use() {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+    return mallinfo2().uordblks + mallinfo2().hblkhd;
+#else
+    return 0;
+#endif
+}
+
+/**
+ * Fill one engine with `count` keys and time hits and misses.
+ */
+template<typename Table>
+void report_engine(const char* name, const std::vector<std::string>& keys) {
+    size_t heap_before = heap_in_use();
+    auto table = std::make_unique<Table>();
+    for (const auto& key : keys) {
+        table->set(key, "value:" + key);
+    }
+    size_t heap_after = heap_in_use();
+    
+    std::vector<size_t> order(keys.size());
+    for (size_t i = 0; i < order.size(); i++) {
+        order[i] = i;
+    }
+    std::shuffle(order.begin(), order.end(), std::mt19937(42));
+    
+    size_t found = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i : order) {
+        found += table->get(keys[i]).has_value();
+    }
+    auto hit_time = std::chrono::steady_clock::now() - start;
+    
+    start = std::chrono::steady_clock::now();
+    for (size_t i : order) {
+        found += table->exists(keys[i] + "!");
+    }
+    auto miss_time = std::chrono::steady_clock::now() - start;
+    
+    if (found != keys.size()) {
+        std::cerr << name << ": lookup mismatch" << std::endl;
+    }
+    
+    double per_op = 1e9 / static_cast<double>(keys.size());
+    std::cout << std::fixed << std::setprecision(1)
+              << std::setw(10) << name
+              << std::setw(14) << std::chrono::duration<double>(hit_time).count() * per_op
+              << std::setw(14) << std::chrono::duration<double>(miss_time).count() * per_op;
+    if (heap_after > heap_before) {
+        std::cout << std::setw(16) 
+                  << static_cast<double>(heap_after - heap_before) / keys.size();
+    }
+    std::cout << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    size_t segments = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 64;
+    size_t ops_per_thread = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 200000;
+    unsigned set_percent = argc > 3 ? static_cast<unsigned>(std::atoi(argv[3])) : 20;
+    size_t grow_keys = argc > 4 ? std::strtoul(argv[4], nullptr, 10) : 2000000;
+    
+    auto keys = make_keys();
+    
+    std::cout << "ConcurrentHashTable: " << KEY_SPACE << " keys, " 
+              << ops_per_thread << " ops/thread, " << set_percent << "% SET" << std::endl;
+    std::cout << "hardware threads: " << std::thread::hardware_concurrency() << std::endl;
+    std::cout << std::endl;
+    std::cout << std::setw(8) << "threads" 
+              << std::setw(16) << "1 lock (Mops)" 
+              << std::setw(12) << segments << " segs (Mops)"
+              << std::setw(10) << "speedup" << std::endl;
+    
+    for (size_t threads = 1; threads <= 32; threads *= 2) {
+        double single = run(1, threads, ops_per_thread, set_percent, keys);
+        double striped = run(segments, threads, ops_per_thread, set_percent, keys);
+        
+        std::cout << std::fixed << std::setprecision(2)
+                  << std::setw(8) << threads
+                  << std::setw(16) << single / 1e6
+                  << std::setw(23) << striped / 1e6
+                  << std::setw(9) << striped / single << "x" << std::endl;
+    }
+    
+    report_growth_latency(grow_keys);
+    
+    std::vector<std::string> engine_keys;
+    engine_keys.reserve(grow_keys);
+    for (size_t i = 0; i < grow_keys; i++) {
+        engine_keys.push_back("user:" + std::to_string(i * 2654435761u % 1000000007u));
+    }
+    
+    std::cout << std::endl;
+    std::cout << "Engines, " << grow_keys << " keys:" << std::endl;
+    std::cout << std::setw(10) << "engine" << std::setw(14) << "GET hit ns" 
+              << std::setw(14) << "GET miss ns" << std::setw(16) << "heap B/key" << std::endl;
+    report_engine<HashTable>("chained", engine_keys);
+    report_engine<SwissTable>("swiss", engine_keys);
+    
+    return 0;
+}
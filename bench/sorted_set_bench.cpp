@@ -0,0 +1,273 @@
+/**
+ * Sorted set engine benchmark.
+ * 
+ * Fills a SortedSet with each engine (AVL tree and skiplist) and reports
+ * ZADD, ZRANK, ZRANGEBYSCORE ... LIMIT 0 10 and ZCOUNT (over a tenth of
+ * the score range) latency, plus heap bytes per member, at each requested
+ * size. Then compares the heap cost of many small sets as listpacks and
+ * in each engine, and times a ZUNIONSTORE-style merge of many leaderboards
+ * done with ZADD ... INCR against the partitioned merge and bulk load.
+ * 
+ * Usage: sorted_set_bench [members ...]   (default: 10000 1000000 10000000)
+ */
+
+#include "data/sorted_set.hpp"
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <random>
+#include <cstdlib>
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <thread>
+
+#if defined(__GLIBC__)
+    #include <malloc.h>
+#endif
+
+using namespace scuffedredis;
+
+namespace {
+
+// Lookups and range queries timed per size
+constexpr size_t QUERIES = 200000;
+
+// Small sets: how many, and members in each
+constexpr size_t SMALL_SETS = 100000;
+constexpr size_t SMALL_MEMBERS = 20;
+
+// Leaderboards merged, members in each, and players they are drawn from
+constexpr size_t BOARDS = 24;
+constexpr size_t BOARD_MEMBERS = 100000;
+constexpr size_t PLAYERS = 1000000;
+
+/**
+ * Bytes currently allocated from the heap (0 if unknown).
+ */
+size_t heap_in_use() {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+    return mallinfo2().uordblks + mallinfo2().hblkhd;
+#else
+    return 0;
+#endif
+}
+
+template<typename Fn>
+double nanos_per_op(size_t ops, Fn&& fn) {
+    auto start = std::chrono::steady_clock::now();
+    fn();
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    return std::chrono::duration<double, std::nano>(elapsed).count() / static_cast<double>(ops);
+}
+
+/**
+ * Fill one engine with `members` and time the three operations.
+ */
+void report_engine(ZSetEngine engine, const std::vector<std::string>& members,
+                   const std::vector<double>& scores) {
+    ZSetOptions options;
+    options.engine = engine;
+    options.listpack_max_entries = 0;
+    
+    size_t heap_before = heap_in_use();
+    auto set = std::make_unique<SortedSet>(options);
+    
+    double zadd_ns = nanos_per_op(members.size(), [&]() {
+        for (size_t i = 0; i < members.size(); i++) {
+            set->add(members[i], scores[i]);
+        }
+    });
+    size_t heap_after = heap_in_use();
+    
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<size_t> pick(0, members.size() - 1);
+    std::vector<size_t> order(QUERIES);
+    for (size_t& i : order) {
+        i = pick(rng);
+    }
+    
+    size_t checksum = 0;
+    double zrank_ns = nanos_per_op(QUERIES, [&]() {
+        for (size_t i : order) {
+            checksum += static_cast<size_t>(set->zrank(members[i]).value_or(0));
+        }
+    });
+    
+    double range_ns = nanos_per_op(QUERIES, [&]() {
+        for (size_t i : order) {
+            checksum += set->zrangebyscore({scores[i], INFINITY}, false, 0, 10).size();
+        }
+    });
+    
+    double zcount_ns = nanos_per_op(QUERIES, [&]() {
+        for (size_t i : order) {
+            checksum += set->zcount({scores[i], scores[i] + 1e5});
+        }
+    });
+    
+    if (checksum == 0) {
+        std::cerr << "impossible" << std::endl;
+    }
+    
+    std::cout << std::fixed << std::setprecision(1)
+              << std::setw(10) << zset_engine_name(engine)
+              << std::setw(12) << zadd_ns
+              << std::setw(12) << zrank_ns
+              << std::setw(16) << range_ns
+              << std::setw(12) << zcount_ns;
+    if (heap_after > heap_before) {
+        std::cout << std::setw(14)
+                  << static_cast<double>(heap_after - heap_before) / members.size();
+    }
+    std::cout << std::endl;
+}
+
+/**
+ * Fill SMALL_SETS sets of SMALL_MEMBERS each and report ZADD latency and
+ * heap bytes per set.
+ */
+void report_small_sets(const char* label, const ZSetOptions& options) {
+    std::vector<std::string> members;
+    for (size_t i = 0; i < SMALL_MEMBERS; i++) {
+        members.push_back("item:" + std::to_string(i));
+    }
+    
+    size_t heap_before = heap_in_use();
+    std::vector<std::unique_ptr<SortedSet>> sets;
+    sets.reserve(SMALL_SETS);
+    double zadd_ns = nanos_per_op(SMALL_SETS * SMALL_MEMBERS, [&]() {
+        for (size_t s = 0; s < SMALL_SETS; s++) {
+            auto set = std::make_unique<SortedSet>(options);
+            for (size_t i = 0; i < SMALL_MEMBERS; i++) {
+                set->add(members[(i * 7 + s) % SMALL_MEMBERS], static_cast<double>(s % 1000 + i));
+            }
+            sets.push_back(std::move(set));
+        }
+    });
+    size_t heap_after = heap_in_use();
+    
+    std::cout << std::fixed << std::setprecision(1)
+              << std::setw(10) << label
+              << std::setw(12) << zadd_ns;
+    if (heap_after > heap_before) {
+        std::cout << std::setw(14)
+                  << static_cast<double>(heap_after - heap_before) / SMALL_SETS;
+    }
+    std::cout << std::endl;
+}
+
+/**
+ * Sum BOARDS leaderboards into one set, as ZUNIONSTORE does, by each way.
+ */
+void report_union() {
+    std::vector<ScoredMembers> boards(BOARDS);
+    std::mt19937_64 rng(7);
+    std::uniform_int_distribution<size_t> player(0, PLAYERS - 1);
+    std::uniform_real_distribution<double> score(0.0, 1e4);
+    for (auto& board : boards) {
+        std::vector<size_t> ids(BOARD_MEMBERS);
+        for (size_t& id : ids) {
+            id = player(rng);
+        }
+        std::sort(ids.begin(), ids.end());
+        ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+        for (size_t id : ids) {
+            board.emplace_back("player:" + std::to_string(id), score(rng));
+        }
+    }
+    
+    size_t zadd_members = 0;
+    double zadd_ms = nanos_per_op(1, [&]() {
+        SortedSet merged;
+        for (const auto& board : boards) {
+            for (const auto& [member, points] : board) {
+                merged.add(member, points, SortedSet::ADD_INCR);
+            }
+        }
+        zadd_members = merged.zcard();
+    }) / 1e6;
+    
+    std::cout << std::endl;
+    std::cout << "ZUNIONSTORE of " << BOARDS << " sets of up to " << BOARD_MEMBERS
+              << " members (" << zadd_members << " in the result):" << std::endl;
+    std::cout << std::fixed << std::setprecision(1)
+              << std::setw(28) << "ZADD INCR per member" << std::setw(10) << zadd_ms << " ms"
+              << std::endl;
+    
+    unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+    for (size_t threads : {static_cast<size_t>(1), static_cast<size_t>(cores)}) {
+        size_t merged_members = 0;
+        double merge_ms = nanos_per_op(1, [&]() {
+            SortedSet merged;
+            merged.load(combine_sorted_sets(ZSetOperation::UNION, boards, {},
+                                            ZSetAggregate::SUM, threads));
+            merged_members = merged.zcard();
+        }) / 1e6;
+        if (merged_members != zadd_members) {
+            std::cerr << "merge disagrees with ZADD" << std::endl;
+        }
+        std::string label = "merge + load, " + std::to_string(threads) +
+                            (threads == 1 ? " thread" : " threads");
+        std::cout << std::setw(28) << label << std::setw(10) << merge_ms << " ms" << std::endl;
+        if (threads == cores) {
+            break;
+        }
+    }
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    std::vector<size_t> sizes;
+    for (int i = 1; i < argc; i++) {
+        sizes.push_back(std::strtoul(argv[i], nullptr, 10));
+    }
+    if (sizes.empty()) {
+        sizes = {10000, 1000000, 10000000};
+    }
+    
+    for (size_t count : sizes) {
+        std::vector<std::string> members;
+        std::vector<double> scores;
+        members.reserve(count);
+        scores.reserve(count);
+        
+        std::mt19937_64 rng(count);
+        std::uniform_real_distribution<double> score(0.0, 1e6);
+        for (size_t i = 0; i < count; i++) {
+            members.push_back("member:" + std::to_string(i));
+            scores.push_back(score(rng));
+        }
+        
+        std::cout << std::endl;
+        std::cout << "Sorted set, " << count << " members:" << std::endl;
+        std::cout << std::setw(10) << "engine" << std::setw(12) << "ZADD ns"
+                  << std::setw(12) << "ZRANK ns" << std::setw(16) << "BYSCORE 10 ns"
+                  << std::setw(12) << "ZCOUNT ns"
+                  << std::setw(14) << "heap B/mem" << std::endl;
+        report_engine(ZSetEngine::AVL, members, scores);
+        report_engine(ZSetEngine::SKIPLIST, members, scores);
+    }
+    
+    ZSetOptions listpack;
+    ZSetOptions skiplist;
+    skiplist.listpack_max_entries = 0;
+    ZSetOptions avl;
+    avl.engine = ZSetEngine::AVL;
+    avl.listpack_max_entries = 0;
+    
+    std::cout << std::endl;
+    std::cout << SMALL_SETS << " sorted sets, " << SMALL_MEMBERS << " members each:" << std::endl;
+    std::cout << std::setw(10) << "encoding" << std::setw(12) << "ZADD ns"
+              << std::setw(14) << "heap B/set" << std::endl;
+    report_small_sets("listpack", listpack);
+    report_small_sets("skiplist", skiplist);
+    report_small_sets("avl", avl);
+    
+    report_union();
+    
+    return 0;
+}
@@ -45,19 +45,18 @@ protocol::MessagePtr RedisClient::send_command(const protocol::MessagePtr& cmd)
     
     // Parse response
     parser_.feed(buffer, received);
+    auto response = parser_.parse_message();
     
     // Keep reading if we don't have a complete message
-    while (!parser_.has_message() && is_connected()) {
+    while (!response && is_connected()) {
         received = client_.receive_with_timeout(buffer, sizeof(buffer), 100);
-        if (received > 0) {
-            parser_.feed(buffer, received);
-        } else {
+        if (received <= 0) {
             break;
         }
+        parser_.feed(buffer, received);
+        response = parser_.parse_message();
     }
     
-    // Get parsed message
-    auto response = parser_.parse_message();
     if (!response) {
         return protocol::utils::error_response("Failed to parse response");
     }
@@ -6,12 +6,19 @@
  * 
  * Self-balancing binary search tree for sorted operations.
  * Used for implementing sorted sets (ZADD, ZRANGE, ZRANK).
+ * 
+ * Every node also counts the nodes in its subtree, which makes it an
+ * order-statistic tree: rank() and select() are O(log n), and iteration
+ * can start at any rank without visiting what comes before.
  */
 
+#include "utils/slab_allocator.hpp"
 #include <memory>
 #include <functional>
 #include <vector>
 #include <optional>
+#include <algorithm>
+#include <cstddef>
 
 namespace scuffedredis {
 
@@ -24,11 +31,12 @@ struct AVLNode {
     K key;
     V value;
     int height;
+    size_t count;  // Nodes in this subtree, including this one
     std::shared_ptr<AVLNode> left;
     std::shared_ptr<AVLNode> right;
     
     AVLNode(const K& k, const V& v) 
-        : key(k), value(v), height(1), left(nullptr), right(nullptr) {}
+        : key(k), value(v), height(1), count(1), left(nullptr), right(nullptr) {}
 };
 
 /**
@@ -38,7 +46,7 @@ struct AVLNode {
  * - O(log n) insert, delete, search
  * - Automatic rebalancing
  * - Range queries
- * - Rank operations
+ * - O(log n) rank and select, iteration from any rank
  */
 template<typename K, typename V, typename Compare = std::less<K>>
 class AVLTree {
@@ -46,6 +54,42 @@ public:
     using NodePtr = std::shared_ptr<AVLNode<K, V>>;
     using Node = AVLNode<K, V>;
     
+    /**
+     * In-order walk from a starting rank, ascending or descending.
+     * Holds the path to the current node, so it is invalidated by any
+     * change to the tree.
+     */
+    class Iterator {
+    public:
+        bool valid() const { return !path_.empty(); }
+        const K& key() const { return path_.back()->key; }
+        const V& value() const { return path_.back()->value; }
+        
+        // Step to the next node in iteration order
+        void next() {
+            const Node* node = path_.back();
+            path_.pop_back();
+            descend(reverse_ ? node->left.get() : node->right.get());
+        }
+    
+    private:
+        friend class AVLTree;
+        
+        // Path entries are the current node and the ancestors still to visit
+        std::vector<const Node*> path_;
+        bool reverse_;
+        
+        explicit Iterator(bool reverse) : reverse_(reverse) {}
+        
+        // Push node and its chain of children toward the iteration start
+        void descend(const Node* node) {
+            while (node) {
+                path_.push_back(node);
+                node = reverse_ ? node->right.get() : node->left.get();
+            }
+        }
+    };
+    
     AVLTree() : root_(nullptr), size_(0) {}
     ~AVLTree() = default;
     
@@ -115,6 +159,68 @@ public:
         return getRank(root_, key);
     }
     
+    /**
+     * Number of keys that compare less than key (whether or not key
+     * itself is present).
+     */
+    size_t count_less(const K& key) const {
+        return partition_point([this, &key](const K& k) { return comp_(k, key); });
+    }
+    
+    /**
+     * Number of leading keys for which pred holds, given that it holds
+     * for every key before the first it fails on. O(log n).
+     */
+    template<typename Pred>
+    size_t partition_point(Pred pred) const {
+        size_t count = 0;
+        for (const Node* node = root_.get(); node; ) {
+            if (pred(node->key)) {
+                count += getSubtreeSize(node->left) + 1;
+                node = node->right.get();
+            } else {
+                node = node->left.get();
+            }
+        }
+        return count;
+    }
+    
+    /**
+     * Get the node at rank k (0-based).
+     * Returns nullptr if k is out of range.
+     */
+    const Node* select(size_t k) const {
+        const Node* node = root_.get();
+        while (node) {
+            size_t left = getSubtreeSize(node->left);
+            if (k < left) {
+                node = node->left.get();
+            } else if (k == left) {
+                return node;
+            } else {
+                k -= left + 1;
+                node = node->right.get();
+            }
+        }
+        return nullptr;
+    }
+    
+    /**
+     * Iterate in ascending order from rank k.
+     * Not valid() if k is out of range.
+     */
+    Iterator begin_at(size_t k) const {
+        return iteratorAt(k, false);
+    }
+    
+    /**
+     * Iterate in descending order from (ascending) rank k.
+     * Not valid() if k is out of range.
+     */
+    Iterator rbegin_at(size_t k) const {
+        return iteratorAt(k, true);
+    }
+    
     /**
      * Get number of elements in tree.
      */
@@ -133,6 +239,17 @@ public:
         size_ = 0;
     }
     
+    /**
+     * Replace the contents with n keys, each mapped to value, taken in
+     * ascending order from next_key(). Builds a balanced tree in O(n)
+     * rather than n rebalancing inserts.
+     */
+    template<typename Next>
+    void assign_sorted(size_t n, Next&& next_key, const V& value) {
+        root_ = buildSorted(n, next_key, value);
+        size_ = n;
+    }
+    
     /**
      * Get tree height.
      * Used for debugging and testing balance.
@@ -155,9 +272,11 @@ private:
         return node ? getHeight(node->left) - getHeight(node->right) : 0;
     }
     
+    // Recompute height and subtree count from the children
     void updateHeight(NodePtr& node) {
         if (node) {
             node->height = 1 + std::max(getHeight(node->left), getHeight(node->right));
+            node->count = 1 + getSubtreeSize(node->left) + getSubtreeSize(node->right);
         }
     }
     
@@ -170,7 +289,7 @@ private:
         x->right = y;
         y->left = T2;
         
-        // Update heights
+        // Update heights and counts, lower node first
         updateHeight(y);
         updateHeight(x);
         
@@ -185,7 +304,7 @@ private:
         y->left = x;
         x->right = T2;
         
-        // Update heights
+        // Update heights and counts, lower node first
         updateHeight(x);
         updateHeight(y);
         
@@ -197,7 +316,8 @@ private:
         // Standard BST insertion
         if (!node) {
             inserted = true;
-            return std::make_shared<Node>(key, value);
+            // Node and control block come from one slab object
+            return std::allocate_shared<Node>(SlabStlAllocator<Node>(), key, value);
         }
         
         if (comp_(key, node->key)) {
@@ -352,25 +472,73 @@ private:
         }
     }
     
-    // Get rank of key
-    int getRank(const NodePtr& node, const K& key) const {
-        if (!node) return -1;
-        
-        if (comp_(key, node->key)) {
-            return getRank(node->left, key);
-        } else if (comp_(node->key, key)) {
-            int leftSize = getSubtreeSize(node->left);
-            int rightRank = getRank(node->right, key);
-            return rightRank == -1 ? -1 : leftSize + 1 + rightRank;
-        } else {
-            return getSubtreeSize(node->left);
+    // Get rank of key, adding up the left subtrees passed on the way down
+    int getRank(const NodePtr& root, const K& key) const {
+        size_t rank = 0;
+        for (const Node* node = root.get(); node; ) {
+            if (comp_(key, node->key)) {
+                node = node->left.get();
+            } else if (comp_(node->key, key)) {
+                rank += getSubtreeSize(node->left) + 1;
+                node = node->right.get();
+            } else {
+                return static_cast<int>(rank + getSubtreeSize(node->left));
+            }
         }
+        return -1;
     }
     
     // Get size of subtree
-    int getSubtreeSize(const NodePtr& node) const {
-        if (!node) return 0;
-        return 1 + getSubtreeSize(node->left) + getSubtreeSize(node->right);
+    size_t getSubtreeSize(const NodePtr& node) const {
+        return node ? node->count : 0;
+    }
+    
+    // Balanced subtree of the next n keys. Nodes are made in order, left
+    // subtree first, so next_key() is consumed in ascending order.
+    template<typename Next>
+    NodePtr buildSorted(size_t n, Next& next_key, const V& value) {
+        if (n == 0) {
+            return nullptr;
+        }
+        
+        NodePtr left = buildSorted(n / 2, next_key, value);
+        NodePtr node = std::allocate_shared<Node>(SlabStlAllocator<Node>(), next_key(), value);
+        node->left = std::move(left);
+        node->right = buildSorted(n - n / 2 - 1, next_key, value);
+        updateHeight(node);
+        return node;
+    }
+    
+    // Build the path to rank k. Ancestors are kept only where iteration
+    // will come back to them: those k lies to the left of when ascending,
+    // to the right of when descending.
+    Iterator iteratorAt(size_t k, bool reverse) const {
+        Iterator it(reverse);
+        if (k >= size_) {
+            return it;
+        }
+        
+        it.path_.reserve(static_cast<size_t>(getHeight(root_)));
+        const Node* node = root_.get();
+        while (node) {
+            size_t left = getSubtreeSize(node->left);
+            if (k < left) {
+                if (!reverse) {
+                    it.path_.push_back(node);
+                }
+                node = node->left.get();
+            } else if (k == left) {
+                it.path_.push_back(node);
+                break;
+            } else {
+                if (reverse) {
+                    it.path_.push_back(node);
+                }
+                k -= left + 1;
+                node = node->right.get();
+            }
+        }
+        return it;
     }
 };
 
@@ -0,0 +1,406 @@
+#ifndef SCUFFEDREDIS_EXPIRY_INDEX_HPP
+#define SCUFFEDREDIS_EXPIRY_INDEX_HPP
+
+/**
+ * Key expiry support shared by the keyspace tables.
+ * 
+ * A key's deadline is stored with the key's own entry, and only when it
+ * has one. Each table also keeps an ExpiryIndex listing the entries that
+ * have a deadline, ordered by a timing wheel, so active expiry finds the
+ * keys that are due without looking at any others. The index holds a
+ * reference to each entry (a node pointer or a slot number), never a copy
+ * of its key.
+ */
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#ifdef _MSC_VER
+    #include <intrin.h>
+#endif
+
+namespace scuffedredis {
+
+// Deadlines are Unix times in milliseconds, as in Redis
+constexpr int64_t NO_EXPIRY = 0;     // The key has no TTL
+constexpr int64_t KEEP_EXPIRY = -1;  // Writes: leave the key's TTL as it is
+
+inline int64_t unix_time_ms() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+namespace expiry_detail {
+
+inline unsigned lowest_bit(uint64_t mask) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward64(&index, mask);
+    return static_cast<unsigned>(index);
+#else
+    return static_cast<unsigned>(__builtin_ctzll(mask));
+#endif
+}
+
+inline unsigned highest_bit(uint64_t mask) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanReverse64(&index, mask);
+    return static_cast<unsigned>(index);
+#else
+    return 63 - static_cast<unsigned>(__builtin_clzll(mask));
+#endif
+}
+
+} // namespace expiry_detail
+
+/**
+ * Keys with a TTL looked at by sample(), and how many of them had expired.
+ */
+struct ExpirySample {
+    size_t sampled = 0;
+    size_t expired = 0;
+    
+    ExpirySample& operator+=(const ExpirySample& other) {
+        sampled += other.sampled;
+        expired += other.expired;
+        return *this;
+    }
+};
+
+/**
+ * Names of the keys removed by an expiry pass, packed into one buffer.
+ * 
+ * Tables append each key as they remove it, under their own lock, so the
+ * caller can report the whole batch afterwards. clear() keeps the memory,
+ * so a batch reused across passes stops allocating once it has grown to
+ * fit a pass.
+ */
+class KeyBatch {
+public:
+    void add(std::string_view key) {
+        bytes_.append(key);
+        ends_.push_back(bytes_.size());
+    }
+    
+    std::string_view operator[](size_t index) const {
+        size_t begin = index == 0 ? 0 : ends_[index - 1];
+        return std::string_view(bytes_).substr(begin, ends_[index] - begin);
+    }
+    
+    size_t size() const { return ends_.size(); }
+    bool empty() const { return ends_.empty(); }
+    
+    void clear() {
+        bytes_.clear();
+        ends_.clear();
+    }
+
+private:
+    std::string bytes_;
+    std::vector<size_t> ends_;  // Where each key ends in bytes_
+};
+
+/**
+ * The entries of one table that have a TTL, on a hierarchical timing wheel.
+ * 
+ * Elements live in a dense array, and each entry records its position
+ * there; removal moves the last element into the gap, and the entry it
+ * belongs to is told its new position. The wheel's buckets list positions:
+ * level 0 has a bucket per millisecond for the next 64 ms, each level
+ * above covers 64 times the span of the one below, and deadlines beyond
+ * the top level wait in an overflow bucket. Every element also records its
+ * bucket and its place in it, so adding, removing and rescheduling are O(1).
+ * 
+ * expire() advances the wheel to the current time a bucket at a time,
+ * found from a per-level occupancy bitmap, so empty stretches cost
+ * nothing. Entries in a bucket that is reached move down a level, or onto
+ * the due list once their deadline passes, so each moves at most once per
+ * level unless its deadline is pushed back meanwhile.
+ * 
+ * Deadline is a functor returning an element's deadline (Unix ms), which
+ * stays with the entry; after changing it, call reschedule(). Not
+ * thread-safe; the owning table's lock covers it.
+ */
+template<typename T, typename Deadline>
+class ExpiryIndex {
+public:
+    /**
+     * Add an element, scheduled at its deadline. Returns its position.
+     */
+    uint32_t add(const T& element) {
+        records_.push_back({element, 0, 0});
+        uint32_t pos = static_cast<uint32_t>(records_.size() - 1);
+        schedule(pos);
+        return pos;
+    }
+    
+    /**
+     * Remove the element at pos. Returns the element moved into pos,
+     * whose entry must record the new position, or nullptr if none was.
+     */
+    T* remove(uint32_t pos) {
+        unschedule(pos);
+        
+        uint32_t last = static_cast<uint32_t>(records_.size() - 1);
+        if (pos != last) {
+            records_[pos] = std::move(records_[last]);
+            buckets_[records_[pos].bucket][records_[pos].index] = pos;
+            records_.pop_back();
+            return &records_[pos].element;
+        }
+        records_.pop_back();
+        return nullptr;
+    }
+    
+    /**
+     * Account for a change to the deadline of the element at pos.
+     */
+    void reschedule(uint32_t pos) {
+        // A later deadline can wait in its earlier bucket, and moves on
+        // when the wheel reaches it; a key refreshed with the same TTL
+        // over and over costs a comparison
+        uint32_t bucket = records_[pos].bucket;
+        if (bucket < OVERFLOW && bucket_start(bucket) <= Deadline()(records_[pos].element)) {
+            return;
+        }
+        unschedule(pos);
+        schedule(pos);
+    }
+    
+    T& operator[](uint32_t pos) { return records_[pos].element; }
+    const T& operator[](uint32_t pos) const { return records_[pos].element; }
+    
+    /**
+     * Hand up to `limit` elements whose deadline is at or before `now` to
+     * visit(element), which must remove them. Returns the number visited.
+     * Due elements left over by the limit are the first visited next time.
+     */
+    template<typename Visit>
+    size_t expire(int64_t now, size_t limit, Visit&& visit) {
+        size_t removed = 0;
+        while (removed < limit) {
+            if (!buckets_.empty() && !buckets_[DUE].empty()) {
+                visit(T(records_[buckets_[DUE].back()].element));
+                removed++;
+            } else if (!advance(now)) {
+                break;
+            }
+        }
+        return removed;
+    }
+    
+    /**
+     * Check up to `count` elements, spread evenly over the index, for a
+     * deadline at or before `now`. Estimates the share of expired entries
+     * that expire() has yet to hand out.
+     */
+    ExpirySample sample(int64_t now, size_t count) const {
+        ExpirySample result;
+        if (records_.empty() || count == 0) {
+            return result;
+        }
+        
+        // The starting point moves with the clock so repeated samples differ
+        size_t stride = records_.size() > count ? records_.size() / count : 1;
+        for (size_t pos = static_cast<uint64_t>(now) % stride;
+             pos < records_.size() && result.sampled < count; pos += stride) {
+            result.sampled++;
+            result.expired += Deadline()(records_[pos].element) <= now ? 1 : 0;
+        }
+        return result;
+    }
+    
+    /**
+     * Call fn(element) for every element, e.g. to fix up references.
+     */
+    template<typename Fn>
+    void for_each(Fn&& fn) {
+        for (Record& record : records_) {
+            fn(record.element);
+        }
+    }
+    
+    size_t size() const { return records_.size(); }
+    bool empty() const { return records_.empty(); }
+    
+    void clear() {
+        records_.clear();
+        records_.shrink_to_fit();
+        buckets_.clear();
+        buckets_.shrink_to_fit();
+        for (uint64_t& mask : occupied_) {
+            mask = 0;
+        }
+    }
+    
+    /**
+     * Bytes held by the index.
+     */
+    size_t memory_usage() const {
+        size_t total = records_.capacity() * sizeof(Record) +
+                       buckets_.capacity() * sizeof(std::vector<uint32_t>);
+        for (const auto& bucket : buckets_) {
+            total += bucket.capacity() * sizeof(uint32_t);
+        }
+        return total;
+    }
+
+private:
+    static constexpr unsigned LEVEL_BITS = 6;
+    static constexpr uint32_t LEVEL_SLOTS = 1u << LEVEL_BITS;  // Buckets per level
+    static constexpr unsigned LEVELS = 5;                      // 1 ms up to ~12 days
+    static constexpr uint32_t OVERFLOW = LEVELS * LEVEL_SLOTS; // Beyond the top level
+    static constexpr uint32_t DUE = OVERFLOW + 1;              // Deadline reached
+    
+    // An element and where it is on the wheel
+    struct Record {
+        T element;
+        uint32_t bucket;  // Level * LEVEL_SLOTS + slot, OVERFLOW or DUE
+        uint32_t index;   // In that bucket
+    };
+    
+    std::vector<Record> records_;
+    std::vector<std::vector<uint32_t>> buckets_;  // Positions; allocated with the first element
+    uint64_t occupied_[LEVELS] = {};             // Non-empty buckets of each level
+    int64_t time_ = 0;                           // Wheel time; buckets are relative to it
+    
+    /**
+     * The bucket for a deadline: the level of the highest 6-bit group in
+     * which it differs from the wheel time, and its bits in that group.
+     */
+    uint32_t bucket_for(int64_t deadline) const {
+        if (deadline <= time_) {
+            return DUE;
+        }
+        
+        uint64_t differ = static_cast<uint64_t>(deadline) ^ static_cast<uint64_t>(time_);
+        unsigned level = expiry_detail::highest_bit(differ) / LEVEL_BITS;
+        if (level >= LEVELS) {
+            return OVERFLOW;
+        }
+        uint32_t slot = static_cast<uint32_t>(static_cast<uint64_t>(deadline) >> (level * LEVEL_BITS)) &
+                        (LEVEL_SLOTS - 1);
+        return level * LEVEL_SLOTS + slot;
+    }
+    
+    /**
+     * When the wheel reaches a level bucket: the wheel time with that
+     * level's group set to the bucket's slot and the groups below cleared.
+     */
+    int64_t bucket_start(uint32_t bucket) const {
+        unsigned shift = bucket / LEVEL_SLOTS * LEVEL_BITS;
+        uint64_t slot = bucket % LEVEL_SLOTS;
+        unsigned span_bits = shift + LEVEL_BITS;
+        return static_cast<int64_t>(
+            (static_cast<uint64_t>(time_) >> span_bits << span_bits) | (slot << shift));
+    }
+    
+    void schedule(uint32_t pos) {
+        if (buckets_.empty()) {
+            buckets_.resize(DUE + 1);
+        }
+        
+        Record& record = records_[pos];
+        uint32_t bucket = bucket_for(Deadline()(record.element));
+        record.bucket = bucket;
+        record.index = static_cast<uint32_t>(buckets_[bucket].size());
+        buckets_[bucket].push_back(pos);
+        if (bucket < OVERFLOW) {
+            occupied_[bucket / LEVEL_SLOTS] |= uint64_t(1) << (bucket % LEVEL_SLOTS);
+        }
+    }
+    
+    void unschedule(uint32_t pos) {
+        const Record& record = records_[pos];
+        std::vector<uint32_t>& bucket = buckets_[record.bucket];
+        
+        // The bucket's last position moves into the gap
+        uint32_t moved = bucket.back();
+        bucket[record.index] = moved;
+        records_[moved].index = record.index;
+        bucket.pop_back();
+        
+        if (bucket.empty() && record.bucket < OVERFLOW) {
+            occupied_[record.bucket / LEVEL_SLOTS] &= ~(uint64_t(1) << (record.bucket % LEVEL_SLOTS));
+        }
+    }
+    
+    /**
+     * Move the wheel to the earliest non-empty bucket, if it starts at or
+     * before `now`, and redistribute its elements. Returns false if there
+     * was none.
+     */
+    bool advance(int64_t now) {
+        if (buckets_.empty()) {
+            return false;
+        }
+        
+        // Lower levels always hold earlier deadlines than higher ones
+        for (unsigned level = 0; level < LEVELS; level++) {
+            if (occupied_[level] == 0) {
+                continue;
+            }
+            
+            unsigned slot = expiry_detail::lowest_bit(occupied_[level]);
+            uint32_t bucket = level * LEVEL_SLOTS + slot;
+            int64_t start = bucket_start(bucket);
+            if (start > now) {
+                return false;
+            }
+            
+            time_ = start;
+            occupied_[level] &= ~(uint64_t(1) << slot);
+            cascade(bucket);
+            return true;
+        }
+        
+        // Only far deadlines remain. They are redistributed each time the
+        // wheel enters a new top-level span, and the wheel can skip ahead
+        // to the earliest of them.
+        if (buckets_[OVERFLOW].empty()) {
+            return false;
+        }
+        unsigned wheel_bits = LEVELS * LEVEL_BITS;
+        int64_t next_span = static_cast<int64_t>(
+            ((static_cast<uint64_t>(time_) >> wheel_bits) + 1) << wheel_bits);
+        if (next_span > now) {
+            return false;
+        }
+        
+        int64_t earliest = now;
+        for (uint32_t pos : buckets_[OVERFLOW]) {
+            int64_t deadline = Deadline()(records_[pos].element);
+            earliest = deadline < earliest ? deadline : earliest;
+        }
+        time_ = earliest;
+        cascade(OVERFLOW);
+        return true;
+    }
+    
+    /**
+     * Reschedule every element of a bucket against the current wheel time.
+     */
+    void cascade(uint32_t bucket) {
+        std::vector<uint32_t> positions;
+        positions.swap(buckets_[bucket]);
+        for (uint32_t pos : positions) {
+            schedule(pos);
+        }
+        
+        // Keep the allocation for the bucket's next turn
+        if (buckets_[bucket].empty()) {
+            positions.clear();
+            buckets_[bucket].swap(positions);
+        }
+    }
+};
+
+} // namespace scuffedredis
+
+#endif // SCUFFEDREDIS_EXPIRY_INDEX_HPP
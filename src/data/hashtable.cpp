@@ -1,6 +1,10 @@
 #include "hashtable.hpp"
+#include "utils/slab_allocator.hpp"
+#include "utils/varint.hpp"
 #include <algorithm>
 #include <cstring>
+#include <tuple>
+#include <cstddef>
 
 namespace scuffedredis {
 
@@ -8,7 +12,7 @@ namespace scuffedredis {
 // MurmurHash3 Implementation (32-bit)
 // ============================================================================
 
-static uint32_t murmur3_32(const void* key, size_t len, uint32_t seed) {
+uint32_t murmur3_32(const void* key, size_t len, uint32_t seed) {
     const uint8_t* data = static_cast<const uint8_t*>(key);
     const int nblocks = static_cast<int>(len / 4);
     
@@ -55,11 +59,177 @@ static uint32_t murmur3_32(const void* key, size_t len, uint32_t seed) {
     return h1;
 }
 
+// ============================================================================
+// Pattern Matching
+// ============================================================================
+
+bool matches_pattern(std::string_view str, std::string_view pattern) {
+    // Simple wildcard matching supporting * only
+    if (pattern == "*") {
+        return true;
+    }
+    
+    size_t str_idx = 0;
+    size_t pat_idx = 0;
+    size_t star_idx = std::string_view::npos;
+    size_t match_idx = 0;
+    
+    while (str_idx < str.size()) {
+        if (pat_idx < pattern.size() && 
+            (pattern[pat_idx] == str[str_idx] || pattern[pat_idx] == '?')) {
+            // Characters match or '?' wildcard
+            str_idx++;
+            pat_idx++;
+        } else if (pat_idx < pattern.size() && pattern[pat_idx] == '*') {
+            // '*' wildcard - remember position
+            star_idx = pat_idx++;
+            match_idx = str_idx;
+        } else if (star_idx != std::string_view::npos) {
+            // Backtrack to last '*'
+            pat_idx = star_idx + 1;
+            str_idx = ++match_idx;
+        } else {
+            // No match
+            return false;
+        }
+    }
+    
+    // Check remaining pattern characters
+    while (pat_idx < pattern.size() && pattern[pat_idx] == '*') {
+        pat_idx++;
+    }
+    
+    return pat_idx == pattern.size();
+}
+
+// ============================================================================
+// HashTable Implementation
+// ============================================================================
+
+// ============================================================================
+// Node Encoding
+// ============================================================================
+
+namespace {
+
+// Offset of the encoded key and value inside a node
+constexpr size_t NODE_HEADER_SIZE = offsetof(HashTable::Node, data);
+
+// Deadline and expiry index position, present if the key has a TTL
+constexpr size_t EXPIRY_FIELDS_SIZE = sizeof(int64_t) + sizeof(uint32_t);
+
+} // namespace
+
+size_t HashTable::Node::encoded_size(size_t key_len, size_t value_len, bool with_expiry) {
+    return NODE_HEADER_SIZE + varint_size(key_len << 1) + (with_expiry ? EXPIRY_FIELDS_SIZE : 0) +
+           key_len + varint_size(value_len) + value_len;
+}
+
+size_t HashTable::Node::encoded_size() const {
+    return encoded_size(key().size(), value().size(), has_expiry());
+}
+
+size_t HashTable::Node::allocation_size() const {
+    return SlabAllocator::class_size(encoded_size());
+}
+
+const uint8_t* HashTable::Node::key_bytes(size_t& key_len) const {
+    const uint8_t* bytes = read_varint(data, key_len);
+    if (key_len & 1) {
+        bytes += EXPIRY_FIELDS_SIZE;
+    }
+    key_len >>= 1;
+    return bytes;
+}
+
+std::string_view HashTable::Node::key() const {
+    size_t key_len;
+    const uint8_t* bytes = key_bytes(key_len);
+    return {reinterpret_cast<const char*>(bytes), key_len};
+}
+
+std::string_view HashTable::Node::value() const {
+    std::string_view k = key();
+    size_t value_len;
+    const uint8_t* bytes = read_varint(reinterpret_cast<const uint8_t*>(k.data() + k.size()), 
+                                       value_len);
+    return {reinterpret_cast<const char*>(bytes), value_len};
+}
+
+// The expiry fields follow the key_len varint and may be unaligned
+
+int64_t HashTable::Node::expire_at() const {
+    if (!has_expiry()) {
+        return NO_EXPIRY;
+    }
+    size_t key_len;
+    int64_t expire_at;
+    std::memcpy(&expire_at, read_varint(data, key_len), sizeof(expire_at));
+    return expire_at;
+}
+
+void HashTable::Node::set_expire_at(int64_t expire_at) {
+    size_t key_len;
+    uint8_t* field = const_cast<uint8_t*>(read_varint(data, key_len));
+    std::memcpy(field, &expire_at, sizeof(expire_at));
+}
+
+uint32_t HashTable::Node::expiry_position() const {
+    size_t key_len;
+    uint32_t position;
+    std::memcpy(&position, read_varint(data, key_len) + sizeof(int64_t), sizeof(position));
+    return position;
+}
+
+void HashTable::Node::set_expiry_position(uint32_t position) {
+    size_t key_len;
+    uint8_t* field = const_cast<uint8_t*>(read_varint(data, key_len)) + sizeof(int64_t);
+    std::memcpy(field, &position, sizeof(position));
+}
+
+bool HashTable::Node::assign_value(std::string_view new_value) {
+    // Staying in the same size class keeps deallocate() sized correctly
+    std::string_view k = key();
+    if (SlabAllocator::class_size(encoded_size(k.size(), new_value.size(), has_expiry())) != 
+        allocation_size()) {
+        return false;
+    }
+    
+    // The key is in front, so only the tail is rewritten
+    uint8_t* out = reinterpret_cast<uint8_t*>(const_cast<char*>(k.data() + k.size()));
+    out = write_varint(out, new_value.size());
+    std::memcpy(out, new_value.data(), new_value.size());
+    return true;
+}
+
+HashTable::Node* HashTable::Node::create(uint32_t hash_val, std::string_view key, 
+                                         std::string_view value, bool with_expiry) {
+    Node* node = static_cast<Node*>(SlabAllocator::allocate(
+        encoded_size(key.size(), value.size(), with_expiry)));
+    node->next = nullptr;
+    node->hash = hash_val;
+    
+    uint8_t* out = write_varint(node->data, (key.size() << 1) | (with_expiry ? 1 : 0));
+    if (with_expiry) {
+        out += EXPIRY_FIELDS_SIZE;  // Filled in by the table
+    }
+    std::memcpy(out, key.data(), key.size());
+    out = write_varint(out + key.size(), value.size());
+    std::memcpy(out, value.data(), value.size());
+    
+    return node;
+}
+
+void HashTable::Node::destroy(Node* node) {
+    SlabAllocator::deallocate(node, node->encoded_size());
+}
+
 // ============================================================================
 // HashTable Implementation
 // ============================================================================
 
-HashTable::HashTable(size_t initial_capacity) : size_(0) {
+HashTable::HashTable(size_t initial_capacity) 
+    : rehash_index_(0), size_(0), entry_bytes_(0) {
     // Round up to power of 2 for better distribution
     size_t capacity = MIN_CAPACITY;
     while (capacity < initial_capacity) {
@@ -68,189 +238,371 @@ HashTable::HashTable(size_t initial_capacity) : size_(0) {
     buckets_.resize(capacity);
 }
 
-HashTable::~HashTable() = default;
+HashTable::~HashTable() {
+    free_chains(buckets_);
+    free_chains(rehash_buckets_);
+}
 
 HashTable::HashTable(HashTable&& other) noexcept
-    : buckets_(std::move(other.buckets_)), size_(other.size_) {
+    : buckets_(std::move(other.buckets_)), 
+      rehash_buckets_(std::move(other.rehash_buckets_)),
+      rehash_index_(other.rehash_index_), size_(other.size_),
+      entry_bytes_(other.entry_bytes_), expires_(std::move(other.expires_)) {
+    other.buckets_.clear();
+    other.rehash_buckets_.clear();
+    other.rehash_index_ = 0;
     other.size_ = 0;
+    other.entry_bytes_ = 0;
+    other.expires_.clear();
 }
 
 HashTable& HashTable::operator=(HashTable&& other) noexcept {
     if (this != &other) {
+        free_chains(buckets_);
+        free_chains(rehash_buckets_);
         buckets_ = std::move(other.buckets_);
+        rehash_buckets_ = std::move(other.rehash_buckets_);
+        rehash_index_ = other.rehash_index_;
         size_ = other.size_;
+        entry_bytes_ = other.entry_bytes_;
+        expires_ = std::move(other.expires_);
+        other.buckets_.clear();
+        other.rehash_buckets_.clear();
+        other.rehash_index_ = 0;
         other.size_ = 0;
+        other.entry_bytes_ = 0;
+        other.expires_.clear();
     }
     return *this;
 }
 
-size_t HashTable::hash(const std::string& key) const {
+void HashTable::free_chains(Buckets& buckets) {
+    for (Node*& bucket : buckets) {
+        Node* curr = bucket;
+        while (curr) {
+            Node* next = curr->next;
+            Node::destroy(curr);
+            curr = next;
+        }
+        bucket = nullptr;
+    }
+}
+
+uint32_t HashTable::hash(std::string_view key) {
     // Use MurmurHash3 with a fixed seed
-    uint32_t hash_val = murmur3_32(key.data(), key.size(), 0x12345678);
-    return hash_val % buckets_.size();
+    return murmur3_32(key.data(), key.size(), 0x12345678);
 }
 
 std::pair<HashTable::Node*, HashTable::Node*> 
-HashTable::find_in_bucket(size_t bucket, const std::string& key) const {
+HashTable::find_in_bucket(const Buckets& buckets, size_t bucket, 
+                          std::string_view key, uint32_t hash_val) {
     Node* prev = nullptr;
-    Node* curr = buckets_[bucket].get();
+    Node* curr = buckets[bucket];
     
     while (curr) {
-        if (curr->key == key) {
+        // Cached hash rejects most mismatches without a string compare
+        if (curr->hash == hash_val && curr->key() == key) {
             return {curr, prev};
         }
         prev = curr;
-        curr = curr->next.get();
+        curr = curr->next;
     }
     
     return {nullptr, nullptr};
 }
 
-bool HashTable::set(const std::string& key, const std::string& value) {
-    // Check if resize is needed before insertion
-    if (load_factor() > MAX_LOAD_FACTOR) {
-        resize();
+HashTable::Location HashTable::locate(std::string_view key, uint32_t hash_val) {
+    Location loc{&buckets_, bucket_index(hash_val, buckets_), nullptr, nullptr};
+    std::tie(loc.node, loc.prev) = find_in_bucket(buckets_, loc.bucket, key, hash_val);
+    
+    // Migrated buckets are empty, so checking the old array is cheap
+    if (!loc.node && is_rehashing()) {
+        loc.table = &rehash_buckets_;
+        loc.bucket = bucket_index(hash_val, rehash_buckets_);
+        std::tie(loc.node, loc.prev) = find_in_bucket(rehash_buckets_, loc.bucket, 
+                                                      key, hash_val);
+    }
+    
+    return loc;
+}
+
+HashTable::Node* HashTable::find(std::string_view key) const {
+    uint32_t hash_val = hash(key);
+    
+    Node* node = find_in_bucket(buckets_, bucket_index(hash_val, buckets_), 
+                                key, hash_val).first;
+    if (!node && is_rehashing()) {
+        node = find_in_bucket(rehash_buckets_, bucket_index(hash_val, rehash_buckets_),
+                              key, hash_val).first;
     }
     
-    size_t bucket = hash(key);
-    auto [node, prev] = find_in_bucket(bucket, key);
+    // Under a shared lock an expired key can't be removed, only hidden
+    if (node && is_expired(node, unix_time_ms())) {
+        return nullptr;
+    }
     
-    if (node) {
+    return node;
+}
+
+void HashTable::erase(const Location& loc) {
+    if (loc.prev) {
+        // Node is in middle or end of chain
+        loc.prev->next = loc.node->next;
+    } else {
+        // Node is at head of bucket
+        (*loc.table)[loc.bucket] = loc.node->next;
+    }
+    
+    if (loc.node->has_expiry()) {
+        untrack_expiry(loc.node);
+    }
+    entry_bytes_ -= loc.node->allocation_size();
+    Node::destroy(loc.node);
+    size_--;
+}
+
+void HashTable::replace_node(Location& loc, std::string_view key, std::string_view value,
+                             int64_t expire_at) {
+    // Built before the old node goes, as key may point into it
+    Node* replacement = Node::create(loc.node->hash, key, value, expire_at != NO_EXPIRY);
+    replacement->next = loc.node->next;
+    (loc.prev ? loc.prev->next : (*loc.table)[loc.bucket]) = replacement;
+    
+    entry_bytes_ += replacement->allocation_size() - loc.node->allocation_size();
+    if (loc.node->has_expiry()) {
+        untrack_expiry(loc.node);
+    }
+    Node::destroy(loc.node);
+    loc.node = replacement;
+    
+    if (expire_at != NO_EXPIRY) {
+        track_expiry(replacement, expire_at);
+    }
+}
+
+void HashTable::track_expiry(Node* node, int64_t expire_at) {
+    node->set_expire_at(expire_at);
+    node->set_expiry_position(expires_.add(node));
+}
+
+void HashTable::untrack_expiry(Node* node) {
+    if (Node** moved = expires_.remove(node->expiry_position())) {
+        (*moved)->set_expiry_position(node->expiry_position());
+    }
+}
+
+void HashTable::retrack_expiry(Node* node, int64_t expire_at) {
+    if (node->expire_at() != expire_at) {
+        node->set_expire_at(expire_at);
+        expires_.reschedule(node->expiry_position());
+    }
+}
+
+bool HashTable::set(std::string_view key, std::string_view value, int64_t expire_at) {
+    if (is_rehashing()) {
+        rehash_step(REHASH_STEP);
+    } else if (load_factor() > MAX_LOAD_FACTOR) {
+        // Check if resize is needed before insertion
+        start_rehash();
+    }
+    
+    uint32_t hash_val = hash(key);
+    Location loc = locate(key, hash_val);
+    
+    // An expired key is replaced as if it were absent
+    if (loc.node && is_expired(loc.node, unix_time_ms())) {
+        erase(loc);
+        loc.node = nullptr;
+    }
+    
+    if (loc.node) {
         // Key exists, update value
-        node->value = value;
+        if (expire_at == KEEP_EXPIRY) {
+            expire_at = loc.node->expire_at();
+        }
+        
+        bool with_expiry = expire_at != NO_EXPIRY;
+        if (with_expiry == loc.node->has_expiry() && loc.node->assign_value(value)) {
+            if (with_expiry) {
+                retrack_expiry(loc.node, expire_at);
+            }
+        } else {
+            // Grew past its allocation or gained or lost its TTL
+            replace_node(loc, key, value, expire_at);
+        }
         return false;  // Not a new insertion
     }
     
+    if (expire_at == KEEP_EXPIRY) {
+        expire_at = NO_EXPIRY;
+    }
+    
+    // New keys go into the array being migrated to
+    Buckets& target = is_rehashing() ? rehash_buckets_ : buckets_;
+    size_t bucket = bucket_index(hash_val, target);
+    
     // Insert new node at head of bucket
-    auto new_node = std::make_unique<Node>(key, value);
-    new_node->next = std::move(buckets_[bucket]);
-    buckets_[bucket] = std::move(new_node);
+    Node* new_node = Node::create(hash_val, key, value, expire_at != NO_EXPIRY);
+    new_node->next = target[bucket];
+    target[bucket] = new_node;
     size_++;
+    entry_bytes_ += new_node->allocation_size();
+    if (expire_at != NO_EXPIRY) {
+        track_expiry(new_node, expire_at);
+    }
     
     return true;  // New insertion
 }
 
-std::optional<std::string> HashTable::get(const std::string& key) const {
-    size_t bucket = hash(key);
-    auto [node, prev] = find_in_bucket(bucket, key);
+std::optional<std::string> HashTable::get(std::string_view key) const {
+    if (auto value = get_view(key)) {
+        return std::string(*value);
+    }
     
-    if (node) {
-        return node->value;
+    return std::nullopt;
+}
+
+std::optional<std::string_view> HashTable::get_view(std::string_view key) const {
+    // Reads run under a shared lock in ConcurrentHashTable, so they
+    // never migrate buckets themselves
+    if (Node* node = find(key)) {
+        return node->value();
     }
     
     return std::nullopt;
 }
 
-bool HashTable::del(const std::string& key) {
-    size_t bucket = hash(key);
-    auto [node, prev] = find_in_bucket(bucket, key);
+bool HashTable::del(std::string_view key) {
+    if (is_rehashing()) {
+        rehash_step(REHASH_STEP);
+    }
     
-    if (!node) {
+    Location loc = locate(key, hash(key));
+    if (!loc.node) {
         return false;  // Key not found
     }
     
-    if (prev) {
-        // Node is in middle or end of chain
-        prev->next = std::move(node->next);
-    } else {
-        // Node is at head of bucket
-        buckets_[bucket] = std::move(node->next);
+    bool expired = is_expired(loc.node, unix_time_ms());
+    erase(loc);
+    return !expired;
+}
+
+std::optional<int64_t> HashTable::expire_time(std::string_view key) const {
+    if (Node* node = find(key)) {
+        return node->expire_at();
     }
     
-    size_--;
-    return true;
+    return std::nullopt;
 }
 
-bool HashTable::exists(const std::string& key) const {
-    size_t bucket = hash(key);
-    auto [node, prev] = find_in_bucket(bucket, key);
-    return node != nullptr;
+std::optional<int64_t> HashTable::set_expire_time(std::string_view key, int64_t expire_at) {
+    Location loc = locate(key, hash(key));
+    if (!loc.node) {
+        return std::nullopt;
+    }
+    if (is_expired(loc.node, unix_time_ms())) {
+        erase(loc);
+        return std::nullopt;
+    }
+    
+    int64_t previous = loc.node->expire_at();
+    if (loc.node->has_expiry() && expire_at != NO_EXPIRY) {
+        retrack_expiry(loc.node, expire_at);
+    } else if (loc.node->has_expiry() || expire_at != NO_EXPIRY) {
+        // The expiry field comes or goes, so the node is rebuilt
+        replace_node(loc, loc.node->key(), loc.node->value(), expire_at);
+    }
+    return previous;
+}
+
+size_t HashTable::remove_expired(int64_t now, size_t limit, KeyBatch* removed) {
+    return expires_.expire(now, limit, [this, removed](Node* node) {
+        if (removed) {
+            removed->add(node->key());
+        }
+        erase(locate(node->key(), node->hash));
+    });
+}
+
+bool HashTable::exists(std::string_view key) const {
+    return find(key) != nullptr;
 }
 
 void HashTable::clear() {
-    for (auto& bucket : buckets_) {
-        bucket.reset();
-    }
+    free_chains(buckets_);
+    free_chains(rehash_buckets_);
+    
+    // Drop any migration in progress; the old array keeps its size
+    rehash_buckets_.clear();
+    rehash_index_ = 0;
     size_ = 0;
+    entry_bytes_ = 0;
+    expires_.clear();
 }
 
-void HashTable::resize() {
-    size_t new_capacity = buckets_.size() * 2;
-    std::vector<std::unique_ptr<Node>> new_buckets(new_capacity);
-    
-    // Rehash all existing entries
-    for (auto& bucket : buckets_) {
-        Node* curr = bucket.get();
-        while (curr) {
-            // Calculate new bucket index
-            size_t new_bucket = murmur3_32(curr->key.data(), 
-                                          curr->key.size(), 
-                                          0x12345678) % new_capacity;
-            
-            // Move node to new bucket
-            Node* next = curr->next.release();
-            curr->next = std::move(new_buckets[new_bucket]);
-            new_buckets[new_bucket].reset(curr);
-            
-            curr = next;
-        }
-        bucket.release();  // Already moved, just release ownership
-    }
-    
-    buckets_ = std::move(new_buckets);
+void HashTable::start_rehash() {
+    rehash_buckets_.resize(buckets_.size() * 2);
+    rehash_index_ = 0;
 }
 
-bool HashTable::matches_pattern(const std::string& str, 
-                               const std::string& pattern) const {
-    // Simple wildcard matching supporting * only
-    if (pattern == "*") {
-        return true;
+bool HashTable::rehash_step(size_t buckets) {
+    if (!is_rehashing()) {
+        return false;
     }
     
-    size_t str_idx = 0;
-    size_t pat_idx = 0;
-    size_t star_idx = std::string::npos;
-    size_t match_idx = 0;
+    // Bound the work on sparse tables too
+    size_t empty_visits = buckets * 10;
     
-    while (str_idx < str.size()) {
-        if (pat_idx < pattern.size() && 
-            (pattern[pat_idx] == str[str_idx] || pattern[pat_idx] == '?')) {
-            // Characters match or '?' wildcard
-            str_idx++;
-            pat_idx++;
-        } else if (pat_idx < pattern.size() && pattern[pat_idx] == '*') {
-            // '*' wildcard - remember position
-            star_idx = pat_idx++;
-            match_idx = str_idx;
-        } else if (star_idx != std::string::npos) {
-            // Backtrack to last '*'
-            pat_idx = star_idx + 1;
-            str_idx = ++match_idx;
-        } else {
-            // No match
-            return false;
+    while (buckets > 0 && rehash_index_ < buckets_.size()) {
+        Node*& bucket = buckets_[rehash_index_];
+        
+        if (!bucket) {
+            rehash_index_++;
+            if (--empty_visits == 0) {
+                break;
+            }
+            continue;
         }
+        
+        // Move every node of this chain to its bucket in the new array
+        Node* curr = bucket;
+        bucket = nullptr;
+        while (curr) {
+            Node* next = curr->next;
+            size_t new_bucket = bucket_index(curr->hash, rehash_buckets_);
+            curr->next = rehash_buckets_[new_bucket];
+            rehash_buckets_[new_bucket] = curr;
+            curr = next;
+        }
+        
+        rehash_index_++;
+        buckets--;
     }
     
-    // Check remaining pattern characters
-    while (pat_idx < pattern.size() && pattern[pat_idx] == '*') {
-        pat_idx++;
+    if (rehash_index_ < buckets_.size()) {
+        return true;
     }
     
-    return pat_idx == pattern.size();
+    // Every bucket moved (old array is all null): the new array becomes the table
+    buckets_ = std::move(rehash_buckets_);
+    rehash_buckets_.clear();
+    rehash_index_ = 0;
+    return false;
 }
 
-std::vector<std::string> HashTable::keys(const std::string& pattern) const {
+std::vector<std::string> HashTable::keys(std::string_view pattern) const {
     std::vector<std::string> result;
+    int64_t now = unix_time_ms();
     
-    // Iterate through all buckets
-    for (const auto& bucket : buckets_) {
-        Node* curr = bucket.get();
-        while (curr) {
-            if (matches_pattern(curr->key, pattern)) {
-                result.push_back(curr->key);
+    // Iterate through all buckets of both arrays
+    for (const Buckets* table : {&buckets_, &rehash_buckets_}) {
+        for (Node* curr : *table) {
+            while (curr) {
+                if (!is_expired(curr, now) && matches_pattern(curr->key(), pattern)) {
+                    result.emplace_back(curr->key());
+                }
+                curr = curr->next;
             }
-            curr = curr->next.get();
         }
     }
     
@@ -260,24 +612,29 @@ std::vector<std::string> HashTable::keys(const std::string& pattern) const {
 HashTable::Stats HashTable::get_stats() const {
     Stats stats{};
     stats.total_entries = size_;
-    stats.total_buckets = buckets_.size();
+    stats.total_buckets = buckets_.size() + rehash_buckets_.size();
     stats.load_factor = load_factor();
+    stats.rehashing = is_rehashing();
+    stats.memory_usage = memory_usage();
+    stats.bytes_per_key = size_ > 0 ? static_cast<double>(stats.memory_usage) / size_ : 0.0;
     
     size_t total_chain_length = 0;
     
-    for (const auto& bucket : buckets_) {
-        if (bucket) {
-            stats.used_buckets++;
-            
-            size_t chain_length = 0;
-            Node* curr = bucket.get();
-            while (curr) {
-                chain_length++;
-                curr = curr->next.get();
+    for (const Buckets* table : {&buckets_, &rehash_buckets_}) {
+        for (Node* bucket : *table) {
+            if (bucket) {
+                stats.used_buckets++;
+                
+                size_t chain_length = 0;
+                Node* curr = bucket;
+                while (curr) {
+                    chain_length++;
+                    curr = curr->next;
+                }
+                
+                total_chain_length += chain_length;
+                stats.max_chain_length = std::max(stats.max_chain_length, chain_length);
             }
-            
-            total_chain_length += chain_length;
-            stats.max_chain_length = std::max(stats.max_chain_length, chain_length);
         }
     }
     
@@ -299,7 +656,7 @@ HashTable::Iterator& HashTable::Iterator::operator++() {
     }
     
     // Move to next node in current bucket
-    node_ = node_->next.get();
+    node_ = node_->next;
     
     // If no more nodes in current bucket, find next non-empty bucket
     if (!node_) {
@@ -311,70 +668,246 @@ HashTable::Iterator& HashTable::Iterator::operator++() {
 
 void HashTable::Iterator::advance_to_next() {
     bucket_++;
-    while (bucket_ < table_->buckets_.size()) {
-        if (table_->buckets_[bucket_]) {
-            node_ = table_->buckets_[bucket_].get();
-            return;
+    visit_bucket();
+}
+
+void HashTable::Iterator::visit_bucket() {
+    while (true) {
+        const Buckets& buckets = rehash_table_ ? table_->rehash_buckets_ : table_->buckets_;
+        
+        while (bucket_ < buckets.size()) {
+            if (buckets[bucket_]) {
+                node_ = buckets[bucket_];
+                return;
+            }
+            bucket_++;
         }
-        bucket_++;
+        
+        // Continue into the array being migrated to, if any
+        if (rehash_table_ || !table_->is_rehashing()) {
+            break;
+        }
+        rehash_table_ = true;
+        bucket_ = 0;
     }
     
     // Reached end
     node_ = nullptr;
     table_ = nullptr;
+    bucket_ = 0;
+    rehash_table_ = false;
 }
 
 bool HashTable::Iterator::operator==(const Iterator& other) const {
     return table_ == other.table_ && 
            bucket_ == other.bucket_ && 
-           node_ == other.node_;
+           node_ == other.node_ &&
+           rehash_table_ == other.rehash_table_;
 }
 
-std::pair<const std::string&, std::string&> HashTable::Iterator::operator*() {
-    return {node_->key, node_->value};
+std::pair<std::string_view, std::string_view> HashTable::Iterator::operator*() {
+    return {node_->key(), node_->value()};
 }
 
 // ============================================================================
 // ConcurrentHashTable Implementation
 // ============================================================================
 
-ConcurrentHashTable::ConcurrentHashTable(size_t initial_capacity)
-    : table_(initial_capacity) {
+const char* hash_engine_name(HashEngine engine) {
+    return engine == HashEngine::SWISS ? "swiss" : "chained";
 }
 
-bool ConcurrentHashTable::set(const std::string& key, const std::string& value) {
-    std::unique_lock lock(mutex_);
-    return table_.set(key, value);
+bool parse_hash_engine(const std::string& name, HashEngine& engine) {
+    if (name == "chained") {
+        engine = HashEngine::CHAINED;
+    } else if (name == "swiss") {
+        engine = HashEngine::SWISS;
+    } else {
+        return false;
+    }
+    return true;
 }
 
-std::optional<std::string> ConcurrentHashTable::get(const std::string& key) const {
-    std::shared_lock lock(mutex_);
-    return table_.get(key);
+ConcurrentHashTable::ConcurrentHashTable(size_t initial_capacity, size_t segments,
+                                         HashEngine engine) 
+    : engine_(engine) {
+    // Power of two so a shift selects the segment
+    segment_count_ = 1;
+    segment_shift_ = 32;
+    while (segment_count_ < segments && segment_count_ < MAX_SEGMENTS) {
+        segment_count_ *= 2;
+        segment_shift_--;
+    }
+    
+    // Spread the requested capacity over the segments
+    size_t per_segment = initial_capacity / segment_count_;
+    segments_.reserve(segment_count_);
+    for (size_t i = 0; i < segment_count_; i++) {
+        segments_.push_back(std::make_unique<Segment>(per_segment, engine));
+    }
 }
 
-bool ConcurrentHashTable::del(const std::string& key) {
-    std::unique_lock lock(mutex_);
-    return table_.del(key);
+ConcurrentHashTable::Segment& ConcurrentHashTable::segment_for(std::string_view key) const {
+    if (segment_count_ == 1) {
+        return *segments_[0];
+    }
+    
+    // High bits pick the segment; HashTable uses the low bits for buckets
+    uint32_t hash_val = murmur3_32(key.data(), key.size(), 0x12345678);
+    return *segments_[hash_val >> segment_shift_];
+}
+
+bool ConcurrentHashTable::set(std::string_view key, std::string_view value, int64_t expire_at) {
+    Segment& segment = segment_for(key);
+    std::unique_lock lock(segment.mutex);
+    return std::visit([&](auto& table) { return table.set(key, value, expire_at); }, 
+                      segment.table);
+}
+
+bool ConcurrentHashTable::set_if(std::string_view key, std::string_view value, bool present,
+                                 int64_t expire_at) {
+    Segment& segment = segment_for(key);
+    std::unique_lock lock(segment.mutex);
+    return std::visit([&](auto& table) {
+        if (table.exists(key) != present) {
+            return false;
+        }
+        table.set(key, value, expire_at);
+        return true;
+    }, segment.table);
+}
+
+std::optional<std::string> ConcurrentHashTable::get(std::string_view key) const {
+    Segment& segment = segment_for(key);
+    std::shared_lock lock(segment.mutex);
+    return std::visit([&](const auto& table) { return table.get(key); }, segment.table);
 }
 
-bool ConcurrentHashTable::exists(const std::string& key) const {
-    std::shared_lock lock(mutex_);
-    return table_.exists(key);
+bool ConcurrentHashTable::del(std::string_view key) {
+    Segment& segment = segment_for(key);
+    std::unique_lock lock(segment.mutex);
+    return std::visit([&](auto& table) { return table.del(key); }, segment.table);
 }
 
-std::vector<std::string> ConcurrentHashTable::keys(const std::string& pattern) const {
-    std::shared_lock lock(mutex_);
-    return table_.keys(pattern);
+bool ConcurrentHashTable::exists(std::string_view key) const {
+    Segment& segment = segment_for(key);
+    std::shared_lock lock(segment.mutex);
+    return std::visit([&](const auto& table) { return table.exists(key); }, segment.table);
+}
+
+std::vector<std::string> ConcurrentHashTable::keys(std::string_view pattern) const {
+    std::vector<std::string> result;
+    
+    // Segments are visited one at a time, so this is not an atomic snapshot
+    for (const auto& segment : segments_) {
+        std::shared_lock lock(segment->mutex);
+        auto segment_keys = std::visit([&](const auto& table) { return table.keys(pattern); }, 
+                                       segment->table);
+        result.insert(result.end(), 
+                     std::make_move_iterator(segment_keys.begin()),
+                     std::make_move_iterator(segment_keys.end()));
+    }
+    
+    return result;
 }
 
 void ConcurrentHashTable::clear() {
-    std::unique_lock lock(mutex_);
-    table_.clear();
+    for (auto& segment : segments_) {
+        std::unique_lock lock(segment->mutex);
+        std::visit([](auto& table) { table.clear(); }, segment->table);
+    }
+}
+
+std::optional<int64_t> ConcurrentHashTable::expire_time(std::string_view key) const {
+    Segment& segment = segment_for(key);
+    std::shared_lock lock(segment.mutex);
+    return std::visit([&](const auto& table) { return table.expire_time(key); }, segment.table);
+}
+
+std::optional<int64_t> ConcurrentHashTable::set_expire_time(std::string_view key, 
+                                                            int64_t expire_at) {
+    Segment& segment = segment_for(key);
+    std::unique_lock lock(segment.mutex);
+    return std::visit([&](auto& table) { return table.set_expire_time(key, expire_at); }, 
+                      segment.table);
+}
+
+size_t ConcurrentHashTable::expires() const {
+    size_t total = 0;
+    for (const auto& segment : segments_) {
+        std::shared_lock lock(segment->mutex);
+        total += std::visit([](const auto& table) { return table.expires(); }, segment->table);
+    }
+    return total;
+}
+
+ExpirySample ConcurrentHashTable::sample_expiry(size_t count) const {
+    int64_t now = unix_time_ms();
+    ExpirySample total;
+    for (const auto& segment : segments_) {
+        std::shared_lock lock(segment->mutex);
+        total += std::visit([&](const auto& table) { return table.sample_expiry(now, count); },
+                            segment->table);
+    }
+    return total;
+}
+
+size_t ConcurrentHashTable::remove_expired(size_t limit, KeyBatch* keys) {
+    int64_t now = unix_time_ms();
+    size_t removed = 0;
+    
+    for (auto& segment : segments_) {
+        // As in rehash_for(), never stall a segment that is serving requests
+        std::unique_lock lock(segment->mutex, std::try_to_lock);
+        if (lock.owns_lock()) {
+            removed += std::visit([&](auto& table) { return table.remove_expired(now, limit, keys); },
+                                  segment->table);
+        }
+    }
+    
+    return removed;
+}
+
+bool ConcurrentHashTable::rehash_for(std::chrono::microseconds budget) {
+    auto deadline = std::chrono::steady_clock::now() + budget;
+    bool pending = false;
+    
+    for (auto& segment : segments_) {
+        // Never stall a segment that is serving requests
+        std::unique_lock lock(segment->mutex, std::try_to_lock);
+        if (!lock.owns_lock()) {
+            pending = true;
+            continue;
+        }
+        
+        // Check the clock every 100 buckets
+        while (std::visit([](auto& table) { return table.rehash_step(100); }, segment->table)) {
+            if (std::chrono::steady_clock::now() >= deadline) {
+                return true;
+            }
+        }
+    }
+    
+    return pending;
+}
+
+size_t ConcurrentHashTable::memory_usage() const {
+    size_t total = 0;
+    for (const auto& segment : segments_) {
+        std::shared_lock lock(segment->mutex);
+        total += std::visit([](const auto& table) { return table.memory_usage(); }, 
+                            segment->table);
+    }
+    return total;
 }
 
 size_t ConcurrentHashTable::size() const {
-    std::shared_lock lock(mutex_);
-    return table_.size();
+    size_t total = 0;
+    for (const auto& segment : segments_) {
+        std::shared_lock lock(segment->mutex);
+        total += std::visit([](const auto& table) { return table.size(); }, segment->table);
+    }
+    return total;
 }
 
 } // namespace scuffedredis
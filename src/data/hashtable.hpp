@@ -4,35 +4,155 @@
 // Hash table with separate chaining and dynamic resizing
 
 #include <vector>
+#include <cstdint>
 #include <string>
+#include <string_view>
 #include <memory>
 #include <functional>
 #include <optional>
 #include <shared_mutex>
+#include <mutex>
+#include <chrono>
+#include <cstdlib>
+#include <new>
+#include <utility>
+#include <variant>
+#include "swiss_table.hpp"
+#include "expiry_index.hpp"
 
 namespace scuffedredis {
 
+/**
+ * MurmurHash3 (32-bit) used for bucket selection.
+ * Exposed so other layers (e.g. shard routing) hash keys the same way;
+ * use a different seed to get bits independent of bucket placement.
+ */
+uint32_t murmur3_32(const void* key, size_t len, uint32_t seed);
+
+/**
+ * Check if string matches a KEYS pattern ('*' and '?' wildcards).
+ */
+bool matches_pattern(std::string_view str, std::string_view pattern);
+
 // Hash table with string keys and values
+//
+// Growing is incremental (as in Redis): when the load factor passes the
+// threshold a second bucket array twice the size is allocated and buckets
+// are migrated a few at a time by later writes and by rehash_step(), so no
+// single operation pays for rehashing the whole table. While migrating,
+// lookups check both arrays and new keys go into the new one.
+//
+// A key can carry a deadline (Unix ms). Expired keys read as absent and
+// are removed by the next write to them or by remove_expired().
 class HashTable {
 public:
     // Node for separate chaining
+    //
+    // Key and value live inline after the header in a single allocation
+    // sized to fit, with varint lengths:
+    //   [next][hash][key_len][key bytes][value_len][value bytes]
+    // A short entry costs one small slab allocation instead of a node plus
+    // up to two string buffers.
+    //
+    // The low bit of the key_len varint says whether the key has a TTL. If
+    // it does, [expire_at][expiry index position] (12 bytes) come before
+    // the key bytes, so keys without one pay nothing.
     struct Node {
-        std::string key;
-        std::string value;
-        std::unique_ptr<Node> next;
+        Node* next;
+        uint32_t hash;              // Cached murmur3 hash of key
+        uint8_t data[4];            // Start of the encoded key and value
+        
+        std::string_view key() const;
+        std::string_view value() const;
+        
+        bool has_expiry() const { return data[0] & 1; }
+        
+        /**
+         * Deadline in Unix ms, or NO_EXPIRY. Setters need has_expiry().
+         */
+        int64_t expire_at() const;
+        void set_expire_at(int64_t expire_at);
+        uint32_t expiry_position() const;
+        void set_expiry_position(uint32_t position);
         
-        Node(const std::string& k, const std::string& v) 
-            : key(k), value(v), next(nullptr) {}
+        /**
+         * Bytes used by this entry's encoding.
+         */
+        size_t encoded_size() const;
+        
+        /**
+         * Bytes reserved for this entry (its slab size class).
+         */
+        size_t allocation_size() const;
+        
+        /**
+         * Overwrite the value if it fits in the node's size class.
+         * Returns false if the node has to be reallocated.
+         */
+        bool assign_value(std::string_view value);
+        
+        static Node* create(uint32_t hash, std::string_view key, std::string_view value,
+                            bool with_expiry = false);
+        static void destroy(Node* node);
+        static size_t encoded_size(size_t key_len, size_t value_len, bool with_expiry = false);
+    
+    private:
+        /**
+         * Length and start of the key bytes.
+         */
+        const uint8_t* key_bytes(size_t& key_len) const;
     };
     
+    /**
+     * Allocator for bucket arrays. calloc hands large arrays out as fresh
+     * zero pages, and an all-zero pointer is null, so value-initialising
+     * a new array is skipped instead of writing every slot. Starting a
+     * rehash into a multi-million bucket array is then close to free.
+     */
+    template<typename T>
+    struct BucketAllocator {
+        using value_type = T;
+        
+        BucketAllocator() = default;
+        template<typename U>
+        BucketAllocator(const BucketAllocator<U>&) noexcept {}
+        
+        T* allocate(size_t n) {
+            void* memory = std::calloc(n, sizeof(T));
+            if (!memory) {
+                throw std::bad_alloc();
+            }
+            return static_cast<T*>(memory);
+        }
+        
+        void deallocate(T* memory, size_t) noexcept { std::free(memory); }
+        
+        // Value-initialisation: memory is already zero
+        template<typename U>
+        void construct(U*) noexcept {}
+        
+        template<typename U, typename... Args>
+        void construct(U* ptr, Args&&... args) {
+            ::new (static_cast<void*>(ptr)) U(std::forward<Args>(args)...);
+        }
+        
+        template<typename U>
+        bool operator==(const BucketAllocator<U>&) const noexcept { return true; }
+        template<typename U>
+        bool operator!=(const BucketAllocator<U>&) const noexcept { return false; }
+    };
+    
+    using Buckets = std::vector<Node*, BucketAllocator<Node*>>;
+    
     // Iterator for traversing the hash table
+    // Walks the old bucket array, then the one being migrated to
     class Iterator {
     public:
         Iterator(HashTable* table, size_t bucket, Node* node)
-            : table_(table), bucket_(bucket), node_(node) {
+            : table_(table), bucket_(bucket), node_(node), rehash_table_(false) {
             // Find first non-empty bucket if current is null
             if (!node_ && table_) {
-                advance_to_next();
+                visit_bucket();
             }
         }
         
@@ -40,14 +160,16 @@ public:
         Iterator& operator++();
         bool operator==(const Iterator& other) const;
         bool operator!=(const Iterator& other) const { return !(*this == other); }
-        std::pair<const std::string&, std::string&> operator*();
+        std::pair<std::string_view, std::string_view> operator*();
         
     private:
         HashTable* table_;
         size_t bucket_;
         Node* node_;
+        bool rehash_table_;  // Walking rehash_buckets_
         
         void advance_to_next();
+        void visit_bucket();
     };
     
     // Constructor with initial capacity
@@ -60,26 +182,95 @@ public:
     HashTable(HashTable&& other) noexcept;
     HashTable& operator=(HashTable&& other) noexcept;
     
-    bool set(const std::string& key, const std::string& value);
-    std::optional<std::string> get(const std::string& key) const;
-    bool del(const std::string& key);
-    bool exists(const std::string& key) const;
-    std::vector<std::string> keys(const std::string& pattern = "*") const;
+    /**
+     * Set a key's value and its deadline: a Unix time in ms, NO_EXPIRY
+     * for none, or KEEP_EXPIRY to keep the one it has.
+     * Returns true if the key was absent (or had expired).
+     */
+    bool set(std::string_view key, std::string_view value, int64_t expire_at = NO_EXPIRY);
+    std::optional<std::string> get(std::string_view key) const;
+    
+    /**
+     * Get a key's value without copying it.
+     * The view is valid until the table is next modified.
+     */
+    std::optional<std::string_view> get_view(std::string_view key) const;
+    
+    /**
+     * Returns false for an absent key, and for an expired one (which is
+     * removed all the same).
+     */
+    bool del(std::string_view key);
+    bool exists(std::string_view key) const;
+    std::vector<std::string> keys(std::string_view pattern = "*") const;
     void clear();
     
+    /**
+     * A key's deadline, NO_EXPIRY if it has none, or nullopt if absent.
+     */
+    std::optional<int64_t> expire_time(std::string_view key) const;
+    
+    /**
+     * Give a key a deadline, or remove it with NO_EXPIRY. Returns the
+     * previous deadline (NO_EXPIRY if none), or nullopt if the key is absent.
+     */
+    std::optional<int64_t> set_expire_time(std::string_view key, int64_t expire_at);
+    
+    /**
+     * Remove up to `limit` keys whose deadline is at or before `now`.
+     * Returns the number removed, and adds their names to `removed` if given.
+     */
+    size_t remove_expired(int64_t now, size_t limit, KeyBatch* removed = nullptr);
+    
+    /**
+     * Number of keys with a TTL, including expired ones not yet removed.
+     */
+    size_t expires() const { return expires_.size(); }
+    
+    /**
+     * Check up to `count` keys with a TTL for having expired by `now`.
+     */
+    ExpirySample sample_expiry(int64_t now, size_t count) const {
+        return expires_.sample(now, count);
+    }
+    
+    // Expired keys count until removed
     size_t size() const { return size_; }
     bool empty() const { return size_ == 0; }
-    size_t capacity() const { return buckets_.size(); }
+    
+    // Capacity the table is growing into while a rehash is in progress
+    size_t capacity() const {
+        return is_rehashing() ? rehash_buckets_.size() : buckets_.size();
+    }
     
     double load_factor() const {
-        return buckets_.empty() ? 0.0 : 
-               static_cast<double>(size_) / buckets_.size();
+        return capacity() == 0 ? 0.0 : 
+               static_cast<double>(size_) / capacity();
     }
     
+    /**
+     * Check if buckets are being migrated to a larger array.
+     */
+    bool is_rehashing() const { return !rehash_buckets_.empty(); }
+    
+    /**
+     * Migrate up to `buckets` non-empty buckets (visiting at most ten
+     * times as many empty ones). Returns true if migration is unfinished.
+     */
+    bool rehash_step(size_t buckets);
+    
     // Iterator support
     Iterator begin() { return Iterator(this, 0, nullptr); }
     Iterator end() { return Iterator(nullptr, 0, nullptr); }
     
+    /**
+     * Approximate bytes used by entries and bucket arrays.
+     */
+    size_t memory_usage() const {
+        return entry_bytes_ + (buckets_.size() + rehash_buckets_.size()) * sizeof(Node*) +
+               expires_.memory_usage();
+    }
+    
     // Statistics for monitoring
     struct Stats {
         size_t total_entries;
@@ -88,61 +279,264 @@ public:
         size_t max_chain_length;
         double average_chain_length;
         double load_factor;
+        bool rehashing;
+        size_t memory_usage;   // Approximate bytes (see memory_usage())
+        double bytes_per_key;
     };
     
     Stats get_stats() const;
 
 private:
-    std::vector<std::unique_ptr<Node>> buckets_;  // Array of bucket heads
-    size_t size_;                                  // Number of entries
+    struct NodeDeadline {
+        int64_t operator()(const Node* node) const { return node->expire_at(); }
+    };
+    
+    Buckets buckets_;         // Array of bucket heads
+    Buckets rehash_buckets_;  // Larger array being migrated to (empty if idle)
+    size_t rehash_index_;     // Next bucket of buckets_ to migrate
+    size_t size_;             // Number of entries
+    size_t entry_bytes_;      // Sum of Node::allocation_size() over entries
+    ExpiryIndex<Node*, NodeDeadline> expires_;  // Nodes with a TTL
     
     // Configuration
     static constexpr double MAX_LOAD_FACTOR = 0.75;
     static constexpr size_t MIN_CAPACITY = 16;
+    static constexpr size_t REHASH_STEP = 1;  // Buckets migrated per write
     
     /**
      * Hash function using MurmurHash3.
      * Better distribution than simple modulo.
      */
-    size_t hash(const std::string& key) const;
+    static uint32_t hash(std::string_view key);
+    
+    /**
+     * Bucket for a hash in an array (capacities are powers of two).
+     */
+    static size_t bucket_index(uint32_t hash_val, const Buckets& buckets) {
+        return hash_val & (buckets.size() - 1);
+    }
     
     /**
-     * Resize the hash table when load factor exceeds threshold.
-     * Rehashes all existing entries.
+     * Start growing into an array twice the current capacity.
      */
-    void resize();
+    void start_rehash();
     
     /**
      * Find node for a given key in a bucket.
      * Returns pair of (node, previous_node) for deletion.
      */
-    std::pair<Node*, Node*> find_in_bucket(size_t bucket, 
-                                          const std::string& key) const;
+    static std::pair<Node*, Node*> find_in_bucket(const Buckets& buckets, size_t bucket,
+                                                  std::string_view key, uint32_t hash_val);
     
     /**
-     * Check if string matches pattern with wildcards.
-     * Simple implementation supporting only * wildcard.
+     * Where a key lives, with its predecessor for unlinking.
      */
-    bool matches_pattern(const std::string& str, 
-                        const std::string& pattern) const;
+    struct Location {
+        Buckets* table;
+        size_t bucket;
+        Node* node;   // nullptr if absent
+        Node* prev;
+    };
+    
+    Location locate(std::string_view key, uint32_t hash_val);
+    
+    /**
+     * Find a key in either bucket array.
+     */
+    Node* find(std::string_view key) const;
+    
+    static bool is_expired(const Node* node, int64_t now) {
+        return node->has_expiry() && node->expire_at() <= now;
+    }
+    
+    /**
+     * Unlink and free the node at loc, dropping it from the expiry index.
+     */
+    void erase(const Location& loc);
+    
+    /**
+     * Swap the node at loc for a new one holding key and value, with a
+     * TTL ending at expire_at or none. key may view the old node.
+     */
+    void replace_node(Location& loc, std::string_view key, std::string_view value,
+                      int64_t expire_at);
+    
+    /**
+     * Add a node created with an expiry field to the index.
+     */
+    void track_expiry(Node* node, int64_t expire_at);
+    void untrack_expiry(Node* node);
+    
+    /**
+     * Change the deadline of a node that has one.
+     */
+    void retrack_expiry(Node* node, int64_t expire_at);
+    
+    /**
+     * Free every chain in a bucket array.
+     */
+    static void free_chains(Buckets& buckets);
 };
 
+// Storage engine behind each ConcurrentHashTable segment
+enum class HashEngine {
+    CHAINED,  // HashTable: separate chaining
+    SWISS     // SwissTable: open addressing with SIMD-probed control bytes
+};
+
+/**
+ * Engine name as used on the command line and in INFO.
+ */
+const char* hash_engine_name(HashEngine engine);
+
+/**
+ * Parse an engine name ("chained" or "swiss").
+ * Returns false if the name is unknown.
+ */
+bool parse_hash_engine(const std::string& name, HashEngine& engine);
+
 // Thread-safe wrapper for HashTable
+//
+// The key space is striped over N independently locked segments, picked by
+// the high bits of the key's MurmurHash3 value (buckets use the low bits).
+// Writers to different segments never block each other and a resize only
+// stalls the segment that is growing. One segment gives the classic
+// single-lock table.
 class ConcurrentHashTable {
 public:
-    explicit ConcurrentHashTable(size_t initial_capacity = 16);
+    static constexpr size_t DEFAULT_SEGMENTS = 16;
+    static constexpr size_t MAX_SEGMENTS = 1024;
+    
+    // segments is rounded up to a power of two
+    explicit ConcurrentHashTable(size_t initial_capacity = 16, 
+                                 size_t segments = DEFAULT_SEGMENTS,
+                                 HashEngine engine = HashEngine::CHAINED);
     
-    bool set(const std::string& key, const std::string& value);
-    std::optional<std::string> get(const std::string& key) const;
-    bool del(const std::string& key);
-    bool exists(const std::string& key) const;
-    std::vector<std::string> keys(const std::string& pattern = "*") const;
+    /**
+     * Set a key's value and deadline (see HashTable::set).
+     */
+    bool set(std::string_view key, std::string_view value, int64_t expire_at = NO_EXPIRY);
+    std::optional<std::string> get(std::string_view key) const;
+    
+    /**
+     * Set key only if it exists (`present`) or only if it doesn't, checked
+     * under the same lock as the write, for SET XX and NX.
+     * Returns true if the value was written.
+     */
+    bool set_if(std::string_view key, std::string_view value, bool present,
+                int64_t expire_at = NO_EXPIRY);
+    
+    /**
+     * Call fn(value) with a view of a key's value while its segment is
+     * read-locked, so the value can be used without copying it.
+     * Returns false (without calling fn) if the key is absent.
+     */
+    template<typename Fn>
+    bool read(std::string_view key, Fn&& fn) const {
+        Segment& segment = segment_for(key);
+        std::shared_lock lock(segment.mutex);
+        auto value = std::visit([&](const auto& table) { return table.get_view(key); },
+                                segment.table);
+        if (!value) {
+            return false;
+        }
+        fn(*value);
+        return true;
+    }
+
+    /**
+     * Like read(), then give the key a new deadline, or remove it with
+     * NO_EXPIRY, all under one write lock so no other write can land in
+     * between (GETEX). A deadline already past deletes the key instead.
+     */
+    template<typename Fn>
+    bool read_and_expire(std::string_view key, int64_t expire_at, Fn&& fn) {
+        Segment& segment = segment_for(key);
+        std::unique_lock lock(segment.mutex);
+        return std::visit([&](auto& table) {
+            auto value = table.get_view(key);
+            if (!value) {
+                return false;
+            }
+            fn(*value);
+            if (expire_at != NO_EXPIRY && expire_at <= unix_time_ms()) {
+                table.del(key);
+            } else {
+                table.set_expire_time(key, expire_at);
+            }
+            return true;
+        }, segment.table);
+    }
+
+    bool del(std::string_view key);
+    bool exists(std::string_view key) const;
+    std::vector<std::string> keys(std::string_view pattern = "*") const;
     void clear();
     size_t size() const;
     
+    /**
+     * A key's deadline (see HashTable::expire_time).
+     */
+    std::optional<int64_t> expire_time(std::string_view key) const;
+    
+    /**
+     * Set or remove a key's deadline (see HashTable::set_expire_time).
+     */
+    std::optional<int64_t> set_expire_time(std::string_view key, int64_t expire_at);
+    
+    /**
+     * Number of keys with a TTL.
+     */
+    size_t expires() const;
+    
+    /**
+     * Check up to `count` keys with a TTL in each segment for having
+     * expired, to estimate how many await removal.
+     */
+    ExpirySample sample_expiry(size_t count) const;
+    
+    /**
+     * Remove up to `limit` expired keys from each segment. Segments busy
+     * with other work are skipped. Returns the number removed, and adds
+     * their names to `removed` if given.
+     */
+    size_t remove_expired(size_t limit, KeyBatch* removed = nullptr);
+    
+    /**
+     * Approximate bytes used by every segment's table.
+     */
+    size_t memory_usage() const;
+    
+    size_t segment_count() const { return segment_count_; }
+    HashEngine engine() const { return engine_; }
+    
+    /**
+     * Spend up to `budget` migrating buckets in segments that are
+     * rehashing. Segments busy with other work are skipped.
+     * Returns true if any segment still has buckets to migrate.
+     */
+    bool rehash_for(std::chrono::microseconds budget);
+    
 private:
-    HashTable table_;
-    mutable std::shared_mutex mutex_;  // Reader-writer lock
+    // Cache-line aligned so neighbouring segment locks don't false-share
+    struct alignas(64) Segment {
+        using Table = std::variant<HashTable, SwissTable>;
+        
+        Table table;
+        mutable std::shared_mutex mutex;  // Reader-writer lock
+        
+        Segment(size_t capacity, HashEngine engine)
+            : table(engine == HashEngine::SWISS
+                    ? Table(std::in_place_type<SwissTable>, capacity)
+                    : Table(std::in_place_type<HashTable>, capacity)) {}
+    };
+    
+    std::vector<std::unique_ptr<Segment>> segments_;
+    HashEngine engine_;
+    size_t segment_count_;
+    unsigned segment_shift_;  // 32 - log2(segment_count_)
+    
+    Segment& segment_for(std::string_view key) const;
 };
 
 } // namespace scuffedredis
@@ -0,0 +1,196 @@
+#include "listpack.hpp"
+#include "utils/slab_allocator.hpp"
+#include "utils/varint.hpp"
+#include <algorithm>
+
+namespace scuffedredis {
+
+namespace {
+
+constexpr size_t SCORE_SIZE = sizeof(double);
+
+size_t entry_size(std::string_view member) {
+    return SCORE_SIZE + varint_size(member.size()) + member.size();
+}
+
+} // namespace
+
+bool ListPack::sorts_before(const Entry& entry, double score, std::string_view member) {
+    return entry.score < score || (entry.score == score && entry.member < member);
+}
+
+ListPack::~ListPack() {
+    clear();
+}
+
+ListPack::Entry ListPack::entry_at(size_t offset) const {
+    Entry entry;
+    std::memcpy(&entry.score, data_ + offset, SCORE_SIZE);
+    
+    size_t length;
+    const uint8_t* member = read_varint(data_ + offset + SCORE_SIZE, length);
+    entry.member = std::string_view(reinterpret_cast<const char*>(member), length);
+    entry.next = static_cast<size_t>(member - data_) + length;
+    return entry;
+}
+
+size_t ListPack::find(std::string_view member) const {
+    for (size_t offset = 0; offset < bytes_; ) {
+        Entry entry = entry_at(offset);
+        if (entry.member == member) {
+            return offset;
+        }
+        offset = entry.next;
+    }
+    return NPOS;
+}
+
+std::optional<double> ListPack::score(std::string_view member) const {
+    size_t offset = find(member);
+    if (offset == NPOS) {
+        return std::nullopt;
+    }
+    return entry_at(offset).score;
+}
+
+void ListPack::insert(std::string_view member, double score) {
+    // Before the first entry that sorts after (score, member)
+    size_t offset = 0;
+    while (offset < bytes_) {
+        Entry entry = entry_at(offset);
+        if (!sorts_before(entry, score, member)) {
+            break;
+        }
+        offset = entry.next;
+    }
+    insert_at(offset, score, member);
+}
+
+void ListPack::update(std::string_view member, double score) {
+    size_t previous = NPOS;
+    size_t offset = 0;
+    Entry entry = entry_at(offset);
+    while (entry.member != member) {
+        previous = offset;
+        offset = entry.next;
+        entry = entry_at(offset);
+    }
+    
+    // Rewrite the score in place if the order is unaffected
+    bool after_previous = previous == NPOS || sorts_before(entry_at(previous), score, member);
+    bool before_next = entry.next == bytes_ || !sorts_before(entry_at(entry.next), score, member);
+    if (after_previous && before_next) {
+        std::memcpy(data_ + offset, &score, SCORE_SIZE);
+        return;
+    }
+    
+    erase_at(offset, entry.next - offset);
+    insert(member, score);
+}
+
+bool ListPack::remove(std::string_view member) {
+    size_t offset = find(member);
+    if (offset == NPOS) {
+        return false;
+    }
+    erase_at(offset, entry_at(offset).next - offset);
+    return true;
+}
+
+std::optional<size_t> ListPack::rank(std::string_view member) const {
+    size_t rank = 0;
+    for (size_t offset = 0; offset < bytes_; rank++) {
+        Entry entry = entry_at(offset);
+        if (entry.member == member) {
+            return rank;
+        }
+        offset = entry.next;
+    }
+    return std::nullopt;
+}
+
+size_t ListPack::count_below(double score, bool inclusive) const {
+    size_t count = 0;
+    for (size_t offset = 0; offset < bytes_; count++) {
+        Entry entry = entry_at(offset);
+        if (entry.score > score || (entry.score == score && !inclusive)) {
+            break;
+        }
+        offset = entry.next;
+    }
+    return count;
+}
+
+void ListPack::load(const std::vector<std::pair<std::string_view, double>>& members) {
+    size_t bytes = 0;
+    for (const auto& [member, score] : members) {
+        bytes += entry_size(member);
+    }
+    resize(bytes);
+    
+    uint8_t* out = data_;
+    for (const auto& [member, score] : members) {
+        std::memcpy(out, &score, SCORE_SIZE);
+        out = write_varint(out + SCORE_SIZE, member.size());
+        std::memcpy(out, member.data(), member.size());
+        out += member.size();
+    }
+    bytes_ = static_cast<uint32_t>(bytes);
+    count_ = static_cast<uint32_t>(members.size());
+}
+
+void ListPack::clear() {
+    if (data_) {
+        SlabAllocator::deallocate(data_, capacity_);
+    }
+    data_ = nullptr;
+    bytes_ = 0;
+    capacity_ = 0;
+    count_ = 0;
+}
+
+void ListPack::insert_at(size_t offset, double score, std::string_view member) {
+    size_t size = entry_size(member);
+    resize(bytes_ + size);
+    
+    uint8_t* at = data_ + offset;
+    std::memmove(at + size, at, bytes_ - offset);
+    std::memcpy(at, &score, SCORE_SIZE);
+    uint8_t* out = write_varint(at + SCORE_SIZE, member.size());
+    std::memcpy(out, member.data(), member.size());
+    
+    bytes_ += static_cast<uint32_t>(size);
+    count_++;
+}
+
+void ListPack::erase_at(size_t offset, size_t size) {
+    std::memmove(data_ + offset, data_ + offset + size, bytes_ - offset - size);
+    bytes_ -= static_cast<uint32_t>(size);
+    count_--;
+    
+    if (count_ == 0) {
+        clear();
+    } else {
+        resize(bytes_);
+    }
+}
+
+void ListPack::resize(size_t bytes) {
+    // Stay in the current size class unless it is outgrown or mostly idle
+    if (bytes <= capacity_ && bytes * 4 >= capacity_) {
+        return;
+    }
+    
+    // Past the slab classes, leave headroom so each insert doesn't copy
+    size_t request = bytes > SlabAllocator::MAX_SLAB_OBJECT ? bytes + bytes / 2 : bytes;
+    size_t capacity = SlabAllocator::class_size(request);
+    uint8_t* data = static_cast<uint8_t*>(SlabAllocator::allocate(capacity));
+    if (data_) {
+        std::memcpy(data, data_, std::min<size_t>(bytes_, bytes));
+        SlabAllocator::deallocate(data_, capacity_);
+    }
+    data_ = data;
+    capacity_ = static_cast<uint32_t>(capacity);
+}
+
+} // namespace scuffedredis
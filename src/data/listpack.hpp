@@ -0,0 +1,128 @@
+#ifndef SCUFFEDREDIS_LISTPACK_HPP
+#define SCUFFEDREDIS_LISTPACK_HPP
+
+/**
+ * Listpack sorted set encoding.
+ * 
+ * Small sets are one contiguous byte buffer of entries sorted by
+ * (score, member), each laid out as
+ *   [score: 8 bytes][member length: varint][member bytes]
+ * and searched linearly, as Redis does for sets under
+ * zset-max-listpack-entries. A set of a few members costs one small slab
+ * allocation rather than a node and an index entry per member plus an
+ * engine header. SortedSet converts to a large engine once a set
+ * outgrows it.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace scuffedredis {
+
+class ListPack {
+public:
+    ListPack() = default;
+    ~ListPack();
+    
+    ListPack(const ListPack&) = delete;
+    ListPack& operator=(const ListPack&) = delete;
+    
+    // Same operations as SkipList. Members passed in must not view this
+    // listpack's own buffer.
+    std::optional<double> score(std::string_view member) const;
+    void insert(std::string_view member, double score);
+    void update(std::string_view member, double score);
+    bool remove(std::string_view member);
+    std::optional<size_t> rank(std::string_view member) const;
+    size_t count_below(double score, bool inclusive = false) const;
+    
+    template<typename Fn>
+    void walk(size_t first, bool reverse, Fn&& fn) const;
+    
+    void load(const std::vector<std::pair<std::string_view, double>>& members);
+    
+    size_t size() const { return count_; }
+    int height() const { return 0; }
+    void clear();
+    
+    /**
+     * Bytes of encoded entries.
+     */
+    size_t bytes() const { return bytes_; }
+
+private:
+    static constexpr size_t NPOS = static_cast<size_t>(-1);
+    
+    uint8_t* data_ = nullptr;
+    uint32_t bytes_ = 0;      // Encoded entries
+    uint32_t capacity_ = 0;   // Slab size class of data_
+    uint32_t count_ = 0;
+    
+    struct Entry {
+        double score;
+        std::string_view member;
+        size_t next;          // Offset of the following entry
+    };
+    
+    Entry entry_at(size_t offset) const;
+    
+    /**
+     * Whether entry sorts before (score, member).
+     */
+    static bool sorts_before(const Entry& entry, double score, std::string_view member);
+    
+    /**
+     * Offset of member's entry, or NPOS.
+     */
+    size_t find(std::string_view member) const;
+    
+    void insert_at(size_t offset, double score, std::string_view member);
+    void erase_at(size_t offset, size_t size);
+    
+    /**
+     * Make room for `bytes` of entries, keeping the current ones.
+     */
+    void resize(size_t bytes);
+};
+
+template<typename Fn>
+void ListPack::walk(size_t first, bool reverse, Fn&& fn) const {
+    if (first >= count_) {
+        return;
+    }
+    
+    if (!reverse) {
+        size_t offset = 0;
+        for (size_t i = 0; i < count_; i++) {
+            Entry entry = entry_at(offset);
+            if (i >= first && !fn(entry.member, entry.score)) {
+                return;
+            }
+            offset = entry.next;
+        }
+        return;
+    }
+    
+    // Entries only chain forward, so note where each starts
+    std::vector<uint32_t> offsets;
+    offsets.reserve(first + 1);
+    for (size_t i = 0, offset = 0; i <= first; i++) {
+        offsets.push_back(static_cast<uint32_t>(offset));
+        offset = entry_at(offset).next;
+    }
+    for (size_t i = first + 1; i-- > 0; ) {
+        Entry entry = entry_at(offsets[i]);
+        if (!fn(entry.member, entry.score)) {
+            return;
+        }
+    }
+}
+
+} // namespace scuffedredis
+
+#endif // SCUFFEDREDIS_LISTPACK_HPP
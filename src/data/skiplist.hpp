@@ -0,0 +1,147 @@
+#ifndef SCUFFEDREDIS_SKIPLIST_HPP
+#define SCUFFEDREDIS_SKIPLIST_HPP
+
+/**
+ * Skiplist sorted set engine.
+ * 
+ * The layout Redis uses for large sorted sets: a skiplist ordered by
+ * (score, member) whose forward links record how many nodes they skip, so
+ * the rank of a node is the sum of the spans crossed on the way to it,
+ * plus a hash index from member to node for O(1) score lookups.
+ * 
+ * Each node is a single slab allocation holding its levels followed by the
+ * member bytes, and the index keys are views of those bytes, so a member
+ * is stored once and nothing is reference counted.
+ */
+
+#include "utils/slab_allocator.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace scuffedredis {
+
+class SkipList {
+public:
+    static constexpr int MAX_LEVEL = 32;
+    
+    struct Node {
+        struct Level {
+            Node* forward;
+            size_t span;       // Ranks advanced by following forward
+        };
+        
+        double score;
+        Node* backward;        // Previous node, nullptr for the first
+        uint32_t member_size;
+        uint8_t level_count;
+        Level levels[1];       // level_count levels, then the member bytes
+        
+        std::string_view member() const {
+            return std::string_view(reinterpret_cast<const char*>(levels + level_count),
+                                    member_size);
+        }
+        
+        static Node* create(int level_count, double score, std::string_view member);
+        static void destroy(Node* node);
+        static size_t allocation_size(int level_count, size_t member_size);
+    };
+    
+    SkipList();
+    ~SkipList();
+    
+    SkipList(const SkipList&) = delete;
+    SkipList& operator=(const SkipList&) = delete;
+    
+    /**
+     * Score of member, or nullopt if absent.
+     */
+    std::optional<double> score(std::string_view member) const;
+    
+    /**
+     * Add a member that is not yet present.
+     */
+    void insert(std::string_view member, double score);
+    
+    /**
+     * Change the score of a member that is present. The node is moved,
+     * not reallocated, and stays put if its neighbours still bracket it.
+     */
+    void update(std::string_view member, double score);
+    
+    /**
+     * Remove member. Returns false if absent.
+     */
+    bool remove(std::string_view member);
+    
+    /**
+     * 0-based ascending rank of member, or nullopt if absent.
+     */
+    std::optional<size_t> rank(std::string_view member) const;
+    
+    /**
+     * Number of members scoring below `score`, or at most `score` if
+     * inclusive.
+     */
+    size_t count_below(double score, bool inclusive = false) const;
+    
+    /**
+     * Call fn(member, score) for each member from ascending rank `first`,
+     * moving up (or down, if reverse) until fn returns false.
+     */
+    template<typename Fn>
+    void walk(size_t first, bool reverse, Fn&& fn) const;
+    
+    /**
+     * Fill an empty skiplist from members sorted by (score, member),
+     * without duplicates. Links each node at the tail, so O(n) overall.
+     */
+    void load(const std::vector<std::pair<std::string_view, double>>& members);
+    
+    size_t size() const { return length_; }
+    int height() const { return level_; }
+    void clear();
+
+private:
+    using Index = std::unordered_map<std::string_view, Node*, std::hash<std::string_view>,
+                                     std::equal_to<std::string_view>,
+                                     SlabStlAllocator<std::pair<const std::string_view, Node*>>>;
+    
+    Node* header_;       // Sentinel with MAX_LEVEL levels
+    int level_;          // Levels in use
+    size_t length_;
+    uint64_t random_;    // xorshift state for node levels
+    Index index_;
+    
+    int random_level();
+    
+    /**
+     * Last node on each level ordered before (score, member).
+     */
+    void find_predecessors(double score, std::string_view member, Node** update) const;
+    
+    void link(Node* node);
+    void unlink(Node* node, Node** update);
+    
+    /**
+     * Node at 0-based rank, or nullptr if out of range.
+     */
+    const Node* node_at(size_t rank) const;
+};
+
+template<typename Fn>
+void SkipList::walk(size_t first, bool reverse, Fn&& fn) const {
+    const Node* node = node_at(first);
+    while (node && fn(node->member(), node->score)) {
+        node = reverse ? node->backward : node->levels[0].forward;
+    }
+}
+
+} // namespace scuffedredis
+
+#endif // SCUFFEDREDIS_SKIPLIST_HPP
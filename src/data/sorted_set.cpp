@@ -1,48 +1,200 @@
 #include "sorted_set.hpp"
+#include "hashtable.hpp"
 #include <algorithm>
 #include <numeric>
+#include <cmath>
+#include <thread>
+#include <unordered_map>
 
 namespace scuffedredis {
 
+const char* zset_engine_name(ZSetEngine engine) {
+    return engine == ZSetEngine::AVL ? "avl" : "skiplist";
+}
+
+bool parse_zset_engine(const std::string& name, ZSetEngine& engine) {
+    if (name == "avl") {
+        engine = ZSetEngine::AVL;
+    } else if (name == "skiplist") {
+        engine = ZSetEngine::SKIPLIST;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// ============================================================================
+// AVLZSet Implementation
+// ============================================================================
+
+std::optional<double> AVLZSet::score(std::string_view member) const {
+    auto it = scores_.find(std::string(member));
+    if (it != scores_.end()) {
+        return it->second;
+    }
+    return std::nullopt;
+}
+
+void AVLZSet::insert(std::string_view member, double score) {
+    std::string key(member);
+    scores_.emplace(key, score);
+    tree_.insert(SortedSetEntry(score, std::move(key)), true);
+}
+
+void AVLZSet::update(std::string_view member, double score) {
+    auto it = scores_.find(std::string(member));
+    
+    // Re-insert under the new score
+    tree_.remove(SortedSetEntry(it->second, it->first));
+    it->second = score;
+    tree_.insert(SortedSetEntry(score, it->first), true);
+}
+
+bool AVLZSet::remove(std::string_view member) {
+    auto it = scores_.find(std::string(member));
+    if (it == scores_.end()) {
+        return false;
+    }
+    
+    tree_.remove(SortedSetEntry(it->second, it->first));
+    scores_.erase(it);
+    return true;
+}
+
+std::optional<size_t> AVLZSet::rank(std::string_view member) const {
+    auto it = scores_.find(std::string(member));
+    if (it == scores_.end()) {
+        return std::nullopt;
+    }
+    return static_cast<size_t>(tree_.rank(SortedSetEntry(it->second, it->first)));
+}
+
+size_t AVLZSet::count_below(double score, bool inclusive) const {
+    return tree_.partition_point([score, inclusive](const SortedSetEntry& entry) {
+        return entry.score < score || (inclusive && entry.score == score);
+    });
+}
+
+void AVLZSet::load(const SortedMemberViews& members) {
+    scores_.reserve(members.size());
+    for (const auto& [member, score] : members) {
+        scores_.emplace(std::string(member), score);
+    }
+    
+    auto next = members.begin();
+    tree_.assign_sorted(members.size(), [&next]() {
+        const auto& [member, score] = *next++;
+        return SortedSetEntry(score, std::string(member));
+    }, true);
+}
+
+void AVLZSet::clear() {
+    tree_.clear();
+    scores_.clear();
+}
+
 // ============================================================================
 // SortedSet Implementation
 // ============================================================================
 
-SortedSet::SortedSet() : size_(0) {
+SortedSet::SortedSet(const ZSetOptions& options) : options_(options) {
+    if (options_.listpack_max_entries == 0) {
+        convert();
+    }
 }
 
 SortedSet::~SortedSet() {
     clear();
 }
 
-int SortedSet::zadd(const std::string& member, double score) {
-    std::lock_guard<std::mutex> lock(mutex_);
+const char* SortedSet::encoding() const {
+    if (std::holds_alternative<ListPack>(encoding_)) {
+        return "listpack";
+    }
+    return std::holds_alternative<std::unique_ptr<AVLZSet>>(encoding_) ? "avl" : "skiplist";
+}
+
+void SortedSet::convert() {
+    // Build the engine before dropping the listpack, whose bytes it reads
+    auto fill = [this](auto& engine) {
+        std::get<ListPack>(encoding_).walk(0, false, [&](std::string_view member, double score) {
+            engine.insert(member, score);
+            return true;
+        });
+    };
     
-    // Check if member already exists
-    auto it = scores_.find(member);
-    if (it != scores_.end()) {
-        // Member exists, remove old entry from tree
-        double old_score = it->second;
-        SortedSetEntry old_entry(old_score, member);
-        tree_.remove(old_entry);
-        
-        // Update score
-        it->second = score;
-        
-        // Add new entry to tree
-        SortedSetEntry new_entry(score, member);
-        tree_.insert(new_entry, true);
-        
-        return 0;  // Updated existing member
+    if (options_.engine == ZSetEngine::AVL) {
+        auto engine = std::make_unique<AVLZSet>();
+        fill(*engine);
+        encoding_.emplace<std::unique_ptr<AVLZSet>>(std::move(engine));
+    } else {
+        auto engine = std::make_unique<SkipList>();
+        fill(*engine);
+        encoding_.emplace<std::unique_ptr<SkipList>>(std::move(engine));
+    }
+}
+
+SortedSet::AddResult SortedSet::add(std::string_view member, double score, unsigned flags,
+                                    double* new_score) {
+    if (std::isnan(score)) {
+        return AddResult::NOT_A_NUMBER;
     }
     
-    // Add new member
-    scores_[member] = score;
-    SortedSetEntry entry(score, member);
-    tree_.insert(entry, true);
-    size_++;
+    // Outgrow the listpack before adding a member it can't hold. A member
+    // over the length limit can't already be in it
+    if (auto* listpack = std::get_if<ListPack>(&encoding_)) {
+        bool too_long = member.size() > options_.listpack_max_value;
+        bool full = listpack->size() >= options_.listpack_max_entries;
+        if (!(flags & ADD_XX) && (too_long || (full && !listpack->score(member)))) {
+            convert();
+        }
+    }
     
-    return 1;  // Added new member
+    return visit([&](auto& engine) {
+        std::optional<double> current = engine.score(member);
+        
+        if (current) {
+            if (flags & ADD_NX) {
+                return AddResult::SKIPPED;
+            }
+            
+            if (flags & ADD_INCR) {
+                score += *current;
+                if (std::isnan(score)) {
+                    return AddResult::NOT_A_NUMBER;  // e.g. inf + -inf
+                }
+            }
+            
+            if (((flags & ADD_GT) && score <= *current) || ((flags & ADD_LT) && score >= *current)) {
+                return AddResult::SKIPPED;
+            }
+            
+            if (new_score) {
+                *new_score = score;
+            }
+            if (score == *current) {
+                return AddResult::UNCHANGED;
+            }
+            
+            engine.update(member, score);
+            return AddResult::UPDATED;
+        }
+        
+        if (flags & ADD_XX) {
+            return AddResult::SKIPPED;
+        }
+        
+        // Add new member (INCR starts from 0)
+        engine.insert(member, score);
+        if (new_score) {
+            *new_score = score;
+        }
+        return AddResult::ADDED;
+    });
+}
+
+int SortedSet::zadd(const std::string& member, double score) {
+    return add(member, score) == AddResult::ADDED ? 1 : 0;
 }
 
 int SortedSet::zadd_multi(const std::vector<std::pair<std::string, double>>& items) {
@@ -53,24 +205,8 @@ int SortedSet::zadd_multi(const std::vector<std::pair<std::string, double>>& ite
     return added;
 }
 
-int SortedSet::zrem(const std::string& member) {
-    std::lock_guard<std::mutex> lock(mutex_);
-    
-    auto it = scores_.find(member);
-    if (it == scores_.end()) {
-        return 0;  // Member not found
-    }
-    
-    // Remove from tree
-    double score = it->second;
-    SortedSetEntry entry(score, member);
-    tree_.remove(entry);
-    
-    // Remove from hash map
-    scores_.erase(it);
-    size_--;
-    
-    return 1;  // Removed
+int SortedSet::zrem(std::string_view member) {
+    return visit([member](auto& engine) { return engine.remove(member) ? 1 : 0; });
 }
 
 int SortedSet::zrem_multi(const std::vector<std::string>& members) {
@@ -81,42 +217,30 @@ int SortedSet::zrem_multi(const std::vector<std::string>& members) {
     return removed;
 }
 
-std::optional<double> SortedSet::zscore(const std::string& member) const {
-    std::lock_guard<std::mutex> lock(mutex_);
-    
-    auto it = scores_.find(member);
-    if (it != scores_.end()) {
-        return it->second;
-    }
-    return std::nullopt;
+std::optional<double> SortedSet::zscore(std::string_view member) const {
+    return visit([member](const auto& engine) { return engine.score(member); });
 }
 
-std::optional<int> SortedSet::zrank(const std::string& member) const {
-    std::lock_guard<std::mutex> lock(mutex_);
-    
-    auto it = scores_.find(member);
-    if (it == scores_.end()) {
+std::optional<int> SortedSet::zrank(std::string_view member) const {
+    auto rank = visit([member](const auto& engine) { return engine.rank(member); });
+    if (!rank) {
         return std::nullopt;
     }
-    
-    double score = it->second;
-    SortedSetEntry entry(score, member);
-    return tree_.rank(entry);
+    return static_cast<int>(*rank);
 }
 
-std::optional<int> SortedSet::zrevrank(const std::string& member) const {
+std::optional<int> SortedSet::zrevrank(std::string_view member) const {
     auto rank_opt = zrank(member);
     if (rank_opt.has_value()) {
-        return static_cast<int>(size_) - 1 - rank_opt.value();
+        return static_cast<int>(zcard()) - 1 - rank_opt.value();
     }
     return std::nullopt;
 }
 
 std::vector<std::pair<std::string, double>> SortedSet::zrange(
     int start, int stop, bool withScores) const {
-    std::lock_guard<std::mutex> lock(mutex_);
-    
-    if (size_ == 0) {
+    int size = static_cast<int>(zcard());
+    if (size == 0) {
         return {};
     }
     
@@ -126,93 +250,92 @@ std::vector<std::pair<std::string, double>> SortedSet::zrange(
     
     // Validate range
     if (start < 0) start = 0;
-    if (stop >= static_cast<int>(size_)) stop = size_ - 1;
+    if (stop >= size) stop = size - 1;
     if (start > stop) return {};
     
-    // Get all entries in order
-    auto all_entries = tree_.inorder();
-    
-    // Extract range
-    std::vector<std::pair<std::string, double>> result;
-    for (int i = start; i <= stop && i < static_cast<int>(all_entries.size()); i++) {
-        const auto& entry = all_entries[i].first;
-        if (withScores) {
-            result.emplace_back(entry.member, entry.score);
-        } else {
-            result.emplace_back(entry.member, 0.0);
-        }
-    }
-    
-    return result;
+    return range_by_rank(start, stop - start + 1, false, withScores);
 }
 
 std::vector<std::pair<std::string, double>> SortedSet::zrevrange(
     int start, int stop, bool withScores) const {
-    auto result = zrange(start, stop, withScores);
-    std::reverse(result.begin(), result.end());
-    return result;
-}
-
-std::vector<std::pair<std::string, double>> SortedSet::zrangebyscore(
-    double min, double max, bool withScores) const {
-    std::lock_guard<std::mutex> lock(mutex_);
+    int size = static_cast<int>(zcard());
+    if (size == 0) {
+        return {};
+    }
     
-    // Create dummy entries for range query
-    SortedSetEntry min_entry(min, "");
-    SortedSetEntry max_entry(max, "\xff");  // Max possible string
+    start = normalize_index(start);
+    stop = normalize_index(stop);
     
-    auto entries = tree_.range(min_entry, max_entry);
+    if (start < 0) start = 0;
+    if (stop >= size) stop = size - 1;
+    if (start > stop) return {};
     
-    std::vector<std::pair<std::string, double>> result;
-    for (const auto& [entry, _] : entries) {
-        if (entry.score >= min && entry.score <= max) {
-            if (withScores) {
-                result.emplace_back(entry.member, entry.score);
-            } else {
-                result.emplace_back(entry.member, 0.0);
-            }
-        }
+    // Reverse rank r is ascending rank size - 1 - r
+    return range_by_rank(size - 1 - start, stop - start + 1, true, withScores);
+}
+
+std::vector<std::pair<std::string, double>> SortedSet::zrangebyscore(
+    const ScoreRange& range, bool withScores, size_t offset, int64_t count) const {
+    auto [first, last] = score_ranks(range);
+    if (last - first <= offset || count == 0) {
+        return {};
     }
     
-    return result;
+    size_t matches = last - first - offset;
+    if (count > 0 && static_cast<size_t>(count) < matches) {
+        matches = static_cast<size_t>(count);
+    }
+    return range_by_rank(first + offset, matches, false, withScores);
 }
 
-size_t SortedSet::zcount(double min, double max) const {
-    auto range = zrangebyscore(min, max, false);
-    return range.size();
+size_t SortedSet::zcount(const ScoreRange& range) const {
+    auto [first, last] = score_ranks(range);
+    return last - first;
+}
+
+size_t SortedSet::zcard() const {
+    return visit([](const auto& engine) { return engine.size(); });
 }
 
 void SortedSet::clear() {
-    std::lock_guard<std::mutex> lock(mutex_);
-    tree_.clear();
-    scores_.clear();
-    size_ = 0;
+    visit([](auto& engine) { engine.clear(); });
 }
 
-SortedSet::Stats SortedSet::get_stats() const {
-    std::lock_guard<std::mutex> lock(mutex_);
+void SortedSet::load(const SortedMemberViews& members) {
+    bool fits = members.size() <= options_.listpack_max_entries &&
+                std::all_of(members.begin(), members.end(), [this](const auto& item) {
+                    return item.first.size() <= options_.listpack_max_value;
+                });
+    if (!fits && std::holds_alternative<ListPack>(encoding_)) {
+        convert();
+    }
     
+    visit([&members](auto& engine) { engine.load(members); });
+}
+
+SortedSet::Stats SortedSet::get_stats() const {
     Stats stats;
-    stats.total_members = size_;
-    stats.tree_height = tree_.height();
+    stats.total_members = zcard();
+    stats.tree_height = visit([](const auto& engine) { return engine.height(); });
+    stats.min_score = 0.0;
+    stats.max_score = 0.0;
+    stats.avg_score = 0.0;
     
-    if (size_ == 0) {
-        stats.min_score = 0.0;
-        stats.max_score = 0.0;
-        stats.avg_score = 0.0;
-    } else {
-        auto all_entries = tree_.inorder();
-        
-        if (!all_entries.empty()) {
-            stats.min_score = all_entries.front().first.score;
-            stats.max_score = all_entries.back().first.score;
-            
-            double sum = 0.0;
-            for (const auto& [entry, _] : all_entries) {
-                sum += entry.score;
-            }
-            stats.avg_score = sum / size_;
-        }
+    if (stats.total_members > 0) {
+        double sum = 0.0;
+        bool first = true;
+        visit([&](const auto& engine) {
+            engine.walk(0, false, [&](std::string_view, double score) {
+                if (first) {
+                    stats.min_score = score;
+                    first = false;
+                }
+                stats.max_score = score;
+                sum += score;
+                return true;
+            });
+        });
+        stats.avg_score = sum / stats.total_members;
     }
     
     return stats;
@@ -220,54 +343,443 @@ SortedSet::Stats SortedSet::get_stats() const {
 
 int SortedSet::normalize_index(int index) const {
     if (index < 0) {
-        return static_cast<int>(size_) + index;
+        return static_cast<int>(zcard()) + index;
     }
     return index;
 }
 
+std::pair<size_t, size_t> SortedSet::score_ranks(const ScoreRange& range) const {
+    if (range.min > range.max) {
+        return {0, 0};
+    }
+    
+    // Two O(log n) descents: past the scores below min, and below max
+    auto [first, last] = visit([&range](const auto& engine) {
+        return std::make_pair(engine.count_below(range.min, range.min_exclusive),
+                              engine.count_below(range.max, !range.max_exclusive));
+    });
+    return {first, std::max(first, last)};
+}
+
+std::vector<std::pair<std::string, double>> SortedSet::range_by_rank(
+    size_t first, size_t count, bool reverse, bool withScores) const {
+    // Walk from the first rank instead of materializing the whole set
+    std::vector<std::pair<std::string, double>> result;
+    result.reserve(count);
+    visit([&](const auto& engine) {
+        engine.walk(first, reverse, [&](std::string_view member, double score) {
+            result.emplace_back(member, withScores ? score : 0.0);
+            return result.size() < count;
+        });
+    });
+    
+    return result;
+}
+
 // ============================================================================
-// SortedSetManager Implementation
+// Set Operations
 // ============================================================================
 
-std::shared_ptr<SortedSet> SortedSetManager::get_or_create(const std::string& key) {
-    std::lock_guard<std::mutex> lock(mutex_);
+namespace {
+
+// Fewer members than this per thread aren't worth a thread
+constexpr size_t MIN_MEMBERS_PER_THREAD = 16384;
+
+// Partition seed, distinct from the ones that place keys
+constexpr uint32_t PARTITION_HASH_SEED = 0x5bd1e995;
+
+double weighted_score(double score, double weight) {
+    // 0 * inf is NaN, which Redis takes as 0
+    double result = score * weight;
+    return std::isnan(result) ? 0.0 : result;
+}
+
+double aggregate_scores(ZSetAggregate aggregate, double a, double b) {
+    switch (aggregate) {
+        case ZSetAggregate::MIN:
+            return std::min(a, b);
+        case ZSetAggregate::MAX:
+            return std::max(a, b);
+        default: {
+            double sum = a + b;
+            return std::isnan(sum) ? 0.0 : sum;  // inf + -inf
+        }
+    }
+}
+
+bool sorts_before(const std::pair<std::string_view, double>& a,
+                  const std::pair<std::string_view, double>& b) {
+    return a.second < b.second || (a.second == b.second && a.first < b.first);
+}
+
+/**
+ * Run fn(0) .. fn(tasks - 1) concurrently, the first on this thread.
+ */
+template<typename Fn>
+void run_parallel(size_t tasks, Fn&& fn) {
+    std::vector<std::thread> workers;
+    workers.reserve(tasks - 1);
+    for (size_t i = 1; i < tasks; i++) {
+        workers.emplace_back([&fn, i]() { fn(i); });
+    }
+    fn(0);
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+} // namespace
+
+SortedMemberViews combine_sorted_sets(ZSetOperation operation,
+                                      const std::vector<ScoredMembers>& inputs,
+                                      const std::vector<double>& weights,
+                                      ZSetAggregate aggregate, size_t threads) {
+    // Merge order: as given, except that intersections start from the
+    // smallest set, as in Redis, so only its members are ever kept
+    std::vector<size_t> order(inputs.size());
+    std::iota(order.begin(), order.end(), 0);
+    if (operation == ZSetOperation::INTER) {
+        std::stable_sort(order.begin(), order.end(), [&inputs](size_t a, size_t b) {
+            return inputs[a].size() < inputs[b].size();
+        });
+    }
+    if (inputs.empty() || (operation != ZSetOperation::UNION && inputs[order[0]].empty())) {
+        return {};
+    }
     
-    auto it = sets_.find(key);
-    if (it != sets_.end()) {
-        return it->second;
+    size_t total = 0;
+    for (const auto& input : inputs) {
+        total += input.size();
+    }
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    size_t partitions = std::clamp<size_t>(total / MIN_MEMBERS_PER_THREAD, 1, threads);
+    
+    // A member as found in one input; `input` is its place in merge order
+    struct Ref {
+        const std::pair<std::string, double>* item;
+        uint32_t input;
+    };
+    
+    // Scatter: worker w takes the w-th slice of the inputs laid end to end
+    // in merge order and files each member under its partition, so reading
+    // buckets[0][p], buckets[1][p], ... visits partition p in merge order
+    std::vector<std::vector<std::vector<Ref>>> buckets(
+        partitions, std::vector<std::vector<Ref>>(partitions));
+    run_parallel(partitions, [&](size_t worker) {
+        size_t begin = total * worker / partitions;
+        size_t end = total * (worker + 1) / partitions;
+        size_t offset = 0;  // Position of the current input's first member
+        for (uint32_t i = 0; i < order.size() && offset < end; i++) {
+            const ScoredMembers& input = inputs[order[i]];
+            size_t last = std::min(end, offset + input.size());
+            for (size_t j = std::max(begin, offset); j < last; j++) {
+                const auto& item = input[j - offset];
+                size_t partition = 0;
+                if (partitions > 1) {
+                    uint32_t hash = murmur3_32(item.first.data(), item.first.size(),
+                                               PARTITION_HASH_SEED);
+                    partition = static_cast<size_t>((static_cast<uint64_t>(hash) * partitions) >> 32);
+                }
+                buckets[worker][partition].push_back({&item, i});
+            }
+            offset += input.size();
+        }
+    });
+    
+    // Merge each partition in a map of its own, then sort what survives
+    std::vector<SortedMemberViews> runs(partitions);
+    run_parallel(partitions, [&](size_t partition) {
+        struct Merged {
+            double score;
+            uint32_t sets;  // Inputs holding the member; 0 once DIFF drops it
+        };
+        
+        std::unordered_map<std::string_view, Merged> merged;
+        if (operation == ZSetOperation::UNION) {
+            size_t refs = 0;
+            for (size_t worker = 0; worker < partitions; worker++) {
+                refs += buckets[worker][partition].size();
+            }
+            merged.reserve(refs);
+        }
+        
+        for (size_t worker = 0; worker < partitions; worker++) {
+            for (const Ref& ref : buckets[worker][partition]) {
+                std::string_view member = ref.item->first;
+                double weight = operation == ZSetOperation::DIFF || weights.empty()
+                                ? 1.0 : weights[order[ref.input]];
+                double score = weighted_score(ref.item->second, weight);
+                
+                if (ref.input == 0) {
+                    merged.emplace(member, Merged{score, 1});
+                    continue;
+                }
+                
+                if (operation == ZSetOperation::UNION) {
+                    auto [it, inserted] = merged.try_emplace(member, Merged{score, 1});
+                    if (!inserted) {
+                        it->second.score = aggregate_scores(aggregate, it->second.score, score);
+                        it->second.sets++;
+                    }
+                    continue;
+                }
+                
+                auto it = merged.find(member);
+                if (it == merged.end()) {
+                    continue;
+                }
+                if (operation == ZSetOperation::DIFF) {
+                    it->second.sets = 0;
+                } else if (it->second.sets == ref.input) {
+                    // In every set so far
+                    it->second.score = aggregate_scores(aggregate, it->second.score, score);
+                    it->second.sets++;
+                }
+            }
+        }
+        
+        SortedMemberViews& run = runs[partition];
+        for (const auto& [member, result] : merged) {
+            bool keep = operation == ZSetOperation::INTER ? result.sets == order.size()
+                                                           : result.sets > 0;
+            if (keep) {
+                run.emplace_back(member, result.score);
+            }
+        }
+        std::sort(run.begin(), run.end(), sorts_before);
+    });
+    
+    if (partitions == 1) {
+        return std::move(runs[0]);
+    }
+    
+    // Merge the sorted partitions pairwise
+    SortedMemberViews result;
+    std::vector<size_t> bounds{0};
+    for (const auto& run : runs) {
+        result.insert(result.end(), run.begin(), run.end());
+        bounds.push_back(result.size());
+    }
+    while (bounds.size() > 2) {
+        std::vector<size_t> merged_bounds{0};
+        for (size_t i = 2; i < bounds.size(); i += 2) {
+            std::inplace_merge(result.begin() + bounds[i - 2], result.begin() + bounds[i - 1],
+                               result.begin() + bounds[i], sorts_before);
+            merged_bounds.push_back(bounds[i]);
+        }
+        if (bounds.size() % 2 == 0) {
+            merged_bounds.push_back(bounds.back());  // Odd run out
+        }
+        bounds = std::move(merged_bounds);
+    }
+    return result;
+}
+
+// ============================================================================
+// SortedSetManager Implementation
+// ============================================================================
+
+SortedSetManager::SortedSetManager(size_t segments, const ZSetOptions& options)
+    : options_(options) {
+    // Power of two so a shift selects the segment
+    size_t count = 1;
+    segment_shift_ = 32;
+    while (count < segments && count < ConcurrentHashTable::MAX_SEGMENTS) {
+        count *= 2;
+        segment_shift_--;
     }
     
-    auto new_set = std::make_shared<SortedSet>();
-    sets_[key] = new_set;
-    return new_set;
+    segments_.reserve(count);
+    for (size_t i = 0; i < count; i++) {
+        segments_.push_back(std::make_unique<Segment>());
+    }
 }
 
-bool SortedSetManager::del(const std::string& key) {
-    std::lock_guard<std::mutex> lock(mutex_);
-    return sets_.erase(key) > 0;
+SortedSetManager::Segment& SortedSetManager::segment_for(std::string_view key) const {
+    if (segments_.size() == 1) {
+        return *segments_[0];
+    }
+    
+    // High bits pick the segment, as in ConcurrentHashTable
+    uint32_t hash_val = murmur3_32(key.data(), key.size(), 0x12345678);
+    return *segments_[hash_val >> segment_shift_];
 }
 
-bool SortedSetManager::exists(const std::string& key) const {
-    std::lock_guard<std::mutex> lock(mutex_);
-    return sets_.find(key) != sets_.end();
+void SortedSetManager::store(std::string_view key, const SortedMemberViews& members) {
+    if (members.empty()) {
+        del(key);
+        return;
+    }
+    
+    auto entry = std::make_unique<Entry>(key, options_);
+    entry->set.load(members);
+    
+    std::unique_ptr<Entry> replaced;  // Freed after the lock is released
+    Segment& segment = segment_for(key);
+    std::unique_lock lock(segment.mutex);
+    
+    // The map key views the entry's copy, so it is replaced too. Counted
+    // first, so the count never dips while a set is replaced
+    count_.fetch_add(1);
+    auto it = segment.sets.find(key);
+    if (it != segment.sets.end()) {
+        replaced = erase(segment, it);
+    }
+    std::string_view stored = entry->key;
+    segment.sets.emplace(stored, std::move(entry));
 }
 
-std::vector<std::string> SortedSetManager::keys() const {
-    std::lock_guard<std::mutex> lock(mutex_);
+bool SortedSetManager::del(std::string_view key) {
+    std::unique_ptr<Entry> removed;  // Freed after the lock is released
+    Segment& segment = segment_for(key);
+    std::unique_lock lock(segment.mutex);
     
+    auto it = segment.sets.find(key);
+    if (it == segment.sets.end()) {
+        return false;
+    }
+    bool expired = it->second->is_expired(unix_time_ms());
+    removed = erase(segment, it);
+    return !expired;
+}
+
+bool SortedSetManager::exists(std::string_view key) const {
+    Segment& segment = segment_for(key);
+    std::shared_lock lock(segment.mutex);
+    return find_live(segment, key) != nullptr;
+}
+
+std::vector<std::string> SortedSetManager::keys(std::string_view pattern) const {
     std::vector<std::string> result;
-    result.reserve(sets_.size());
+    int64_t now = unix_time_ms();
     
-    for (const auto& [key, _] : sets_) {
-        result.push_back(key);
+    for (const auto& segment : segments_) {
+        std::shared_lock lock(segment->mutex);
+        for (const auto& [key, entry] : segment->sets) {
+            if (!entry->is_expired(now) && matches_pattern(key, pattern)) {
+                result.emplace_back(key);
+            }
+        }
     }
     
     return result;
 }
 
 void SortedSetManager::clear() {
-    std::lock_guard<std::mutex> lock(mutex_);
-    sets_.clear();
+    for (auto& segment : segments_) {
+        std::unique_lock lock(segment->mutex);
+        count_.fetch_sub(segment->sets.size());
+        segment->sets.clear();
+        segment->expires.clear();
+    }
+}
+
+std::optional<int64_t> SortedSetManager::expire_time(std::string_view key) const {
+    Segment& segment = segment_for(key);
+    std::shared_lock lock(segment.mutex);
+    
+    if (Entry* entry = find_live(segment, key)) {
+        return entry->expire_at;
+    }
+    return std::nullopt;
+}
+
+std::optional<int64_t> SortedSetManager::set_expire_time(std::string_view key, int64_t expire_at) {
+    std::unique_ptr<Entry> removed;
+    Segment& segment = segment_for(key);
+    std::unique_lock lock(segment.mutex);
+    
+    auto it = segment.sets.find(key);
+    if (it == segment.sets.end()) {
+        return std::nullopt;
+    }
+    if (it->second->is_expired(unix_time_ms())) {
+        removed = erase(segment, it);
+        return std::nullopt;
+    }
+    
+    int64_t previous = it->second->expire_at;
+    set_entry_expiry(segment, *it->second, expire_at);
+    return previous;
+}
+
+size_t SortedSetManager::remove_expired(size_t limit, KeyBatch* keys) {
+    int64_t now = unix_time_ms();
+    size_t removed = 0;
+    
+    for (auto& segment : segments_) {
+        std::unique_lock lock(segment->mutex, std::try_to_lock);
+        if (!lock.owns_lock()) {
+            continue;
+        }
+        
+        removed += segment->expires.expire(now, limit, [&](Entry* entry) {
+            if (keys) {
+                keys->add(entry->key);
+            }
+            erase(*segment, segment->sets.find(entry->key));
+        });
+    }
+    
+    return removed;
+}
+
+size_t SortedSetManager::expires() const {
+    size_t total = 0;
+    for (const auto& segment : segments_) {
+        std::shared_lock lock(segment->mutex);
+        total += segment->expires.size();
+    }
+    return total;
+}
+
+ExpirySample SortedSetManager::sample_expiry(size_t count) const {
+    int64_t now = unix_time_ms();
+    ExpirySample total;
+    for (const auto& segment : segments_) {
+        std::shared_lock lock(segment->mutex);
+        total += segment->expires.sample(now, count);
+    }
+    return total;
+}
+
+SortedSetManager::Entry* SortedSetManager::find_live(const Segment& segment, std::string_view key) {
+    auto it = segment.sets.find(key);
+    if (it == segment.sets.end() || it->second->is_expired(unix_time_ms())) {
+        return nullptr;
+    }
+    return it->second.get();
+}
+
+std::unique_ptr<SortedSetManager::Entry> SortedSetManager::erase(Segment& segment,
+                                                                 EntryMap::iterator it) {
+    std::unique_ptr<Entry> entry = std::move(it->second);
+    segment.sets.erase(it);
+    count_.fetch_sub(1);
+    
+    if (entry->expire_at != NO_EXPIRY) {
+        set_entry_expiry(segment, *entry, NO_EXPIRY);
+    }
+    return entry;
+}
+
+void SortedSetManager::set_entry_expiry(Segment& segment, Entry& entry, int64_t expire_at) {
+    // The index reads the new deadline from the entry
+    int64_t previous = entry.expire_at;
+    entry.expire_at = expire_at;
+    
+    if (previous == NO_EXPIRY && expire_at != NO_EXPIRY) {
+        entry.expiry_position = segment.expires.add(&entry);
+    } else if (previous != NO_EXPIRY && expire_at == NO_EXPIRY) {
+        // The last entry moves into the gap
+        if (Entry** moved = segment.expires.remove(entry.expiry_position)) {
+            (*moved)->expiry_position = entry.expiry_position;
+        }
+    } else if (previous != NO_EXPIRY) {
+        segment.expires.reschedule(entry.expiry_position);
+    }
 }
 
 } // namespace scuffedredis
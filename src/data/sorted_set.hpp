@@ -4,16 +4,27 @@
 /**
  * Sorted Set implementation for ScuffedRedis.
  * 
- * Implements Redis sorted set commands using AVL tree.
- * Supports ZADD, ZRANGE, ZRANK, ZREM, ZSCORE operations.
+ * Implements Redis sorted set commands over a skiplist (default) or an
+ * AVL tree engine, with small sets packed into a listpack.
+ * Supports ZADD, ZRANGE, ZRANK, ZREM, ZSCORE operations, and the
+ * ZUNIONSTORE / ZINTERSTORE / ZDIFFSTORE set algebra.
  */
 
 #include "avl_tree.hpp"
+#include "skiplist.hpp"
+#include "listpack.hpp"
+#include "expiry_index.hpp"
 #include <unordered_map>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <optional>
+#include <memory>
+#include <shared_mutex>
 #include <mutex>
+#include <atomic>
+#include <cstdint>
+#include <variant>
 
 namespace scuffedredis {
 
@@ -25,7 +36,7 @@ struct SortedSetEntry {
     double score;
     std::string member;
     
-    SortedSetEntry(double s, const std::string& m) : score(s), member(m) {}
+    SortedSetEntry(double s, std::string m) : score(s), member(std::move(m)) {}
     
     // Comparison for AVL tree ordering
     // First by score, then by member (lexicographic)
@@ -37,17 +48,147 @@ struct SortedSetEntry {
     }
 };
 
+// Storage engine behind each SortedSet
+enum class ZSetEngine {
+    AVL,       // AVLZSet: order-statistic AVL tree plus a score map
+    SKIPLIST   // SkipList: Redis-style skiplist with spans
+};
+
+/**
+ * Engine name as used on the command line and in INFO.
+ */
+const char* zset_engine_name(ZSetEngine engine);
+
+/**
+ * Parse an engine name ("avl" or "skiplist").
+ * Returns false if the name is unknown.
+ */
+bool parse_zset_engine(const std::string& name, ZSetEngine& engine);
+
+/**
+ * How sorted sets are stored. A set starts as a listpack and converts to
+ * `engine` for good once it holds more than listpack_max_entries members
+ * or a member longer than listpack_max_value bytes (Redis's
+ * zset-max-listpack-entries and zset-max-listpack-value).
+ */
+struct ZSetOptions {
+    static constexpr uint32_t DEFAULT_LISTPACK_ENTRIES = 128;
+    static constexpr uint32_t DEFAULT_LISTPACK_VALUE = 64;
+    
+    ZSetEngine engine = ZSetEngine::SKIPLIST;
+    uint32_t listpack_max_entries = DEFAULT_LISTPACK_ENTRIES;  // 0 disables listpacks
+    uint32_t listpack_max_value = DEFAULT_LISTPACK_VALUE;
+};
+
+/**
+ * Members with scores, as ZRANGE ... WITHSCORES returns them.
+ */
+using ScoredMembers = std::vector<std::pair<std::string, double>>;
+
+/**
+ * Views of members with scores, sorted by (score, member) without
+ * duplicates, for the bulk load() of an empty set.
+ */
+using SortedMemberViews = std::vector<std::pair<std::string_view, double>>;
+
+/**
+ * Score interval for ZRANGEBYSCORE and ZCOUNT. Either end may be
+ * exclusive, as with "(1.5", or infinite.
+ */
+struct ScoreRange {
+    double min;
+    double max;
+    bool min_exclusive = false;
+    bool max_exclusive = false;
+};
+
+/**
+ * AVL sorted set engine.
+ * 
+ * Members are ordered in an AVL tree of (score, member) entries, with a
+ * hash map from member to score beside it; each member is stored in both.
+ * Offers the same operations as SkipList.
+ */
+class AVLZSet {
+public:
+    std::optional<double> score(std::string_view member) const;
+    void insert(std::string_view member, double score);
+    void update(std::string_view member, double score);
+    bool remove(std::string_view member);
+    std::optional<size_t> rank(std::string_view member) const;
+    size_t count_below(double score, bool inclusive = false) const;
+    void load(const SortedMemberViews& members);
+    
+    template<typename Fn>
+    void walk(size_t first, bool reverse, Fn&& fn) const {
+        auto it = reverse ? tree_.rbegin_at(first) : tree_.begin_at(first);
+        for (; it.valid(); it.next()) {
+            if (!fn(std::string_view(it.key().member), it.key().score)) {
+                return;
+            }
+        }
+    }
+    
+    size_t size() const { return tree_.size(); }
+    int height() const { return tree_.height(); }
+    void clear();
+
+private:
+    // AVL tree for sorted storage
+    AVLTree<SortedSetEntry, bool> tree_;
+    
+    // Hash map for O(1) score lookups
+    std::unordered_map<std::string, double> scores_;
+};
+
 /**
  * Sorted Set implementation.
  * 
- * Uses AVL tree for sorted storage and hash map for O(1) score lookups.
- * Thread-safe with mutex protection.
+ * ZADD semantics and range handling over a pluggable engine (see
+ * ZSetOptions). Both large engines find a member's score in O(1) and a
+ * rank in O(log n), and a rank range costs O(log n + k) for k members
+ * returned; a listpack scans its few members instead. Large engines live
+ * behind a pointer so a small set pays only for the listpack.
+ * Not synchronized: SortedSetManager locks a set's segment around every
+ * access.
  */
 class SortedSet {
 public:
-    SortedSet();
+    explicit SortedSet(const ZSetOptions& options = ZSetOptions());
     ~SortedSet();
     
+    /**
+     * Current encoding: "listpack", "skiplist" or "avl".
+     */
+    const char* encoding() const;
+    
+    /**
+     * ZADD options for add().
+     */
+    enum AddFlags : unsigned {
+        ADD_NX = 1 << 0,    // Only add new members
+        ADD_XX = 1 << 1,    // Only update existing members
+        ADD_GT = 1 << 2,    // Only update if the new score is greater
+        ADD_LT = 1 << 3,    // Only update if the new score is less
+        ADD_INCR = 1 << 4   // Add score to the current one (0 if new)
+    };
+    
+    enum class AddResult {
+        ADDED,         // New member
+        UPDATED,       // Existing member, score changed
+        UNCHANGED,     // Existing member, same score
+        SKIPPED,       // Prevented by NX/XX/GT/LT
+        NOT_A_NUMBER   // Score (or INCR result) is NaN; nothing changed
+    };
+    
+    /**
+     * Add or update a member, as ZADD with the given AddFlags.
+     * new_score receives the member's resulting score unless the
+     * result is SKIPPED or NOT_A_NUMBER.
+     */
+    AddResult add(std::string_view member, double score, unsigned flags = 0,
+                  double* new_score = nullptr);
+    
     /**
      * Add member with score to sorted set.
      * Updates score if member already exists.
@@ -65,7 +206,7 @@ public:
      * Remove member from sorted set.
      * Returns 1 if removed, 0 if not found.
      */
-    int zrem(const std::string& member);
+    int zrem(std::string_view member);
     
     /**
      * Remove multiple members.
@@ -77,19 +218,19 @@ public:
      * Get score of member.
      * Returns nullopt if member doesn't exist.
      */
-    std::optional<double> zscore(const std::string& member) const;
+    std::optional<double> zscore(std::string_view member) const;
     
     /**
      * Get rank of member (0-based, ascending order).
      * Returns nullopt if member doesn't exist.
      */
-    std::optional<int> zrank(const std::string& member) const;
+    std::optional<int> zrank(std::string_view member) const;
     
     /**
      * Get reverse rank of member (0-based, descending order).
      * Returns nullopt if member doesn't exist.
      */
-    std::optional<int> zrevrank(const std::string& member) const;
+    std::optional<int> zrevrank(std::string_view member) const;
     
     /**
      * Get range of members by rank [start, stop].
@@ -100,39 +241,47 @@ public:
         int start, int stop, bool withScores = false) const;
     
     /**
-     * Get reverse range of members by rank [start, stop].
-     * Same as zrange but in descending order.
+     * Get reverse range of members by rank [start, stop], where rank 0
+     * is the highest score. Results are in descending order.
      */
     std::vector<std::pair<std::string, double>> zrevrange(
         int start, int stop, bool withScores = false) const;
     
     /**
-     * Get range of members by score [min, max].
-     * Both bounds are inclusive.
+     * Get range of members by score. Skips the first `offset` matches and
+     * returns at most `count` of the rest (all if count is negative),
+     * visiting only the members returned.
      */
     std::vector<std::pair<std::string, double>> zrangebyscore(
-        double min, double max, bool withScores = false) const;
+        const ScoreRange& range, bool withScores = false,
+        size_t offset = 0, int64_t count = -1) const;
     
     /**
-     * Count members with scores in range [min, max].
+     * Count members with scores in range, in O(log n).
      */
-    size_t zcount(double min, double max) const;
+    size_t zcount(const ScoreRange& range) const;
     
     /**
      * Get number of members in sorted set.
      */
-    size_t zcard() const { return size_; }
+    size_t zcard() const;
     
     /**
      * Check if sorted set is empty.
      */
-    bool empty() const { return size_ == 0; }
+    bool empty() const { return zcard() == 0; }
     
     /**
      * Clear all members.
      */
     void clear();
     
+    /**
+     * Fill an empty set in O(n), choosing the encoding up front instead of
+     * converting partway.
+     */
+    void load(const SortedMemberViews& members);
+    
     /**
      * Get statistics about the sorted set.
      */
@@ -141,23 +290,45 @@ public:
         double min_score;
         double max_score;
         double avg_score;
-        int tree_height;
+        int tree_height;      // Tree height, or skiplist levels in use
     };
     
     Stats get_stats() const;
 
 private:
-    // AVL tree for sorted storage
-    AVLTree<SortedSetEntry, bool> tree_;
+    using Encoding = std::variant<ListPack, std::unique_ptr<AVLZSet>, std::unique_ptr<SkipList>>;
     
-    // Hash map for O(1) score lookups
-    std::unordered_map<std::string, double> scores_;
+    Encoding encoding_;
+    ZSetOptions options_;
     
-    // Size tracking
-    size_t size_;
+    /**
+     * Move a listpack's members into the large engine.
+     */
+    void convert();
+    
+    /**
+     * Call fn with the engine behind the current encoding.
+     */
+    template<typename Fn>
+    decltype(auto) visit(Fn&& fn) {
+        return std::visit([&](auto& encoding) -> decltype(auto) {
+            return fn(engine_of(encoding));
+        }, encoding_);
+    }
+    
+    template<typename Fn>
+    decltype(auto) visit(Fn&& fn) const {
+        return std::visit([&](const auto& encoding) -> decltype(auto) {
+            return fn(engine_of(encoding));
+        }, encoding_);
+    }
     
-    // Thread safety
-    mutable std::mutex mutex_;
+    template<typename T>
+    static T& engine_of(T& engine) { return engine; }
+    template<typename T>
+    static T& engine_of(std::unique_ptr<T>& engine) { return *engine; }
+    template<typename T>
+    static const T& engine_of(const std::unique_ptr<T>& engine) { return *engine; }
     
     /**
      * Normalize index for range operations.
@@ -166,53 +337,242 @@ private:
     int normalize_index(int index) const;
     
     /**
-     * Convert tree entries to result format.
+     * Ascending ranks [first, last) of the members scoring within range.
      */
-    std::vector<std::pair<std::string, double>> format_results(
-        const std::vector<std::pair<SortedSetEntry, bool>>& entries,
-        bool withScores) const;
+    std::pair<size_t, size_t> score_ranks(const ScoreRange& range) const;
+    
+    /**
+     * Members from ascending rank `first`, ascending or descending, at
+     * most `count` of them.
+     */
+    std::vector<std::pair<std::string, double>> range_by_rank(
+        size_t first, size_t count, bool reverse, bool withScores) const;
 };
 
+// ZUNIONSTORE, ZINTERSTORE and ZDIFFSTORE
+enum class ZSetOperation { UNION, INTER, DIFF };
+
+// How a member's weighted scores from several sets are combined
+enum class ZSetAggregate { SUM, MIN, MAX };
+
 /**
- * Thread-safe sorted set manager.
- * Manages multiple sorted sets by key.
+ * Combine sorted sets as Redis's ZUNIONSTORE, ZINTERSTORE and ZDIFFSTORE
+ * do: each input score is multiplied by its set's weight, and a member's
+ * scores are combined with `aggregate`. DIFF keeps the members of the
+ * first set found in no other, with their own scores. `weights` has one
+ * weight per input, or is empty for all 1s; DIFF ignores it. Returns the
+ * result sorted by (score, member), viewing members of `inputs`.
+ * 
+ * Large inputs are split by member hash into partitions merged on up to
+ * `threads` threads (0: one per core), each into its own hash map, and
+ * the sorted partitions are then merged.
+ */
+SortedMemberViews combine_sorted_sets(ZSetOperation operation,
+                                      const std::vector<ScoredMembers>& inputs,
+                                      const std::vector<double>& weights,
+                                      ZSetAggregate aggregate, size_t threads = 0);
+
+/**
+ * Sorted sets by key.
+ * 
+ * Lock-striped like ConcurrentHashTable: a key hashes to one of several
+ * segments, each with its own map and read-write lock, and a set is only
+ * touched while its segment is locked. A set left empty by an update is
+ * removed, as in Redis.
+ * 
+ * A set can have a deadline (Unix ms), kept on its entry. Expired sets
+ * read as absent and are removed by the next write to them or by
+ * remove_expired().
  */
 class SortedSetManager {
 public:
-    SortedSetManager() = default;
+    static constexpr size_t DEFAULT_SEGMENTS = 16;
+    
+    // segments is rounded up to a power of two; new sets use `options`
+    explicit SortedSetManager(size_t segments = DEFAULT_SEGMENTS,
+                              const ZSetOptions& options = ZSetOptions());
     ~SortedSetManager() = default;
     
+    const ZSetOptions& options() const { return options_; }
+    
+    /**
+     * Call fn(const SortedSet&) while the key's segment is read-locked.
+     * Returns false (without calling fn) if there is no set at key.
+     */
+    template<typename Fn>
+    bool read(std::string_view key, Fn&& fn) const;
+    
+    /**
+     * Call fn(SortedSet&) while the key's segment is write-locked. With
+     * `create`, a missing (or expired) set is first created empty - fn can
+     * tell it is new from that. Returns false (without calling fn) if
+     * there is no set at key and create is false.
+     */
+    template<typename Fn>
+    bool update(std::string_view key, bool create, Fn&& fn);
+    
     /**
-     * Get or create sorted set by key.
+     * Replace the set at key, and any TTL it had, with one loaded from
+     * members, or delete it if members is empty. The new set is built
+     * before the segment is locked, so readers only wait for the swap.
      */
-    std::shared_ptr<SortedSet> get_or_create(const std::string& key);
+    void store(std::string_view key, const SortedMemberViews& members);
     
     /**
      * Delete sorted set by key.
-     * Returns true if deleted, false if not found.
+     * Returns true if deleted, false if not found (or expired).
      */
-    bool del(const std::string& key);
+    bool del(std::string_view key);
     
     /**
      * Check if sorted set exists.
      */
-    bool exists(const std::string& key) const;
+    bool exists(std::string_view key) const;
+    
+    /**
+     * Get sorted set keys matching a KEYS pattern.
+     */
+    std::vector<std::string> keys(std::string_view pattern = "*") const;
     
     /**
-     * Get all sorted set keys.
+     * Number of sorted sets. Sequentially consistent with set creation,
+     * so a writer of another type can tell whether to look for a set.
      */
-    std::vector<std::string> keys() const;
+    size_t size() const { return count_.load(); }
     
     /**
      * Clear all sorted sets.
      */
     void clear();
+    
+    /**
+     * A set's deadline, NO_EXPIRY if it has none, or nullopt if absent.
+     */
+    std::optional<int64_t> expire_time(std::string_view key) const;
+    
+    /**
+     * Give a set a deadline, or remove it with NO_EXPIRY. Returns the
+     * previous deadline (NO_EXPIRY if none), or nullopt if there is no set.
+     */
+    std::optional<int64_t> set_expire_time(std::string_view key, int64_t expire_at);
+    
+    /**
+     * Remove up to `limit` expired sets from each segment. Segments busy
+     * with other work are skipped. Returns the number removed, and adds
+     * their keys to `removed` if given.
+     */
+    size_t remove_expired(size_t limit, KeyBatch* removed = nullptr);
+    
+    /**
+     * Number of sets with a TTL.
+     */
+    size_t expires() const;
+    
+    /**
+     * Check up to `count` sets with a TTL in each segment for having
+     * expired, to estimate how many await removal.
+     */
+    ExpirySample sample_expiry(size_t count) const;
 
 private:
-    std::unordered_map<std::string, std::shared_ptr<SortedSet>> sets_;
-    mutable std::mutex mutex_;
+    // The map's keys view the key stored with each set
+    struct Entry {
+        std::string key;
+        SortedSet set;
+        int64_t expire_at = NO_EXPIRY;  // Unix ms
+        uint32_t expiry_position = 0;   // In the segment's expiry index, if expiring
+        
+        Entry(std::string_view k, const ZSetOptions& options) : key(k), set(options) {}
+        
+        bool is_expired(int64_t now) const {
+            return expire_at != NO_EXPIRY && expire_at <= now;
+        }
+    };
+    
+    struct EntryDeadline {
+        int64_t operator()(const Entry* entry) const { return entry->expire_at; }
+    };
+    
+    using EntryMap = std::unordered_map<std::string_view, std::unique_ptr<Entry>>;
+    
+    // Cache-line aligned so neighbouring segment locks don't false-share
+    struct alignas(64) Segment {
+        EntryMap sets;
+        ExpiryIndex<Entry*, EntryDeadline> expires;  // Entries with a TTL
+        mutable std::shared_mutex mutex;
+    };
+    
+    std::vector<std::unique_ptr<Segment>> segments_;
+    unsigned segment_shift_;  // 32 - log2(segment count)
+    ZSetOptions options_;
+    std::atomic<size_t> count_{0};
+    
+    Segment& segment_for(std::string_view key) const;
+    
+    /**
+     * Find the live (unexpired) set at key. Returns nullptr if none.
+     */
+    static Entry* find_live(const Segment& segment, std::string_view key);
+    
+    /**
+     * Remove an entry along with its TTL. Returns the entry, to be freed
+     * once the segment is unlocked if the caller wishes.
+     */
+    std::unique_ptr<Entry> erase(Segment& segment, EntryMap::iterator it);
+    
+    static void set_entry_expiry(Segment& segment, Entry& entry, int64_t expire_at);
 };
 
+template<typename Fn>
+bool SortedSetManager::read(std::string_view key, Fn&& fn) const {
+    Segment& segment = segment_for(key);
+    std::shared_lock lock(segment.mutex);
+    
+    Entry* entry = find_live(segment, key);
+    if (!entry) {
+        return false;
+    }
+    fn(static_cast<const SortedSet&>(entry->set));
+    return true;
+}
+
+template<typename Fn>
+bool SortedSetManager::update(std::string_view key, bool create, Fn&& fn) {
+    Segment& segment = segment_for(key);
+    std::unique_lock lock(segment.mutex);
+    
+    auto it = segment.sets.find(key);
+    if (it != segment.sets.end() && it->second->is_expired(unix_time_ms())) {
+        erase(segment, it);
+        it = segment.sets.end();
+    }
+    
+    if (it == segment.sets.end()) {
+        if (!create) {
+            return false;
+        }
+        auto entry = std::make_unique<Entry>(key, options_);
+        std::string_view stored = entry->key;
+        it = segment.sets.emplace(stored, std::move(entry)).first;
+        count_.fetch_add(1);
+    }
+    
+    SortedSet& set = it->second->set;
+    try {
+        fn(set);
+    } catch (...) {
+        if (set.empty()) {
+            erase(segment, it);
+        }
+        throw;
+    }
+    
+    if (set.empty()) {
+        erase(segment, it);
+    }
+    return true;
+}
+
 } // namespace scuffedredis
 
 #endif // SCUFFEDREDIS_SORTED_SET_HPP
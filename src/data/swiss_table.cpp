@@ -0,0 +1,674 @@
+#include "swiss_table.hpp"
+#include "hashtable.hpp"
+#include <algorithm>
+#include <cstring>
+#include <new>
+#include <utility>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #define SCUFFEDREDIS_SWISS_SSE2 1
+    #include <emmintrin.h>
+#endif
+
+#ifdef _MSC_VER
+    #include <intrin.h>
+#endif
+
+namespace scuffedredis {
+
+// ============================================================================
+// Control Bytes
+// ============================================================================
+
+namespace {
+
+// Full slots hold the low 7 bits of the hash (0..127); the special
+// values have the sign bit set so one movemask finds every free slot
+constexpr int8_t CTRL_EMPTY = -128;   // 0x80
+constexpr int8_t CTRL_DELETED = -2;   // 0xFE, tombstone
+
+constexpr size_t NOT_FOUND = static_cast<size_t>(-1);
+
+// 7-bit tag stored in the control byte
+inline int8_t h2(uint32_t hash_val) {
+    return static_cast<int8_t>(hash_val & 0x7F);
+}
+
+// Probe start. Taken from the high half of a 64-bit multiply so every
+// hash bit contributes, including the top bits ConcurrentHashTable
+// already used to pick the segment.
+inline size_t h1(uint32_t hash_val) {
+    return static_cast<size_t>((hash_val * 0x9E3779B97F4A7C15ull) >> 32);
+}
+
+inline unsigned lowest_bit(uint32_t mask) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return static_cast<unsigned>(index);
+#else
+    return static_cast<unsigned>(__builtin_ctz(mask));
+#endif
+}
+
+/**
+ * GROUP_WIDTH control bytes matched in parallel.
+ * Each match returns a bitmask with bit i set for byte i.
+ */
+struct Group {
+#ifdef SCUFFEDREDIS_SWISS_SSE2
+    __m128i ctrl;
+    
+    explicit Group(const int8_t* pos)
+        : ctrl(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pos))) {}
+    
+    uint32_t match(int8_t tag) const {
+        return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(tag), ctrl)));
+    }
+    
+    uint32_t match_empty() const {
+        return match(CTRL_EMPTY);
+    }
+    
+    uint32_t match_empty_or_deleted() const {
+        // Sign bit is set exactly for the special values
+        return static_cast<uint32_t>(_mm_movemask_epi8(ctrl));
+    }
+#else
+    const int8_t* ctrl;
+    
+    explicit Group(const int8_t* pos) : ctrl(pos) {}
+    
+    uint32_t match(int8_t tag) const {
+        uint32_t mask = 0;
+        for (size_t i = 0; i < SwissTable::GROUP_WIDTH; i++) {
+            if (ctrl[i] == tag) {
+                mask |= 1u << i;
+            }
+        }
+        return mask;
+    }
+    
+    uint32_t match_empty() const {
+        return match(CTRL_EMPTY);
+    }
+    
+    uint32_t match_empty_or_deleted() const {
+        uint32_t mask = 0;
+        for (size_t i = 0; i < SwissTable::GROUP_WIDTH; i++) {
+            if (ctrl[i] < 0) {
+                mask |= 1u << i;
+            }
+        }
+        return mask;
+    }
+#endif
+};
+
+/**
+ * Triangular probing over groups: visits every group once when the
+ * capacity is a power of two.
+ */
+struct ProbeSequence {
+    size_t mask;
+    size_t offset;
+    size_t stride;
+    
+    ProbeSequence(uint32_t hash_val, size_t capacity)
+        : mask(capacity - 1), offset(h1(hash_val) & mask), stride(0) {}
+    
+    size_t slot(unsigned bit) const { return (offset + bit) & mask; }
+    
+    void next() {
+        stride += SwissTable::GROUP_WIDTH;
+        offset = (offset + stride) & mask;
+    }
+};
+
+// Maximum load before growing: 7/8 of the slots
+inline size_t max_growth(size_t capacity) {
+    return capacity - capacity / 8;
+}
+
+// Heap buffer behind a string, 0 while it fits the inline SSO storage
+inline size_t string_heap_bytes(const std::string& str) {
+    static const size_t inline_capacity = std::string().capacity();
+    return str.capacity() > inline_capacity ? str.capacity() + 1 : 0;
+}
+
+} // namespace
+
+// ============================================================================
+// RawTable Implementation
+// ============================================================================
+
+SwissTable::RawTable::RawTable()
+    : ctrl(nullptr), slots(nullptr), capacity(0), size(0), growth_left(0), heap_bytes(0) {
+}
+
+SwissTable::RawTable::RawTable(size_t cap)
+    : ctrl(new int8_t[cap + GROUP_WIDTH]),
+      slots(static_cast<Slot*>(::operator new(cap * sizeof(Slot)))),
+      capacity(cap), size(0), growth_left(max_growth(cap)), heap_bytes(0) {
+    std::memset(ctrl, CTRL_EMPTY, cap + GROUP_WIDTH);
+}
+
+SwissTable::RawTable::~RawTable() {
+    release();
+}
+
+SwissTable::RawTable::RawTable(RawTable&& other) noexcept
+    : ctrl(other.ctrl), slots(other.slots), capacity(other.capacity),
+      size(other.size), growth_left(other.growth_left), heap_bytes(other.heap_bytes) {
+    other.ctrl = nullptr;
+    other.slots = nullptr;
+    other.capacity = 0;
+    other.size = 0;
+    other.growth_left = 0;
+    other.heap_bytes = 0;
+}
+
+SwissTable::RawTable& SwissTable::RawTable::operator=(RawTable&& other) noexcept {
+    if (this != &other) {
+        release();
+        ctrl = other.ctrl;
+        slots = other.slots;
+        capacity = other.capacity;
+        size = other.size;
+        growth_left = other.growth_left;
+        heap_bytes = other.heap_bytes;
+        other.ctrl = nullptr;
+        other.slots = nullptr;
+        other.capacity = 0;
+        other.size = 0;
+        other.growth_left = 0;
+        other.heap_bytes = 0;
+    }
+    return *this;
+}
+
+void SwissTable::RawTable::release() {
+    if (!ctrl) {
+        return;
+    }
+    
+    for (size_t i = 0; i < capacity; i++) {
+        if (is_full(i)) {
+            slots[i].~Slot();
+        }
+    }
+    
+    ::operator delete(slots);
+    delete[] ctrl;
+    ctrl = nullptr;
+    slots = nullptr;
+    capacity = 0;
+    size = 0;
+    growth_left = 0;
+    heap_bytes = 0;
+}
+
+void SwissTable::RawTable::set_ctrl(size_t index, int8_t value) {
+    ctrl[index] = value;
+    
+    // Mirror the first group after the end so a group load starting
+    // near the end wraps around without a bounds check
+    if (index < GROUP_WIDTH) {
+        ctrl[capacity + index] = value;
+    }
+}
+
+size_t SwissTable::RawTable::find(std::string_view key, uint32_t hash_val) const {
+    if (capacity == 0) {
+        return NOT_FOUND;
+    }
+    
+    int8_t tag = h2(hash_val);
+    ProbeSequence seq(hash_val, capacity);
+    
+    while (true) {
+        Group group(ctrl + seq.offset);
+        
+        // Only slots whose tag matches are compared
+        for (uint32_t match = group.match(tag); match; match &= match - 1) {
+            size_t index = seq.slot(lowest_bit(match));
+            const Slot& slot = slots[index];
+            if (slot.hash == hash_val && slot.key == key) {
+                return index;
+            }
+        }
+        
+        // An empty slot ends the probe sequence
+        if (group.match_empty()) {
+            return NOT_FOUND;
+        }
+        
+        seq.next();
+    }
+}
+
+size_t SwissTable::RawTable::find_insert_slot(uint32_t hash_val) const {
+    ProbeSequence seq(hash_val, capacity);
+    
+    while (true) {
+        Group group(ctrl + seq.offset);
+        
+        uint32_t free_slots = group.match_empty_or_deleted();
+        if (free_slots) {
+            return seq.slot(lowest_bit(free_slots));
+        }
+        
+        seq.next();
+    }
+}
+
+void SwissTable::RawTable::insert_at(size_t index, uint32_t hash_val,
+                                     std::string&& key, std::string&& value) {
+    // Reusing a tombstone doesn't consume growth
+    if (ctrl[index] == CTRL_EMPTY) {
+        growth_left--;
+    }
+    
+    Slot* slot = new (&slots[index]) Slot{hash_val, 0, std::move(key), std::move(value)};
+    set_ctrl(index, h2(hash_val));
+    size++;
+    heap_bytes += string_heap_bytes(slot->key) + string_heap_bytes(slot->value);
+}
+
+void SwissTable::RawTable::erase_at(size_t index) {
+    heap_bytes -= string_heap_bytes(slots[index].key) + string_heap_bytes(slots[index].value);
+    slots[index].~Slot();
+    set_ctrl(index, CTRL_DELETED);
+    size--;
+}
+
+size_t SwissTable::RawTable::probe_length(size_t index) const {
+    ProbeSequence seq(slots[index].hash, capacity);
+    size_t groups = 1;
+    
+    // Slot is inside the group starting at seq.offset (wrapping)
+    while (((index - seq.offset) & seq.mask) >= GROUP_WIDTH) {
+        seq.next();
+        groups++;
+    }
+    
+    return groups;
+}
+
+// ============================================================================
+// SwissTable Implementation
+// ============================================================================
+
+SwissTable::SwissTable(size_t initial_capacity) : rehash_index_(0), main_id_(0) {
+    // Room for initial_capacity entries at the maximum load
+    size_t capacity = MIN_CAPACITY;
+    while (max_growth(capacity) < initial_capacity) {
+        capacity *= 2;
+    }
+    table_ = RawTable(capacity);
+}
+
+SwissTable::~SwissTable() = default;
+
+SwissTable::SwissTable(SwissTable&& other) noexcept
+    : table_(std::move(other.table_)),
+      rehash_table_(std::move(other.rehash_table_)),
+      rehash_index_(other.rehash_index_), expires_(std::move(other.expires_)),
+      main_id_(other.main_id_) {
+    other.rehash_index_ = 0;
+    other.expires_.clear();
+}
+
+SwissTable& SwissTable::operator=(SwissTable&& other) noexcept {
+    if (this != &other) {
+        table_ = std::move(other.table_);
+        rehash_table_ = std::move(other.rehash_table_);
+        rehash_index_ = other.rehash_index_;
+        expires_ = std::move(other.expires_);
+        main_id_ = other.main_id_;
+        other.rehash_index_ = 0;
+        other.expires_.clear();
+    }
+    return *this;
+}
+
+uint32_t SwissTable::hash(std::string_view key) {
+    return murmur3_32(key.data(), key.size(), 0x12345678);
+}
+
+const SwissTable::RawTable* SwissTable::find(std::string_view key, uint32_t hash_val,
+                                             size_t& index) const {
+    // Migrated slots are tombstones, so probing the old array stays valid
+    index = table_.find(key, hash_val);
+    if (index != NOT_FOUND) {
+        return &table_;
+    }
+    
+    if (is_rehashing()) {
+        index = rehash_table_.find(key, hash_val);
+        if (index != NOT_FOUND) {
+            return &rehash_table_;
+        }
+    }
+    
+    return nullptr;
+}
+
+const SwissTable::RawTable* SwissTable::find_live(std::string_view key, size_t& index) const {
+    const RawTable* table = find(key, hash(key), index);
+    if (table && is_expired(table->slots[index], unix_time_ms())) {
+        return nullptr;
+    }
+    return table;
+}
+
+void SwissTable::set_slot_expiry(RawTable& table, size_t index, int64_t expire_at) {
+    Slot& slot = table.slots[index];
+    if (slot.expiry && expire_at != NO_EXPIRY) {
+        expires_[slot.expiry - 1].expire_at = expire_at;
+        expires_.reschedule(slot.expiry - 1);
+    } else if (slot.expiry) {
+        // The last entry moves into the gap; point its slot at the new place
+        if (ExpiryRef* moved = expires_.remove(slot.expiry - 1)) {
+            const RawTable& owner = table_for(*moved);
+            owner.slots[moved->slot].expiry = slot.expiry;
+        }
+        slot.expiry = 0;
+    } else if (expire_at != NO_EXPIRY) {
+        uint8_t id = &table == &table_ ? main_id_ : main_id_ ^ 1;
+        uint32_t position = expires_.add({expire_at, static_cast<uint32_t>(index), id});
+        slot.expiry = position + 1;
+    }
+}
+
+void SwissTable::erase(RawTable& table, size_t index) {
+    set_slot_expiry(table, index, NO_EXPIRY);
+    table.erase_at(index);
+}
+
+bool SwissTable::set(std::string_view key, std::string_view value, int64_t expire_at) {
+    if (is_rehashing()) {
+        rehash_step(REHASH_STEP);
+    } else if (table_.growth_left == 0) {
+        start_rehash();
+    }
+    
+    uint32_t hash_val = hash(key);
+    size_t index;
+    if (const RawTable* table = find(key, hash_val, index)) {
+        RawTable* owner = const_cast<RawTable*>(table);
+        if (!is_expired(owner->slots[index], unix_time_ms())) {
+            // Key exists, update value
+            std::string& stored = owner->slots[index].value;
+            owner->heap_bytes -= string_heap_bytes(stored);
+            stored = value;
+            owner->heap_bytes += string_heap_bytes(stored);
+            if (expire_at != KEEP_EXPIRY) {
+                set_slot_expiry(*owner, index, expire_at);
+            }
+            return false;  // Not a new insertion
+        }
+        
+        // An expired key is replaced as if it were absent
+        erase(*owner, index);
+    }
+    
+    // New keys go into the array being migrated to
+    RawTable* target = is_rehashing() ? &rehash_table_ : &table_;
+    if (target->growth_left == 0) {
+        // Migration normally finishes long before the new array fills;
+        // if it hasn't, finish it now and grow again
+        while (rehash_step(table_.capacity)) {}
+        start_rehash();
+        target = &rehash_table_;
+    }
+    
+    index = target->find_insert_slot(hash_val);
+    target->insert_at(index, hash_val, std::string(key), std::string(value));
+    if (expire_at != NO_EXPIRY && expire_at != KEEP_EXPIRY) {
+        set_slot_expiry(*target, index, expire_at);
+    }
+    
+    return true;  // New insertion
+}
+
+std::optional<std::string> SwissTable::get(std::string_view key) const {
+    if (auto value = get_view(key)) {
+        return std::string(*value);
+    }
+    
+    return std::nullopt;
+}
+
+std::optional<std::string_view> SwissTable::get_view(std::string_view key) const {
+    size_t index;
+    if (const RawTable* table = find_live(key, index)) {
+        return std::string_view(table->slots[index].value);
+    }
+    
+    return std::nullopt;
+}
+
+bool SwissTable::del(std::string_view key) {
+    if (is_rehashing()) {
+        rehash_step(REHASH_STEP);
+    }
+    
+    size_t index;
+    const RawTable* table = find(key, hash(key), index);
+    if (!table) {
+        return false;  // Key not found
+    }
+    
+    bool expired = is_expired(table->slots[index], unix_time_ms());
+    erase(*const_cast<RawTable*>(table), index);
+    return !expired;
+}
+
+bool SwissTable::exists(std::string_view key) const {
+    size_t index;
+    return find_live(key, index) != nullptr;
+}
+
+std::optional<int64_t> SwissTable::expire_time(std::string_view key) const {
+    size_t index;
+    if (const RawTable* table = find_live(key, index)) {
+        return expire_at(table->slots[index]);
+    }
+    
+    return std::nullopt;
+}
+
+std::optional<int64_t> SwissTable::set_expire_time(std::string_view key, int64_t at) {
+    size_t index;
+    const RawTable* table = find(key, hash(key), index);
+    if (!table) {
+        return std::nullopt;
+    }
+    
+    RawTable& owner = *const_cast<RawTable*>(table);
+    if (is_expired(owner.slots[index], unix_time_ms())) {
+        erase(owner, index);
+        return std::nullopt;
+    }
+    
+    int64_t previous = expire_at(owner.slots[index]);
+    set_slot_expiry(owner, index, at);
+    return previous;
+}
+
+size_t SwissTable::remove_expired(int64_t now, size_t limit, KeyBatch* removed) {
+    return expires_.expire(now, limit, [this, removed](const ExpiryRef& ref) {
+        RawTable& owner = const_cast<RawTable&>(table_for(ref));
+        if (removed) {
+            removed->add(owner.slots[ref.slot].key);
+        }
+        erase(owner, ref.slot);
+    });
+}
+
+void SwissTable::clear() {
+    // Keep the current capacity, dropping any migration in progress
+    size_t capacity = table_.capacity;
+    rehash_table_ = RawTable();
+    rehash_index_ = 0;
+    table_ = RawTable(capacity);
+    expires_.clear();
+}
+
+void SwissTable::start_rehash() {
+    // Mostly tombstones: rebuild at the same size to reclaim them
+    size_t capacity = table_.capacity * 2;
+    if (table_.size < table_.capacity * 7 / 16) {
+        capacity = table_.capacity;
+    }
+    
+    rehash_table_ = RawTable(capacity);
+    rehash_index_ = 0;
+}
+
+bool SwissTable::rehash_step(size_t groups) {
+    if (!is_rehashing()) {
+        return false;
+    }
+    
+    size_t end = std::min(table_.capacity, rehash_index_ + groups * GROUP_WIDTH);
+    
+    for (; rehash_index_ < end; rehash_index_++) {
+        if (!table_.is_full(rehash_index_)) {
+            continue;
+        }
+        
+        Slot& slot = table_.slots[rehash_index_];
+        size_t index = rehash_table_.find_insert_slot(slot.hash);
+        rehash_table_.insert_at(index, slot.hash, std::move(slot.key), std::move(slot.value));
+        
+        // The key's TTL follows it
+        if (slot.expiry) {
+            rehash_table_.slots[index].expiry = slot.expiry;
+            expires_[slot.expiry - 1].slot = static_cast<uint32_t>(index);
+            expires_[slot.expiry - 1].table = main_id_ ^ 1;
+        }
+        table_.erase_at(rehash_index_);
+    }
+    
+    if (rehash_index_ < table_.capacity) {
+        return true;
+    }
+    
+    // Every slot moved: the new array becomes the table, and so do the
+    // expiry index's references to it
+    table_ = std::move(rehash_table_);
+    rehash_index_ = 0;
+    main_id_ ^= 1;
+    return false;
+}
+
+std::vector<std::string> SwissTable::keys(std::string_view pattern) const {
+    std::vector<std::string> result;
+    int64_t now = unix_time_ms();
+    
+    for (const RawTable* table : {&table_, &rehash_table_}) {
+        for (size_t i = 0; i < table->capacity; i++) {
+            if (table->is_full(i) && !is_expired(table->slots[i], now) &&
+                matches_pattern(table->slots[i].key, pattern)) {
+                result.push_back(table->slots[i].key);
+            }
+        }
+    }
+    
+    return result;
+}
+
+size_t SwissTable::memory_usage() const {
+    size_t total = expires_.memory_usage();
+    for (const RawTable* table : {&table_, &rehash_table_}) {
+        if (table->capacity > 0) {
+            total += table->capacity * sizeof(Slot) + table->capacity + GROUP_WIDTH + 
+                     table->heap_bytes;
+        }
+    }
+    return total;
+}
+
+SwissTable::Stats SwissTable::get_stats() const {
+    Stats stats{};
+    stats.total_entries = size();
+    stats.total_buckets = table_.capacity + rehash_table_.capacity;
+    stats.used_buckets = size();
+    stats.load_factor = load_factor();
+    stats.rehashing = is_rehashing();
+    stats.memory_usage = memory_usage();
+    stats.bytes_per_key = size() > 0 ? static_cast<double>(stats.memory_usage) / size() : 0.0;
+    
+    size_t total_probe_length = 0;
+    
+    for (const RawTable* table : {&table_, &rehash_table_}) {
+        for (size_t i = 0; i < table->capacity; i++) {
+            if (table->is_full(i)) {
+                size_t length = table->probe_length(i);
+                total_probe_length += length;
+                stats.max_chain_length = std::max(stats.max_chain_length, length);
+            }
+        }
+    }
+    
+    if (stats.used_buckets > 0) {
+        stats.average_chain_length = static_cast<double>(total_probe_length) /
+                                    stats.used_buckets;
+    }
+    
+    return stats;
+}
+
+// ============================================================================
+// Iterator Implementation
+// ============================================================================
+
+SwissTable::Iterator& SwissTable::Iterator::operator++() {
+    if (!table_) {
+        return *this;
+    }
+    
+    index_++;
+    visit_slot();
+    return *this;
+}
+
+void SwissTable::Iterator::visit_slot() {
+    while (true) {
+        const RawTable& raw = rehash_table_ ? table_->rehash_table_ : table_->table_;
+        
+        while (index_ < raw.capacity) {
+            if (raw.is_full(index_)) {
+                return;
+            }
+            index_++;
+        }
+        
+        // Continue into the array being migrated to, if any
+        if (rehash_table_ || !table_->is_rehashing()) {
+            break;
+        }
+        rehash_table_ = true;
+        index_ = 0;
+    }
+    
+    // Reached end
+    table_ = nullptr;
+    index_ = 0;
+    rehash_table_ = false;
+}
+
+bool SwissTable::Iterator::operator==(const Iterator& other) const {
+    return table_ == other.table_ &&
+           index_ == other.index_ &&
+           rehash_table_ == other.rehash_table_;
+}
+
+std::pair<std::string_view, std::string_view> SwissTable::Iterator::operator*() {
+    Slot& slot = (rehash_table_ ? table_->rehash_table_ : table_->table_).slots[index_];
+    return {slot.key, slot.value};
+}
+
+} // namespace scuffedredis
@@ -0,0 +1,296 @@
+#ifndef SCUFFEDREDIS_SWISS_TABLE_HPP
+#define SCUFFEDREDIS_SWISS_TABLE_HPP
+
+// Open-addressing hash table in the style of Abseil's Swiss tables
+//
+// Entries live in one flat slot array next to an array of control bytes
+// (one per slot: empty, deleted, or 7 bits of the key's hash). A lookup
+// compares a whole 16-byte group of control bytes against the hash tag at
+// once (SSE2, scalar fallback elsewhere) and only touches slots whose tag
+// matches, so most misses never read a key and there is no pointer chasing.
+//
+// Same interface as HashTable, including incremental growth: when full, a
+// second array is allocated and slots migrate a group at a time, and key
+// expiry. A key's deadline is kept in the expiry index, which the slot
+// points to from padding it already had.
+
+#include <vector>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <optional>
+#include "expiry_index.hpp"
+
+namespace scuffedredis {
+
+class SwissTable {
+public:
+    static constexpr size_t GROUP_WIDTH = 16;  // Control bytes probed at once
+
+private:
+    // One stored entry
+    struct Slot {
+        uint32_t hash;              // Cached murmur3 hash of key
+        uint32_t expiry;            // Expiry index position + 1, or 0 without a TTL
+        std::string key;
+        std::string value;
+    };
+    
+    // A key with a TTL, as recorded in the expiry index
+    struct ExpiryRef {
+        int64_t expire_at;          // Unix ms
+        uint32_t slot;
+        uint8_t table;              // RawTable holding the slot (see main_id_)
+    };
+    
+    struct RefDeadline {
+        int64_t operator()(const ExpiryRef& ref) const { return ref.expire_at; }
+    };
+    
+    // A single open-addressed array: control bytes plus slots
+    struct RawTable {
+        int8_t* ctrl;       // capacity + GROUP_WIDTH bytes (tail mirrors the head)
+        Slot* slots;        // Raw storage; only full slots are constructed
+        size_t capacity;    // Power of two, or 0 when unallocated
+        size_t size;        // Full slots
+        size_t growth_left; // Empty slots usable before the 7/8 load limit
+        size_t heap_bytes;  // String buffers allocated outside the slots
+        
+        RawTable();
+        explicit RawTable(size_t capacity);
+        ~RawTable();
+        
+        RawTable(const RawTable&) = delete;
+        RawTable& operator=(const RawTable&) = delete;
+        RawTable(RawTable&& other) noexcept;
+        RawTable& operator=(RawTable&& other) noexcept;
+        
+        bool is_full(size_t index) const { return ctrl[index] >= 0; }
+        
+        /**
+         * Find the slot holding key. Returns SIZE_MAX if absent.
+         */
+        size_t find(std::string_view key, uint32_t hash_val) const;
+        
+        /**
+         * First empty or deleted slot on the key's probe sequence.
+         */
+        size_t find_insert_slot(uint32_t hash_val) const;
+        
+        /**
+         * Construct an entry in a slot from find_insert_slot().
+         */
+        void insert_at(size_t index, uint32_t hash_val, std::string&& key, std::string&& value);
+        
+        /**
+         * Destroy an entry, leaving a tombstone so probes continue past it.
+         */
+        void erase_at(size_t index);
+        
+        /**
+         * Number of groups probed before reaching a full slot.
+         */
+        size_t probe_length(size_t index) const;
+        
+        void set_ctrl(size_t index, int8_t value);
+        void release();
+    };
+
+public:
+    // Iterator for traversing the hash table
+    // Walks the old slot array, then the one being migrated to
+    class Iterator {
+    public:
+        Iterator(SwissTable* table, size_t index)
+            : table_(table), index_(index), rehash_table_(false) {
+            if (table_) {
+                visit_slot();
+            }
+        }
+        
+        // Iterator operations
+        Iterator& operator++();
+        bool operator==(const Iterator& other) const;
+        bool operator!=(const Iterator& other) const { return !(*this == other); }
+        std::pair<std::string_view, std::string_view> operator*();
+    
+    private:
+        SwissTable* table_;
+        size_t index_;
+        bool rehash_table_;  // Walking rehash_table_
+        
+        void visit_slot();
+    };
+    
+    // Constructor with initial capacity
+    explicit SwissTable(size_t initial_capacity = 16);
+    ~SwissTable();
+    
+    // Disable copy, allow move
+    SwissTable(const SwissTable&) = delete;
+    SwissTable& operator=(const SwissTable&) = delete;
+    SwissTable(SwissTable&& other) noexcept;
+    SwissTable& operator=(SwissTable&& other) noexcept;
+    
+    /**
+     * Set a key's value and its deadline: a Unix time in ms, NO_EXPIRY
+     * for none, or KEEP_EXPIRY to keep the one it has.
+     * Returns true if the key was absent (or had expired).
+     */
+    bool set(std::string_view key, std::string_view value, int64_t expire_at = NO_EXPIRY);
+    std::optional<std::string> get(std::string_view key) const;
+    
+    /**
+     * Get a key's value without copying it.
+     * The view is valid until the table is next modified.
+     */
+    std::optional<std::string_view> get_view(std::string_view key) const;
+    
+    /**
+     * Returns false for an absent key, and for an expired one (which is
+     * removed all the same).
+     */
+    bool del(std::string_view key);
+    bool exists(std::string_view key) const;
+    std::vector<std::string> keys(std::string_view pattern = "*") const;
+    void clear();
+    
+    /**
+     * A key's deadline, NO_EXPIRY if it has none, or nullopt if absent.
+     */
+    std::optional<int64_t> expire_time(std::string_view key) const;
+    
+    /**
+     * Give a key a deadline, or remove it with NO_EXPIRY. Returns the
+     * previous deadline (NO_EXPIRY if none), or nullopt if the key is absent.
+     */
+    std::optional<int64_t> set_expire_time(std::string_view key, int64_t expire_at);
+    
+    /**
+     * Remove up to `limit` keys whose deadline is at or before `now`.
+     * Returns the number removed, and adds their names to `removed` if given.
+     */
+    size_t remove_expired(int64_t now, size_t limit, KeyBatch* removed = nullptr);
+    
+    /**
+     * Number of keys with a TTL, including expired ones not yet removed.
+     */
+    size_t expires() const { return expires_.size(); }
+    
+    /**
+     * Check up to `count` keys with a TTL for having expired by `now`.
+     */
+    ExpirySample sample_expiry(int64_t now, size_t count) const {
+        return expires_.sample(now, count);
+    }
+    
+    // Expired keys count until removed
+    size_t size() const { return table_.size + rehash_table_.size; }
+    bool empty() const { return size() == 0; }
+    
+    // Capacity the table is growing into while a rehash is in progress
+    size_t capacity() const {
+        return is_rehashing() ? rehash_table_.capacity : table_.capacity;
+    }
+    
+    double load_factor() const {
+        return capacity() == 0 ? 0.0 :
+               static_cast<double>(size()) / capacity();
+    }
+    
+    /**
+     * Check if slots are being migrated to a new array.
+     */
+    bool is_rehashing() const { return rehash_table_.capacity != 0; }
+    
+    /**
+     * Migrate up to `groups` groups of slots. Returns true if migration
+     * is unfinished.
+     */
+    bool rehash_step(size_t groups);
+    
+    // Iterator support
+    Iterator begin() { return Iterator(this, 0); }
+    Iterator end() { return Iterator(nullptr, 0); }
+    
+    /**
+     * Approximate bytes used by slot arrays, control bytes and any
+     * string buffers too long for small-string storage.
+     */
+    size_t memory_usage() const;
+    
+    // Statistics for monitoring
+    // Buckets are slots and chains are probe sequences (in groups)
+    struct Stats {
+        size_t total_entries;
+        size_t total_buckets;
+        size_t used_buckets;
+        size_t max_chain_length;
+        double average_chain_length;
+        double load_factor;
+        bool rehashing;
+        size_t memory_usage;   // Approximate bytes (see memory_usage())
+        double bytes_per_key;
+    };
+    
+    Stats get_stats() const;
+
+private:
+    RawTable table_;         // Main slot array
+    RawTable rehash_table_;  // Array being migrated to (capacity 0 if idle)
+    size_t rehash_index_;    // Next slot of table_ to migrate
+    ExpiryIndex<ExpiryRef, RefDeadline> expires_;  // Keys with a TTL
+    uint8_t main_id_;        // ExpiryRef::table of table_; flipped when a migration ends
+    
+    // Configuration
+    static constexpr size_t MIN_CAPACITY = 16;
+    static constexpr size_t REHASH_STEP = 1;  // Groups migrated per write
+    
+    /**
+     * Hash function using MurmurHash3 (same hash as HashTable).
+     */
+    static uint32_t hash(std::string_view key);
+    
+    /**
+     * Start migrating into a new array. Grows 2x unless most of the
+     * used space is tombstones, in which case it just compacts.
+     */
+    void start_rehash();
+    
+    /**
+     * Find the table and slot holding key. Returns nullptr if absent.
+     */
+    const RawTable* find(std::string_view key, uint32_t hash_val, size_t& index) const;
+    
+    /**
+     * Find a key unless it has expired. Returns nullptr if either.
+     */
+    const RawTable* find_live(std::string_view key, size_t& index) const;
+    
+    const RawTable& table_for(const ExpiryRef& ref) const {
+        return ref.table == main_id_ ? table_ : rehash_table_;
+    }
+    
+    int64_t expire_at(const Slot& slot) const {
+        return slot.expiry ? expires_[slot.expiry - 1].expire_at : NO_EXPIRY;
+    }
+    
+    bool is_expired(const Slot& slot, int64_t now) const {
+        return slot.expiry && expires_[slot.expiry - 1].expire_at <= now;
+    }
+    
+    /**
+     * Give the slot at index of table a TTL, replacing any it has, or
+     * take it away with NO_EXPIRY.
+     */
+    void set_slot_expiry(RawTable& table, size_t index, int64_t expire_at);
+    
+    /**
+     * Remove the slot at index of table, with its expiry index entry.
+     */
+    void erase(RawTable& table, size_t index);
+};
+
+} // namespace scuffedredis
+
+#endif // SCUFFEDREDIS_SWISS_TABLE_HPP
@@ -3,6 +3,8 @@
 #include "utils/logger.hpp"
 #include <algorithm>
 #include <chrono>
+#include <cstring>
+#include <cerrno>
 
 #ifdef _WIN32
     #include <winsock2.h>
@@ -13,8 +15,16 @@
     #include <unistd.h>
 #endif
 
+#ifdef SCUFFEDREDIS_USE_EPOLL
+    #include <sys/epoll.h>
+    #include <sys/eventfd.h>
+#endif
+
 namespace scuffedredis {
 
+// Loop currently running on this thread, if any
+static thread_local EventLoop* current_loop = nullptr;
+
 // ============================================================================
 // ConnectionManager Implementation
 // ============================================================================
@@ -30,6 +40,7 @@ uint64_t ConnectionManager::add_connection(std::unique_ptr<ClientConnection> con
     std::lock_guard<std::mutex> lock(mutex_);
     
     uint64_t conn_id = next_conn_id_++;
+    conn->set_id(conn_id);
     connections_[conn_id] = std::move(conn);
     
     LOG_DEBUG(format_log("Added connection ", conn_id, 
@@ -81,13 +92,155 @@ void ConnectionManager::clear() {
 EventLoop::EventLoop() 
     : running_(false), 
       stop_requested_(false),
+      connections_accepted_(0),
+      wakeup_pending_(false),
+      next_timer_id_(1),
       events_processed_(0),
       start_time_(std::chrono::steady_clock::now()) {
+#ifdef SCUFFEDREDIS_USE_EPOLL
+    epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd_ < 0) {
+        LOG_ERROR(format_log("epoll_create1() failed: ", strerror(errno)));
+    }
+    
+    // post() writes to this eventfd to break epoll_wait early
+    wakeup_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wakeup_fd_ >= 0) {
+        add_socket(wakeup_fd_, static_cast<int>(EventType::READ),
+                   [this](socket_t fd, EventType) {
+                       uint64_t count;
+                       while (::read(fd, &count, sizeof(count)) > 0) {}
+                   });
+    } else {
+        LOG_ERROR(format_log("eventfd() failed: ", strerror(errno)));
+    }
+#endif
 }
 
 EventLoop::~EventLoop() {
     stop();
+#ifdef SCUFFEDREDIS_USE_EPOLL
+    if (wakeup_fd_ >= 0) {
+        ::close(wakeup_fd_);
+    }
+    if (epoll_fd_ >= 0) {
+        ::close(epoll_fd_);
+    }
+#endif
+}
+
+EventLoop* EventLoop::current() {
+    return current_loop;
+}
+
+void EventLoop::post(LoopTask task) {
+    tasks_.push(std::move(task));
+    
+    // Only the first post since the last drain needs to wake the loop
+    if (!wakeup_pending_.exchange(true)) {
+#ifdef SCUFFEDREDIS_USE_EPOLL
+        uint64_t one = 1;
+        if (::write(wakeup_fd_, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+            LOG_ERROR(format_log("Failed to wake event loop: ", strerror(errno)));
+        }
+#endif
+        // Without epoll the loop picks tasks up at its next poll timeout
+    }
+}
+
+void EventLoop::run_posted_tasks() {
+    // Clear before draining so a post that lands mid-drain wakes us again
+    wakeup_pending_ = false;
+    
+    // Only what is queued now, so a task that keeps posting itself (a
+    // connection with more input to serve) can't starve the sockets
+    LoopTask task;
+    while (tasks_.pop(task)) {
+        running_tasks_.push_back(std::move(task));
+    }
+    for (LoopTask& posted : running_tasks_) {
+        posted();
+    }
+    running_tasks_.clear();
+}
+
+uint64_t EventLoop::add_periodic(std::chrono::milliseconds interval, LoopTask callback) {
+    std::lock_guard<std::mutex> lock(timer_mutex_);
+    
+    uint64_t timer_id = next_timer_id_++;
+    periodic_tasks_.push_back({timer_id, interval, 
+                               std::chrono::steady_clock::now() + interval,
+                               std::make_shared<LoopTask>(std::move(callback))});
+    return timer_id;
+}
+
+void EventLoop::remove_periodic(uint64_t timer_id) {
+    std::lock_guard<std::mutex> lock(timer_mutex_);
+    
+    periodic_tasks_.erase(
+        std::remove_if(periodic_tasks_.begin(), periodic_tasks_.end(),
+                       [timer_id](const PeriodicTask& task) { return task.id == timer_id; }),
+        periodic_tasks_.end());
+}
+
+void EventLoop::run_periodic_tasks() {
+    std::vector<std::shared_ptr<LoopTask>> due;
+    
+    {
+        std::lock_guard<std::mutex> lock(timer_mutex_);
+        if (periodic_tasks_.empty()) {
+            return;
+        }
+        
+        auto now = std::chrono::steady_clock::now();
+        for (auto& task : periodic_tasks_) {
+            if (task.next_run <= now) {
+                task.next_run = now + task.interval;
+                due.push_back(task.callback);
+            }
+        }
+    }
+    
+    // Run unlocked so a callback may add or remove timers
+    for (const auto& callback : due) {
+        (*callback)();
+    }
+}
+
+int EventLoop::next_timer_timeout(int max_ms) const {
+    std::lock_guard<std::mutex> lock(timer_mutex_);
+    
+    auto now = std::chrono::steady_clock::now();
+    int timeout = max_ms;
+    for (const auto& task : periodic_tasks_) {
+        auto wait = std::chrono::ceil<std::chrono::milliseconds>(task.next_run - now);
+        timeout = std::min(timeout, static_cast<int>(std::max<int64_t>(wait.count(), 0)));
+    }
+    
+    return timeout;
+}
+
+void EventLoop::notify(socket_t fd, EventType event) {
+    if (auto callback = find_callback(fd)) {
+        (*callback)(fd, event);
+    }
+}
+
+#ifdef SCUFFEDREDIS_USE_EPOLL
+uint32_t EventLoop::to_epoll_events(int events) {
+    // Edge-triggered: we are only told about state changes, so callbacks
+    // drain sockets until EAGAIN. Saves re-reporting idle-but-readable fds.
+    uint32_t flags = EPOLLET | EPOLLRDHUP;
+    if (events & static_cast<int>(EventType::READ)) {
+        flags |= EPOLLIN;
+    }
+    if (events & static_cast<int>(EventType::WRITE)) {
+        flags |= EPOLLOUT;
+    }
+    // EPOLLERR and EPOLLHUP are always reported by the kernel
+    return flags;
 }
+#endif
 
 void EventLoop::run() {
     if (running_.load()) {
@@ -96,26 +249,31 @@ void EventLoop::run() {
     }
     
     running_ = true;
-    stop_requested_ = false;
     start_time_ = std::chrono::steady_clock::now();
     
     LOG_INFO("Starting event loop");
     
     // Run event loop in current thread
     // In production, this would typically run in a separate thread
+    current_loop = this;
     event_loop_main();
+    current_loop = nullptr;
     
+    // Ready to be run again
+    stop_requested_ = false;
     running_ = false;
     LOG_INFO("Event loop stopped");
 }
 
 void EventLoop::stop() {
+    // Set unconditionally so a stop that races with run() is not lost
+    stop_requested_ = true;
+    
     if (!running_.load()) {
         return;
     }
     
     LOG_INFO("Stopping event loop...");
-    stop_requested_ = true;
     
     // Wait for event loop to finish
     if (event_thread_.joinable()) {
@@ -126,9 +284,19 @@ void EventLoop::stop() {
 void EventLoop::add_socket(socket_t fd, int events, EventCallback callback) {
     std::lock_guard<std::mutex> lock(socket_mutex_);
     
-    socket_callbacks_[fd] = callback;
+    socket_callbacks_[fd] = std::make_shared<EventCallback>(std::move(callback));
     socket_events_[fd] = events;
     
+#ifdef SCUFFEDREDIS_USE_EPOLL
+    epoll_event ev{};
+    ev.events = to_epoll_events(events);
+    ev.data.fd = fd;
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        LOG_ERROR(format_log("epoll_ctl(ADD) failed for socket ", fd, ": ", 
+                            strerror(errno)));
+    }
+#endif
+    
     LOG_DEBUG(format_log("Added socket ", fd, " with events ", events));
 }
 
@@ -138,6 +306,11 @@ void EventLoop::remove_socket(socket_t fd) {
     socket_callbacks_.erase(fd);
     socket_events_.erase(fd);
     
+#ifdef SCUFFEDREDIS_USE_EPOLL
+    // Fails harmlessly if the fd was already closed (closing removes it)
+    epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+#endif
+    
     LOG_DEBUG(format_log("Removed socket ", fd));
 }
 
@@ -145,13 +318,24 @@ void EventLoop::update_socket(socket_t fd, int events) {
     std::lock_guard<std::mutex> lock(socket_mutex_);
     
     auto it = socket_events_.find(fd);
-    if (it != socket_events_.end()) {
+    if (it != socket_events_.end() && it->second != events) {
         it->second = events;
+        
+#ifdef SCUFFEDREDIS_USE_EPOLL
+        epoll_event ev{};
+        ev.events = to_epoll_events(events);
+        ev.data.fd = fd;
+        if (epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, fd, &ev) < 0) {
+            LOG_ERROR(format_log("epoll_ctl(MOD) failed for socket ", fd, ": ", 
+                                strerror(errno)));
+        }
+#endif
         LOG_DEBUG(format_log("Updated socket ", fd, " events to ", events));
     }
 }
 
 uint64_t EventLoop::add_client(std::unique_ptr<ClientConnection> conn) {
+    connections_accepted_++;
     return connections_.add_connection(std::move(conn));
 }
 
@@ -159,12 +343,19 @@ void EventLoop::remove_client(uint64_t conn_id) {
     connections_.remove_connection(conn_id);
 }
 
+std::shared_ptr<EventCallback> EventLoop::find_callback(socket_t fd) const {
+    std::lock_guard<std::mutex> lock(socket_mutex_);
+    
+    auto it = socket_callbacks_.find(fd);
+    return (it != socket_callbacks_.end()) ? it->second : nullptr;
+}
+
 void EventLoop::event_loop_main() {
     LOG_INFO("Event loop main thread started");
     
     while (!stop_requested_.load()) {
-        // Process events with 100ms timeout
-        int events = process_events(100);
+        // Process events, waking at most every 100ms or for the next timer
+        int events = process_events(next_timer_timeout(100));
         
         if (events < 0) {
             LOG_ERROR("Error in event processing");
@@ -173,6 +364,12 @@ void EventLoop::event_loop_main() {
         
         events_processed_ += events;
         
+        // Work handed over by other threads
+        run_posted_tasks();
+        
+        // Housekeeping
+        run_periodic_tasks();
+        
         // Clean up closed connections periodically
         if (events_processed_ % 100 == 0) {
             // TODO: Implement connection cleanup
@@ -183,6 +380,42 @@ void EventLoop::event_loop_main() {
 }
 
 int EventLoop::process_events(int timeout_ms) {
+#ifdef SCUFFEDREDIS_USE_EPOLL
+    epoll_event events[MAX_EPOLL_EVENTS];
+    
+    int result = epoll_wait(epoll_fd_, events, MAX_EPOLL_EVENTS, timeout_ms);
+    
+    if (result < 0) {
+        if (errno == EINTR) {
+            // Interrupted by a signal (e.g. shutdown request), not an error
+            return 0;
+        }
+        LOG_ERROR(format_log("epoll_wait() error: ", strerror(errno)));
+        return -1;
+    }
+    
+    for (int i = 0; i < result; i++) {
+        socket_t fd = events[i].data.fd;
+        uint32_t flags = events[i].events;
+        
+        // Re-resolve the callback before each dispatch: an earlier callback
+        // in this batch may have removed the socket.
+        if (flags & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+            if (auto callback = find_callback(fd)) {
+                (*callback)(fd, (flags & EPOLLERR) ? EventType::ERROR_EVENT 
+                                                   : EventType::READ);
+            }
+        }
+        
+        if (flags & EPOLLOUT) {
+            if (auto callback = find_callback(fd)) {
+                (*callback)(fd, EventType::WRITE);
+            }
+        }
+    }
+    
+    return result;
+#else
     fd_set read_fds, write_fds, error_fds;
     int max_fd = 0;
     
@@ -204,6 +437,9 @@ int EventLoop::process_events(int timeout_ms) {
     int result = select(max_fd + 1, &read_fds, &write_fds, &error_fds, &tv);
     
     if (result < 0) {
+        if (errno == EINTR) {
+            return 0;
+        }
         // Error in select
         LOG_ERROR(format_log("select() error: ", strerror(errno)));
         return -1;
@@ -218,6 +454,7 @@ int EventLoop::process_events(int timeout_ms) {
     process_select_events(read_fds, write_fds, error_fds);
     
     return result;
+#endif
 }
 
 void EventLoop::setup_fd_sets(fd_set& read_fds, fd_set& write_fds, 
@@ -250,25 +487,37 @@ void EventLoop::setup_fd_sets(fd_set& read_fds, fd_set& write_fds,
 void EventLoop::process_select_events(const fd_set& read_fds, 
                                      const fd_set& write_fds,
                                      const fd_set& error_fds) {
-    std::lock_guard<std::mutex> lock(socket_mutex_);
+    // Snapshot the ready sockets first; callbacks may add or remove
+    // sockets, so they must run without socket_mutex_ held.
+    std::vector<socket_t> fds;
+    {
+        std::lock_guard<std::mutex> lock(socket_mutex_);
+        fds.reserve(socket_callbacks_.size());
+        for (const auto& pair : socket_callbacks_) {
+            fds.push_back(pair.first);
+        }
+    }
     
-    for (const auto& pair : socket_callbacks_) {
-        socket_t fd = pair.first;
-        const EventCallback& callback = pair.second;
-        
+    for (socket_t fd : fds) {
         // Check for read events
         if (FD_ISSET(fd, &read_fds)) {
-            callback(fd, EventType::READ);
+            if (auto callback = find_callback(fd)) {
+                (*callback)(fd, EventType::READ);
+            }
         }
         
         // Check for write events
         if (FD_ISSET(fd, &write_fds)) {
-            callback(fd, EventType::WRITE);
+            if (auto callback = find_callback(fd)) {
+                (*callback)(fd, EventType::WRITE);
+            }
         }
         
         // Check for error events
         if (FD_ISSET(fd, &error_fds)) {
-            callback(fd, EventType::ERROR_EVENT);
+            if (auto callback = find_callback(fd)) {
+                (*callback)(fd, EventType::ERROR_EVENT);
+            }
         }
     }
 }
@@ -327,6 +576,7 @@ void EventLoop::handle_client_error(socket_t client_fd) {
 EventLoop::Stats EventLoop::get_stats() const {
     Stats stats;
     stats.active_connections = connections_.size();
+    stats.accepted_connections = connections_accepted_.load();
     stats.events_processed = events_processed_.load();
     
     {
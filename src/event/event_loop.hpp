@@ -4,12 +4,14 @@
 /**
  * Event Loop for ScuffedRedis.
  * 
- * Provides event-driven I/O using select/poll for cross-platform support.
+ * Provides event-driven I/O using edge-triggered epoll on Linux, with a
+ * select() fallback for other platforms.
  * Handles multiple client connections efficiently.
  */
 
 #include "network/socket.hpp"
 #include "network/tcp_server.hpp"
+#include "utils/mpsc_queue.hpp"
 #include <vector>
 #include <unordered_map>
 #include <functional>
@@ -17,6 +19,12 @@
 #include <atomic>
 #include <thread>
 #include <mutex>
+#include <chrono>
+#include <algorithm>
+
+#if defined(__linux__)
+    #define SCUFFEDREDIS_USE_EPOLL 1
+#endif
 
 namespace scuffedredis {
 
@@ -32,9 +40,18 @@ enum class EventType {
 /**
  * Event callback function type.
  * Called when an event occurs on a socket.
+ *
+ * With the epoll backend notifications are edge-triggered, so a READ
+ * callback must drain the socket until it would block or the event
+ * will not fire again for data that is already buffered.
  */
 using EventCallback = std::function<void(socket_t fd, EventType event)>;
 
+/**
+ * Work item posted to an event loop from another thread.
+ */
+using LoopTask = std::function<void()>;
+
 /**
  * Connection manager for tracking client connections.
  */
@@ -67,7 +84,10 @@ public:
     /**
      * Get number of active connections.
      */
-    size_t size() const { return connections_.size(); }
+    size_t size() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return connections_.size();
+    }
     
     /**
      * Clear all connections.
@@ -81,11 +101,11 @@ private:
 };
 
 /**
- * Cross-platform event loop using select/poll.
+ * Cross-platform event loop using epoll (Linux) or select.
  * 
  * Features:
  * - Non-blocking I/O for all sockets
- * - Efficient multiplexing with select/poll
+ * - Edge-triggered epoll multiplexing, O(ready) per wakeup
  * - Connection management
  * - Event callbacks
  * - Thread-safe operations
@@ -103,7 +123,8 @@ public:
     
     /**
      * Stop the event loop.
-     * Thread-safe, can be called from any thread.
+     * Thread-safe, can be called from any thread. A stop requested
+     * before run() makes the next run() return immediately.
      */
     void stop();
     
@@ -112,6 +133,38 @@ public:
      */
     bool is_running() const { return running_.load(); }
     
+    /**
+     * Get the event loop running on the calling thread.
+     * Returns nullptr when called from outside any loop.
+     */
+    static EventLoop* current();
+    
+    /**
+     * Queue a task to run on this loop's thread.
+     * Thread-safe and lock-free; wakes the loop if it is waiting.
+     */
+    void post(LoopTask task);
+    
+    /**
+     * Run a callback on this loop's thread every `interval`.
+     * Used for housekeeping that should happen while the loop is idle
+     * (incremental rehashing, expiry). Thread-safe.
+     * Returns an ID for remove_periodic().
+     */
+    uint64_t add_periodic(std::chrono::milliseconds interval, LoopTask callback);
+    
+    /**
+     * Cancel a periodic callback.
+     */
+    void remove_periodic(uint64_t timer_id);
+    
+    /**
+     * Invoke a socket's callback as if the event had occurred.
+     * Must be called on the loop thread. Used to resume work on a
+     * connection that completed asynchronously (e.g. a posted task).
+     */
+    void notify(socket_t fd, EventType event);
+    
     /**
      * Add a socket to the event loop.
      * fd: Socket file descriptor
@@ -152,6 +205,7 @@ public:
      */
     struct Stats {
         size_t active_connections;
+        size_t accepted_connections;  // Total clients ever added
         size_t events_processed;
         size_t sockets_monitored;
         double events_per_second;
@@ -166,17 +220,69 @@ private:
     std::thread event_thread_;
     
     // Socket management
-    std::unordered_map<socket_t, EventCallback> socket_callbacks_;
+    // Callbacks are shared so dispatch can run them without holding
+    // socket_mutex_ (a callback may add or remove sockets).
+    std::unordered_map<socket_t, std::shared_ptr<EventCallback>> socket_callbacks_;
     std::unordered_map<socket_t, int> socket_events_;
     mutable std::mutex socket_mutex_;
     
     // Connection management
     ConnectionManager connections_;
+    std::atomic<size_t> connections_accepted_;
+    
+    // Cross-thread task queue
+    MpscQueue<LoopTask> tasks_;
+    std::atomic<bool> wakeup_pending_;  // Coalesces wakeups between drains
+    std::vector<LoopTask> running_tasks_;  // Taken from tasks_ by the current drain
+    
+    // Periodic callbacks
+    struct PeriodicTask {
+        uint64_t id;
+        std::chrono::milliseconds interval;
+        std::chrono::steady_clock::time_point next_run;
+        std::shared_ptr<LoopTask> callback;
+    };
+    std::vector<PeriodicTask> periodic_tasks_;
+    uint64_t next_timer_id_;
+    mutable std::mutex timer_mutex_;
     
     // Statistics
     std::atomic<size_t> events_processed_;
     std::chrono::steady_clock::time_point start_time_;
     
+#ifdef SCUFFEDREDIS_USE_EPOLL
+    int epoll_fd_;                              // epoll instance
+    int wakeup_fd_;                             // eventfd signalled by post()
+    static constexpr int MAX_EPOLL_EVENTS = 256;  // Events per epoll_wait
+    
+    /**
+     * Translate an EventType bitmask into epoll flags (edge-triggered).
+     */
+    static uint32_t to_epoll_events(int events);
+#endif
+    
+    /**
+     * Run every task posted so far. Tasks they post in turn wait for the
+     * next pass, after the sockets that became ready in the meantime.
+     */
+    void run_posted_tasks();
+    
+    /**
+     * Run periodic callbacks that are due.
+     */
+    void run_periodic_tasks();
+    
+    /**
+     * Milliseconds until the next periodic callback, capped at max_ms.
+     */
+    int next_timer_timeout(int max_ms) const;
+    
+    /**
+     * Look up the callback registered for a socket.
+     * Returns nullptr if the socket was removed.
+     */
+    std::shared_ptr<EventCallback> find_callback(socket_t fd) const;
+    
     /**
      * Main event loop function.
      * Runs in separate thread.
@@ -184,8 +290,8 @@ private:
     void event_loop_main();
     
     /**
-     * Process events using select().
-     * Returns number of events processed.
+     * Wait for and dispatch events (epoll_wait or select).
+     * Returns number of events processed, -1 on fatal error.
      */
     int process_events(int timeout_ms);
     
@@ -226,6 +332,8 @@ private:
 /**
  * Global event loop instance.
  * Singleton for easy access throughout the application.
+ * Also keeps a registry of every running loop (one per I/O thread)
+ * so INFO can report per-thread statistics.
  */
 class EventLoopManager {
 public:
@@ -251,10 +359,42 @@ public:
     void stop() {
         loop_.stop();
     }
+    
+    /**
+     * Register a running I/O thread loop.
+     */
+    void register_loop(EventLoop* loop) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        loops_.push_back(loop);
+    }
+    
+    /**
+     * Unregister a loop before it is destroyed.
+     */
+    void unregister_loop(EventLoop* loop) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        loops_.erase(std::remove(loops_.begin(), loops_.end(), loop), loops_.end());
+    }
+    
+    /**
+     * Get statistics for every registered loop, in registration order.
+     */
+    std::vector<EventLoop::Stats> get_all_stats() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        
+        std::vector<EventLoop::Stats> stats;
+        stats.reserve(loops_.size());
+        for (const EventLoop* loop : loops_) {
+            stats.push_back(loop->get_stats());
+        }
+        return stats;
+    }
 
 private:
     EventLoopManager() = default;
     EventLoop loop_;
+    std::vector<EventLoop*> loops_;  // Registered I/O thread loops
+    mutable std::mutex mutex_;
 };
 
 } // namespace scuffedredis
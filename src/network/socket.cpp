@@ -11,6 +11,7 @@
 #else
     #include <fcntl.h>
     #include <netinet/tcp.h>
+    #include <sys/uio.h>
     #include <errno.h>
 #endif
 
@@ -177,6 +178,43 @@ ssize_t Socket::send(const void* data, size_t size) {
 #endif
 }
 
+ssize_t Socket::send_vectored(const IoSlice* slices, size_t count) {
+    if (!is_valid()) return -1;
+    
+    if (count > MAX_IO_SLICES) {
+        count = MAX_IO_SLICES;
+    }
+    
+#ifdef _WIN32
+    WSABUF buffers[MAX_IO_SLICES];
+    for (size_t i = 0; i < count; i++) {
+        buffers[i].buf = static_cast<char*>(const_cast<void*>(slices[i].data));
+        buffers[i].len = static_cast<ULONG>(slices[i].size);
+    }
+    
+    DWORD sent = 0;
+    int result = WSASend(fd_, buffers, static_cast<DWORD>(count), &sent, 0, nullptr, nullptr);
+    return result == 0 ? static_cast<ssize_t>(sent) : -1;
+#else
+    iovec buffers[MAX_IO_SLICES];
+    for (size_t i = 0; i < count; i++) {
+        buffers[i].iov_base = const_cast<void*>(slices[i].data);
+        buffers[i].iov_len = slices[i].size;
+    }
+    
+    msghdr msg{};
+    msg.msg_iov = buffers;
+    msg.msg_iovlen = count;
+    
+    // A client that hung up must not kill the server with SIGPIPE
+#ifdef MSG_NOSIGNAL
+    return ::sendmsg(fd_, &msg, MSG_NOSIGNAL);
+#else
+    return ::sendmsg(fd_, &msg, 0);
+#endif
+#endif
+}
+
 ssize_t Socket::recv(void* buffer, size_t size) {
     if (!is_valid()) return -1;
     
@@ -258,6 +296,28 @@ bool Socket::set_reuseaddr(bool enable) {
     return true;
 }
 
+bool Socket::set_reuseport(bool enable) {
+    if (!is_valid()) return false;
+    
+#ifdef SO_REUSEPORT
+    // SO_REUSEPORT lets each I/O thread own a listening socket on the
+    // same port instead of contending on a single accept queue
+    int flag = enable ? 1 : 0;
+    if (setsockopt(fd_, SOL_SOCKET, SO_REUSEPORT, 
+                   reinterpret_cast<const char*>(&flag), sizeof(flag)) < 0) {
+        std::cerr << "Failed to set SO_REUSEPORT: " 
+                  << get_socket_error() << std::endl;
+        return false;
+    }
+    
+    return true;
+#else
+    (void)enable;
+    std::cerr << "SO_REUSEPORT is not supported on this platform" << std::endl;
+    return false;
+#endif
+}
+
 void Socket::close() {
     if (is_valid()) {
 #ifdef _WIN32
@@ -269,6 +329,14 @@ void Socket::close() {
     }
 }
 
+bool Socket::would_block() const {
+#ifdef _WIN32
+    return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+    return errno == EAGAIN || errno == EWOULDBLOCK;
+#endif
+}
+
 std::string Socket::get_last_error() const {
     return get_socket_error();
 }
@@ -101,6 +101,25 @@ public:
      */
     ssize_t send(const void* data, size_t size);
     
+    /**
+     * One contiguous region for send_vectored().
+     */
+    struct IoSlice {
+        const void* data;
+        size_t size;
+    };
+    
+    // Regions passed to one send_vectored() call at most
+    static constexpr size_t MAX_IO_SLICES = 64;
+    
+    /**
+     * Send several buffers with a single system call (sendmsg/WSASend).
+     * Only the first MAX_IO_SLICES slices are used. Never raises SIGPIPE
+     * when the peer has gone away.
+     * Returns number of bytes sent, or -1 on error.
+     */
+    ssize_t send_vectored(const IoSlice* slices, size_t count);
+    
     /**
      * Receive data from socket.
      * Returns number of bytes received, 0 on connection close, or -1 on error.
@@ -125,6 +144,13 @@ public:
      */
     bool set_reuseaddr(bool enable = true);
     
+    /**
+     * Enable SO_REUSEPORT option.
+     * Lets several sockets listen on the same port, with the kernel
+     * distributing new connections between them. Not available on Windows.
+     */
+    bool set_reuseport(bool enable = true);
+    
     /**
      * Close the socket.
      * Called automatically by destructor.
@@ -142,6 +168,12 @@ public:
      */
     socket_t get_fd() const { return fd_; }
     
+    /**
+     * Check if the last failed call only failed because a non-blocking
+     * socket had nothing to do (EAGAIN/EWOULDBLOCK), i.e. retry later.
+     */
+    bool would_block() const;
+    
     /**
      * Get last error message.
      */
@@ -1,6 +1,7 @@
 #include "tcp_client.hpp"
 #include <iostream>
 #include <cstring>
+#include <algorithm>
 
 #ifdef _WIN32
     #include <winsock2.h>
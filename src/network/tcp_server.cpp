@@ -1,4 +1,7 @@
 #include "tcp_server.hpp"
+#include "event/event_loop.hpp"
+#include "server/pubsub.hpp"
+#include "utils/logger.hpp"
 #include <iostream>
 #include <algorithm>
 #include <cstring>
@@ -12,10 +15,14 @@ namespace scuffedredis {
 
 ClientConnection::ClientConnection(Socket&& socket) 
     : socket_(std::move(socket)), 
-      closed_(false) {
-    // Reserve initial buffer space for efficiency
-    read_buffer_.reserve(READ_BUFFER_SIZE);
-    
+      write_offset_(0),
+      parser_(protocol::Protocol::AUTO),
+      id_(0),
+      closed_(false),
+      blocked_(false),
+      subscriptions_(0),
+      drained_(true),
+      read_queued_(false) {
     // TODO: Get client address info for logging
     client_info_ = "client";  // Placeholder
 }
@@ -27,24 +34,19 @@ ClientConnection::~ClientConnection() {
 ssize_t ClientConnection::read() {
     if (!is_connected()) return -1;
     
-    // Temporary buffer for reading
-    uint8_t temp_buffer[READ_BUFFER_SIZE];
+    // Check buffer size limit to prevent memory exhaustion
+    if (parser_.buffer_size() >= MAX_BUFFER_SIZE) {
+        std::cerr << "Client buffer overflow, closing connection" << std::endl;
+        close();
+        return -1;
+    }
     
-    // Read from socket
-    ssize_t bytes_read = socket_.recv(temp_buffer, sizeof(temp_buffer));
+    // Read from socket straight into the parser's buffer
+    uint8_t* space = parser_.prepare(READ_BUFFER_SIZE);
+    ssize_t bytes_read = socket_.recv(space, READ_BUFFER_SIZE);
     
     if (bytes_read > 0) {
-        // Check buffer size limit to prevent memory exhaustion
-        if (read_buffer_.size() + bytes_read > MAX_BUFFER_SIZE) {
-            std::cerr << "Client buffer overflow, closing connection" << std::endl;
-            close();
-            return -1;
-        }
-        
-        // Append to read buffer
-        read_buffer_.insert(read_buffer_.end(), 
-                          temp_buffer, 
-                          temp_buffer + bytes_read);
+        parser_.commit(static_cast<size_t>(bytes_read));
     } else if (bytes_read == 0) {
         // Connection closed by client
         close();
@@ -54,39 +56,128 @@ ssize_t ClientConnection::read() {
     return bytes_read;
 }
 
+bool ClientConnection::read_available() {
+    // Drain the socket; edge-triggered polling won't report this data again
+    size_t batch = 0;
+    
+    while (is_connected()) {
+        ssize_t bytes_read = read();
+        
+        if (bytes_read > 0) {
+            batch += static_cast<size_t>(bytes_read);
+            if (batch >= READ_BATCH_SIZE) {
+                return true;  // Let the caller parse before reading more
+            }
+            continue;
+        }
+        
+        if (bytes_read < 0 && is_connected() && socket_.would_block()) {
+            drained_ = true;
+            return true;  // Everything available has been read
+        }
+        
+        // Peer closed or a real error
+        close();
+        return false;
+    }
+    
+    return false;
+}
+
 bool ClientConnection::write(const void* data, size_t size) {
     if (!is_connected() || size == 0) return false;
     
+    // Preserve ordering behind output that is already queued
     const uint8_t* bytes = static_cast<const uint8_t*>(data);
-    size_t total_sent = 0;
+    std::vector<uint8_t>& output = output_buffer();
+    output.insert(output.end(), bytes, bytes + size);
+    
+    return flush();
+}
+
+bool ClientConnection::write(const std::string& str) {
+    return write(str.data(), str.size());
+}
+
+void ClientConnection::queue(std::vector<uint8_t>&& data) {
+    if (data.empty()) return;
+    
+    if (!write_chunks_.empty() && write_chunks_.back().empty()) {
+        write_chunks_.back() = std::move(data);
+    } else {
+        write_chunks_.push_back(std::move(data));
+    }
+}
+
+std::vector<uint8_t>& ClientConnection::output_buffer() {
+    if (write_chunks_.empty()) {
+        write_chunks_.emplace_back();
+    }
+    return write_chunks_.back();
+}
+
+size_t ClientConnection::pending_output() const {
+    size_t total = 0;
+    for (const auto& chunk : write_chunks_) {
+        total += chunk.size();
+    }
+    return total - write_offset_;
+}
+
+bool ClientConnection::flush() {
+    if (!is_connected()) return false;
     
-    // Keep sending until all data is sent
-    // Handles partial writes automatically
-    while (total_sent < size) {
-        ssize_t sent = socket_.send(bytes + total_sent, size - total_sent);
+    while (has_pending_writes()) {
+        // Gather every queued chunk into one system call
+        Socket::IoSlice slices[Socket::MAX_IO_SLICES];
+        size_t count = 0;
+        size_t offset = write_offset_;
+        
+        for (const auto& chunk : write_chunks_) {
+            if (count == Socket::MAX_IO_SLICES) {
+                break;
+            }
+            if (chunk.size() > offset) {
+                slices[count++] = {chunk.data() + offset, chunk.size() - offset};
+            }
+            offset = 0;
+        }
+        
+        ssize_t sent = socket_.send_vectored(slices, count);
         
         if (sent < 0) {
+            if (socket_.would_block()) {
+                break;  // Try again on the next write-ready event
+            }
+            
             std::cerr << "Failed to write to client: " << socket_.get_last_error() << std::endl;
             close();
             return false;
         }
         
-        total_sent += sent;
+        consume_output(static_cast<size_t>(sent));
     }
     
     return true;
 }
 
-bool ClientConnection::write(const std::string& str) {
-    return write(str.data(), str.size());
-}
-
-void ClientConnection::consume_bytes(size_t count) {
-    if (count >= read_buffer_.size()) {
-        read_buffer_.clear();
-    } else {
-        // Erase consumed bytes from beginning of buffer
-        read_buffer_.erase(read_buffer_.begin(), read_buffer_.begin() + count);
+void ClientConnection::consume_output(size_t sent) {
+    while (sent > 0 && !write_chunks_.empty()) {
+        std::vector<uint8_t>& front = write_chunks_.front();
+        size_t left = front.size() - write_offset_;
+        
+        if (sent < left) {
+            write_offset_ += sent;  // Partial send: no bytes are moved
+            return;
+        }
+        
+        sent -= left;
+        write_offset_ = 0;
+        if (write_chunks_.size() == 1) {
+            front.clear();
+        } else {
+            write_chunks_.pop_front();
+        }
     }
 }
 
@@ -94,8 +185,9 @@ void ClientConnection::close() {
     if (!closed_) {
         socket_.close();
         closed_ = true;
-        read_buffer_.clear();
-        write_buffer_.clear();
+        parser_.reset();
+        write_chunks_.clear();
+        write_offset_ = 0;
     }
 }
 
@@ -106,6 +198,7 @@ void ClientConnection::close() {
 TcpServer::TcpServer() 
     : running_(false), 
       stop_requested_(false),
+      event_mode_(false),
       port_(0) {
 }
 
@@ -113,39 +206,72 @@ TcpServer::~TcpServer() {
     stop();
 }
 
-bool TcpServer::init(const std::string& address, uint16_t port) {
+bool TcpServer::init(const std::string& address, uint16_t port, size_t io_threads) {
     // Initialize sockets (Windows specific)
     if (!initialize_sockets()) {
         return false;
     }
     
+    if (io_threads == 0) {
+        io_threads = 1;
+    }
+    
+    io_threads_.clear();
+    for (size_t i = 0; i < io_threads; i++) {
+        auto io = std::make_unique<IoThread>();
+        io->index = i;
+        io->loop = std::make_unique<EventLoop>();
+        
+        if (!open_listener(io->listen_socket, address, port, io_threads > 1)) {
+            io_threads_.clear();
+            return false;
+        }
+        
+        io_threads_.push_back(std::move(io));
+    }
+    
+    bind_address_ = address;
+    port_ = port;
+    
+    std::cout << "Server initialized on " << address << ":" << port;
+    if (io_threads > 1) {
+        std::cout << " with " << io_threads << " I/O threads";
+    }
+    std::cout << std::endl;
+    return true;
+}
+
+bool TcpServer::open_listener(Socket& socket, const std::string& address, 
+                              uint16_t port, bool reuse_port) {
     // Create TCP socket
-    if (!listen_socket_.create_tcp()) {
+    if (!socket.create_tcp()) {
         return false;
     }
     
     // Enable address reuse to avoid TIME_WAIT issues
-    listen_socket_.set_reuseaddr(true);
+    socket.set_reuseaddr(true);
+    
+    // Let several sockets bind the same port; the kernel load-balances
+    // new connections between them
+    if (reuse_port && !socket.set_reuseport(true)) {
+        return false;
+    }
     
     // Bind to address and port
-    if (!listen_socket_.bind(address, port)) {
+    if (!socket.bind(address, port)) {
         return false;
     }
     
     // Start listening for connections
-    if (!listen_socket_.listen(128)) {  // 128 connection backlog
+    if (!socket.listen(128)) {  // 128 connection backlog
         return false;
     }
     
-    bind_address_ = address;
-    port_ = port;
-    
-    std::cout << "Server initialized on " << address << ":" << port << std::endl;
     return true;
 }
 
 void TcpServer::run_blocking(ClientHandler handler) {
-    if (!listen_socket_.is_valid()) {
+    if (io_threads_.empty() || !listen_socket().is_valid()) {
         std::cerr << "Server not initialized" << std::endl;
         return;
     }
@@ -158,7 +284,7 @@ void TcpServer::run_blocking(ClientHandler handler) {
     // Main accept loop
     while (running_ && !stop_requested_) {
         // Accept new connection
-        Socket client_socket = listen_socket_.accept();
+        Socket client_socket = listen_socket().accept();
         
         if (!client_socket.is_valid()) {
             // Could be due to non-blocking mode or actual error
@@ -186,7 +312,7 @@ void TcpServer::run_blocking(ClientHandler handler) {
 }
 
 void TcpServer::run_async(ClientHandler handler) {
-    if (!listen_socket_.is_valid()) {
+    if (io_threads_.empty() || !listen_socket().is_valid()) {
         std::cerr << "Server not initialized" << std::endl;
         return;
     }
@@ -199,11 +325,187 @@ void TcpServer::run_async(ClientHandler handler) {
     std::cout << "Server running in async mode..." << std::endl;
 }
 
+void TcpServer::run_event_loop(ClientHandler handler) {
+    if (io_threads_.empty() || !listen_socket().is_valid()) {
+        std::cerr << "Server not initialized" << std::endl;
+        return;
+    }
+    
+    running_ = true;
+    stop_requested_ = false;
+    event_mode_ = true;
+    handler_ = std::move(handler);
+    
+    std::cout << "Server running in event loop mode with " 
+              << io_threads_.size() << " I/O thread(s)..." << std::endl;
+    
+    // The calling thread serves I/O thread 0
+    for (size_t i = 1; i < io_threads_.size(); i++) {
+        IoThread& io = *io_threads_[i];
+        io.thread = std::thread([this, &io]() { run_io_thread(io); });
+    }
+    
+    run_io_thread(*io_threads_[0]);
+    
+    for (auto& io : io_threads_) {
+        if (io->thread.joinable()) {
+            io->thread.join();
+        }
+    }
+    
+    running_ = false;
+    std::cout << "Server stopped" << std::endl;
+}
+
+void TcpServer::run_io_thread(IoThread& io) {
+    EventLoopManager::instance().register_loop(io.loop.get());
+    
+    // Everything on the loop must be non-blocking so no client can stall it
+    io.listen_socket.set_nonblocking(true);
+    io.loop->add_socket(io.listen_socket.get_fd(), 
+                        static_cast<int>(EventType::READ),
+                        [this, &io](socket_t, EventType) { on_accept_ready(io); });
+    
+    // Blocks until stop() is called
+    io.loop->run();
+    
+    // Tear down on the loop thread so callbacks never race with cleanup
+    io.loop->remove_socket(io.listen_socket.get_fd());
+    for (uint64_t conn_id : io.loop->get_connections().get_connection_ids()) {
+        close_client(io, conn_id, io.loop->get_connections().get_connection(conn_id));
+    }
+    
+    EventLoopManager::instance().unregister_loop(io.loop.get());
+}
+
+void TcpServer::on_accept_ready(IoThread& io) {
+    // Edge-triggered: accept until the backlog is empty
+    while (true) {
+        Socket client_socket = io.listen_socket.accept();
+        
+        if (!client_socket.is_valid()) {
+            if (!io.listen_socket.would_block()) {
+                LOG_ERROR(format_log("accept() failed: ", io.listen_socket.get_last_error()));
+            }
+            return;
+        }
+        
+        client_socket.set_nonblocking(true);
+        client_socket.set_nodelay(true);
+        
+        socket_t fd = client_socket.get_fd();
+        uint64_t conn_id = io.loop->add_client(
+            std::make_unique<ClientConnection>(std::move(client_socket)));
+        
+        io.loop->add_socket(fd, static_cast<int>(EventType::READ),
+                            [this, &io, conn_id](socket_t, EventType event) {
+                                on_client_event(io, conn_id, event);
+                            });
+        
+        LOG_DEBUG(format_log("Client ", conn_id, " connected to I/O thread ", io.index));
+    }
+}
+
+void TcpServer::on_client_event(IoThread& io, uint64_t conn_id, EventType event) {
+    ClientConnection* client = io.loop->get_connections().get_connection(conn_id);
+    if (!client) {
+        return;
+    }
+    
+    if (event == EventType::ERROR_EVENT) {
+        close_client(io, conn_id, client);
+        return;
+    }
+    
+    if (event == EventType::READ) {
+        client->mark_readable();
+    }
+    
+    // Make room first: write readiness is what resumes a backlogged client
+    if (event == EventType::WRITE && !client->flush()) {
+        close_client(io, conn_id, client);
+        return;
+    }
+    
+    // Read and serve one batch per event, so a client streaming a deep
+    // pipeline takes turns with the others on this loop. A client waiting
+    // on another shard's reply leaves further input in the socket until
+    // resume_client() wakes it; one with a continuation queued waits for it.
+    // A client that isn't reading its replies is left unread until it does.
+    bool open = true;
+    if (!client->is_drained() && !client->is_blocked() && !client->is_read_queued() &&
+        !client->is_output_backlogged()) {
+        open = client->read_available();
+        
+        // Serve whatever arrived, even if the client half-closed after sending
+        if (client->has_input() && !handler_(*client)) {
+            open = false;
+        }
+    }
+    
+    if (!open) {
+        // Best effort to deliver replies to a client that hung up
+        client->flush();
+        close_client(io, conn_id, client);
+        return;
+    }
+    
+    if (!client->flush()) {
+        close_client(io, conn_id, client);
+        return;
+    }
+    
+    // Edge-triggered polling won't report the unread input again, so the
+    // next batch is posted to run after the sockets that are ready now.
+    // A backlogged client waits for write readiness instead.
+    if (!client->is_drained() && !client->is_blocked() && !client->is_read_queued() &&
+        !client->is_output_backlogged()) {
+        client->set_read_queued(true);
+        io.loop->post([this, &io, conn_id]() {
+            if (ClientConnection* queued = io.loop->get_connections().get_connection(conn_id)) {
+                queued->set_read_queued(false);
+                on_client_event(io, conn_id, EventType::READ);
+            }
+        });
+    }
+    
+    // Only ask for write readiness while output is queued
+    int events = static_cast<int>(EventType::READ);
+    if (client->has_pending_writes()) {
+        events |= static_cast<int>(EventType::WRITE);
+    }
+    io.loop->update_socket(client->get_socket().get_fd(), events);
+}
+
+void TcpServer::close_client(IoThread& io, uint64_t conn_id, ClientConnection* client) {
+    if (client) {
+        // Subscriptions end with the connection, not at the next publish
+        if (client->subscriptions() > 0) {
+            PubSub::instance().drop_client(io.loop.get(), conn_id);
+        }
+        io.loop->remove_socket(client->get_socket().get_fd());
+        client->close();
+    }
+    io.loop->remove_client(conn_id);
+    
+    LOG_DEBUG(format_log("Client ", conn_id, " disconnected"));
+}
+
 void TcpServer::stop() {
     stop_requested_ = true;
     
-    // Close listening socket to break accept() call
-    listen_socket_.close();
+    if (event_mode_) {
+        // Event loop mode: each loop thread notices and cleans up
+        for (auto& io : io_threads_) {
+            io->loop->stop();
+        }
+        return;
+    }
+    
+    // Close listening sockets to break accept() call
+    for (auto& io : io_threads_) {
+        io->listen_socket.close();
+    }
     
     // Wait for server thread if running async
     if (server_thread_.joinable()) {
@@ -247,6 +549,11 @@ void TcpServer::handle_client(std::unique_ptr<ClientConnection> client,
             // Handler requested connection close
             break;
         }
+        
+        // Send this batch's replies
+        if (!client->flush()) {
+            break;
+        }
     }
     
     std::cout << "Client disconnected" << std::endl;
@@ -5,11 +5,14 @@
  * TCP Server implementation for Redis.
  * 
  * Handles incoming connections and manages client sessions.
- * Will evolve to support event-driven I/O and concurrent connections.
+ * Supports a simple blocking mode and an event-driven mode that
+ * multiplexes many non-blocking connections on one thread.
  */
 
 #include "socket.hpp"
+#include "protocol/protocol.hpp"
 #include <vector>
+#include <deque>
 #include <memory>
 #include <functional>
 #include <thread>
@@ -17,8 +20,10 @@
 
 namespace scuffedredis {
 
-// Forward declaration
+// Forward declarations
 class ClientConnection;
+class EventLoop;
+enum class EventType;
 
 /**
  * Callback type for handling client data.
@@ -41,24 +46,78 @@ public:
      */
     ssize_t read();
     
+    /**
+     * Read everything currently available on a non-blocking socket.
+     * Required by edge-triggered polling, which only reports new data once.
+     * Stops after READ_BATCH_SIZE bytes so a deep pipeline can be handled
+     * before the rest is read; is_drained() tells whether to call again.
+     * Returns false if the client closed the connection or an error occurred.
+     */
+    bool read_available();
+    
+    /**
+     * Check if the socket has been read until it would block since the
+     * last readiness event (see mark_readable()).
+     */
+    bool is_drained() const { return drained_; }
+    void mark_readable() { drained_ = false; }
+    
+    /**
+     * Set while the rest of the input waits its turn behind the loop's
+     * other connections (see TcpServer::on_client_event()).
+     */
+    bool is_read_queued() const { return read_queued_; }
+    void set_read_queued(bool queued) { read_queued_ = queued; }
+    
     /**
      * Write data to client.
-     * Handles partial writes automatically.
+     * Queued behind any earlier output, then sent as far as the socket
+     * allows. On a non-blocking socket the rest waits for flush().
      */
     bool write(const void* data, size_t size);
     bool write(const std::string& str);
     
     /**
-     * Get data from read buffer.
-     * Does not remove data from buffer.
+     * Queue an already encoded buffer without copying it.
+     * Sent by the next flush().
+     */
+    void queue(std::vector<uint8_t>&& data);
+    
+    /**
+     * Send queued output with one gathered write per call to the socket,
+     * stopping when the socket would block.
+     * Returns false on a fatal socket error.
+     */
+    bool flush();
+    
+    /**
+     * Check if output is still waiting to be sent.
+     */
+    bool has_pending_writes() const { return pending_output() > 0; }
+    
+    /**
+     * Bytes of output not yet sent.
      */
-    const std::vector<uint8_t>& get_read_buffer() const { return read_buffer_; }
+    size_t pending_output() const;
     
     /**
-     * Consume bytes from read buffer.
-     * Used after processing data to remove it from buffer.
+     * Check if so much output is waiting that no more requests should
+     * be read until the client takes some of it (backpressure).
      */
-    void consume_bytes(size_t count);
+    bool is_output_backlogged() const { return pending_output() >= OUTPUT_PAUSE_SIZE; }
+    
+    /**
+     * Buffer for new output. Replies may be appended here directly (see
+     * protocol::ResponseWriter); they go out on the next flush().
+     */
+    std::vector<uint8_t>& output_buffer();
+    
+    /**
+     * Check if received data is waiting in the parser.
+     * Data is read straight into the parser's buffer, which keeps it
+     * until complete messages are parsed out of it.
+     */
+    bool has_input() const { return parser_.buffer_size() > 0; }
     
     /**
      * Check if connection is still valid.
@@ -76,17 +135,65 @@ public:
     std::string get_client_info() const { return client_info_; }
     
     Socket& get_socket() { return socket_; }
+    
+    /**
+     * Protocol parser holding this client's partially received messages.
+     * Kept per connection so interleaved clients never share state.
+     */
+    protocol::Parser& get_parser() { return parser_; }
+    
+    /**
+     * Wire protocol, detected from the client's first request (AUTO until
+     * then). Replies must be encoded in the same protocol.
+     */
+    protocol::Protocol get_protocol() const { return parser_.protocol(); }
+    void set_protocol(protocol::Protocol protocol) { parser_.set_protocol(protocol); }
+    
+    /**
+     * Connection ID assigned by the owning event loop (0 if none).
+     */
+    uint64_t get_id() const { return id_; }
+    void set_id(uint64_t id) { id_ = id; }
+    
+    /**
+     * Pause request processing while a reply is produced elsewhere
+     * (e.g. by another shard). Input keeps buffering in the parser so
+     * pipelined replies stay in order.
+     */
+    bool is_blocked() const { return blocked_; }
+    void set_blocked(bool blocked) { blocked_ = blocked; }
+    
+    /**
+     * Number of pub/sub channels the client is subscribed to. A RESP2
+     * client with any can only manage its subscriptions (see PubSub).
+     */
+    size_t subscriptions() const { return subscriptions_; }
+    void set_subscriptions(size_t count) { subscriptions_ = count; }
 
 private:
     Socket socket_;
-    std::vector<uint8_t> read_buffer_;   // Buffer for incoming data
-    std::vector<uint8_t> write_buffer_;  // Buffer for outgoing data (if needed)
+    std::deque<std::vector<uint8_t>> write_chunks_;  // Output not yet sent, in order
+    size_t write_offset_;                // Bytes of the front chunk already sent
+    protocol::Parser parser_;            // Incoming data and request parser state
     std::string client_info_;            // Client address:port string
+    uint64_t id_;                        // Event loop connection ID
     bool closed_;                        // Connection state
+    bool blocked_;                       // Waiting on an async reply
+    size_t subscriptions_;               // Pub/sub channels subscribed to
+    bool drained_;                       // Socket had no more data to read
+    bool read_queued_;                   // A continuation will read more
+    
+    /**
+     * Drop `sent` bytes from the front of the output queue.
+     * The last chunk is kept (emptied) so its capacity is reused.
+     */
+    void consume_output(size_t sent);
     
     // Buffer management constants
     static constexpr size_t READ_BUFFER_SIZE = 4096;
-    static constexpr size_t MAX_BUFFER_SIZE = 1024 * 1024;  // 1MB max
+    static constexpr size_t READ_BATCH_SIZE = 256 * 1024;   // Read per read_available()
+    static constexpr size_t MAX_BUFFER_SIZE = 1024 * 1024;  // 1MB max unparsed
+    static constexpr size_t OUTPUT_PAUSE_SIZE = 4 * 1024 * 1024;  // Unsent output that stops reads
 };
 
 /**
@@ -101,8 +208,11 @@ public:
      * Initialize server on specified address and port.
      * address: IP to bind to ("0.0.0.0" for all interfaces)
      * port: Port to listen on
+     * io_threads: Number of event loop threads. With more than one, each
+     *             thread gets its own SO_REUSEPORT listening socket and the
+     *             kernel spreads incoming connections across them.
      */
-    bool init(const std::string& address, uint16_t port);
+    bool init(const std::string& address, uint16_t port, size_t io_threads = 1);
     
     /**
      * Run the server with blocking accept loop.
@@ -111,6 +221,16 @@ public:
      */
     void run_blocking(ClientHandler handler);
     
+    /**
+     * Run the server on event loops.
+     * Serves any number of clients concurrently using non-blocking sockets.
+     * The calling thread runs the first I/O thread; the others are spawned.
+     * Returns after stop() is called.
+     * handler: Callback invoked whenever a client has new data; called
+     *          concurrently from every I/O thread
+     */
+    void run_event_loop(ClientHandler handler);
+    
     /**
      * Run server in a separate thread.
      * Non-blocking call that starts server in background.
@@ -120,6 +240,8 @@ public:
     /**
      * Stop the server.
      * Closes all connections and stops accept loop.
+     * In event loop mode this only requests shutdown; the loop thread
+     * closes connections on its way out.
      */
     void stop();
     
@@ -137,15 +259,54 @@ public:
      * Get number of active connections.
      */
     size_t get_connection_count() const { return connections_.size(); }
+    
+    /**
+     * Get number of I/O threads.
+     */
+    size_t get_io_thread_count() const { return io_threads_.size(); }
+    
+    /**
+     * Get the event loop of an I/O thread (valid after init()).
+     */
+    EventLoop& get_io_loop(size_t index) { return *io_threads_.at(index)->loop; }
 
 private:
-    Socket listen_socket_;                              // Server listening socket
+    /**
+     * One reactor: a listening socket, the event loop that owns it and
+     * the clients it accepted. Nothing is shared between I/O threads.
+     */
+    struct IoThread {
+        size_t index;
+        Socket listen_socket;
+        std::unique_ptr<EventLoop> loop;
+        std::thread thread;
+    };
+    
+    std::vector<std::unique_ptr<IoThread>> io_threads_;  // I/O threads (event mode)
     std::vector<std::unique_ptr<ClientConnection>> connections_;  // Active connections
     std::atomic<bool> running_;                        // Server state
     std::atomic<bool> stop_requested_;                 // Shutdown flag
+    std::atomic<bool> event_mode_;                     // Serving from event loops
     std::thread server_thread_;                        // Async server thread
     std::string bind_address_;                         // Server bind address
     uint16_t port_;                                    // Server port
+    ClientHandler handler_;                            // Handler (event mode)
+    
+    /**
+     * Listening socket used by the blocking modes.
+     */
+    Socket& listen_socket() { return io_threads_.front()->listen_socket; }
+    
+    /**
+     * Create, bind and listen on a socket for one I/O thread.
+     */
+    bool open_listener(Socket& socket, const std::string& address, 
+                       uint16_t port, bool reuse_port);
+    
+    /**
+     * Event loop body for one I/O thread.
+     */
+    void run_io_thread(IoThread& io);
     
     /**
      * Accept new connections.
@@ -163,6 +324,22 @@ private:
      * Remove closed connections from the list.
      */
     void cleanup_connections();
+    
+    /**
+     * Accept every pending connection on the listening socket and
+     * register each one with the event loop.
+     */
+    void on_accept_ready(IoThread& io);
+    
+    /**
+     * Dispatch an event for a registered client connection.
+     */
+    void on_client_event(IoThread& io, uint64_t conn_id, EventType event);
+    
+    /**
+     * Remove a client from the event loop and close it.
+     */
+    void close_client(IoThread& io, uint64_t conn_id, ClientConnection* client);
 };
 
 } // namespace scuffedredis
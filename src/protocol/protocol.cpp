@@ -1,6 +1,9 @@
 #include "protocol.hpp"
 #include <cstring>
 #include <algorithm>
+#include <array>
+#include <charconv>
+#include <cmath>
 
 namespace scuffedredis {
 namespace protocol {
@@ -37,6 +40,12 @@ MessagePtr Message::make_array(const MessageArray& array) {
     return msg;
 }
 
+MessagePtr Message::make_array(MessageArray&& array) {
+    auto msg = std::make_shared<Message>(MessageType::ARRAY);
+    msg->value_ = std::move(array);
+    return msg;
+}
+
 MessagePtr Message::make_null() {
     return std::make_shared<Message>(MessageType::NULL_VALUE);
 }
@@ -64,292 +73,809 @@ const MessageArray* Message::as_array() const {
 
 std::vector<uint8_t> Message::serialize() const {
     std::vector<uint8_t> result;
-    
-    // Add type byte
-    result.push_back(static_cast<uint8_t>(type_));
+    ResponseWriter(result).message(*this);
+    return result;
+}
+
+size_t Message::serialized_size() const {
+    // Type (1) + Length (4) + Data
+    size_t size = 5;
     
     switch (type_) {
         case MessageType::SIMPLE_STRING:
         case MessageType::ERROR_MSG:
-        case MessageType::BULK_STRING: {
-            const std::string& str = as_string();
-            uint32_t len = static_cast<uint32_t>(str.size());
-            
-            // Add length (4 bytes, little-endian)
-            result.push_back(len & 0xFF);
-            result.push_back((len >> 8) & 0xFF);
-            result.push_back((len >> 16) & 0xFF);
-            result.push_back((len >> 24) & 0xFF);
-            
-            // Add string data
-            result.insert(result.end(), str.begin(), str.end());
-            break;
-        }
-        
-        case MessageType::INTEGER: {
-            int64_t val = as_integer();
-            
-            // Length is always 8 for int64
-            uint32_t len = 8;
-            result.push_back(len & 0xFF);
-            result.push_back((len >> 8) & 0xFF);
-            result.push_back((len >> 16) & 0xFF);
-            result.push_back((len >> 24) & 0xFF);
-            
-            // Add integer value (8 bytes, little-endian)
-            for (int i = 0; i < 8; i++) {
-                result.push_back((val >> (i * 8)) & 0xFF);
+        case MessageType::BULK_STRING:
+            if (auto* str = std::get_if<std::string>(&value_)) {
+                size += str->size();
             }
             break;
-        }
-        
-        case MessageType::ARRAY: {
-            auto arr = as_array();
-            uint32_t count = arr ? static_cast<uint32_t>(arr->size()) : 0;
             
-            // Add array count as length
-            result.push_back(count & 0xFF);
-            result.push_back((count >> 8) & 0xFF);
-            result.push_back((count >> 16) & 0xFF);
-            result.push_back((count >> 24) & 0xFF);
+        case MessageType::INTEGER:
+            size += 8;  // int64_t
+            break;
             
-            // Recursively serialize each element
-            if (arr) {
+        case MessageType::ARRAY:
+            if (auto arr = as_array()) {
                 for (const auto& elem : *arr) {
-                    if (elem) {
-                        auto elem_data = elem->serialize();
-                        result.insert(result.end(), elem_data.begin(), elem_data.end());
-                    } else {
-                        // Null element - serialize as NULL_VALUE
-                        auto null_msg = make_null();
-                        auto null_data = null_msg->serialize();
-                        result.insert(result.end(), null_data.begin(), null_data.end());
-                    }
+                    size += elem ? elem->serialized_size() : 5;  // NULL is 5 bytes
                 }
             }
             break;
-        }
-        
-        case MessageType::NULL_VALUE: {
-            // Length is 0 for null
-            result.push_back(0);
-            result.push_back(0);
-            result.push_back(0);
-            result.push_back(0);
+            
+        case MessageType::NULL_VALUE:
+            // Already included in header
             break;
+    }
+    
+    return size;
+}
+
+// ResponseWriter Implementation
+
+namespace {
+
+constexpr size_t REPLY_COUNT = static_cast<size_t>(Reply::WRONG_TYPE) + 1;
+using ReplyTable = std::array<std::string, REPLY_COUNT>;
+
+// Encode every Reply the slow way; only used to build the tables below
+ReplyTable encode_replies(Protocol protocol) {
+    ReplyTable table;
+    for (size_t i = 0; i < REPLY_COUNT; i++) {
+        std::vector<uint8_t> bytes;
+        ResponseWriter writer(bytes, protocol);
+        switch (static_cast<Reply>(i)) {
+            case Reply::OK:                  writer.simple_string("OK"); break;
+            case Reply::PONG:                writer.simple_string("PONG"); break;
+            case Reply::NIL:                 writer.null(); break;
+            case Reply::EMPTY_ARRAY:         writer.array_header(0); break;
+            case Reply::ERR_INVALID_COMMAND: writer.error("ERR invalid command format"); break;
+            case Reply::ERR_PROTOCOL:        writer.error("ERR protocol error"); break;
+            case Reply::ERR_INTERNAL:        writer.error("ERR internal error"); break;
+            case Reply::ERR_SYNTAX:          writer.error("ERR syntax error"); break;
+            case Reply::WRONG_TYPE:
+                writer.error("WRONGTYPE Operation against a key holding the wrong kind of value");
+                break;
         }
+        table[i] = std::string(bytes.begin(), bytes.end());
+    }
+    return table;
+}
+
+// Pre-encoded bytes for each Reply in each protocol, built on first use
+const std::string& encoded_reply(Protocol protocol, Reply reply) {
+    static const ReplyTable tables[] = {
+        encode_replies(Protocol::BINARY),
+        encode_replies(Protocol::RESP2),
+        encode_replies(Protocol::RESP3)
+    };
+    size_t index = protocol == Protocol::RESP3 ? 2 : protocol == Protocol::RESP2 ? 1 : 0;
+    return tables[index][static_cast<size_t>(reply)];
+}
+
+} // namespace
+
+void ResponseWriter::ensure(size_t bytes) {
+    // Grow geometrically so a long run of small replies stays linear
+    if (out_.capacity() - out_.size() < bytes) {
+        out_.reserve(std::max(out_.capacity() * 2, out_.size() + bytes));
+    }
+}
+
+void ResponseWriter::header(MessageType type, uint32_t length) {
+    // Type byte, then length (4 bytes, little-endian)
+    uint8_t bytes[5] = {
+        static_cast<uint8_t>(type),
+        static_cast<uint8_t>(length & 0xFF),
+        static_cast<uint8_t>((length >> 8) & 0xFF),
+        static_cast<uint8_t>((length >> 16) & 0xFF),
+        static_cast<uint8_t>((length >> 24) & 0xFF)
+    };
+    out_.insert(out_.end(), bytes, bytes + 5);
+}
+
+void ResponseWriter::resp_line(char prefix, std::string_view text) {
+    ensure(text.size() + 3);
+    out_.push_back(static_cast<uint8_t>(prefix));
+    for (char c : text) {
+        // A line can't contain its own terminator
+        out_.push_back(static_cast<uint8_t>(c == '\r' || c == '\n' ? ' ' : c));
+    }
+    out_.push_back('\r');
+    out_.push_back('\n');
+}
+
+void ResponseWriter::resp_number(char prefix, int64_t value) {
+    char line[24];
+    line[0] = prefix;
+    char* end = std::to_chars(line + 1, line + sizeof(line) - 2, value).ptr;
+    *end++ = '\r';
+    *end++ = '\n';
+    ensure(end - line);
+    out_.insert(out_.end(), line, end);
+}
+
+void ResponseWriter::simple_string(std::string_view str) {
+    if (is_resp()) {
+        resp_line('+', str);
+        return;
+    }
+    ensure(5 + str.size());
+    header(MessageType::SIMPLE_STRING, static_cast<uint32_t>(str.size()));
+    out_.insert(out_.end(), str.begin(), str.end());
+}
+
+void ResponseWriter::error(std::string_view message) {
+    if (is_resp()) {
+        resp_line('-', message);
+        return;
+    }
+    ensure(5 + message.size());
+    header(MessageType::ERROR_MSG, static_cast<uint32_t>(message.size()));
+    out_.insert(out_.end(), message.begin(), message.end());
+}
+
+void ResponseWriter::bulk_string(std::string_view str) {
+    if (is_resp()) {
+        // $<length>\r\n<data>\r\n
+        ensure(str.size() + 16);
+        resp_number('$', static_cast<int64_t>(str.size()));
+        out_.insert(out_.end(), str.begin(), str.end());
+        out_.push_back('\r');
+        out_.push_back('\n');
+        return;
+    }
+    ensure(5 + str.size());
+    header(MessageType::BULK_STRING, static_cast<uint32_t>(str.size()));
+    out_.insert(out_.end(), str.begin(), str.end());
+}
+
+void ResponseWriter::integer(int64_t value) {
+    if (is_resp()) {
+        resp_number(':', value);
+        return;
     }
     
-    return result;
+    // Length is always 8 for int64, value is little-endian
+    uint8_t bytes[8];
+    for (int i = 0; i < 8; i++) {
+        bytes[i] = static_cast<uint8_t>((static_cast<uint64_t>(value) >> (i * 8)) & 0xFF);
+    }
+    ensure(5 + 8);
+    header(MessageType::INTEGER, 8);
+    out_.insert(out_.end(), bytes, bytes + 8);
 }
 
-size_t Message::serialized_size() const {
-    // Type (1) + Length (4) + Data
-    size_t size = 5;
+void ResponseWriter::double_value(double value) {
+    char text[32];
+    size_t length;
+    if (std::isinf(value)) {
+        length = value > 0 ? 3 : 4;
+        std::memcpy(text, value > 0 ? "inf" : "-inf", length);
+    } else {
+        length = std::to_chars(text, text + sizeof(text), value).ptr - text;
+    }
     
-    switch (type_) {
+    if (protocol_ == Protocol::RESP3) {
+        resp_line(',', std::string_view(text, length));
+    } else {
+        bulk_string(std::string_view(text, length));
+    }
+}
+
+void ResponseWriter::null() {
+    if (protocol_ == Protocol::RESP3) {
+        resp_line('_', "");
+    } else if (protocol_ == Protocol::RESP2) {
+        resp_number('$', -1);  // Null bulk string
+    } else {
+        header(MessageType::NULL_VALUE, 0);
+    }
+}
+
+void ResponseWriter::reply(Reply reply) {
+    const std::string& bytes = encoded_reply(protocol_, reply);
+    ensure(bytes.size());
+    out_.insert(out_.end(), bytes.begin(), bytes.end());
+}
+
+void ResponseWriter::array_header(uint32_t count) {
+    if (is_resp()) {
+        resp_number('*', count);
+        return;
+    }
+    header(MessageType::ARRAY, count);
+}
+
+void ResponseWriter::map_header(uint32_t pairs) {
+    if (protocol_ == Protocol::RESP3) {
+        resp_number('%', pairs);
+        return;
+    }
+    array_header(pairs * 2);
+}
+
+void ResponseWriter::push_header(uint32_t count) {
+    if (protocol_ == Protocol::RESP3) {
+        resp_number('>', count);
+        return;
+    }
+    array_header(count);
+}
+
+void ResponseWriter::message(const Message& msg) {
+    // The binary size is exact for binary and close enough for RESP
+    ensure(msg.serialized_size());
+    write_message(msg);
+}
+
+void ResponseWriter::write_message(const Message& msg) {
+    const auto& value = msg.get_value();
+    
+    switch (msg.get_type()) {
         case MessageType::SIMPLE_STRING:
         case MessageType::ERROR_MSG:
-        case MessageType::BULK_STRING:
-            size += as_string().size();
+        case MessageType::BULK_STRING: {
+            const std::string* str = std::get_if<std::string>(&value);
+            std::string_view data = str ? std::string_view(*str) : std::string_view();
+            if (msg.get_type() == MessageType::SIMPLE_STRING) {
+                simple_string(data);
+            } else if (msg.get_type() == MessageType::ERROR_MSG) {
+                error(data);
+            } else {
+                bulk_string(data);
+            }
             break;
-            
+        }
+        
         case MessageType::INTEGER:
-            size += 8;  // int64_t
+            integer(msg.as_integer());
             break;
-            
-        case MessageType::ARRAY:
-            if (auto arr = as_array()) {
+        
+        case MessageType::ARRAY: {
+            auto arr = msg.as_array();
+            array_header(arr ? static_cast<uint32_t>(arr->size()) : 0);
+            if (arr) {
                 for (const auto& elem : *arr) {
-                    size += elem ? elem->serialized_size() : 5;  // NULL is 5 bytes
+                    if (elem) {
+                        write_message(*elem);
+                    } else {
+                        // Null element - serialize as NULL_VALUE
+                        null();
+                    }
                 }
             }
             break;
-            
+        }
+        
         case MessageType::NULL_VALUE:
-            // Already included in header
+            null();
             break;
     }
+}
+
+// Command Implementation
+
+Command::Command(std::initializer_list<std::string_view> args) : argc_(0) {
+    for (std::string_view arg : args) {
+        push_back(arg);
+    }
+}
+
+Command::Command(const std::vector<std::string>& args) : argc_(0) {
+    for (const auto& arg : args) {
+        push_back(arg);
+    }
+}
+
+void Command::push_back(std::string_view arg) {
+    if (argc_ < INLINE_ARGS) {
+        inline_[argc_++] = arg;
+        return;
+    }
     
-    return size;
+    if (argc_ == INLINE_ARGS) {
+        // Spill: keep every argument contiguous in the vector from now on
+        overflow_.assign(inline_, inline_ + INLINE_ARGS);
+    }
+    overflow_.push_back(arg);
+    argc_++;
+}
+
+void Command::clear() {
+    argc_ = 0;
+    overflow_.clear();
+}
+
+std::vector<std::string> Command::to_strings() const {
+    return std::vector<std::string>(begin(), end());
 }
 
 // Parser Implementation
 
-Parser::Parser() {
-    buffer_.reserve(4096);  // Reserve initial space for efficiency
+namespace {
+
+// Little-endian length field of a header starting at p
+inline uint32_t read_length(const uint8_t* p) {
+    return static_cast<uint32_t>(p[1]) |
+           static_cast<uint32_t>(p[2]) << 8 |
+           static_cast<uint32_t>(p[3]) << 16 |
+           static_cast<uint32_t>(p[4]) << 24;
+}
+
+constexpr size_t HEADER_SIZE = 5;
+
+// RESP limits, as in Redis: longest line without a newline, most
+// arguments per command, longest argument
+constexpr size_t MAX_INLINE_SIZE = 64 * 1024;
+constexpr int64_t MAX_MULTIBULK_LENGTH = 1024 * 1024;
+constexpr int64_t MAX_BULK_LENGTH = 512 * 1024 * 1024;
+
+inline bool is_inline_space(uint8_t c) {
+    return c == ' ' || c == '\t';
+}
+
+} // namespace
+
+Parser::Parser(Protocol protocol)
+    : read_pos_(0),
+      parse_pos_(0),
+      end_(0),
+      command_started_(false),
+      command_invalid_(false),
+      command_remaining_(0),
+      bulk_length_(-1),
+      protocol_(protocol),
+      mode_(Mode::NONE) {
+    buffer_.resize(4096);  // Reserve initial space for efficiency
 }
 
 Parser::~Parser() = default;
 
 void Parser::feed(const uint8_t* data, size_t size) {
-    buffer_.insert(buffer_.end(), data, data + size);
+    if (size == 0) {
+        return;
+    }
+    std::memcpy(prepare(size), data, size);
+    commit(size);
 }
 
 void Parser::feed(const std::vector<uint8_t>& data) {
     feed(data.data(), data.size());
 }
 
-bool Parser::has_message() const {
-    // Need at least 5 bytes for header (type + length)
-    if (buffer_.size() < 5) {
-        return false;
+uint8_t* Parser::prepare(size_t size) {
+    if (buffer_.size() - end_ < size && read_pos_ > 0) {
+        // Reclaim consumed space; only the unparsed tail moves. Offsets
+        // into the current message are relative to read_pos_ and survive.
+        size_t unconsumed = end_ - read_pos_;
+        if (unconsumed > 0) {
+            std::memmove(buffer_.data(), buffer_.data() + read_pos_, unconsumed);
+        }
+        parse_pos_ -= read_pos_;
+        end_ = unconsumed;
+        read_pos_ = 0;
     }
     
-    // Read length to check if we have complete message
-    uint32_t length = 0;
-    length |= buffer_[1];
-    length |= buffer_[2] << 8;
-    length |= buffer_[3] << 16;
-    length |= buffer_[4] << 24;
-    
-    // Check if it's an array (special case)
-    MessageType type = static_cast<MessageType>(buffer_[0]);
-    if (type == MessageType::ARRAY) {
-        // For arrays, length is count, need to parse recursively
-        // This is a simplified check
-        return true;  // Let parse_message handle the details
+    if (buffer_.size() - end_ < size) {
+        buffer_.resize(std::max(buffer_.size() * 2, end_ + size));
     }
     
-    // Check if we have the complete message
-    return buffer_.size() >= 5 + length;
+    return buffer_.data() + end_;
 }
 
-MessagePtr Parser::parse_message() {
-    MessageType type;
-    uint32_t length;
-    
-    if (!read_header(type, length)) {
-        return nullptr;
+void Parser::commit(size_t size) {
+    end_ += std::min(size, buffer_.size() - end_);
+}
+
+bool Parser::read_header(size_t pos, MessageType& type, uint32_t& length) const {
+    if (!has_bytes(pos, HEADER_SIZE)) {
+        return false;
     }
     
+    type = static_cast<MessageType>(buffer_[pos]);
+    length = read_length(buffer_.data() + pos);
+    return true;
+}
+
+size_t Parser::value_size(MessageType type, uint32_t length) {
     switch (type) {
         case MessageType::SIMPLE_STRING:
-            return parse_simple_string(length);
-            
         case MessageType::ERROR_MSG:
-            return parse_error(length);
-            
-        case MessageType::INTEGER:
-            return parse_integer(length);
-            
         case MessageType::BULK_STRING:
-            return parse_bulk_string(length);
+            return HEADER_SIZE + length;
             
-        case MessageType::ARRAY:
-            return parse_array(length);  // length is count for arrays
+        case MessageType::INTEGER:
+            return length == 8 ? HEADER_SIZE + 8 : 0;
             
         case MessageType::NULL_VALUE:
-            consume_bytes(5);  // Just the header
-            return Message::make_null();
+            return HEADER_SIZE;
             
         default:
-            // Unknown type, clear buffer to recover
-            reset();
-            return nullptr;
+            return 0;  // Arrays are handled by the callers
     }
 }
 
-bool Parser::read_header(MessageType& type, uint32_t& length) {
-    if (!has_bytes(5)) {
-        return false;
+void Parser::switch_mode(Mode mode) {
+    if (mode_ != mode && parse_pos_ != read_pos_) {
+        // Progress belongs to the other method - parse this message again
+        parse_pos_ = read_pos_;
+        frames_.clear();
+        command_started_ = false;
+        bulk_length_ = -1;
+    }
+    mode_ = mode;
+}
+
+void Parser::consume_message() {
+    read_pos_ = parse_pos_;
+    if (read_pos_ == end_) {
+        // Everything consumed: start over at the front for free
+        read_pos_ = parse_pos_ = end_ = 0;
+    }
+}
+
+bool Parser::has_message() const {
+    // Walk headers from the message start, counting values still owed
+    size_t pos = read_pos_;
+    uint64_t remaining = 1;
+    
+    while (remaining > 0) {
+        MessageType type;
+        uint32_t length;
+        if (!read_header(pos, type, length)) {
+            return false;
+        }
+        
+        if (type == MessageType::ARRAY) {
+            pos += HEADER_SIZE;
+            remaining += length;
+        } else {
+            size_t size = value_size(type, length);
+            if (size == 0) {
+                return true;  // Corrupt; let parsing report it
+            }
+            if (!has_bytes(pos, size)) {
+                return false;
+            }
+            pos += size;
+        }
+        remaining--;
     }
-    
-    type = static_cast<MessageType>(buffer_[0]);
-    
-    // Read length (little-endian)
-    length = 0;
-    length |= buffer_[1];
-    length |= buffer_[2] << 8;
-    length |= buffer_[3] << 16;
-    length |= buffer_[4] << 24;
     
     return true;
 }
 
-MessagePtr Parser::parse_simple_string(uint32_t length) {
-    if (!has_bytes(5 + length)) {
-        return nullptr;
+MessagePtr Parser::parse_message() {
+    switch_mode(Mode::MESSAGE);
+    
+    while (true) {
+        MessageType type;
+        uint32_t length;
+        if (!read_header(parse_pos_, type, length)) {
+            return nullptr;
+        }
+        
+        const uint8_t* data = buffer_.data() + parse_pos_ + HEADER_SIZE;
+        MessagePtr value;
+        
+        if (type == MessageType::ARRAY) {
+            parse_pos_ += HEADER_SIZE;
+            if (length > 0) {
+                // Elements are collected as they arrive; the array is
+                // built once its last element is parsed
+                frames_.push_back(Frame{MessageArray(), length});
+                frames_.back().items.reserve(std::min<uint32_t>(length, 1024));
+                continue;
+            }
+            value = Message::make_array(MessageArray());
+        } else {
+            size_t size = value_size(type, length);
+            if (size == 0) {
+                // Unknown type, clear buffer to recover
+                reset();
+                return nullptr;
+            }
+            if (!has_bytes(parse_pos_, size)) {
+                return nullptr;
+            }
+            
+            std::string str(reinterpret_cast<const char*>(data), size - HEADER_SIZE);
+            switch (type) {
+                case MessageType::SIMPLE_STRING:
+                    value = Message::make_simple_string(str);
+                    break;
+                case MessageType::ERROR_MSG:
+                    value = Message::make_error(str);
+                    break;
+                case MessageType::BULK_STRING:
+                    value = Message::make_bulk_string(str);
+                    break;
+                case MessageType::INTEGER: {
+                    // Read int64_t (little-endian)
+                    uint64_t bits = 0;
+                    for (int i = 0; i < 8; i++) {
+                        bits |= static_cast<uint64_t>(data[i]) << (i * 8);
+                    }
+                    value = Message::make_integer(static_cast<int64_t>(bits));
+                    break;
+                }
+                default:
+                    value = Message::make_null();
+                    break;
+            }
+            parse_pos_ += size;
+        }
+        
+        // Close every array this value completes
+        while (!frames_.empty()) {
+            Frame& frame = frames_.back();
+            frame.items.push_back(std::move(value));
+            if (--frame.remaining > 0) {
+                break;
+            }
+            value = Message::make_array(std::move(frame.items));
+            frames_.pop_back();
+        }
+        
+        if (frames_.empty()) {
+            consume_message();
+            mode_ = Mode::NONE;
+            return value;
+        }
     }
+}
+
+Parser::Result Parser::parse_command(Command& args) {
+    switch_mode(Mode::COMMAND);
     
-    std::string str(buffer_.begin() + 5, buffer_.begin() + 5 + length);
-    consume_bytes(5 + length);
+    if (protocol_ == Protocol::AUTO) {
+        if (!has_bytes(parse_pos_, 1)) {
+            return Result::INCOMPLETE;
+        }
+        uint8_t first = buffer_[parse_pos_];
+        bool binary = first >= static_cast<uint8_t>(MessageType::SIMPLE_STRING) &&
+                      first <= static_cast<uint8_t>(MessageType::NULL_VALUE);
+        protocol_ = binary ? Protocol::BINARY : Protocol::RESP2;
+    }
     
-    return Message::make_simple_string(str);
+    return protocol_ == Protocol::BINARY ? parse_binary_command(args)
+                                         : parse_resp_command(args);
 }
 
-MessagePtr Parser::parse_error(uint32_t length) {
-    if (!has_bytes(5 + length)) {
-        return nullptr;
+Parser::Result Parser::parse_binary_command(Command& args) {
+    if (!command_started_) {
+        MessageType type;
+        uint32_t length;
+        if (!read_header(parse_pos_, type, length)) {
+            return Result::INCOMPLETE;
+        }
+        
+        arg_spans_.clear();
+        command_started_ = true;
+        if (type == MessageType::ARRAY) {
+            parse_pos_ += HEADER_SIZE;
+            command_remaining_ = length;
+            command_invalid_ = (length == 0);
+        } else {
+            // A lone value: skip it like an array element
+            command_remaining_ = 1;
+            command_invalid_ = true;
+        }
     }
     
-    std::string str(buffer_.begin() + 5, buffer_.begin() + 5 + length);
-    consume_bytes(5 + length);
+    while (command_remaining_ > 0) {
+        MessageType type;
+        uint32_t length;
+        if (!read_header(parse_pos_, type, length)) {
+            return Result::INCOMPLETE;
+        }
+        
+        if (type == MessageType::ARRAY) {
+            // Nested arrays make it invalid, but their values still
+            // have to be skipped
+            parse_pos_ += HEADER_SIZE;
+            command_remaining_ += length;
+            command_invalid_ = true;
+        } else {
+            size_t size = value_size(type, length);
+            if (size == 0) {
+                reset();
+                return Result::PROTOCOL_ERROR;
+            }
+            if (!has_bytes(parse_pos_, size)) {
+                return Result::INCOMPLETE;
+            }
+            
+            if (type == MessageType::SIMPLE_STRING || type == MessageType::BULK_STRING) {
+                if (!command_invalid_) {
+                    arg_spans_.emplace_back(parse_pos_ + HEADER_SIZE - read_pos_, length);
+                }
+            } else {
+                command_invalid_ = true;
+            }
+            parse_pos_ += size;
+        }
+        command_remaining_--;
+    }
     
-    return Message::make_error(str);
+    return finish_command(args);
 }
 
-MessagePtr Parser::parse_integer(uint32_t length) {
-    if (length != 8 || !has_bytes(5 + 8)) {
-        return nullptr;
+Parser::Result Parser::parse_resp_command(Command& args) {
+    while (!command_started_) {
+        if (!has_bytes(parse_pos_, 1)) {
+            return Result::INCOMPLETE;
+        }
+        
+        // Anything but a multibulk array is an inline command
+        if (buffer_[parse_pos_] != '*') {
+            Result result = parse_inline_command(args);
+            if (result == Result::INVALID) {
+                continue;  // Blank line
+            }
+            return result;
+        }
+        
+        size_t line_end = find_line_end(parse_pos_);
+        if (line_end == SIZE_MAX) {
+            return incomplete_line();
+        }
+        
+        int64_t count;
+        if (!read_resp_number(parse_pos_ + 1, line_end, count) || count > MAX_MULTIBULK_LENGTH) {
+            reset();
+            return Result::PROTOCOL_ERROR;
+        }
+        parse_pos_ = line_end + 1;
+        
+        if (count <= 0) {
+            // Empty and null arrays are ignored, as in Redis
+            consume_message();
+            continue;
+        }
+        
+        arg_spans_.clear();
+        command_started_ = true;
+        command_invalid_ = false;
+        command_remaining_ = static_cast<uint64_t>(count);
+        bulk_length_ = -1;
     }
     
-    // Read int64_t (little-endian)
-    int64_t value = 0;
-    for (int i = 0; i < 8; i++) {
-        value |= static_cast<int64_t>(buffer_[5 + i]) << (i * 8);
+    while (command_remaining_ > 0) {
+        if (bulk_length_ < 0) {
+            // Every argument is a bulk string: $<length>\r\n
+            if (!has_bytes(parse_pos_, 1)) {
+                return Result::INCOMPLETE;
+            }
+            
+            if (buffer_[parse_pos_] != '$') {
+                reset();
+                return Result::PROTOCOL_ERROR;
+            }
+            
+            size_t line_end = find_line_end(parse_pos_);
+            if (line_end == SIZE_MAX) {
+                return incomplete_line();
+            }
+            
+            int64_t length;
+            if (!read_resp_number(parse_pos_ + 1, line_end, length) ||
+                length < 0 || length > MAX_BULK_LENGTH) {
+                reset();
+                return Result::PROTOCOL_ERROR;
+            }
+            parse_pos_ = line_end + 1;
+            bulk_length_ = length;
+        }
+        
+        size_t length = static_cast<size_t>(bulk_length_);
+        if (!has_bytes(parse_pos_, length + 2)) {
+            return Result::INCOMPLETE;
+        }
+        if (buffer_[parse_pos_ + length] != '\r' || buffer_[parse_pos_ + length + 1] != '\n') {
+            reset();
+            return Result::PROTOCOL_ERROR;
+        }
+        
+        arg_spans_.emplace_back(parse_pos_ - read_pos_, length);
+        parse_pos_ += length + 2;
+        bulk_length_ = -1;
+        command_remaining_--;
     }
     
-    consume_bytes(5 + 8);
-    return Message::make_integer(value);
+    return finish_command(args);
 }
 
-MessagePtr Parser::parse_bulk_string(uint32_t length) {
-    if (!has_bytes(5 + length)) {
-        return nullptr;
+Parser::Result Parser::parse_inline_command(Command& args) {
+    size_t line_end = find_line_end(parse_pos_);
+    if (line_end == SIZE_MAX) {
+        return incomplete_line();
     }
     
-    std::string str(buffer_.begin() + 5, buffer_.begin() + 5 + length);
-    consume_bytes(5 + length);
+    size_t end = line_end;
+    if (end > parse_pos_ && buffer_[end - 1] == '\r') {
+        end--;
+    }
     
-    return Message::make_bulk_string(str);
+    // Split on spaces and tabs (no quoting)
+    arg_spans_.clear();
+    size_t pos = parse_pos_;
+    while (pos < end) {
+        while (pos < end && is_inline_space(buffer_[pos])) {
+            pos++;
+        }
+        size_t start = pos;
+        while (pos < end && !is_inline_space(buffer_[pos])) {
+            pos++;
+        }
+        if (pos > start) {
+            arg_spans_.emplace_back(start - read_pos_, pos - start);
+        }
+    }
+    parse_pos_ = line_end + 1;
+    
+    if (arg_spans_.empty()) {
+        consume_message();
+        return Result::INVALID;
+    }
+    
+    command_invalid_ = false;
+    return finish_command(args);
 }
 
-MessagePtr Parser::parse_array(uint32_t count) {
-    // Consume array header
-    consume_bytes(5);
-    
-    MessageArray array;
-    array.reserve(count);
-    
-    // Parse each element
-    for (uint32_t i = 0; i < count; i++) {
-        auto elem = parse_message();
-        if (!elem) {
-            // Not enough data, restore buffer
-            // This is simplified - proper implementation would track position
-            return nullptr;
+Parser::Result Parser::finish_command(Command& args) {
+    // Views are taken before consuming; consuming never moves data
+    args.clear();
+    if (!command_invalid_) {
+        const char* base = reinterpret_cast<const char*>(buffer_.data() + read_pos_);
+        for (const auto& span : arg_spans_) {
+            args.push_back(std::string_view(base + span.first, span.second));
         }
-        array.push_back(elem);
     }
     
-    return Message::make_array(array);
+    bool invalid = command_invalid_;
+    command_started_ = false;
+    mode_ = Mode::NONE;
+    consume_message();
+    
+    return invalid ? Result::INVALID : Result::COMMAND;
 }
 
-void Parser::consume_bytes(size_t count) {
-    if (count >= buffer_.size()) {
-        buffer_.clear();
-    } else {
-        buffer_.erase(buffer_.begin(), buffer_.begin() + count);
+size_t Parser::find_line_end(size_t pos) const {
+    const void* newline = std::memchr(buffer_.data() + pos, '\n', end_ - pos);
+    if (!newline) {
+        return SIZE_MAX;
+    }
+    return static_cast<const uint8_t*>(newline) - buffer_.data();
+}
+
+Parser::Result Parser::incomplete_line() {
+    // No newline yet: wait for it, unless the line is already too long
+    if (end_ - parse_pos_ > MAX_INLINE_SIZE) {
+        reset();
+        return Result::PROTOCOL_ERROR;
     }
+    return Result::INCOMPLETE;
 }
 
-bool Parser::has_bytes(size_t count) const {
-    return buffer_.size() >= count;
+bool Parser::read_resp_number(size_t pos, size_t line_end, int64_t& value) const {
+    // Header lines must end in \r\n
+    if (line_end <= pos || buffer_[line_end - 1] != '\r') {
+        return false;
+    }
+    
+    const char* begin = reinterpret_cast<const char*>(buffer_.data() + pos);
+    const char* end = reinterpret_cast<const char*>(buffer_.data() + line_end - 1);
+    auto result = std::from_chars(begin, end, value);
+    return result.ec == std::errc() && result.ptr == end;
 }
 
 void Parser::reset() {
-    buffer_.clear();
+    read_pos_ = parse_pos_ = end_ = 0;
+    frames_.clear();
+    command_started_ = false;
+    bulk_length_ = -1;
+    mode_ = Mode::NONE;
 }
 
 // Protocol Utilities
@@ -4,12 +4,19 @@
 // ScuffedRedis Binary Protocol
 // Format: [Type:1][Length:4][Data:N]
 // Types: String(1), Error(2), Integer(3), BulkString(4), Array(5), Null(6)
+//
+// Servers also speak RESP (the Redis protocol) so standard clients and
+// tools can connect: a connection's first byte tells them apart, since
+// binary type bytes are all below any character RESP starts with.
 
 #include <cstdint>
 #include <string>
 #include <vector>
 #include <memory>
 #include <variant>
+#include <string_view>
+#include <initializer_list>
+#include <algorithm>
 
 namespace scuffedredis {
 namespace protocol {
@@ -23,6 +30,16 @@ enum class MessageType : uint8_t {
     NULL_VALUE = 0x06
 };
 
+/**
+ * Wire protocol spoken on a connection.
+ */
+enum class Protocol : uint8_t {
+    AUTO,    // Not known yet; decided by the first byte received
+    BINARY,  // [Type:1][Length:4][Data:N] framing above
+    RESP2,   // Redis protocol, version 2
+    RESP3    // RESP2 plus distinct null and map types (after HELLO 3)
+};
+
 // Forward declarations
 class Message;
 using MessagePtr = std::shared_ptr<Message>;
@@ -50,6 +67,7 @@ public:
     static MessagePtr make_integer(int64_t value);
     static MessagePtr make_bulk_string(const std::string& str);
     static MessagePtr make_array(const MessageArray& array);
+    static MessagePtr make_array(MessageArray&& array);
     static MessagePtr make_null();
     
     // Getters
@@ -85,15 +103,186 @@ private:
     void set_value(const Value& val) { value_ = val; }
 };
 
+/**
+ * Replies common enough to be encoded once and copied as raw bytes.
+ */
+enum class Reply {
+    OK,                   // +OK
+    PONG,                 // +PONG
+    NIL,                  // Null
+    EMPTY_ARRAY,          // Array of 0 elements
+    ERR_INVALID_COMMAND,  // -ERR invalid command format
+    ERR_PROTOCOL,         // -ERR protocol error
+    ERR_INTERNAL,         // -ERR internal error
+    ERR_SYNTAX,           // -ERR syntax error
+    WRONG_TYPE            // -WRONGTYPE Operation against a key holding the wrong kind of value
+};
+
+/**
+ * Appends encoded replies to an output buffer (normally a connection's).
+ * 
+ * Each write knows its encoded size up front, so the buffer grows at
+ * most once per reply and nothing is built on the side. Writing strings,
+ * integers and pre-encoded replies never allocates beyond that growth.
+ * Replies are encoded in the connection's protocol (AUTO means binary).
+ */
+class ResponseWriter {
+public:
+    explicit ResponseWriter(std::vector<uint8_t>& out, Protocol protocol = Protocol::BINARY)
+        : out_(out), protocol_(protocol) {}
+    
+    Protocol protocol() const { return protocol_; }
+    
+    void simple_string(std::string_view str);
+    void error(std::string_view message);
+    void integer(int64_t value);
+    void bulk_string(std::string_view str);
+    
+    /**
+     * A floating point number, in its shortest round-trip form ("inf" and
+     * "-inf" for infinities). RESP3 has a double type; elsewhere it is a
+     * bulk string, as Redis sends scores.
+     */
+    void double_value(double value);
+    
+    void null();
+    void reply(Reply reply);
+    
+    /**
+     * Start an array; the next `count` writes are its elements.
+     */
+    void array_header(uint32_t count);
+    
+    /**
+     * Start a map of `pairs` key/value pairs; the next 2 * pairs writes
+     * are its keys and values. Only RESP3 has a map type - elsewhere it
+     * is a flat array of keys and values.
+     */
+    void map_header(uint32_t pairs);
+    
+    /**
+     * Start an out-of-band message of `count` elements, such as a
+     * pub/sub message. RESP3 marks these as push data so they can't be
+     * taken for a reply; elsewhere they are plain arrays.
+     */
+    void push_header(uint32_t count);
+    
+    /**
+     * Encode a whole message tree in one pass.
+     */
+    void message(const Message& msg);
+    
+    /**
+     * Bytes in the output buffer, and dropping back to an earlier size
+     * (e.g. to discard a reply that failed half way).
+     */
+    size_t size() const { return out_.size(); }
+    void truncate(size_t size) { out_.resize(std::min(size, out_.size())); }
+
+private:
+    std::vector<uint8_t>& out_;
+    Protocol protocol_;
+    
+    bool is_resp() const {
+        return protocol_ == Protocol::RESP2 || protocol_ == Protocol::RESP3;
+    }
+    
+    void ensure(size_t bytes);
+    void header(MessageType type, uint32_t length);
+    void write_message(const Message& msg);
+    
+    /**
+     * RESP framing: "<prefix><text>\r\n" and "<prefix><number>\r\n".
+     */
+    void resp_line(char prefix, std::string_view text);
+    void resp_number(char prefix, int64_t value);
+};
+
+/**
+ * A parsed command as flat argument slices, e.g. {"SET", "key", "value"}.
+ * 
+ * Arguments are views into whatever holds the bytes - normally the
+ * connection's read buffer - so the owner must outlive the command. Up to
+ * INLINE_ARGS arguments are stored in place without touching the heap.
+ */
+class Command {
+public:
+    static constexpr size_t INLINE_ARGS = 8;
+    
+    Command() : argc_(0) {}
+    Command(std::initializer_list<std::string_view> args);
+    
+    /**
+     * View arguments owned by `args`.
+     */
+    explicit Command(const std::vector<std::string>& args);
+    
+    void push_back(std::string_view arg);
+    void clear();
+    
+    size_t argc() const { return argc_; }
+    size_t size() const { return argc_; }
+    bool empty() const { return argc_ == 0; }
+    
+    std::string_view operator[](size_t index) const { return data()[index]; }
+    const std::string_view* begin() const { return data(); }
+    const std::string_view* end() const { return data() + argc_; }
+    
+    /**
+     * Copy the arguments into owned strings (for crossing threads).
+     */
+    std::vector<std::string> to_strings() const;
+
+private:
+    std::string_view inline_[INLINE_ARGS];
+    std::vector<std::string_view> overflow_;  // All arguments once past INLINE_ARGS
+    size_t argc_;
+    
+    const std::string_view* data() const {
+        return argc_ <= INLINE_ARGS ? inline_ : overflow_.data();
+    }
+};
+
 /**
  * Protocol parser for deserializing messages.
- * Handles partial messages and buffering.
+ * 
+ * Input accumulates in one contiguous buffer and is consumed by moving a
+ * read offset forward, so a pipelined batch is never shifted per message;
+ * consumed space is reclaimed with at most one move of the unparsed tail
+ * when more room is needed. Parsing is a resumable state machine: a
+ * partially buffered message keeps its progress, so every byte is examined
+ * once however the stream is split across reads.
+ * 
+ * Commands can also be parsed from RESP - multibulk arrays of bulk
+ * strings, or whitespace separated inline commands as typed into telnet.
+ * Messages (parse_message(), has_message()) are always binary.
  */
 class Parser {
 public:
-    Parser();
+    /**
+     * Outcome of parse_command().
+     */
+    enum class Result {
+        INCOMPLETE,     // Need more data
+        COMMAND,        // A command was parsed into args
+        INVALID,        // A complete message that is not a command was skipped
+        PROTOCOL_ERROR  // Unknown type byte; buffered input was discarded
+    };
+    
+    /**
+     * protocol: how commands are framed. AUTO picks BINARY or RESP2 from
+     * the first byte received.
+     */
+    explicit Parser(Protocol protocol = Protocol::BINARY);
     ~Parser();
     
+    /**
+     * Protocol in use (AUTO until the first byte arrives). Setting RESP3
+     * only changes how replies should be encoded; requests parse the same.
+     */
+    Protocol protocol() const { return protocol_; }
+    void set_protocol(Protocol protocol) { protocol_ = protocol; }
+    
     /**
      * Feed data to the parser.
      * Data is buffered internally for partial message handling.
@@ -101,6 +290,13 @@ public:
     void feed(const uint8_t* data, size_t size);
     void feed(const std::vector<uint8_t>& data);
     
+    /**
+     * Get space for up to `size` more bytes, so a socket can read straight
+     * into the parser. Follow with commit() for the bytes actually written.
+     */
+    uint8_t* prepare(size_t size);
+    void commit(size_t size);
+    
     /**
      * Try to parse a complete message.
      * Returns nullptr if no complete message is available.
@@ -108,6 +304,14 @@ public:
      */
     MessagePtr parse_message();
     
+    /**
+     * Parse the next request as a command (an array of strings) without
+     * copying it. On COMMAND, args point into the parser's buffer and stay
+     * valid until the next feed(), prepare() or reset().
+     * Malformed RESP framing is a PROTOCOL_ERROR, as in Redis.
+     */
+    Result parse_command(Command& args);
+    
     /**
      * Check if a complete message is available.
      */
@@ -119,24 +323,90 @@ public:
     void reset();
     
     /**
-     * Get current buffer size (for debugging/monitoring).
+     * Get number of buffered bytes not yet consumed (for debugging/monitoring).
      */
-    size_t buffer_size() const { return buffer_.size(); }
+    size_t buffer_size() const { return end_ - read_pos_; }
 
 private:
-    std::vector<uint8_t> buffer_;  // Internal buffer for partial messages
-    
-    // Helper methods for parsing
-    bool read_header(MessageType& type, uint32_t& length);
-    MessagePtr parse_simple_string(uint32_t length);
-    MessagePtr parse_error(uint32_t length);
-    MessagePtr parse_integer(uint32_t length);
-    MessagePtr parse_bulk_string(uint32_t length);
-    MessagePtr parse_array(uint32_t count);
-    
-    // Buffer management
-    void consume_bytes(size_t count);
-    bool has_bytes(size_t count) const;
+    std::vector<uint8_t> buffer_;  // Storage; bytes [read_pos_, end_) are unconsumed
+    size_t read_pos_;              // Start of the message being parsed
+    size_t parse_pos_;             // Next header to read in that message
+    size_t end_;                   // End of received data
+    
+    // parse_message() state: arrays opened but not yet complete
+    struct Frame {
+        MessageArray items;
+        uint32_t remaining;
+    };
+    std::vector<Frame> frames_;
+    
+    // parse_command() state
+    bool command_started_;         // Top-level header consumed
+    bool command_invalid_;         // Message is not an array of strings
+    uint64_t command_remaining_;   // Values left to read, nested ones included
+    std::vector<std::pair<size_t, size_t>> arg_spans_;  // Offset from read_pos_, length
+    int64_t bulk_length_;          // RESP: length of the bulk string being read, or -1
+    
+    Protocol protocol_;            // Command framing (see protocol())
+    
+    // Which parse method owns the progress in the current message
+    enum class Mode { NONE, MESSAGE, COMMAND };
+    Mode mode_;
+    
+    /**
+     * Restart the current message if another parse method was mid-way.
+     */
+    void switch_mode(Mode mode);
+    
+    /**
+     * Read the header at `pos` if all 5 bytes are buffered.
+     */
+    bool read_header(size_t pos, MessageType& type, uint32_t& length) const;
+    
+    /**
+     * Bytes a non-array value occupies, header included.
+     * Returns 0 for unknown types.
+     */
+    static size_t value_size(MessageType type, uint32_t length);
+    
+    /**
+     * Finish the current message and start the next one.
+     */
+    void consume_message();
+    
+    /**
+     * Command parsing for each framing; the current message is the
+     * command. parse_inline_command() returns INVALID for a blank line,
+     * which is skipped.
+     */
+    Result parse_binary_command(Command& args);
+    Result parse_resp_command(Command& args);
+    Result parse_inline_command(Command& args);
+    
+    /**
+     * Hand out the arguments of a complete command and consume it.
+     */
+    Result finish_command(Command& args);
+    
+    /**
+     * Position of the '\n' ending the line that starts at `pos`, or
+     * SIZE_MAX if it has not arrived yet.
+     */
+    size_t find_line_end(size_t pos) const;
+    
+    /**
+     * Result for a line whose newline is missing: INCOMPLETE, or
+     * PROTOCOL_ERROR once it is too long to be valid.
+     */
+    Result incomplete_line();
+    
+    /**
+     * Read the number in a RESP header line ("*3\r\n", "$5\r\n"), from
+     * just after the prefix up to the '\n' at line_end.
+     */
+    bool read_resp_number(size_t pos, size_t line_end, int64_t& value) const;
+    
+    bool has_bytes(size_t pos, size_t count) const { return end_ - pos >= count; }
 };
 
 /**
@@ -1,6 +1,13 @@
 #include "command_handler.hpp"
+#include "pubsub.hpp"
+#include "event/event_loop.hpp"
 #include "utils/logger.hpp"
 #include <iostream>
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cstdint>
+#include <memory>
 
 namespace scuffedredis {
 
@@ -17,69 +24,253 @@ CommandHandler::~CommandHandler() {
 bool CommandHandler::handle_client(ClientConnection& client) {
     connections_handled_++;
     
-    // Get data from client's read buffer
-    const auto& buffer = client.get_read_buffer();
+    // The client's parser holds everything read so far, including any
+    // partial message until the rest of it arrives
+    protocol::Parser& parser = client.get_parser();
+    protocol::Command args;
     
-    if (buffer.empty()) {
-        return true;  // Keep connection open, no data yet
-    }
-    
-    // Feed data to protocol parser
-    parser_.feed(buffer);
-    
-    // Process all complete messages
-    bool connection_ok = true;
-    size_t messages_processed = 0;
-    
-    while (parser_.has_message()) {
-        auto request = parser_.parse_message();
+    // Process all complete messages, stopping while a reply is pending
+    // elsewhere so responses stay in request order. Replies accumulate in
+    // the output buffer; the server sends them together after the batch.
+    while (!client.is_blocked()) {
+        auto result = parser.parse_command(args);
         
-        if (!request) {
-            // Parse error - shouldn't happen if has_message() returned true
-            LOG_ERROR("Protocol parse error despite has_message() returning true");
-            errors_encountered_++;
+        if (result == protocol::Parser::Result::INCOMPLETE) {
             break;
         }
         
-        // Process request and send response
-        if (!process_request(client, request)) {
-            connection_ok = false;
-            break;
+        if (result == protocol::Parser::Result::PROTOCOL_ERROR) {
+            // Can't find the next message boundary - drop the client
+            LOG_ERROR(format_log("Protocol error from ", client.get_client_info()));
+            errors_encountered_++;
+            protocol::ResponseWriter(client.output_buffer(), client.get_protocol())
+                .reply(protocol::Reply::ERR_PROTOCOL);
+            send_output(client);
+            return false;
         }
         
-        messages_processed++;
-    }
-    
-    // Consume processed bytes from client buffer
-    // For simplicity, clear entire buffer after processing
-    // In production, would track exact bytes consumed
-    if (messages_processed > 0) {
-        client.consume_bytes(buffer.size());
+        // Not a command: an empty argument list gets the format error
+        if (result == protocol::Parser::Result::INVALID) {
+            args.clear();
+        }
+        
+        // Process request and queue response
+        if (!process_request(client, args)) {
+            return false;
+        }
+        
+        // Don't let a huge batch hold all of its replies in memory
+        if (client.pending_output() >= OUTPUT_FLUSH_THRESHOLD && !send_output(client)) {
+            return false;
+        }
     }
     
-    return connection_ok;
+    return true;
 }
 
 bool CommandHandler::process_request(ClientConnection& client, 
-                                    const protocol::MessagePtr& request) {
+                                    const protocol::Command& args) {
     requests_processed_++;
     
     // Log the request for debugging
     LOG_DEBUG(format_log("Processing request from ", client.get_client_info()));
     
-    // Execute command against KV store
-    protocol::MessagePtr response;
+    CommandId command = args.empty() ? CommandId::UNKNOWN : lookup_command(args[0]);
+    
+    // A subscribed RESP2 connection carries nothing but messages, as
+    // replies would be indistinguishable from them
+    if (client.subscriptions() > 0 && client.get_protocol() != protocol::Protocol::RESP3 &&
+        command != CommandId::SUBSCRIBE && command != CommandId::UNSUBSCRIBE &&
+        command != CommandId::PING) {
+        protocol::ResponseWriter(client.output_buffer(), client.get_protocol())
+            .error("ERR Can't execute '" + std::string(args.empty() ? "" : args[0]) +
+                   "': only SUBSCRIBE / UNSUBSCRIBE / PING are allowed in this context");
+        return client.is_connected();
+    }
+    
+    switch (command) {
+        case CommandId::HELLO:
+            handle_hello(client, args);
+            return client.is_connected();
+            
+        case CommandId::SUBSCRIBE:
+        case CommandId::UNSUBSCRIBE:
+            handle_subscribe(client, args);
+            return client.is_connected();
+            
+        case CommandId::PUBLISH:
+            handle_publish(client, args);
+            return client.is_connected();
+            
+        case CommandId::PING:
+            if (client.subscriptions() > 0 && client.get_protocol() != protocol::Protocol::RESP3) {
+                // Told apart from a message by its shape, as in Redis
+                protocol::ResponseWriter out(client.output_buffer(), client.get_protocol());
+                out.array_header(2);
+                out.bulk_string("pong");
+                out.bulk_string(args.size() >= 2 ? args[1] : std::string_view());
+                return client.is_connected();
+            }
+            break;
+            
+        default:
+            break;
+    }
+    
+    if (KVStoreManager::instance().is_sharded()) {
+        return process_sharded_request(client, args);
+    }
+    
+    // Execute command against KV store; the reply is encoded straight
+    // into the client's output buffer
+    execute_into(store_, args, client.output_buffer(), client.get_protocol());
+    
+    return client.is_connected();
+}
+
+void CommandHandler::handle_hello(ClientConnection& client, const protocol::Command& args) {
+    protocol::ResponseWriter out(client.output_buffer(), client.get_protocol());
+    
+    if (client.get_protocol() == protocol::Protocol::BINARY) {
+        out.error("NOPROTO the binary protocol has no other versions");
+        return;
+    }
+    
+    protocol::Protocol version = client.get_protocol();
+    if (args.size() >= 2) {
+        if (args[1] == "2") {
+            version = protocol::Protocol::RESP2;
+        } else if (args[1] == "3") {
+            version = protocol::Protocol::RESP3;
+        } else {
+            out.error("NOPROTO unsupported protocol version");
+            return;
+        }
+    }
+    
+    // There are no users or client names: options are checked, then ignored
+    for (size_t i = 2; i < args.size(); i++) {
+        if (command_table::equals_ignore_case(args[i], "AUTH") && i + 2 < args.size()) {
+            i += 2;
+        } else if (command_table::equals_ignore_case(args[i], "SETNAME") && i + 1 < args.size()) {
+            i += 1;
+        } else {
+            out.error("ERR Syntax error in HELLO option '" + std::string(args[i]) + "'");
+            return;
+        }
+    }
+    
+    // Subscriptions keep the protocol they were made in (see PubSub)
+    if (client.subscriptions() > 0 && version != client.get_protocol()) {
+        out.error("ERR HELLO can't change the protocol of a subscribed connection");
+        return;
+    }
+    
+    client.set_protocol(version);
+    protocol::ResponseWriter reply(client.output_buffer(), version);
+    reply.map_header(7);
+    reply.bulk_string("server");
+    reply.bulk_string("scuffedredis");
+    reply.bulk_string("version");
+    reply.bulk_string("0.1.0");
+    reply.bulk_string("proto");
+    reply.integer(version == protocol::Protocol::RESP3 ? 3 : 2);
+    reply.bulk_string("id");
+    reply.integer(static_cast<int64_t>(client.get_id()));
+    reply.bulk_string("mode");
+    reply.bulk_string("standalone");
+    reply.bulk_string("role");
+    reply.bulk_string("master");
+    reply.bulk_string("modules");
+    reply.array_header(0);
+}
+
+void CommandHandler::handle_subscribe(ClientConnection& client, const protocol::Command& args) {
+    protocol::ResponseWriter out(client.output_buffer(), client.get_protocol());
+    
+    // Messages are delivered through the connection's event loop
+    EventLoop* loop = EventLoop::current();
+    if (client.get_protocol() == protocol::Protocol::BINARY || !loop) {
+        out.error("ERR pub/sub is only available to RESP connections");
+        return;
+    }
+    
+    bool subscribe = lookup_command(args[0]) == CommandId::SUBSCRIBE;
+    if (subscribe && args.size() < 2) {
+        out.error("ERR wrong number of arguments for 'SUBSCRIBE'");
+        return;
+    }
+    
+    PubSub& pubsub = PubSub::instance();
+    size_t count = client.subscriptions();
+    auto confirm = [&](std::string_view channel) {
+        out.push_header(3);
+        out.bulk_string(subscribe ? "subscribe" : "unsubscribe");
+        if (channel.data()) {
+            out.bulk_string(channel);
+        } else {
+            out.null();
+        }
+        out.integer(static_cast<int64_t>(count));
+    };
+    
+    if (subscribe) {
+        for (size_t i = 1; i < args.size(); i++) {
+            count = pubsub.subscribe(args[i], loop, client.get_id(), client.get_protocol());
+            confirm(args[i]);
+        }
+    } else if (args.size() >= 2) {
+        for (size_t i = 1; i < args.size(); i++) {
+            count = pubsub.unsubscribe(args[i], loop, client.get_id());
+            confirm(args[i]);
+        }
+    } else {
+        std::vector<std::string> channels = pubsub.channels_of(loop, client.get_id());
+        for (const std::string& channel : channels) {
+            count = pubsub.unsubscribe(channel, loop, client.get_id());
+            confirm(channel);
+        }
+        if (channels.empty()) {
+            confirm(std::string_view());  // Still one reply, with no channel
+        }
+    }
+    
+    client.set_subscriptions(count);
+}
+
+void CommandHandler::handle_publish(ClientConnection& client, const protocol::Command& args) {
+    protocol::ResponseWriter out(client.output_buffer(), client.get_protocol());
+    if (args.size() != 3) {
+        out.error("ERR wrong number of arguments for 'PUBLISH'");
+        return;
+    }
+    out.integer(static_cast<int64_t>(PubSub::instance().publish(args[1], args[2])));
+}
+
+void CommandHandler::execute_into(KVStore& store, const protocol::Command& args,
+                                 std::vector<uint8_t>& output, protocol::Protocol protocol) {
+    protocol::ResponseWriter writer(output, protocol);
+    size_t mark = writer.size();
     
     try {
-        response = store_.execute_command(request);
+        store.execute(args, writer);
     } catch (const std::exception& e) {
         LOG_ERROR(format_log("Command execution error: ", e.what()));
-        response = protocol::utils::error_response("ERR internal error");
+        writer.truncate(mark);
+        writer.reply(protocol::Reply::ERR_INTERNAL);
+        errors_encountered_++;
+    }
+}
+
+bool CommandHandler::send_output(ClientConnection& client) {
+    bool success = client.flush();
+    
+    if (!success) {
+        LOG_ERROR(format_log("Failed to send response to ", client.get_client_info()));
         errors_encountered_++;
     }
     
-    // Send response back to client
-    return send_response(client, response);
+    return success;
 }
 
 bool CommandHandler::send_response(ClientConnection& client, 
@@ -89,18 +280,9 @@ bool CommandHandler::send_response(ClientConnection& client,
         return false;
     }
     
-    // Serialize response
-    auto data = response->serialize();
-    
-    // Send to client
-    bool success = client.write(data.data(), data.size());
-    
-    if (!success) {
-        LOG_ERROR(format_log("Failed to send response to ", client.get_client_info()));
-        errors_encountered_++;
-    }
-    
-    return success;
+    // Serialize response into the output buffer
+    protocol::ResponseWriter(client.output_buffer(), client.get_protocol()).message(*response);
+    return client.is_connected();
 }
 
 CommandHandler::Stats CommandHandler::get_stats() const {
@@ -108,9 +290,319 @@ CommandHandler::Stats CommandHandler::get_stats() const {
     stats.connections_handled = connections_handled_.load();
     stats.requests_processed = requests_processed_.load();
     stats.errors_encountered = errors_encountered_.load();
+    stats.requests_forwarded = requests_forwarded_.load();
     return stats;
 }
 
+// ============================================================================
+// Sharded Request Routing
+// ============================================================================
+
+CommandHandler::KeyScope CommandHandler::key_scope(std::string_view command) {
+    switch (lookup_command(command)) {
+        case CommandId::GET:
+        case CommandId::SET:
+        case CommandId::TYPE:
+        case CommandId::ZADD:
+        case CommandId::ZINCRBY:
+        case CommandId::ZREM:
+        case CommandId::ZSCORE:
+        case CommandId::ZRANK:
+        case CommandId::ZREVRANK:
+        case CommandId::ZRANGE:
+        case CommandId::ZREVRANGE:
+        case CommandId::ZRANGEBYSCORE:
+        case CommandId::ZCOUNT:
+        case CommandId::ZCARD:
+        case CommandId::SETEX:
+        case CommandId::PSETEX:
+        case CommandId::GETEX:
+        case CommandId::EXPIRE:
+        case CommandId::PEXPIRE:
+        case CommandId::EXPIREAT:
+        case CommandId::PEXPIREAT:
+        case CommandId::TTL:
+        case CommandId::PTTL:
+        case CommandId::PERSIST:
+            return KeyScope::FIRST;
+            
+        case CommandId::DEL:
+        case CommandId::EXISTS:
+            return KeyScope::ALL_ARGS;
+            
+        case CommandId::ZUNIONSTORE:
+        case CommandId::ZINTERSTORE:
+        case CommandId::ZDIFFSTORE:
+            return KeyScope::STORE;
+            
+        case CommandId::KEYS:
+        case CommandId::DBSIZE:
+        case CommandId::FLUSHDB:
+            return KeyScope::KEYSPACE;
+            
+        default:
+            // PING, ECHO, INFO and unknown commands (which just produce an error)
+            return KeyScope::NONE;
+    }
+}
+
+bool CommandHandler::process_sharded_request(ClientConnection& client,
+                                            const protocol::Command& args) {
+    KVStoreManager& manager = KVStoreManager::instance();
+    
+    size_t local = manager.local_shard();
+    KeyScope scope = args.empty() ? KeyScope::NONE : key_scope(args[0]);
+    
+    if (scope == KeyScope::KEYSPACE) {
+        std::vector<ShardPart> parts;
+        for (size_t shard = 0; shard < manager.shard_count(); shard++) {
+            parts.push_back({shard, args.to_strings()});
+        }
+        return fan_out(client, std::move(parts));
+    }
+    
+    // Keyless commands, and wrong-arity ones that will only error out
+    size_t owner = local;
+    if (scope != KeyScope::NONE && args.size() >= 2) {
+        owner = manager.shard_for_key(args[1]);
+    }
+    
+    if (scope == KeyScope::ALL_ARGS) {
+        for (size_t i = 2; i < args.size(); i++) {
+            if (manager.shard_for_key(args[i]) != owner) {
+                // Keys span shards: each shard counts its own keys
+                std::vector<ShardPart> parts;
+                std::vector<size_t> part_of(manager.shard_count(), SIZE_MAX);
+                for (size_t key = 1; key < args.size(); key++) {
+                    size_t shard = manager.shard_for_key(args[key]);
+                    if (part_of[shard] == SIZE_MAX) {
+                        part_of[shard] = parts.size();
+                        parts.push_back({shard, {std::string(args[0])}});
+                    }
+                    parts[part_of[shard]].args.emplace_back(args[key]);
+                }
+                return fan_out(client, std::move(parts));
+            }
+        }
+    }
+    
+    if (scope == KeyScope::STORE && args.size() >= 3) {
+        // Run where the destination lives, as Redis Cluster does, so every
+        // source must live there too. A bad numkeys errors out later
+        int64_t numkeys = 0;
+        std::string_view count = args[2];
+        std::from_chars(count.data(), count.data() + count.size(), numkeys);
+        for (int64_t i = 0; i < numkeys && 3 + static_cast<size_t>(i) < args.size(); i++) {
+            if (manager.shard_for_key(args[3 + i]) != owner) {
+                protocol::ResponseWriter(client.output_buffer(), client.get_protocol())
+                    .error("CROSSSLOT Keys in request don't hash to the same slot");
+                return client.is_connected();
+            }
+        }
+    }
+    
+    if (owner >= manager.shard_count()) {
+        owner = 0;  // Not on a shard thread (e.g. blocking mode)
+    }
+    
+    // Only hop threads when we are on a loop that can receive the reply
+    if (owner != local && EventLoop::current() && manager.get_shard_loop(owner)) {
+        forward_request(client, owner, args);
+        return true;
+    }
+    
+    execute_into(manager.get_shard(owner), args, client.output_buffer(), client.get_protocol());
+    return client.is_connected();
+}
+
+void CommandHandler::forward_request(ClientConnection& client, size_t shard,
+                                    const protocol::Command& args) {
+    EventLoop* origin = EventLoop::current();
+    uint64_t conn_id = client.get_id();
+    protocol::Protocol protocol = client.get_protocol();
+    
+    // Hold back the rest of the pipeline until this reply is written
+    client.set_blocked(true);
+    requests_forwarded_++;
+    
+    KVStoreManager::instance().get_shard_loop(shard)->post(
+        [this, shard, strings = args.to_strings(), origin, conn_id, protocol]() {
+            // The read buffer may be reused meanwhile, so this copy owns the bytes
+            protocol::Command args(strings);
+            
+            // Encode on the shard thread, write on the client's thread
+            std::vector<uint8_t> reply;
+            execute_into(KVStoreManager::instance().get_shard(shard), args, reply, protocol);
+            origin->post([this, origin, conn_id, reply = std::move(reply)]() mutable {
+                resume_client(*origin, conn_id, std::move(reply));
+            });
+        });
+}
+
+void CommandHandler::resume_client(EventLoop& loop, uint64_t conn_id,
+                                  std::vector<uint8_t>&& reply) {
+    ClientConnection* client = loop.get_connections().get_connection(conn_id);
+    if (!client || !client->is_connected()) {
+        return;  // Client went away while its request was in flight
+    }
+    
+    client->set_blocked(false);
+    
+    // Queued as is; it goes out with the replies that follow it
+    client->queue(std::move(reply));
+    
+    // Carry on with requests that were pipelined behind this one
+    bool ok = handle_client(*client);
+    
+    // Let the server flush (or close) through its usual event path
+    loop.notify(client->get_socket().get_fd(),
+                ok ? EventType::WRITE : EventType::ERROR_EVENT);
+}
+
+bool CommandHandler::fan_out(ClientConnection& client, std::vector<ShardPart>&& parts) {
+    KVStoreManager& manager = KVStoreManager::instance();
+    EventLoop* origin = EventLoop::current();
+    size_t local = manager.local_shard();
+    
+    // Replies are collected on the client's loop, so nothing here is shared
+    struct Gather {
+        std::vector<std::vector<uint8_t>> replies;
+        size_t pending = 0;
+        protocol::Protocol protocol;
+    };
+    auto gather = std::make_shared<Gather>();
+    gather->replies.resize(parts.size());
+    gather->protocol = client.get_protocol();
+    
+    // Parts for this thread's own shard run now. Off the event loops
+    // (blocking mode) there is no thread to hand the others to either
+    std::vector<bool> posted(parts.size(), false);
+    for (size_t i = 0; i < parts.size(); i++) {
+        size_t shard = parts[i].shard;
+        if (shard != local && origin && manager.get_shard_loop(shard)) {
+            posted[i] = true;
+            gather->pending++;
+        } else {
+            execute_into(manager.get_shard(shard), protocol::Command(parts[i].args),
+                         gather->replies[i], protocol::Protocol::RESP2);
+        }
+    }
+    
+    if (gather->pending == 0) {
+        merge_replies(gather->replies, client.output_buffer(), client.get_protocol());
+        return client.is_connected();
+    }
+    
+    // Hold back the rest of the pipeline until the merged reply is written
+    uint64_t conn_id = client.get_id();
+    client.set_blocked(true);
+    requests_forwarded_++;
+    
+    for (size_t i = 0; i < parts.size(); i++) {
+        if (!posted[i]) {
+            continue;
+        }
+        size_t shard = parts[i].shard;
+        manager.get_shard_loop(shard)->post(
+            [this, gather, i, shard, strings = std::move(parts[i].args), origin, conn_id]() {
+                std::vector<uint8_t> reply;
+                execute_into(KVStoreManager::instance().get_shard(shard), protocol::Command(strings),
+                             reply, protocol::Protocol::RESP2);
+                origin->post([this, gather, i, origin, conn_id, reply = std::move(reply)]() mutable {
+                    gather->replies[i] = std::move(reply);
+                    if (--gather->pending > 0) {
+                        return;
+                    }
+                    std::vector<uint8_t> merged;
+                    merge_replies(gather->replies, merged, gather->protocol);
+                    resume_client(*origin, conn_id, std::move(merged));
+                });
+            });
+    }
+    
+    return true;
+}
+
+namespace {
+
+// Walks a RESP2 reply encoded by ResponseWriter, which is well formed
+struct Resp2Reader {
+    std::string_view data;
+    
+    char type() const { return data.empty() ? '\0' : data[0]; }
+    
+    std::string_view line() {
+        size_t end = data.find("\r\n");
+        std::string_view text = data.substr(1, end - 1);
+        data.remove_prefix(end + 2);
+        return text;
+    }
+    
+    int64_t number() {
+        std::string_view text = line();
+        int64_t value = 0;
+        std::from_chars(text.data(), text.data() + text.size(), value);
+        return value;
+    }
+    
+    std::string_view bulk() {
+        size_t length = static_cast<size_t>(number());
+        std::string_view bytes = data.substr(0, length);
+        data.remove_prefix(length + 2);
+        return bytes;
+    }
+};
+
+Resp2Reader reader_for(const std::vector<uint8_t>& reply) {
+    return Resp2Reader{std::string_view(reinterpret_cast<const char*>(reply.data()), reply.size())};
+}
+
+} // namespace
+
+void CommandHandler::merge_replies(const std::vector<std::vector<uint8_t>>& replies,
+                                  std::vector<uint8_t>& output, protocol::Protocol protocol) {
+    protocol::ResponseWriter out(output, protocol);
+    
+    for (const auto& reply : replies) {
+        Resp2Reader reader = reader_for(reply);
+        if (reader.type() == '-') {
+            out.error(reader.line());
+            return;
+        }
+    }
+    
+    Resp2Reader first = reader_for(replies.front());
+    switch (first.type()) {
+        case ':': {
+            int64_t total = 0;
+            for (const auto& reply : replies) {
+                total += reader_for(reply).number();
+            }
+            out.integer(total);
+            break;
+        }
+        
+        case '*': {
+            int64_t total = 0;
+            for (const auto& reply : replies) {
+                total += reader_for(reply).number();
+            }
+            out.array_header(static_cast<uint32_t>(total));
+            for (const auto& reply : replies) {
+                Resp2Reader reader = reader_for(reply);
+                for (int64_t count = reader.number(); count > 0; count--) {
+                    out.bulk_string(reader.bulk());
+                }
+            }
+            break;
+        }
+        
+        default:
+            out.simple_string(first.line());
+            break;
+    }
+}
+
 // Factory function for creating command handler
 std::function<bool(ClientConnection&)> make_command_handler() {
     // Create a shared command handler
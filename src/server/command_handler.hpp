@@ -12,6 +12,9 @@
 #include "protocol/protocol.hpp"
 #include "kv_store.hpp"
 #include <atomic>
+#include <vector>
+#include <string>
+#include <string_view>
 
 namespace scuffedredis {
 
@@ -43,32 +46,130 @@ public:
         size_t connections_handled;
         size_t requests_processed;
         size_t errors_encountered;
+        size_t requests_forwarded;  // Sent to another shard's thread
     };
     
     Stats get_stats() const;
 
 private:
     KVStore& store_;                      // Reference to KV store
-    protocol::Parser parser_;             // Protocol parser for this handler
     
     // Statistics
     std::atomic<size_t> connections_handled_{0};
     std::atomic<size_t> requests_processed_{0};
     std::atomic<size_t> errors_encountered_{0};
+    std::atomic<size_t> requests_forwarded_{0};
+    
+    /**
+     * How a command's keys map onto shards.
+     */
+    enum class KeyScope {
+        NONE,      // No keys - served by the local shard (PING, ECHO, INFO)
+        FIRST,     // One key in args[1] (GET, SET, TYPE, Z*)
+        ALL_ARGS,  // Every argument is a key (DEL, EXISTS)
+        STORE,     // Destination in args[1], numkeys sources after args[2]
+                   // (ZUNIONSTORE, ZINTERSTORE, ZDIFFSTORE)
+        KEYSPACE   // Whole keyspace - every shard (KEYS, DBSIZE, FLUSHDB)
+    };
+    
+    static KeyScope key_scope(std::string_view command);
     
     /**
      * Process a single request and send response.
      * Returns false on connection error.
      */
     bool process_request(ClientConnection& client, 
-                        const protocol::MessagePtr& request);
+                        const protocol::Command& args);
+    
+    /**
+     * HELLO [protover [AUTH username password] [SETNAME name]]
+     * Switch a RESP connection between RESP2 and RESP3 and describe the
+     * server. Handled here since the protocol belongs to the connection.
+     */
+    void handle_hello(ClientConnection& client, const protocol::Command& args);
+    
+    /**
+     * SUBSCRIBE channel [channel ...] / UNSUBSCRIBE [channel ...]
+     * Change the connection's channel subscriptions, confirming each
+     * channel with the number the connection is left subscribed to.
+     * UNSUBSCRIBE without channels leaves them all.
+     */
+    void handle_subscribe(ClientConnection& client, const protocol::Command& args);
     
     /**
-     * Send response message to client.
+     * PUBLISH channel message
+     * Reply with the number of subscribers the message was sent to.
+     */
+    void handle_publish(ClientConnection& client, const protocol::Command& args);
+    
+    /**
+     * Route a request to the shard owning its keys (sharded mode).
+     * Requests owned by another shard are forwarded to that shard's
+     * thread; the client is blocked until the reply comes back.
+     */
+    bool process_sharded_request(ClientConnection& client,
+                                const protocol::Command& args);
+    
+    /**
+     * Hand a request to another shard's event loop.
+     */
+    void forward_request(ClientConnection& client, size_t shard,
+                        const protocol::Command& args);
+    
+    /**
+     * Deliver a forwarded reply and continue with pipelined requests.
+     * Runs on the client's own event loop thread.
+     */
+    void resume_client(EventLoop& loop, uint64_t conn_id,
+                      std::vector<uint8_t>&& reply);
+    
+    /**
+     * One shard's share of a request that spans several shards.
+     */
+    struct ShardPart {
+        size_t shard;
+        std::vector<std::string> args;
+    };
+    
+    /**
+     * Run each part on the thread that owns its shard and reply with the
+     * merged result. The local shard's part runs at once; the others are
+     * posted to their loops like forward_request(), and the client stays
+     * blocked until the last reply is back on its own loop.
+     */
+    bool fan_out(ClientConnection& client, std::vector<ShardPart>&& parts);
+    
+    /**
+     * Merge the RESP2 replies of a fanned-out request into one reply in
+     * the client's protocol: the first error wins, integers are summed,
+     * arrays (of bulk strings) concatenated, and anything else is the
+     * same from every shard (FLUSHDB's OK).
+     */
+    static void merge_replies(const std::vector<std::vector<uint8_t>>& replies,
+                              std::vector<uint8_t>& output, protocol::Protocol protocol);
+    
+    /**
+     * Queue response message for the client.
      * Handles serialization and error checking.
      */
     bool send_response(ClientConnection& client, 
                       const protocol::MessagePtr& response);
+    
+    /**
+     * Run a command on a store, appending its reply to output in the
+     * given protocol. Exceptions become an error reply.
+     */
+    void execute_into(KVStore& store, const protocol::Command& args,
+                     std::vector<uint8_t>& output, protocol::Protocol protocol);
+    
+    /**
+     * Send the client's buffered output.
+     * Returns false on connection error.
+     */
+    bool send_output(ClientConnection& client);
+    
+    // Queued reply bytes that trigger a send in the middle of a batch
+    static constexpr size_t OUTPUT_FLUSH_THRESHOLD = 64 * 1024;
 };
 
 /**
@@ -0,0 +1,210 @@
+#ifndef SCUFFEDREDIS_COMMAND_TABLE_HPP
+#define SCUFFEDREDIS_COMMAND_TABLE_HPP
+
+/**
+ * Command name lookup.
+ * 
+ * Names map to ids through a perfect hash built at compile time: a seed is
+ * searched for that sends every known name to a slot of its own, so a
+ * lookup is one hash over the raw bytes (case folded as it goes), one slot
+ * load and one case-insensitive compare. Nothing is copied or allocated.
+ */
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace scuffedredis {
+
+/**
+ * Every command the server knows, in no particular order.
+ */
+enum class CommandId : uint8_t {
+    GET,
+    SET,
+    DEL,
+    EXISTS,
+    KEYS,
+    PING,
+    ECHO,
+    FLUSHDB,
+    DBSIZE,
+    INFO,
+    HELLO,
+    TYPE,
+    ZADD,
+    ZINCRBY,
+    ZREM,
+    ZSCORE,
+    ZRANK,
+    ZREVRANK,
+    ZRANGE,
+    ZREVRANGE,
+    ZRANGEBYSCORE,
+    ZCOUNT,
+    ZCARD,
+    ZUNIONSTORE,
+    ZINTERSTORE,
+    ZDIFFSTORE,
+    SETEX,
+    PSETEX,
+    GETEX,
+    EXPIRE,
+    PEXPIRE,
+    EXPIREAT,
+    PEXPIREAT,
+    TTL,
+    PTTL,
+    PERSIST,
+    SUBSCRIBE,
+    UNSUBSCRIBE,
+    PUBLISH,
+    UNKNOWN  // Not a command; also the number of commands
+};
+
+constexpr size_t COMMAND_COUNT = static_cast<size_t>(CommandId::UNKNOWN);
+
+namespace command_table {
+
+struct Entry {
+    std::string_view name;  // Upper case
+    CommandId id;
+};
+
+constexpr Entry COMMANDS[] = {
+    {"GET", CommandId::GET},
+    {"SET", CommandId::SET},
+    {"DEL", CommandId::DEL},
+    {"EXISTS", CommandId::EXISTS},
+    {"KEYS", CommandId::KEYS},
+    {"PING", CommandId::PING},
+    {"ECHO", CommandId::ECHO},
+    {"FLUSHDB", CommandId::FLUSHDB},
+    {"DBSIZE", CommandId::DBSIZE},
+    {"INFO", CommandId::INFO},
+    {"HELLO", CommandId::HELLO},
+    {"TYPE", CommandId::TYPE},
+    {"ZADD", CommandId::ZADD},
+    {"ZINCRBY", CommandId::ZINCRBY},
+    {"ZREM", CommandId::ZREM},
+    {"ZSCORE", CommandId::ZSCORE},
+    {"ZRANK", CommandId::ZRANK},
+    {"ZREVRANK", CommandId::ZREVRANK},
+    {"ZRANGE", CommandId::ZRANGE},
+    {"ZREVRANGE", CommandId::ZREVRANGE},
+    {"ZRANGEBYSCORE", CommandId::ZRANGEBYSCORE},
+    {"ZCOUNT", CommandId::ZCOUNT},
+    {"ZCARD", CommandId::ZCARD},
+    {"ZUNIONSTORE", CommandId::ZUNIONSTORE},
+    {"ZINTERSTORE", CommandId::ZINTERSTORE},
+    {"ZDIFFSTORE", CommandId::ZDIFFSTORE},
+    {"SETEX", CommandId::SETEX},
+    {"PSETEX", CommandId::PSETEX},
+    {"GETEX", CommandId::GETEX},
+    {"EXPIRE", CommandId::EXPIRE},
+    {"PEXPIRE", CommandId::PEXPIRE},
+    {"EXPIREAT", CommandId::EXPIREAT},
+    {"PEXPIREAT", CommandId::PEXPIREAT},
+    {"TTL", CommandId::TTL},
+    {"PTTL", CommandId::PTTL},
+    {"PERSIST", CommandId::PERSIST},
+    {"SUBSCRIBE", CommandId::SUBSCRIBE},
+    {"UNSUBSCRIBE", CommandId::UNSUBSCRIBE},
+    {"PUBLISH", CommandId::PUBLISH}
+};
+
+static_assert(sizeof(COMMANDS) / sizeof(COMMANDS[0]) == COMMAND_COUNT,
+              "every CommandId needs a name");
+
+// Slots in the table: a power of two with plenty of room, so a seed
+// without collisions turns up quickly
+constexpr size_t TABLE_SIZE = 128;
+
+static_assert(COMMAND_COUNT * 2 <= TABLE_SIZE, "grow TABLE_SIZE");
+
+constexpr char to_upper(char c) {
+    return (c >= 'a' && c <= 'z') ? static_cast<char>(c - 'a' + 'A') : c;
+}
+
+/**
+ * Compare against an upper-case name, ignoring the case of `str`.
+ */
+constexpr bool equals_ignore_case(std::string_view str, std::string_view upper) {
+    if (str.size() != upper.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < str.size(); i++) {
+        if (to_upper(str[i]) != upper[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// FNV-1a over the upper-cased bytes
+constexpr uint32_t hash(std::string_view name, uint32_t seed) {
+    uint32_t h = seed ^ static_cast<uint32_t>(name.size());
+    for (char c : name) {
+        h = (h ^ static_cast<uint8_t>(to_upper(c))) * 16777619u;
+    }
+    return h ^ (h >> 16);
+}
+
+constexpr size_t slot_of(std::string_view name, uint32_t seed) {
+    return hash(name, seed) & (TABLE_SIZE - 1);
+}
+
+constexpr bool is_perfect(uint32_t seed) {
+    bool used[TABLE_SIZE] = {};
+    for (const Entry& entry : COMMANDS) {
+        size_t slot = slot_of(entry.name, seed);
+        if (used[slot]) {
+            return false;
+        }
+        used[slot] = true;
+    }
+    return true;
+}
+
+constexpr uint32_t find_seed() {
+    for (uint32_t seed = 2166136261u; seed < 2166136261u + 100000; seed++) {
+        if (is_perfect(seed)) {
+            return seed;
+        }
+    }
+    return 0;
+}
+
+constexpr uint32_t SEED = find_seed();
+
+static_assert(SEED != 0, "no collision-free seed found; grow TABLE_SIZE");
+
+constexpr std::array<Entry, TABLE_SIZE> build_slots() {
+    std::array<Entry, TABLE_SIZE> slots{};
+    for (size_t i = 0; i < TABLE_SIZE; i++) {
+        slots[i] = Entry{std::string_view(), CommandId::UNKNOWN};
+    }
+    for (const Entry& entry : COMMANDS) {
+        slots[slot_of(entry.name, SEED)] = entry;
+    }
+    return slots;
+}
+
+constexpr std::array<Entry, TABLE_SIZE> SLOTS = build_slots();
+
+} // namespace command_table
+
+/**
+ * Identify a command from its name in any case.
+ * Returns CommandId::UNKNOWN for anything else.
+ */
+constexpr CommandId lookup_command(std::string_view name) {
+    const command_table::Entry& slot =
+        command_table::SLOTS[command_table::slot_of(name, command_table::SEED)];
+    return command_table::equals_ignore_case(name, slot.name) ? slot.id : CommandId::UNKNOWN;
+}
+
+} // namespace scuffedredis
+
+#endif // SCUFFEDREDIS_COMMAND_TABLE_HPP
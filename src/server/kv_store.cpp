@@ -1,14 +1,23 @@
 #include "kv_store.hpp"
+#include "pubsub.hpp"
+#include "event/event_loop.hpp"
 #include "utils/logger.hpp"
+#include "utils/slab_allocator.hpp"
 #include <algorithm>
 #include <sstream>
+#include <iomanip>
 #include <cctype>
+#include <charconv>
+#include <climits>
+#include <cmath>
 
 namespace scuffedredis {
 
-KVStore::KVStore() {
-    init_handlers();
-    LOG_INFO("Key-Value store initialized");
+KVStore::KVStore(HashEngine engine, const ZSetOptions& zset_options) 
+    : store_(16, ConcurrentHashTable::DEFAULT_SEGMENTS, engine),
+      sorted_sets_(SortedSetManager::DEFAULT_SEGMENTS, zset_options) {
+    LOG_INFO(format_log("Key-Value store initialized (", hash_engine_name(engine), 
+                        " hash table, ", zset_engine_name(zset_options.engine), " sorted sets)"));
 }
 
 KVStore::~KVStore() {
@@ -16,136 +25,303 @@ KVStore::~KVStore() {
                        commands_processed_.load(), " commands"));
 }
 
-void KVStore::init_handlers() {
-    // Register all command handlers
-    // Using lambdas to bind this pointer
-    
-    handlers_["GET"] = [this](const auto& args) { 
-        return handle_get(args); 
-    };
-    
-    handlers_["SET"] = [this](const auto& args) { 
-        return handle_set(args); 
-    };
-    
-    handlers_["DEL"] = [this](const auto& args) { 
-        return handle_del(args); 
-    };
-    
-    handlers_["EXISTS"] = [this](const auto& args) { 
-        return handle_exists(args); 
-    };
-    
-    handlers_["KEYS"] = [this](const auto& args) { 
-        return handle_keys(args); 
-    };
-    
-    handlers_["PING"] = [this](const auto& args) { 
-        return handle_ping(args); 
-    };
-    
-    handlers_["ECHO"] = [this](const auto& args) { 
-        return handle_echo(args); 
-    };
-    
-    handlers_["FLUSHDB"] = [this](const auto& args) { 
-        return handle_flushdb(args); 
+constexpr std::array<KVStore::Handler, COMMAND_COUNT> KVStore::make_handlers() {
+    std::array<Handler, COMMAND_COUNT> handlers{};
+    auto set = [&handlers](CommandId id, Handler handler) {
+        handlers[static_cast<size_t>(id)] = handler;
     };
     
-    handlers_["DBSIZE"] = [this](const auto& args) { 
-        return handle_dbsize(args); 
-    };
+    set(CommandId::GET, &KVStore::handle_get);
+    set(CommandId::SET, &KVStore::handle_set);
+    set(CommandId::DEL, &KVStore::handle_del);
+    set(CommandId::EXISTS, &KVStore::handle_exists);
+    set(CommandId::KEYS, &KVStore::handle_keys);
+    set(CommandId::PING, &KVStore::handle_ping);
+    set(CommandId::ECHO, &KVStore::handle_echo);
+    set(CommandId::FLUSHDB, &KVStore::handle_flushdb);
+    set(CommandId::DBSIZE, &KVStore::handle_dbsize);
+    set(CommandId::INFO, &KVStore::handle_info);
+    set(CommandId::TYPE, &KVStore::handle_type);
+    set(CommandId::ZADD, &KVStore::handle_zadd);
+    set(CommandId::ZINCRBY, &KVStore::handle_zincrby);
+    set(CommandId::ZREM, &KVStore::handle_zrem);
+    set(CommandId::ZSCORE, &KVStore::handle_zscore);
+    set(CommandId::ZRANK, &KVStore::handle_zrank);
+    set(CommandId::ZREVRANK, &KVStore::handle_zrevrank);
+    set(CommandId::ZRANGE, &KVStore::handle_zrange);
+    set(CommandId::ZREVRANGE, &KVStore::handle_zrevrange);
+    set(CommandId::ZRANGEBYSCORE, &KVStore::handle_zrangebyscore);
+    set(CommandId::ZCOUNT, &KVStore::handle_zcount);
+    set(CommandId::ZCARD, &KVStore::handle_zcard);
+    set(CommandId::ZUNIONSTORE, &KVStore::handle_zunionstore);
+    set(CommandId::ZINTERSTORE, &KVStore::handle_zinterstore);
+    set(CommandId::ZDIFFSTORE, &KVStore::handle_zdiffstore);
+    set(CommandId::SETEX, &KVStore::handle_setex);
+    set(CommandId::PSETEX, &KVStore::handle_psetex);
+    set(CommandId::GETEX, &KVStore::handle_getex);
+    set(CommandId::EXPIRE, &KVStore::handle_expire);
+    set(CommandId::PEXPIRE, &KVStore::handle_pexpire);
+    set(CommandId::EXPIREAT, &KVStore::handle_expireat);
+    set(CommandId::PEXPIREAT, &KVStore::handle_pexpireat);
+    set(CommandId::TTL, &KVStore::handle_ttl);
+    set(CommandId::PTTL, &KVStore::handle_pttl);
+    set(CommandId::PERSIST, &KVStore::handle_persist);
     
-    handlers_["INFO"] = [this](const auto& args) { 
-        return handle_info(args); 
-    };
+    // HELLO and pub/sub belong to the connection (see CommandHandler)
+    return handlers;
 }
 
-std::string KVStore::to_upper(const std::string& str) const {
-    std::string result = str;
+// Constant-initialized, so usable before any static constructor runs
+const std::array<KVStore::Handler, COMMAND_COUNT> KVStore::HANDLERS = KVStore::make_handlers();
+
+std::string KVStore::to_upper(std::string_view str) const {
+    std::string result(str);
     std::transform(result.begin(), result.end(), result.begin(),
                   [](unsigned char c) { return std::toupper(c); });
     return result;
 }
 
 protocol::MessagePtr KVStore::execute_command(const protocol::MessagePtr& request) {
-    commands_processed_++;
-    
     // Parse command from request
     auto args = protocol::utils::parse_command(request);
+    return execute_command(protocol::Command(args));
+}
+
+protocol::MessagePtr KVStore::execute_command(const protocol::Command& args) {
+    std::vector<uint8_t> reply;
+    protocol::ResponseWriter out(reply);
+    execute(args, out);
+    return decode_reply(reply);
+}
+
+void KVStore::execute(const protocol::Command& args, protocol::ResponseWriter& out) {
+    commands_processed_++;
     
     if (args.empty()) {
-        return protocol::utils::error_response("ERR invalid command format");
+        out.reply(protocol::Reply::ERR_INVALID_COMMAND);
+        return;
     }
     
-    return execute_raw(args);
+    dispatch(args, out);
 }
 
 protocol::MessagePtr KVStore::execute_raw(const std::vector<std::string>& args) {
+    return execute_raw(protocol::Command(args));
+}
+
+protocol::MessagePtr KVStore::execute_raw(const protocol::Command& args) {
+    std::vector<uint8_t> reply;
+    protocol::ResponseWriter out(reply);
+    dispatch(args, out);
+    return decode_reply(reply);
+}
+
+void KVStore::dispatch(const protocol::Command& args, protocol::ResponseWriter& out) {
     if (args.empty()) {
-        return protocol::utils::error_response("ERR empty command");
+        out.error("ERR empty command");
+        return;
     }
     
-    // Get command name (case-insensitive)
-    std::string cmd = to_upper(args[0]);
-    
-    // Find handler
-    auto it = handlers_.find(cmd);
-    if (it == handlers_.end()) {
-        return protocol::utils::error_response("ERR unknown command '" + args[0] + "'");
+    // Find handler (command names are case-insensitive)
+    CommandId id = lookup_command(args[0]);
+    Handler handler = id == CommandId::UNKNOWN ? nullptr : HANDLERS[static_cast<size_t>(id)];
+    if (!handler) {
+        out.error("ERR unknown command '" + std::string(args[0]) + "'");
+        return;
     }
     
-    // Execute handler
+    // Execute handler, discarding any partial reply if it throws
+    size_t mark = out.size();
     try {
-        return it->second(args);
+        (this->*handler)(args, out);
     } catch (const std::exception& e) {
         LOG_ERROR(format_log("Command execution error: ", e.what()));
-        return protocol::utils::error_response("ERR " + std::string(e.what()));
+        out.truncate(mark);
+        out.error("ERR " + std::string(e.what()));
     }
 }
 
+protocol::MessagePtr KVStore::decode_reply(const std::vector<uint8_t>& reply) {
+    protocol::Parser parser;
+    parser.feed(reply);
+    return parser.parse_message();
+}
+
+namespace {
+
+bool parse_integer(std::string_view text, int64_t& value) {
+    const char* end = text.data() + text.size();
+    auto [ptr, ec] = std::from_chars(text.data(), end, value);
+    return ec == std::errc() && ptr == end;
+}
+
+/**
+ * Convert an expiry argument - `amount` seconds or milliseconds, from now
+ * or as a Unix time - to a deadline in Unix ms. Fails on overflow.
+ */
+bool expiry_to_deadline(int64_t amount, bool milliseconds, bool absolute, int64_t& expire_at) {
+    if (!milliseconds && (amount > INT64_MAX / 1000 || amount < INT64_MIN / 1000)) {
+        return false;
+    }
+    int64_t ms = milliseconds ? amount : amount * 1000;
+    
+    if (!absolute) {
+        int64_t now = unix_time_ms();
+        if (ms > INT64_MAX - now) {
+            return false;
+        }
+        ms += now;
+    }
+    
+    expire_at = ms;
+    return true;
+}
+
+/**
+ * Identify an EX, PX, EXAT or PXAT option by its unit and whether it
+ * gives a Unix time. Returns false for any other word.
+ */
+bool expiry_option(std::string_view name, bool& milliseconds, bool& absolute) {
+    milliseconds = command_table::equals_ignore_case(name, "PX") ||
+                   command_table::equals_ignore_case(name, "PXAT");
+    absolute = command_table::equals_ignore_case(name, "EXAT") ||
+               command_table::equals_ignore_case(name, "PXAT");
+    return milliseconds || absolute || command_table::equals_ignore_case(name, "EX");
+}
+
+/**
+ * Parse the value of an expiry option of `command`, which must be
+ * positive, into a deadline. Writes the error and returns false if it
+ * isn't valid.
+ */
+bool parse_expire_time(std::string_view text, bool milliseconds, bool absolute,
+                       std::string_view command, protocol::ResponseWriter& out,
+                       int64_t& expire_at) {
+    int64_t amount;
+    if (!parse_integer(text, amount)) {
+        out.error("ERR value is not an integer or out of range");
+        return false;
+    }
+    if (amount <= 0 || !expiry_to_deadline(amount, milliseconds, absolute, expire_at)) {
+        out.error("ERR invalid expire time in '" + std::string(command) + "' command");
+        return false;
+    }
+    
+    return true;
+}
+
+} // namespace
+
 // ============================================================================
 // Command Handlers
 // ============================================================================
 
-protocol::MessagePtr KVStore::handle_get(const std::vector<std::string>& args) {
+void KVStore::handle_get(const protocol::Command& args, protocol::ResponseWriter& out) {
     if (args.size() != 2) {
-        return protocol::utils::error_response("ERR wrong number of arguments for 'GET'");
+        out.error("ERR wrong number of arguments for 'GET'");
+        return;
     }
     
     get_commands_++;
     
-    const std::string& key = args[1];
-    auto value = store_.get(key);
+    // Copy the value straight from the table into the reply
+    bool found = store_.read(args[1], [&out](std::string_view value) {
+        out.bulk_string(value);
+    });
     
-    if (value.has_value()) {
-        // Return bulk string with value
-        return protocol::Message::make_bulk_string(value.value());
-    } else {
+    if (!found) {
         // Key doesn't exist - return nil
-        return protocol::utils::nil_response();
+        if (sorted_sets_.size() > 0 && sorted_sets_.exists(args[1])) {
+            out.reply(protocol::Reply::WRONG_TYPE);
+        } else {
+            out.reply(protocol::Reply::NIL);
+        }
     }
 }
 
-protocol::MessagePtr KVStore::handle_set(const std::vector<std::string>& args) {
+void KVStore::handle_set(const protocol::Command& args, protocol::ResponseWriter& out) {
     if (args.size() < 3) {
-        return protocol::utils::error_response("ERR wrong number of arguments for 'SET'");
+        out.error("ERR wrong number of arguments for 'SET'");
+        return;
     }
     
     set_commands_++;
     
-    const std::string& key = args[1];
-    const std::string& value = args[2];
+    // SET key value [NX|XX] [EX seconds|PX milliseconds|EXAT unix-time-seconds|
+    //                        PXAT unix-time-milliseconds|KEEPTTL]
+    SetCondition condition = SetCondition::ALWAYS;
+    int64_t expire_at = NO_EXPIRY;
+    for (size_t i = 3; i < args.size(); i++) {
+        std::string_view option = args[i];
+        bool milliseconds;
+        bool absolute;
+        if (command_table::equals_ignore_case(option, "NX") && condition == SetCondition::ALWAYS) {
+            condition = SetCondition::IF_ABSENT;
+        } else if (command_table::equals_ignore_case(option, "XX") &&
+                   condition == SetCondition::ALWAYS) {
+            condition = SetCondition::IF_PRESENT;
+        } else if (command_table::equals_ignore_case(option, "KEEPTTL") &&
+                   expire_at == NO_EXPIRY) {
+            expire_at = KEEP_EXPIRY;
+        } else if (expiry_option(option, milliseconds, absolute) && expire_at == NO_EXPIRY &&
+                   i + 1 < args.size()) {
+            if (!parse_expire_time(args[++i], milliseconds, absolute, "SET", out, expire_at)) {
+                return;
+            }
+        } else {
+            out.reply(protocol::Reply::ERR_SYNTAX);
+            return;
+        }
+    }
     
-    // TODO: Handle additional SET options (EX, PX, NX, XX) later
+    if (set_string(args[1], args[2], condition, expire_at)) {
+        out.reply(protocol::Reply::OK);
+    } else {
+        out.reply(protocol::Reply::NIL);
+    }
+}
+
+bool KVStore::set_string(std::string_view key, std::string_view value, SetCondition condition,
+                         int64_t expire_at) {
+    // A sorted set at the key counts as present, and KEEPTTL keeps its TTL
+    std::optional<int64_t> zset_expiry;
+    if ((condition != SetCondition::ALWAYS || expire_at == KEEP_EXPIRY) &&
+        sorted_sets_.size() > 0) {
+        zset_expiry = sorted_sets_.expire_time(key);
+        if (zset_expiry && expire_at == KEEP_EXPIRY) {
+            expire_at = *zset_expiry;
+        }
+    }
+    
+    // The value and its TTL are written together under the key's lock
+    bool written;
+    if (condition == SetCondition::IF_ABSENT) {
+        written = !zset_expiry && store_.set_if(key, value, false, expire_at);
+    } else if (condition == SetCondition::ALWAYS || zset_expiry) {
+        store_.set(key, value, expire_at);
+        written = true;
+    } else {
+        written = store_.set_if(key, value, true, expire_at);
+    }
+    if (!written) {
+        return false;
+    }
     
-    store_.set(key, value);
-    return protocol::utils::ok_response();
+    // SET overwrites a key of any type. Pairs with the check in
+    // update_zset(): the string is visible before we look for a set, and a
+    // set created concurrently is counted before it looks for a string, so
+    // at least one side sees the other.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (sorted_sets_.size() > 0) {
+        sorted_sets_.del(key);
+    }
+    return true;
 }
 
-protocol::MessagePtr KVStore::handle_del(const std::vector<std::string>& args) {
+void KVStore::handle_del(const protocol::Command& args, protocol::ResponseWriter& out) {
     if (args.size() < 2) {
-        return protocol::utils::error_response("ERR wrong number of arguments for 'DEL'");
+        out.error("ERR wrong number of arguments for 'DEL'");
+        return;
     }
     
     del_commands_++;
@@ -154,124 +330,904 @@ protocol::MessagePtr KVStore::handle_del(const std::vector<std::string>& args) {
     
     // Delete each key
     for (size_t i = 1; i < args.size(); i++) {
-        if (store_.del(args[i])) {
+        if (delete_key(args[i])) {
             deleted++;
         }
     }
     
     // Return number of keys deleted
-    return protocol::Message::make_integer(deleted);
+    out.integer(deleted);
 }
 
-protocol::MessagePtr KVStore::handle_exists(const std::vector<std::string>& args) {
+void KVStore::handle_exists(const protocol::Command& args, protocol::ResponseWriter& out) {
     if (args.size() < 2) {
-        return protocol::utils::error_response("ERR wrong number of arguments for 'EXISTS'");
+        out.error("ERR wrong number of arguments for 'EXISTS'");
+        return;
     }
     
     int64_t count = 0;
     
     // Check each key
     for (size_t i = 1; i < args.size(); i++) {
-        if (store_.exists(args[i])) {
+        if (key_exists(args[i])) {
             count++;
         }
     }
     
     // Return number of keys that exist
-    return protocol::Message::make_integer(count);
+    out.integer(count);
 }
 
-protocol::MessagePtr KVStore::handle_keys(const std::vector<std::string>& args) {
+void KVStore::handle_keys(const protocol::Command& args, protocol::ResponseWriter& out) {
     if (args.size() != 2) {
-        return protocol::utils::error_response("ERR wrong number of arguments for 'KEYS'");
+        out.error("ERR wrong number of arguments for 'KEYS'");
+        return;
     }
     
-    const std::string& pattern = args[1];
+    std::string_view pattern = args[1];
     auto keys = store_.keys(pattern);
+    auto zset_keys = sorted_sets_.keys(pattern);
+    keys.insert(keys.end(), zset_keys.begin(), zset_keys.end());
     
-    // Convert to array of bulk strings
-    protocol::MessageArray array;
-    array.reserve(keys.size());
-    
+    // Array of bulk strings
+    out.array_header(static_cast<uint32_t>(keys.size()));
     for (const auto& key : keys) {
-        array.push_back(protocol::Message::make_bulk_string(key));
+        out.bulk_string(key);
     }
-    
-    return protocol::Message::make_array(array);
 }
 
-protocol::MessagePtr KVStore::handle_ping(const std::vector<std::string>& args) {
+void KVStore::handle_ping(const protocol::Command& args, protocol::ResponseWriter& out) {
     if (args.size() == 1) {
         // No argument - return PONG
-        return protocol::utils::pong_response();
+        out.reply(protocol::Reply::PONG);
     } else if (args.size() == 2) {
         // Echo back the argument
-        return protocol::Message::make_bulk_string(args[1]);
+        out.bulk_string(args[1]);
     } else {
-        return protocol::utils::error_response("ERR wrong number of arguments for 'PING'");
+        out.error("ERR wrong number of arguments for 'PING'");
     }
 }
 
-protocol::MessagePtr KVStore::handle_echo(const std::vector<std::string>& args) {
+void KVStore::handle_echo(const protocol::Command& args, protocol::ResponseWriter& out) {
     if (args.size() != 2) {
-        return protocol::utils::error_response("ERR wrong number of arguments for 'ECHO'");
+        out.error("ERR wrong number of arguments for 'ECHO'");
+        return;
     }
     
     // Echo back the message
-    return protocol::Message::make_bulk_string(args[1]);
+    out.bulk_string(args[1]);
 }
 
-protocol::MessagePtr KVStore::handle_flushdb(const std::vector<std::string>& args) {
+void KVStore::handle_flushdb(const protocol::Command& args, protocol::ResponseWriter& out) {
     if (args.size() != 1) {
-        return protocol::utils::error_response("ERR wrong number of arguments for 'FLUSHDB'");
+        out.error("ERR wrong number of arguments for 'FLUSHDB'");
+        return;
     }
     
     store_.clear();
+    sorted_sets_.clear();
     LOG_INFO("Database flushed");
     
-    return protocol::utils::ok_response();
+    out.reply(protocol::Reply::OK);
 }
 
-protocol::MessagePtr KVStore::handle_dbsize(const std::vector<std::string>& args) {
+void KVStore::handle_dbsize(const protocol::Command& args, protocol::ResponseWriter& out) {
     if (args.size() != 1) {
-        return protocol::utils::error_response("ERR wrong number of arguments for 'DBSIZE'");
+        out.error("ERR wrong number of arguments for 'DBSIZE'");
+        return;
     }
     
     // Return number of keys in database
-    return protocol::Message::make_integer(static_cast<int64_t>(store_.size()));
+    out.integer(static_cast<int64_t>(store_.size() + sorted_sets_.size()));
 }
 
-protocol::MessagePtr KVStore::handle_info(const std::vector<std::string>& args) {
+void KVStore::handle_info(const protocol::Command& args, protocol::ResponseWriter& out) {
+    // INFO [section]: a single section, or everything
+    std::string section = args.size() > 1 ? to_upper(args[1]) : "ALL";
+    auto wants = [&section](const char* name) {
+        return section == "ALL" || section == "DEFAULT" || section == name;
+    };
+    
+    // Per-I/O-thread connection counts
+    auto loop_stats = EventLoopManager::instance().get_all_stats();
+    size_t connected_clients = 0;
+    for (const auto& stats : loop_stats) {
+        connected_clients += stats.active_connections;
+    }
+    
+    // Report the whole keyspace, not just this shard
+    KVStoreManager& manager = KVStoreManager::instance();
+    size_t keys = manager.is_sharded() ? manager.total_keys() : get_stats().keys_count;
+    size_t expires = manager.is_sharded() ? manager.total_expires() : get_stats().expires_count;
+    
     // Build info string
     std::ostringstream info;
     
-    info << "# Server\r\n";
-    info << "redis_version:ScuffedRedis-0.1.0\r\n";
-    info << "redis_mode:standalone\r\n";
-    info << "process_id:" << 1234 << "\r\n";  // Placeholder
-    info << "\r\n";
+    if (wants("SERVER")) {
+        info << "# Server\r\n";
+        info << "redis_version:ScuffedRedis-0.1.0\r\n";
+        info << "redis_mode:standalone\r\n";
+        info << "process_id:" << 1234 << "\r\n";  // Placeholder
+        info << "\r\n";
+    }
+    
+    if (wants("CLIENTS")) {
+        info << "# Clients\r\n";
+        info << "connected_clients:" << connected_clients << "\r\n";
+        info << "\r\n";
+    }
     
-    info << "# Clients\r\n";
-    info << "connected_clients:1\r\n";  // Placeholder
-    info << "\r\n";
+    if (wants("THREADS")) {
+        info << "# Threads\r\n";
+        info << "io_threads:" << loop_stats.size() << "\r\n";
+        for (size_t i = 0; i < loop_stats.size(); i++) {
+            info << "io_thread_" << i << ":accepted=" << loop_stats[i].accepted_connections
+                 << ",active=" << loop_stats[i].active_connections << "\r\n";
+        }
+        info << "\r\n";
+    }
     
-    info << "# Memory\r\n";
-    info << "used_memory:" << (store_.size() * 100) << "\r\n";  // Rough estimate
-    info << "\r\n";
+    if (wants("MEMORY")) {
+        size_t memory = manager.is_sharded() ? manager.total_memory() : store_.memory_usage();
+        auto slab = SlabAllocator::get_stats();
+        
+        info << "# Memory\r\n";
+        info << "used_memory:" << memory << "\r\n";  // Keyspace only
+        info << "bytes_per_key:" << (keys > 0 ? memory / keys : 0) << "\r\n";
+        info << "slab_reserved_bytes:" << slab.slab_bytes << "\r\n";
+        info << "slab_used_bytes:" << slab.used_bytes << "\r\n";
+        info << "slab_requested_bytes:" << slab.requested_bytes << "\r\n";
+        info << "slab_large_bytes:" << slab.large_bytes << "\r\n";
+        info << std::fixed << std::setprecision(3);
+        info << "slab_utilization:" << slab.utilization << "\r\n";
+        info << "slab_fragmentation:" << slab.fragmentation << "\r\n";
+        for (const auto& cls : slab.classes) {
+            info << "slab_class_" << cls.object_size << ":slabs=" << cls.slabs
+                 << ",used=" << cls.objects_in_use << ",free=" << cls.objects_free << "\r\n";
+        }
+        info << "\r\n";
+    }
     
-    info << "# Stats\r\n";
-    info << "total_commands_processed:" << commands_processed_.load() << "\r\n";
-    info << "instantaneous_ops_per_sec:0\r\n";  // Placeholder
-    info << "\r\n";
+    if (wants("STATS")) {
+        info << "# Stats\r\n";
+        info << "total_commands_processed:" << commands_processed_.load() << "\r\n";
+        info << "instantaneous_ops_per_sec:0\r\n";  // Placeholder
+        
+        // Active expiry, over every shard
+        Stats expiry = manager.is_sharded() ? manager.total_expiry_stats() : get_stats();
+        info << "expired_keys:" << expiry.expired_keys << "\r\n";
+        info << std::fixed << std::setprecision(2);
+        info << "instantaneous_expired_per_sec:" << expiry.expired_per_sec << "\r\n";
+        info << "expired_stale_perc:" << expiry.expired_stale_ratio * 100 << "\r\n";
+        info << "expired_time_cap_reached_count:" << expiry.expire_time_cap_reached << "\r\n";
+        info << "expire_cycle_cpu_milliseconds:" << expiry.expire_cycle_us / 1000 << "\r\n";
+        info << "\r\n";
+    }
     
-    info << "# Keyspace\r\n";
-    info << "db0:keys=" << store_.size() << ",expires=0\r\n";
+    if (wants("KEYSPACE")) {
+        info << "# Keyspace\r\n";
+        info << "hash_engine:" << hash_engine_name(store_.engine()) << "\r\n";
+        info << "zset_engine:" << zset_engine_name(sorted_sets_.options().engine) << "\r\n";
+        info << "zset_max_listpack_entries:" << sorted_sets_.options().listpack_max_entries << "\r\n";
+        info << "db0:keys=" << keys << ",expires=" << expires << "\r\n";
+        if (manager.is_sharded()) {
+            info << "\r\n";
+            info << "# Shards\r\n";
+            info << "shards:" << manager.shard_count() << "\r\n";
+            for (size_t i = 0; i < manager.shard_count(); i++) {
+                info << "shard_" << i << ":keys=" << manager.get_shard(i).get_stats().keys_count << "\r\n";
+            }
+        }
+    }
     
-    return protocol::Message::make_bulk_string(info.str());
+    out.bulk_string(info.str());
+}
+
+void KVStore::handle_type(const protocol::Command& args, protocol::ResponseWriter& out) {
+    if (args.size() != 2) {
+        out.error("ERR wrong number of arguments for 'TYPE'");
+        return;
+    }
+    
+    if (store_.exists(args[1])) {
+        out.simple_string("string");
+    } else if (sorted_sets_.exists(args[1])) {
+        out.simple_string("zset");
+    } else {
+        out.simple_string("none");
+    }
+}
+
+void KVStore::handle_setex(const protocol::Command& args, protocol::ResponseWriter& out) {
+    setex_generic(args, out, false);
+}
+
+void KVStore::handle_psetex(const protocol::Command& args, protocol::ResponseWriter& out) {
+    setex_generic(args, out, true);
+}
+
+void KVStore::setex_generic(const protocol::Command& args, protocol::ResponseWriter& out,
+                            bool milliseconds) {
+    // SETEX key seconds value, PSETEX key milliseconds value
+    std::string_view name = milliseconds ? "PSETEX" : "SETEX";
+    if (args.size() != 4) {
+        out.error("ERR wrong number of arguments for '" + std::string(name) + "'");
+        return;
+    }
+    
+    int64_t expire_at;
+    if (!parse_expire_time(args[2], milliseconds, false, name, out, expire_at)) {
+        return;
+    }
+    
+    set_commands_++;
+    set_string(args[1], args[3], SetCondition::ALWAYS, expire_at);
+    out.reply(protocol::Reply::OK);
+}
+
+void KVStore::handle_getex(const protocol::Command& args, protocol::ResponseWriter& out) {
+    // GETEX key [EX seconds|PX milliseconds|EXAT unix-time-seconds|
+    //            PXAT unix-time-milliseconds|PERSIST]
+    if (args.size() < 2) {
+        out.error("ERR wrong number of arguments for 'GETEX'");
+        return;
+    }
+    
+    // KEEP_EXPIRY until an option says otherwise; PERSIST is NO_EXPIRY
+    int64_t expire_at = KEEP_EXPIRY;
+    for (size_t i = 2; i < args.size(); i++) {
+        std::string_view option = args[i];
+        bool milliseconds;
+        bool absolute;
+        if (command_table::equals_ignore_case(option, "PERSIST") && expire_at == KEEP_EXPIRY) {
+            expire_at = NO_EXPIRY;
+        } else if (expiry_option(option, milliseconds, absolute) && expire_at == KEEP_EXPIRY &&
+                   i + 1 < args.size()) {
+            if (!parse_expire_time(args[++i], milliseconds, absolute, "GETEX", out, expire_at)) {
+                return;
+            }
+        } else {
+            out.reply(protocol::Reply::ERR_SYNTAX);
+            return;
+        }
+    }
+    
+    std::string_view key = args[1];
+    get_commands_++;
+    
+    // The new deadline goes on the value being returned, even if another
+    // thread is writing the key
+    auto reply = [&out](std::string_view value) { out.bulk_string(value); };
+    bool found = expire_at == KEEP_EXPIRY ? store_.read(key, reply)
+                                          : store_.read_and_expire(key, expire_at, reply);
+    if (!found) {
+        if (sorted_sets_.size() > 0 && sorted_sets_.exists(key)) {
+            out.reply(protocol::Reply::WRONG_TYPE);
+        } else {
+            out.reply(protocol::Reply::NIL);
+        }
+    }
+}
+
+// ============================================================================
+// Expiry Command Handlers
+// ============================================================================
+
+bool KVStore::key_exists(std::string_view key) const {
+    return store_.exists(key) || (sorted_sets_.size() > 0 && sorted_sets_.exists(key));
+}
+
+bool KVStore::delete_key(std::string_view key) {
+    return store_.del(key) || (sorted_sets_.size() > 0 && sorted_sets_.del(key));
+}
+
+std::optional<int64_t> KVStore::expire_time(std::string_view key) const {
+    if (auto expire_at = store_.expire_time(key)) {
+        return expire_at;
+    }
+    return sorted_sets_.size() > 0 ? sorted_sets_.expire_time(key) : std::nullopt;
+}
+
+std::optional<int64_t> KVStore::set_expire_time(std::string_view key, int64_t expire_at) {
+    if (auto previous = store_.set_expire_time(key, expire_at)) {
+        return previous;
+    }
+    return sorted_sets_.size() > 0 ? sorted_sets_.set_expire_time(key, expire_at) : std::nullopt;
+}
+
+void KVStore::handle_expire(const protocol::Command& args, protocol::ResponseWriter& out) {
+    expire_generic(args, out, "EXPIRE", false, false);
+}
+
+void KVStore::handle_pexpire(const protocol::Command& args, protocol::ResponseWriter& out) {
+    expire_generic(args, out, "PEXPIRE", true, false);
+}
+
+void KVStore::handle_expireat(const protocol::Command& args, protocol::ResponseWriter& out) {
+    expire_generic(args, out, "EXPIREAT", false, true);
+}
+
+void KVStore::handle_pexpireat(const protocol::Command& args, protocol::ResponseWriter& out) {
+    expire_generic(args, out, "PEXPIREAT", true, true);
+}
+
+void KVStore::expire_generic(const protocol::Command& args, protocol::ResponseWriter& out,
+                             std::string_view name, bool milliseconds, bool absolute) {
+    if (args.size() != 3) {
+        out.error("ERR wrong number of arguments for '" + std::string(name) + "'");
+        return;
+    }
+    
+    int64_t amount;
+    int64_t expire_at;
+    if (!parse_integer(args[2], amount)) {
+        out.error("ERR value is not an integer or out of range");
+        return;
+    }
+    if (!expiry_to_deadline(amount, milliseconds, absolute, expire_at)) {
+        out.error("ERR invalid expire time in '" + std::string(name) + "' command");
+        return;
+    }
+    
+    // As in Redis, a time already past deletes the key
+    std::string_view key = args[1];
+    bool done = expire_at <= unix_time_ms() ? delete_key(key)
+                                            : set_expire_time(key, expire_at).has_value();
+    out.integer(done ? 1 : 0);
+}
+
+void KVStore::handle_ttl(const protocol::Command& args, protocol::ResponseWriter& out) {
+    ttl_generic(args, out, false);
+}
+
+void KVStore::handle_pttl(const protocol::Command& args, protocol::ResponseWriter& out) {
+    ttl_generic(args, out, true);
+}
+
+void KVStore::ttl_generic(const protocol::Command& args, protocol::ResponseWriter& out,
+                          bool milliseconds) {
+    if (args.size() != 2) {
+        out.error(milliseconds ? "ERR wrong number of arguments for 'PTTL'"
+                               : "ERR wrong number of arguments for 'TTL'");
+        return;
+    }
+    
+    // -2 if the key doesn't exist, -1 if it has no TTL
+    std::optional<int64_t> expire_at = expire_time(args[1]);
+    if (!expire_at || *expire_at == NO_EXPIRY) {
+        out.integer(expire_at ? -1 : -2);
+        return;
+    }
+    
+    int64_t remaining = std::max<int64_t>(*expire_at - unix_time_ms(), 0);
+    out.integer(milliseconds ? remaining : (remaining + 500) / 1000);  // Rounded, as Redis does
+}
+
+void KVStore::handle_persist(const protocol::Command& args, protocol::ResponseWriter& out) {
+    if (args.size() != 2) {
+        out.error("ERR wrong number of arguments for 'PERSIST'");
+        return;
+    }
+    
+    std::optional<int64_t> previous = set_expire_time(args[1], NO_EXPIRY);
+    out.integer(previous && *previous != NO_EXPIRY ? 1 : 0);
+}
+
+// ============================================================================
+// Sorted Set Command Handlers
+// ============================================================================
+
+namespace {
+
+/**
+ * Parse a score: a decimal number or [+-]inf. NaN is rejected.
+ */
+bool parse_score(std::string_view text, double& score) {
+    // from_chars takes a leading '-' but not '+'
+    if (text.size() > 1 && text[0] == '+' && text[1] != '-' && text[1] != '+') {
+        text.remove_prefix(1);
+    }
+    
+    const char* end = text.data() + text.size();
+    auto [ptr, ec] = std::from_chars(text.data(), end, score);
+    return ec == std::errc() && ptr == end && !std::isnan(score);
+}
+
+/**
+ * Parse ZRANGEBYSCORE/ZCOUNT bounds: scores, each optionally prefixed with
+ * '(' to exclude it.
+ */
+bool parse_score_range(std::string_view min, std::string_view max, ScoreRange& range) {
+    range.min_exclusive = !min.empty() && min[0] == '(';
+    range.max_exclusive = !max.empty() && max[0] == '(';
+    min.remove_prefix(range.min_exclusive ? 1 : 0);
+    max.remove_prefix(range.max_exclusive ? 1 : 0);
+    return parse_score(min, range.min) && parse_score(max, range.max);
+}
+
+// Ranks past either end of an int are clamped by SortedSet anyway
+int clamp_rank(int64_t rank) {
+    return static_cast<int>(std::clamp<int64_t>(rank, INT_MIN, INT_MAX));
+}
+
+} // namespace
+
+template<typename Fn>
+KVStore::ZsetAccess KVStore::read_zset(std::string_view key, Fn&& fn) const {
+    if (sorted_sets_.read(key, std::forward<Fn>(fn))) {
+        return ZsetAccess::FOUND;
+    }
+    return store_.exists(key) ? ZsetAccess::WRONG_TYPE : ZsetAccess::MISSING;
+}
+
+template<typename Fn>
+KVStore::ZsetAccess KVStore::update_zset(std::string_view key, bool create, Fn&& fn) {
+    bool wrong_type = false;
+    bool found = sorted_sets_.update(key, create, [&](SortedSet& set) {
+        // A set created just now must not shadow a string. The set is
+        // counted before we look, pairing with the fence in set_string().
+        if (set.empty()) {
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (store_.exists(key)) {
+                wrong_type = true;
+                return;  // Left empty, so update() removes it
+            }
+        }
+        fn(set);
+    });
+    
+    if (wrong_type) {
+        return ZsetAccess::WRONG_TYPE;
+    }
+    if (found) {
+        return ZsetAccess::FOUND;
+    }
+    return store_.exists(key) ? ZsetAccess::WRONG_TYPE : ZsetAccess::MISSING;
+}
+
+void KVStore::write_members(protocol::ResponseWriter& out,
+                            const std::vector<std::pair<std::string, double>>& members,
+                            bool with_scores) {
+    if (!with_scores) {
+        out.array_header(static_cast<uint32_t>(members.size()));
+        for (const auto& [member, _] : members) {
+            out.bulk_string(member);
+        }
+        return;
+    }
+    
+    // RESP3 nests each member with its score; otherwise they alternate
+    bool nested = out.protocol() == protocol::Protocol::RESP3;
+    out.array_header(static_cast<uint32_t>(nested ? members.size() : members.size() * 2));
+    for (const auto& [member, score] : members) {
+        if (nested) {
+            out.array_header(2);
+        }
+        out.bulk_string(member);
+        out.double_value(score);
+    }
+}
+
+void KVStore::handle_zadd(const protocol::Command& args, protocol::ResponseWriter& out) {
+    // ZADD key [NX|XX] [GT|LT] [CH] [INCR] score member [score member ...]
+    if (args.size() < 4) {
+        out.error("ERR wrong number of arguments for 'ZADD'");
+        return;
+    }
+    
+    unsigned flags = 0;
+    bool count_changed = false;
+    size_t first = 2;
+    for (; first < args.size(); first++) {
+        std::string_view option = args[first];
+        if (command_table::equals_ignore_case(option, "NX")) {
+            flags |= SortedSet::ADD_NX;
+        } else if (command_table::equals_ignore_case(option, "XX")) {
+            flags |= SortedSet::ADD_XX;
+        } else if (command_table::equals_ignore_case(option, "GT")) {
+            flags |= SortedSet::ADD_GT;
+        } else if (command_table::equals_ignore_case(option, "LT")) {
+            flags |= SortedSet::ADD_LT;
+        } else if (command_table::equals_ignore_case(option, "CH")) {
+            count_changed = true;
+        } else if (command_table::equals_ignore_case(option, "INCR")) {
+            flags |= SortedSet::ADD_INCR;
+        } else {
+            break;
+        }
+    }
+    
+    size_t elements = args.size() - first;
+    if (elements == 0 || elements % 2 != 0) {
+        out.reply(protocol::Reply::ERR_SYNTAX);
+        return;
+    }
+    if ((flags & SortedSet::ADD_NX) && (flags & SortedSet::ADD_XX)) {
+        out.error("ERR XX and NX options at the same time are not compatible");
+        return;
+    }
+    if (((flags & SortedSet::ADD_GT) && (flags & SortedSet::ADD_LT)) ||
+        ((flags & SortedSet::ADD_NX) && (flags & (SortedSet::ADD_GT | SortedSet::ADD_LT)))) {
+        out.error("ERR GT, LT, and/or NX options at the same time are not compatible");
+        return;
+    }
+    bool incr = flags & SortedSet::ADD_INCR;
+    if (incr && elements != 2) {
+        out.error("ERR INCR option supports a single increment-element pair");
+        return;
+    }
+    
+    // Validate every score before changing anything
+    std::vector<double> scores(elements / 2);
+    for (size_t i = 0; i < scores.size(); i++) {
+        if (!parse_score(args[first + i * 2], scores[i])) {
+            out.error("ERR value is not a valid float");
+            return;
+        }
+    }
+    
+    int64_t added = 0;
+    int64_t updated = 0;
+    SortedSet::AddResult result = SortedSet::AddResult::SKIPPED;
+    double new_score = 0.0;
+    
+    // XX never creates the key
+    bool create = !(flags & SortedSet::ADD_XX);
+    ZsetAccess access = update_zset(args[1], create, [&](SortedSet& set) {
+        for (size_t i = 0; i < scores.size(); i++) {
+            result = set.add(args[first + i * 2 + 1], scores[i], flags, &new_score);
+            if (result == SortedSet::AddResult::ADDED) {
+                added++;
+            } else if (result == SortedSet::AddResult::UPDATED) {
+                updated++;
+            }
+        }
+    });
+    
+    if (access == ZsetAccess::WRONG_TYPE) {
+        out.reply(protocol::Reply::WRONG_TYPE);
+    } else if (!incr) {
+        out.integer(count_changed ? added + updated : added);
+    } else if (result == SortedSet::AddResult::NOT_A_NUMBER) {
+        out.error("ERR resulting score is not a number (NaN)");
+    } else if (access == ZsetAccess::MISSING || result == SortedSet::AddResult::SKIPPED) {
+        out.reply(protocol::Reply::NIL);
+    } else {
+        out.double_value(new_score);
+    }
+}
+
+void KVStore::handle_zincrby(const protocol::Command& args, protocol::ResponseWriter& out) {
+    if (args.size() != 4) {
+        out.error("ERR wrong number of arguments for 'ZINCRBY'");
+        return;
+    }
+    
+    double increment;
+    if (!parse_score(args[2], increment)) {
+        out.error("ERR value is not a valid float");
+        return;
+    }
+    
+    SortedSet::AddResult result = SortedSet::AddResult::SKIPPED;
+    double new_score = 0.0;
+    ZsetAccess access = update_zset(args[1], true, [&](SortedSet& set) {
+        result = set.add(args[3], increment, SortedSet::ADD_INCR, &new_score);
+    });
+    
+    if (access == ZsetAccess::WRONG_TYPE) {
+        out.reply(protocol::Reply::WRONG_TYPE);
+    } else if (result == SortedSet::AddResult::NOT_A_NUMBER) {
+        out.error("ERR resulting score is not a number (NaN)");
+    } else {
+        out.double_value(new_score);
+    }
+}
+
+void KVStore::handle_zrem(const protocol::Command& args, protocol::ResponseWriter& out) {
+    if (args.size() < 3) {
+        out.error("ERR wrong number of arguments for 'ZREM'");
+        return;
+    }
+    
+    int64_t removed = 0;
+    ZsetAccess access = update_zset(args[1], false, [&](SortedSet& set) {
+        for (size_t i = 2; i < args.size(); i++) {
+            removed += set.zrem(args[i]);
+        }
+    });
+    
+    if (access == ZsetAccess::WRONG_TYPE) {
+        out.reply(protocol::Reply::WRONG_TYPE);
+    } else {
+        out.integer(removed);
+    }
+}
+
+void KVStore::handle_zscore(const protocol::Command& args, protocol::ResponseWriter& out) {
+    if (args.size() != 3) {
+        out.error("ERR wrong number of arguments for 'ZSCORE'");
+        return;
+    }
+    
+    std::optional<double> score;
+    ZsetAccess access = read_zset(args[1], [&](const SortedSet& set) {
+        score = set.zscore(args[2]);
+    });
+    
+    if (access == ZsetAccess::WRONG_TYPE) {
+        out.reply(protocol::Reply::WRONG_TYPE);
+    } else if (score) {
+        out.double_value(*score);
+    } else {
+        out.reply(protocol::Reply::NIL);
+    }
+}
+
+void KVStore::handle_zrank(const protocol::Command& args, protocol::ResponseWriter& out) {
+    zrank_generic(args, out, false);
+}
+
+void KVStore::handle_zrevrank(const protocol::Command& args, protocol::ResponseWriter& out) {
+    zrank_generic(args, out, true);
+}
+
+void KVStore::zrank_generic(const protocol::Command& args, protocol::ResponseWriter& out,
+                            bool reverse) {
+    if (args.size() != 3) {
+        out.error(reverse ? "ERR wrong number of arguments for 'ZREVRANK'"
+                          : "ERR wrong number of arguments for 'ZRANK'");
+        return;
+    }
+    
+    std::optional<int> rank;
+    ZsetAccess access = read_zset(args[1], [&](const SortedSet& set) {
+        rank = reverse ? set.zrevrank(args[2]) : set.zrank(args[2]);
+    });
+    
+    if (access == ZsetAccess::WRONG_TYPE) {
+        out.reply(protocol::Reply::WRONG_TYPE);
+    } else if (rank) {
+        out.integer(*rank);
+    } else {
+        out.reply(protocol::Reply::NIL);
+    }
+}
+
+void KVStore::handle_zrange(const protocol::Command& args, protocol::ResponseWriter& out) {
+    zrange_generic(args, out, false);
+}
+
+void KVStore::handle_zrevrange(const protocol::Command& args, protocol::ResponseWriter& out) {
+    zrange_generic(args, out, true);
+}
+
+void KVStore::zrange_generic(const protocol::Command& args, protocol::ResponseWriter& out,
+                             bool reverse) {
+    // Z[REV]RANGE key start stop [WITHSCORES]
+    if (args.size() != 4 && args.size() != 5) {
+        out.error(reverse ? "ERR wrong number of arguments for 'ZREVRANGE'"
+                          : "ERR wrong number of arguments for 'ZRANGE'");
+        return;
+    }
+    
+    int64_t start, stop;
+    if (!parse_integer(args[2], start) || !parse_integer(args[3], stop)) {
+        out.error("ERR value is not an integer or out of range");
+        return;
+    }
+    
+    bool with_scores = false;
+    if (args.size() == 5) {
+        if (!command_table::equals_ignore_case(args[4], "WITHSCORES")) {
+            out.reply(protocol::Reply::ERR_SYNTAX);
+            return;
+        }
+        with_scores = true;
+    }
+    
+    std::vector<std::pair<std::string, double>> members;
+    ZsetAccess access = read_zset(args[1], [&](const SortedSet& set) {
+        members = reverse ? set.zrevrange(clamp_rank(start), clamp_rank(stop), with_scores)
+                          : set.zrange(clamp_rank(start), clamp_rank(stop), with_scores);
+    });
+    
+    if (access == ZsetAccess::WRONG_TYPE) {
+        out.reply(protocol::Reply::WRONG_TYPE);
+    } else {
+        write_members(out, members, with_scores);
+    }
+}
+
+void KVStore::handle_zrangebyscore(const protocol::Command& args, protocol::ResponseWriter& out) {
+    // ZRANGEBYSCORE key min max [WITHSCORES] [LIMIT offset count]
+    if (args.size() < 4) {
+        out.error("ERR wrong number of arguments for 'ZRANGEBYSCORE'");
+        return;
+    }
+    
+    ScoreRange range;
+    if (!parse_score_range(args[2], args[3], range)) {
+        out.error("ERR min or max is not a float");
+        return;
+    }
+    
+    bool with_scores = false;
+    int64_t offset = 0;
+    int64_t count = -1;
+    for (size_t i = 4; i < args.size(); i++) {
+        if (command_table::equals_ignore_case(args[i], "WITHSCORES")) {
+            with_scores = true;
+        } else if (command_table::equals_ignore_case(args[i], "LIMIT") && i + 2 < args.size()) {
+            if (!parse_integer(args[i + 1], offset) || !parse_integer(args[i + 2], count)) {
+                out.error("ERR value is not an integer or out of range");
+                return;
+            }
+            i += 2;
+        } else {
+            out.reply(protocol::Reply::ERR_SYNTAX);
+            return;
+        }
+    }
+    
+    std::vector<std::pair<std::string, double>> members;
+    ZsetAccess access = read_zset(args[1], [&](const SortedSet& set) {
+        // A negative offset matches nothing
+        if (offset >= 0) {
+            members = set.zrangebyscore(range, with_scores,
+                                        static_cast<size_t>(offset), count);
+        }
+    });
+    
+    if (access == ZsetAccess::WRONG_TYPE) {
+        out.reply(protocol::Reply::WRONG_TYPE);
+    } else {
+        write_members(out, members, with_scores);
+    }
+}
+
+void KVStore::handle_zcount(const protocol::Command& args, protocol::ResponseWriter& out) {
+    if (args.size() != 4) {
+        out.error("ERR wrong number of arguments for 'ZCOUNT'");
+        return;
+    }
+    
+    ScoreRange range;
+    if (!parse_score_range(args[2], args[3], range)) {
+        out.error("ERR min or max is not a float");
+        return;
+    }
+    
+    size_t count = 0;
+    ZsetAccess access = read_zset(args[1], [&](const SortedSet& set) {
+        count = set.zcount(range);
+    });
+    
+    if (access == ZsetAccess::WRONG_TYPE) {
+        out.reply(protocol::Reply::WRONG_TYPE);
+    } else {
+        out.integer(static_cast<int64_t>(count));
+    }
+}
+
+void KVStore::handle_zcard(const protocol::Command& args, protocol::ResponseWriter& out) {
+    if (args.size() != 2) {
+        out.error("ERR wrong number of arguments for 'ZCARD'");
+        return;
+    }
+    
+    size_t card = 0;
+    ZsetAccess access = read_zset(args[1], [&](const SortedSet& set) {
+        card = set.zcard();
+    });
+    
+    if (access == ZsetAccess::WRONG_TYPE) {
+        out.reply(protocol::Reply::WRONG_TYPE);
+    } else {
+        out.integer(static_cast<int64_t>(card));
+    }
+}
+
+void KVStore::handle_zunionstore(const protocol::Command& args, protocol::ResponseWriter& out) {
+    zstore_generic(args, out, ZSetOperation::UNION);
+}
+
+void KVStore::handle_zinterstore(const protocol::Command& args, protocol::ResponseWriter& out) {
+    zstore_generic(args, out, ZSetOperation::INTER);
+}
+
+void KVStore::handle_zdiffstore(const protocol::Command& args, protocol::ResponseWriter& out) {
+    zstore_generic(args, out, ZSetOperation::DIFF);
+}
+
+void KVStore::zstore_generic(const protocol::Command& args, protocol::ResponseWriter& out,
+                             ZSetOperation operation) {
+    // Z{UNION,INTER}STORE destination numkeys key [key ...] [WEIGHTS weight ...]
+    //                    [AGGREGATE SUM|MIN|MAX]
+    // ZDIFFSTORE destination numkeys key [key ...]
+    std::string_view name = operation == ZSetOperation::UNION ? "ZUNIONSTORE"
+                          : operation == ZSetOperation::INTER ? "ZINTERSTORE" : "ZDIFFSTORE";
+    if (args.size() < 4) {
+        out.error("ERR wrong number of arguments for '" + std::string(name) + "'");
+        return;
+    }
+    
+    int64_t numkeys;
+    if (!parse_integer(args[2], numkeys)) {
+        out.error("ERR value is not an integer or out of range");
+        return;
+    }
+    if (numkeys < 1) {
+        out.error("ERR at least 1 input key is needed for '" + std::string(name) + "' command");
+        return;
+    }
+    if (static_cast<uint64_t>(numkeys) > args.size() - 3) {
+        out.reply(protocol::Reply::ERR_SYNTAX);
+        return;
+    }
+    
+    size_t count = static_cast<size_t>(numkeys);
+    std::vector<double> weights;
+    ZSetAggregate aggregate = ZSetAggregate::SUM;
+    for (size_t i = 3 + count; i < args.size(); i++) {
+        bool weighted = operation != ZSetOperation::DIFF;
+        if (weighted && command_table::equals_ignore_case(args[i], "WEIGHTS") &&
+            i + count < args.size()) {
+            weights.resize(count);
+            for (size_t w = 0; w < count; w++) {
+                if (!parse_score(args[++i], weights[w])) {
+                    out.error("ERR weight value is not a float");
+                    return;
+                }
+            }
+        } else if (weighted && command_table::equals_ignore_case(args[i], "AGGREGATE") &&
+                   i + 1 < args.size()) {
+            std::string_view mode = args[++i];
+            if (command_table::equals_ignore_case(mode, "SUM")) {
+                aggregate = ZSetAggregate::SUM;
+            } else if (command_table::equals_ignore_case(mode, "MIN")) {
+                aggregate = ZSetAggregate::MIN;
+            } else if (command_table::equals_ignore_case(mode, "MAX")) {
+                aggregate = ZSetAggregate::MAX;
+            } else {
+                out.reply(protocol::Reply::ERR_SYNTAX);
+                return;
+            }
+        } else {
+            out.reply(protocol::Reply::ERR_SYNTAX);
+            return;
+        }
+    }
+    
+    // Copy each source out under its own lock, so no two are held at once.
+    // The sources are read one after another, not as one snapshot.
+    std::vector<ScoredMembers> inputs(count);
+    for (size_t i = 0; i < count; i++) {
+        ZsetAccess access = read_zset(args[3 + i], [&](const SortedSet& set) {
+            inputs[i] = set.zrange(0, -1, true);
+        });
+        if (access == ZsetAccess::WRONG_TYPE) {
+            out.reply(protocol::Reply::WRONG_TYPE);
+            return;
+        }
+    }
+    
+    SortedMemberViews result = combine_sorted_sets(operation, inputs, weights, aggregate);
+    
+    // The destination is overwritten whatever its type. As with SET, the
+    // fence orders our set before the look for a string, so a racing SET
+    // and store can't leave the key holding both
+    std::string_view destination = args[1];
+    sorted_sets_.store(destination, result);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    store_.del(destination);
+    
+    out.integer(static_cast<int64_t>(result.size()));
 }
 
 void KVStore::clear() {
     store_.clear();
+    sorted_sets_.clear();
     
     // Reset statistics
     commands_processed_ = 0;
@@ -280,16 +1236,202 @@ void KVStore::clear() {
     del_commands_ = 0;
 }
 
+void KVStore::background_maintenance() {
+    // Same slice Redis gives incremental rehashing in its cron
+    store_.rehash_for(std::chrono::milliseconds(1));
+    
+    // Keys that expire without being touched again
+    active_expire_cycle();
+}
+
+void KVStore::active_expire_cycle() {
+    using std::chrono::steady_clock;
+    auto start = steady_clock::now();
+    auto cutoff = start + expire_budget_;
+    
+    // Names are only gathered while someone is listening for them
+    PubSub& pubsub = PubSub::instance();
+    KeyBatch* names = nullptr;
+    if (pubsub.notify_expired() && pubsub.has_subscribers(EXPIRED_EVENT_CHANNEL)) {
+        expired_batch_.clear();
+        names = &expired_batch_;
+    }
+    
+    size_t removed = 0;
+    while (true) {
+        size_t batch = store_.remove_expired(EXPIRE_BATCH, names) +
+                       sorted_sets_.remove_expired(EXPIRE_BATCH, names);
+        removed += batch;
+        if (batch == 0) {
+            break;  // Nothing left that is due
+        }
+        if (steady_clock::now() >= cutoff) {
+            expire_time_cap_reached_++;
+            break;
+        }
+    }
+    
+    // One publish for the whole cycle, outside every table lock
+    if (names && !names->empty()) {
+        pubsub.publish(EXPIRED_EVENT_CHANNEL, *names);
+    }
+    auto end = steady_clock::now();
+    
+    // What is left decides how hard the next cycle works
+    ExpirySample sample = store_.sample_expiry(EXPIRE_SAMPLES);
+    sample += sorted_sets_.sample_expiry(EXPIRE_SAMPLES);
+    double stale = sample.sampled > 0 ? static_cast<double>(sample.expired) / sample.sampled : 0.0;
+    double effort = std::min(1.0, stale / EXPIRE_ACCEPTABLE_STALE);
+    expire_budget_ = EXPIRE_MIN_BUDGET + std::chrono::duration_cast<std::chrono::microseconds>(
+        (EXPIRE_MAX_BUDGET - EXPIRE_MIN_BUDGET) * effort);
+    
+    // Smoothed as Redis does for expired_stale_perc
+    expired_stale_ratio_ = expired_stale_ratio_.load() * 0.95 + stale * 0.05;
+    
+    // Removal rate averaged over the last EXPIRE_RATE_SAMPLES cycles
+    double interval = std::chrono::duration<double>(end - last_expire_cycle_).count();
+    last_expire_cycle_ = end;
+    expire_rates_[expire_rate_index_++ % EXPIRE_RATE_SAMPLES] = interval > 0 ? removed / interval : 0.0;
+    double rate = 0.0;
+    for (double sample_rate : expire_rates_) {
+        rate += sample_rate;
+    }
+    expired_per_sec_ = rate / EXPIRE_RATE_SAMPLES;
+    
+    expired_keys_ += removed;
+    expire_cycle_us_ += static_cast<size_t>(
+        std::chrono::duration_cast<std::chrono::microseconds>(end - start).count());
+}
+
 KVStore::Stats KVStore::get_stats() const {
     Stats stats;
-    stats.keys_count = store_.size();
-    stats.memory_usage = store_.size() * 100;  // Rough estimate
+    stats.keys_count = store_.size() + sorted_sets_.size();
+    stats.expires_count = store_.expires() + sorted_sets_.expires();
+    stats.memory_usage = store_.memory_usage();
     stats.commands_processed = commands_processed_.load();
     stats.get_commands = get_commands_.load();
     stats.set_commands = set_commands_.load();
     stats.del_commands = del_commands_.load();
+    stats.expired_keys = expired_keys_.load();
+    stats.expired_per_sec = expired_per_sec_.load();
+    stats.expired_stale_ratio = expired_stale_ratio_.load();
+    stats.expire_cycle_us = expire_cycle_us_.load();
+    stats.expire_time_cap_reached = expire_time_cap_reached_.load();
     
     return stats;
 }
 
+// ============================================================================
+// KVStoreManager Implementation
+// ============================================================================
+
+void KVStoreManager::set_hash_engine(HashEngine engine) {
+    engine_ = engine;
+    for (auto& shard : shards_) {
+        shard = std::make_unique<KVStore>(engine_, zset_options_);
+    }
+}
+
+void KVStoreManager::set_zset_options(const ZSetOptions& options) {
+    zset_options_ = options;
+    for (auto& shard : shards_) {
+        shard = std::make_unique<KVStore>(engine_, zset_options_);
+    }
+}
+
+void KVStoreManager::configure_shards(const std::vector<EventLoop*>& loops) {
+    // Shard 0 is kept so references from get_store() stay valid
+    size_t count = loops.empty() ? 1 : loops.size();
+    while (shards_.size() < count) {
+        shards_.push_back(std::make_unique<KVStore>(engine_, zset_options_));
+    }
+    shards_.resize(count);
+    
+    shard_loops_ = loops;
+    shard_loops_.resize(count, nullptr);
+    
+    LOG_INFO(format_log("Keyspace split into ", count, " shards"));
+}
+
+size_t KVStoreManager::shard_for_key(std::string_view key) const {
+    if (shards_.size() == 1) {
+        return 0;
+    }
+    
+    // Only the first non-empty {hash tag} counts, as in Redis Cluster, so
+    // related keys can be put on one shard
+    size_t open = key.find('{');
+    if (open != std::string_view::npos) {
+        size_t close = key.find('}', open + 1);
+        if (close != std::string_view::npos && close > open + 1) {
+            key = key.substr(open + 1, close - open - 1);
+        }
+    }
+    return murmur3_32(key.data(), key.size(), SHARD_HASH_SEED) % shards_.size();
+}
+
+size_t KVStoreManager::local_shard() const {
+    EventLoop* loop = EventLoop::current();
+    
+    for (size_t i = 0; loop && i < shard_loops_.size(); i++) {
+        if (shard_loops_[i] == loop) {
+            return i;
+        }
+    }
+    
+    return shards_.size();
+}
+
+size_t KVStoreManager::total_memory() const {
+    size_t total = 0;
+    for (const auto& shard : shards_) {
+        total += shard->get_stats().memory_usage;
+    }
+    return total;
+}
+
+size_t KVStoreManager::total_keys() const {
+    size_t total = 0;
+    for (const auto& shard : shards_) {
+        total += shard->get_stats().keys_count;
+    }
+    return total;
+}
+
+size_t KVStoreManager::total_expires() const {
+    size_t total = 0;
+    for (const auto& shard : shards_) {
+        total += shard->get_stats().expires_count;
+    }
+    return total;
+}
+
+KVStore::Stats KVStoreManager::total_expiry_stats() const {
+    KVStore::Stats total{};
+    double stale_weighted = 0.0;
+    for (const auto& shard : shards_) {
+        KVStore::Stats stats = shard->get_stats();
+        total.expires_count += stats.expires_count;
+        total.expired_keys += stats.expired_keys;
+        total.expired_per_sec += stats.expired_per_sec;
+        total.expire_cycle_us += stats.expire_cycle_us;
+        total.expire_time_cap_reached += stats.expire_time_cap_reached;
+        stale_weighted += stats.expired_stale_ratio * stats.expires_count;
+    }
+    if (total.expires_count > 0) {
+        total.expired_stale_ratio = stale_weighted / total.expires_count;
+    }
+    return total;
+}
+
+void KVStoreManager::schedule_maintenance(EventLoop& default_loop) {
+    for (size_t i = 0; i < shards_.size(); i++) {
+        EventLoop* loop = shard_loops_[i] ? shard_loops_[i] : &default_loop;
+        KVStore* shard = shards_[i].get();
+        loop->add_periodic(MAINTENANCE_INTERVAL, [shard]() {
+            shard->background_maintenance();
+        });
+    }
+}
+
 } // namespace scuffedredis
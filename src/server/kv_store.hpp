@@ -11,28 +11,30 @@
 #include "data/hashtable.hpp"
 #include "data/sorted_set.hpp"
 #include "protocol/protocol.hpp"
+#include "command_table.hpp"
+#include <array>
 #include <memory>
 #include <string>
+#include <string_view>
 #include <vector>
-#include <functional>
-#include <unordered_map>
 #include <atomic>
+#include <chrono>
+#include <optional>
 
 namespace scuffedredis {
 
-/**
- * Command handler function type.
- * Takes command arguments and returns response message.
- */
-using CommandHandlerFunc = std::function<protocol::MessagePtr(
-    const std::vector<std::string>&)>;
+class EventLoop;
 
 /**
  * Key-Value store with Redis command support.
  * 
  * Supported commands:
  * - GET key
- * - SET key value
+ * - SET key value [NX|XX] [EX seconds|PX milliseconds|EXAT unix-time-seconds|
+ *   PXAT unix-time-milliseconds|KEEPTTL]
+ * - SETEX / PSETEX key seconds|milliseconds value
+ * - GETEX key [EX seconds|PX milliseconds|EXAT unix-time-seconds|
+ *   PXAT unix-time-milliseconds|PERSIST]
  * - DEL key [key ...]
  * - EXISTS key [key ...]
  * - KEYS pattern
@@ -41,16 +43,35 @@ using CommandHandlerFunc = std::function<protocol::MessagePtr(
  * - FLUSHDB
  * - DBSIZE
  * - INFO
- * - ZADD key score member [score member ...]
- * - ZRANGE key start stop [WITHSCORES]
- * - ZRANK key member
+ * - TYPE key
+ * - ZADD key [NX|XX] [GT|LT] [CH] [INCR] score member [score member ...]
+ * - ZINCRBY key increment member
+ * - ZRANGE / ZREVRANGE key start stop [WITHSCORES]
+ * - ZRANGEBYSCORE key min max [WITHSCORES] [LIMIT offset count]
+ * - ZRANK / ZREVRANK key member
  * - ZREM key member [member ...]
  * - ZSCORE key member
  * - ZCARD key
+ * - ZCOUNT key min max
+ * - ZUNIONSTORE / ZINTERSTORE destination numkeys key [key ...]
+ *   [WEIGHTS weight ...] [AGGREGATE SUM|MIN|MAX]
+ * - ZDIFFSTORE destination numkeys key [key ...]
+ * - EXPIRE / PEXPIRE key seconds|milliseconds
+ * - EXPIREAT / PEXPIREAT key unix-time-seconds|unix-time-milliseconds
+ * - TTL / PTTL key
+ * - PERSIST key
+ * 
+ * Strings and sorted sets share one keyspace: a key holds one type, and
+ * commands for the other type get a WRONGTYPE error.
+ * 
+ * Keys of either type can expire. The deadline is kept on the key's own
+ * entry, so an expired key is gone to every command at once; its memory
+ * goes with the next write to it, or background_maintenance().
  */
 class KVStore {
 public:
-    KVStore();
+    explicit KVStore(HashEngine engine = HashEngine::CHAINED,
+                     const ZSetOptions& zset_options = ZSetOptions());
     ~KVStore();
     
     /**
@@ -59,22 +80,44 @@ public:
      */
     protocol::MessagePtr execute_command(const protocol::MessagePtr& request);
     
+    /**
+     * Execute an already parsed command, returning the reply as a message.
+     */
+    protocol::MessagePtr execute_command(const protocol::Command& args);
+    
+    /**
+     * Execute an already parsed command, appending the encoded reply
+     * to out. This is the request path; it allocates nothing for
+     * GET/SET beyond the output buffer's growth.
+     * An empty argument list is reported as a malformed command.
+     */
+    void execute(const protocol::Command& args, protocol::ResponseWriter& out);
+    
     /**
      * Execute a raw command (for testing).
      * Command format: ["SET", "key", "value"]
      */
     protocol::MessagePtr execute_raw(const std::vector<std::string>& args);
+    protocol::MessagePtr execute_raw(const protocol::Command& args);
     
     /**
      * Get store statistics.
      */
     struct Stats {
         size_t keys_count;
+        size_t expires_count;  // Keys with a TTL
         size_t memory_usage;  // Approximate
         size_t commands_processed;
         size_t get_commands;
         size_t set_commands;
         size_t del_commands;
+        
+        // Active expiry
+        size_t expired_keys;          // Removed by active expiry
+        double expired_per_sec;       // Recent removal rate
+        double expired_stale_ratio;   // Share of keys with a TTL found expired, smoothed
+        size_t expire_cycle_us;       // Time spent in expiry cycles
+        size_t expire_time_cap_reached;  // Cycles that ran out of budget
     };
     
     Stats get_stats() const;
@@ -83,11 +126,40 @@ public:
      * Clear all data.
      */
     void clear();
+    
+    /**
+     * Periodic housekeeping, called from an event loop timer.
+     * Spends a bounded slice of time migrating hash table buckets so
+     * resizes finish even when no writes arrive, and runs an active
+     * expiry cycle.
+     */
+    void background_maintenance();
 
 private:
     ConcurrentHashTable store_;                              // Main data store
     SortedSetManager sorted_sets_;                          // Sorted sets store
-    std::unordered_map<std::string, CommandHandlerFunc> handlers_;  // Command handlers
+    
+    // Active expiry (see active_expire_cycle())
+    static constexpr size_t EXPIRE_BATCH = 64;    // Keys removed per table segment per round
+    static constexpr size_t EXPIRE_SAMPLES = 20;  // Keys sampled per table segment per cycle
+    static constexpr std::chrono::microseconds EXPIRE_MIN_BUDGET{1000};
+    static constexpr std::chrono::microseconds EXPIRE_MAX_BUDGET{25000};  // A quarter of the interval
+    static constexpr double EXPIRE_ACCEPTABLE_STALE = 0.1;  // Stale share that earns the full budget
+    static constexpr size_t EXPIRE_RATE_SAMPLES = 16;       // Cycles averaged for expired_per_sec
+    
+    // Active expiry state, touched only by the maintenance timer
+    std::chrono::microseconds expire_budget_ = EXPIRE_MIN_BUDGET;
+    std::chrono::steady_clock::time_point last_expire_cycle_ = std::chrono::steady_clock::now();
+    double expire_rates_[EXPIRE_RATE_SAMPLES] = {};
+    size_t expire_rate_index_ = 0;
+    KeyBatch expired_batch_;  // Names for the expired event; reused each cycle
+    
+    // Active expiry statistics, read by INFO from any thread
+    std::atomic<size_t> expired_keys_{0};
+    std::atomic<double> expired_per_sec_{0.0};
+    std::atomic<double> expired_stale_ratio_{0.0};
+    std::atomic<size_t> expire_cycle_us_{0};
+    std::atomic<size_t> expire_time_cap_reached_{0};
     
     // Statistics counters
     mutable std::atomic<size_t> commands_processed_{0};
@@ -96,40 +168,171 @@ private:
     mutable std::atomic<size_t> del_commands_{0};
     
     /**
-     * Initialize command handlers.
+     * Command implementation: takes the arguments and writes the reply.
+     */
+    using Handler = void (KVStore::*)(const protocol::Command&, protocol::ResponseWriter&);
+    
+    /**
+     * Handlers indexed by CommandId; null for commands served elsewhere.
+     */
+    static const std::array<Handler, COMMAND_COUNT> HANDLERS;
+    static constexpr std::array<Handler, COMMAND_COUNT> make_handlers();
+    
+    /**
+     * Look up and run the handler for args[0].
+     */
+    void dispatch(const protocol::Command& args, protocol::ResponseWriter& out);
+    
+    /**
+     * Decode a reply written by a handler (for the message-based API).
      */
-    void init_handlers();
+    static protocol::MessagePtr decode_reply(const std::vector<uint8_t>& reply);
     
     // Command implementations
-    protocol::MessagePtr handle_get(const std::vector<std::string>& args);
-    protocol::MessagePtr handle_set(const std::vector<std::string>& args);
-    protocol::MessagePtr handle_del(const std::vector<std::string>& args);
-    protocol::MessagePtr handle_exists(const std::vector<std::string>& args);
-    protocol::MessagePtr handle_keys(const std::vector<std::string>& args);
-    protocol::MessagePtr handle_ping(const std::vector<std::string>& args);
-    protocol::MessagePtr handle_echo(const std::vector<std::string>& args);
-    protocol::MessagePtr handle_flushdb(const std::vector<std::string>& args);
-    protocol::MessagePtr handle_dbsize(const std::vector<std::string>& args);
-    protocol::MessagePtr handle_info(const std::vector<std::string>& args);
+    void handle_get(const protocol::Command& args, protocol::ResponseWriter& out);
+    void handle_set(const protocol::Command& args, protocol::ResponseWriter& out);
+    void handle_del(const protocol::Command& args, protocol::ResponseWriter& out);
+    void handle_exists(const protocol::Command& args, protocol::ResponseWriter& out);
+    void handle_keys(const protocol::Command& args, protocol::ResponseWriter& out);
+    void handle_ping(const protocol::Command& args, protocol::ResponseWriter& out);
+    void handle_echo(const protocol::Command& args, protocol::ResponseWriter& out);
+    void handle_flushdb(const protocol::Command& args, protocol::ResponseWriter& out);
+    void handle_dbsize(const protocol::Command& args, protocol::ResponseWriter& out);
+    void handle_info(const protocol::Command& args, protocol::ResponseWriter& out);
+    void handle_type(const protocol::Command& args, protocol::ResponseWriter& out);
+    void handle_setex(const protocol::Command& args, protocol::ResponseWriter& out);
+    void handle_psetex(const protocol::Command& args, protocol::ResponseWriter& out);
+    void handle_getex(const protocol::Command& args, protocol::ResponseWriter& out);
+    
+    /**
+     * Remove expired keys in rounds of EXPIRE_BATCH per table segment
+     * until none are due or the cycle's time budget is spent, then sample
+     * keys with a TTL to estimate how many expired ones remain. The next
+     * cycle's budget grows with that share, from EXPIRE_MIN_BUDGET when
+     * nothing is stale to EXPIRE_MAX_BUDGET at EXPIRE_ACCEPTABLE_STALE,
+     * so a burst of expiring keys is drained over several cycles instead
+     * of stalling the loop in one.
+     */
+    void active_expire_cycle();
+    
+    // Expiry command handlers
+    void handle_expire(const protocol::Command& args, protocol::ResponseWriter& out);
+    void handle_pexpire(const protocol::Command& args, protocol::ResponseWriter& out);
+    void handle_expireat(const protocol::Command& args, protocol::ResponseWriter& out);
+    void handle_pexpireat(const protocol::Command& args, protocol::ResponseWriter& out);
+    void handle_ttl(const protocol::Command& args, protocol::ResponseWriter& out);
+    void handle_pttl(const protocol::Command& args, protocol::ResponseWriter& out);
+    void handle_persist(const protocol::Command& args, protocol::ResponseWriter& out);
     
     // Sorted set command handlers
-    protocol::MessagePtr handle_zadd(const std::vector<std::string>& args);
-    protocol::MessagePtr handle_zrange(const std::vector<std::string>& args);
-    protocol::MessagePtr handle_zrank(const std::vector<std::string>& args);
-    protocol::MessagePtr handle_zrem(const std::vector<std::string>& args);
-    protocol::MessagePtr handle_zscore(const std::vector<std::string>& args);
-    protocol::MessagePtr handle_zcard(const std::vector<std::string>& args);
+    void handle_zadd(const protocol::Command& args, protocol::ResponseWriter& out);
+    void handle_zincrby(const protocol::Command& args, protocol::ResponseWriter& out);
+    void handle_zrange(const protocol::Command& args, protocol::ResponseWriter& out);
+    void handle_zrevrange(const protocol::Command& args, protocol::ResponseWriter& out);
+    void handle_zrangebyscore(const protocol::Command& args, protocol::ResponseWriter& out);
+    void handle_zrank(const protocol::Command& args, protocol::ResponseWriter& out);
+    void handle_zrevrank(const protocol::Command& args, protocol::ResponseWriter& out);
+    void handle_zrem(const protocol::Command& args, protocol::ResponseWriter& out);
+    void handle_zscore(const protocol::Command& args, protocol::ResponseWriter& out);
+    void handle_zcard(const protocol::Command& args, protocol::ResponseWriter& out);
+    void handle_zcount(const protocol::Command& args, protocol::ResponseWriter& out);
+    void handle_zunionstore(const protocol::Command& args, protocol::ResponseWriter& out);
+    void handle_zinterstore(const protocol::Command& args, protocol::ResponseWriter& out);
+    void handle_zdiffstore(const protocol::Command& args, protocol::ResponseWriter& out);
+    
+    /**
+     * Whether key holds a value of either type.
+     */
+    bool key_exists(std::string_view key) const;
+    
+    /**
+     * Delete key, whatever its type, along with its TTL.
+     * Returns true if the key existed.
+     */
+    bool delete_key(std::string_view key);
+    
+    /**
+     * Deadline of key, whatever its type: NO_EXPIRY if it has none, or
+     * nullopt if the key doesn't exist.
+     */
+    std::optional<int64_t> expire_time(std::string_view key) const;
+    
+    /**
+     * Set or (with NO_EXPIRY) remove the deadline of key, whatever its
+     * type. Returns the previous one, as expire_time() would have.
+     */
+    std::optional<int64_t> set_expire_time(std::string_view key, int64_t expire_at);
+    
+    /**
+     * When SET writes: always, or only if the key is absent (NX) or
+     * present (XX).
+     */
+    enum class SetCondition { ALWAYS, IF_ABSENT, IF_PRESENT };
+    
+    /**
+     * Shared by the SET family: write a string over whatever key holds,
+     * with a TTL ending at expire_at, or NO_EXPIRY, or KEEP_EXPIRY to keep
+     * the one it had. Returns false if the condition kept it from being
+     * written.
+     */
+    bool set_string(std::string_view key, std::string_view value, SetCondition condition,
+                    int64_t expire_at);
+    
+    /**
+     * Shared by EXPIRE, PEXPIRE, EXPIREAT and PEXPIREAT.
+     */
+    void expire_generic(const protocol::Command& args, protocol::ResponseWriter& out,
+                        std::string_view name, bool milliseconds, bool absolute);
+    void ttl_generic(const protocol::Command& args, protocol::ResponseWriter& out,
+                     bool milliseconds);
+    void setex_generic(const protocol::Command& args, protocol::ResponseWriter& out,
+                       bool milliseconds);
+    
+    /**
+     * What a sorted set command found at its key.
+     */
+    enum class ZsetAccess { FOUND, MISSING, WRONG_TYPE };
+    
+    /**
+     * Run fn on the sorted set at key (see SortedSetManager::read and
+     * update). A key without a set is WRONG_TYPE if it holds a string;
+     * update() never creates a set over a string.
+     */
+    template<typename Fn>
+    ZsetAccess read_zset(std::string_view key, Fn&& fn) const;
+    template<typename Fn>
+    ZsetAccess update_zset(std::string_view key, bool create, Fn&& fn);
+    
+    /**
+     * Shared by the ascending and descending variants.
+     */
+    void zrank_generic(const protocol::Command& args, protocol::ResponseWriter& out, bool reverse);
+    void zrange_generic(const protocol::Command& args, protocol::ResponseWriter& out, bool reverse);
+    void zstore_generic(const protocol::Command& args, protocol::ResponseWriter& out,
+                        ZSetOperation operation);
+    
+    /**
+     * Members, optionally with scores: flat in RESP2 and binary, as
+     * [member, score] pairs in RESP3.
+     */
+    static void write_members(protocol::ResponseWriter& out,
+                              const std::vector<std::pair<std::string, double>>& members,
+                              bool with_scores);
     
     /**
      * Convert command name to uppercase.
      * Redis commands are case-insensitive.
      */
-    std::string to_upper(const std::string& str) const;
+    std::string to_upper(std::string_view str) const;
 };
 
 /**
  * Global KV store instance manager.
  * Provides singleton access to the store.
+ * 
+ * In sharded (shared-nothing) mode the keyspace is split into one KVStore
+ * per I/O thread. A key always lives in shard_for_key(key), and requests
+ * for it are executed on the event loop thread that owns that shard.
  */
 class KVStoreManager {
 public:
@@ -138,11 +341,93 @@ public:
         return manager;
     }
     
-    KVStore& get_store() { return store_; }
+    /**
+     * Get the main store (shard 0 in sharded mode).
+     */
+    KVStore& get_store() { return *shards_.front(); }
+    
+    /**
+     * Select the hash table engine and recreate every shard with it.
+     * Must be called before configure_shards() and before any request
+     * is served, as it invalidates references from get_store().
+     */
+    void set_hash_engine(HashEngine engine);
+    HashEngine hash_engine() const { return engine_; }
+    
+    /**
+     * Select the sorted set engine and listpack limits, with the same
+     * caveats as set_hash_engine().
+     */
+    void set_zset_options(const ZSetOptions& options);
+    const ZSetOptions& zset_options() const { return zset_options_; }
+    
+    /**
+     * Split the keyspace into one shard per event loop; shard i is owned
+     * by loops[i]. Must be called before any request is served.
+     */
+    void configure_shards(const std::vector<EventLoop*>& loops);
+    
+    bool is_sharded() const { return shards_.size() > 1; }
+    size_t shard_count() const { return shards_.size(); }
+    KVStore& get_shard(size_t index) { return *shards_[index]; }
+    EventLoop* get_shard_loop(size_t index) const { return shard_loops_[index]; }
     
+    /**
+     * Get the shard that owns a key. A key containing a non-empty
+     * {hash tag} is placed by the tag alone, as in Redis Cluster.
+     */
+    size_t shard_for_key(std::string_view key) const;
+    
+    /**
+     * Get the shard owned by the calling thread.
+     * Returns shard_count() if the caller is not a shard's loop thread.
+     */
+    size_t local_shard() const;
+    
+    /**
+     * Total number of keys across all shards.
+     */
+    size_t total_keys() const;
+    
+    /**
+     * Total number of keys with a TTL across all shards.
+     */
+    size_t total_expires() const;
+    
+    /**
+     * Approximate dataset bytes across all shards.
+     */
+    size_t total_memory() const;
+    
+    /**
+     * Active expiry statistics summed over all shards; the stale ratio is
+     * weighted by each shard's keys with a TTL.
+     */
+    KVStore::Stats total_expiry_stats() const;
+    
+    /**
+     * Schedule background_maintenance() for every shard on its owning
+     * loop; unowned shards use default_loop.
+     */
+    void schedule_maintenance(EventLoop& default_loop);
+
 private:
-    KVStoreManager() = default;
-    KVStore store_;
+    KVStoreManager() {
+        shards_.push_back(std::make_unique<KVStore>());
+        shard_loops_.push_back(nullptr);
+    }
+    
+    std::vector<std::unique_ptr<KVStore>> shards_;  // Keyspace shards
+    std::vector<EventLoop*> shard_loops_;           // Owning loop per shard
+    HashEngine engine_ = HashEngine::CHAINED;       // Engine for new shards
+    ZSetOptions zset_options_;                      // Sorted set storage for new shards
+    
+    // Seed for shard selection, distinct from the hashtable's bucket seed
+    // so keys within a shard still spread over all of its buckets
+    static constexpr uint32_t SHARD_HASH_SEED = 0x9747b28c;
+    
+    // How often each shard runs its housekeeping
+    static constexpr std::chrono::milliseconds MAINTENANCE_INTERVAL{100};
 };
 
 } // namespace scuffedredis
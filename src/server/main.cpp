@@ -2,6 +2,8 @@
 
 #include "network/tcp_server.hpp"
 #include "server/command_handler.hpp"
+#include "server/pubsub.hpp"
+#include "event/event_loop.hpp"
 #include "utils/logger.hpp"
 #include <iostream>
 #include <cstdlib>
@@ -27,32 +29,97 @@ void signal_handler(int sig) {
 int main(int argc, char* argv[]) {
     std::string bind_address = "0.0.0.0";
     int port = 6379;
-
-    if (argc > 1) port = std::atoi(argv[1]);
-    if (argc > 2) bind_address = argv[2];
-
+    int io_threads = 1;
+    bool sharded = false;
+    HashEngine engine = HashEngine::CHAINED;
+    ZSetOptions zset_options;
+    bool notify_expired = false;
+    
+    // Usage: scuffed-redis-server [port] [bind_address] [--io-threads N] [--sharded]
+    //                            [--hash-engine chained|swiss] [--zset-engine skiplist|avl]
+    //                            [--zset-max-listpack-entries N]
+    //                            [--notify-keyspace-events classes]
+    int positional = 0;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--io-threads" && i + 1 < argc) {
+            io_threads = std::atoi(argv[++i]);
+        } else if (arg == "--sharded") {
+            sharded = true;
+        } else if (arg == "--hash-engine" && i + 1 < argc) {
+            if (!parse_hash_engine(argv[++i], engine)) {
+                std::cerr << "--hash-engine must be chained or swiss" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--zset-engine" && i + 1 < argc) {
+            if (!parse_zset_engine(argv[++i], zset_options.engine)) {
+                std::cerr << "--zset-engine must be skiplist or avl" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--zset-max-listpack-entries" && i + 1 < argc) {
+            int entries = std::atoi(argv[++i]);
+            if (entries < 0) {
+                std::cerr << "--zset-max-listpack-entries must not be negative" << std::endl;
+                return 1;
+            }
+            zset_options.listpack_max_entries = static_cast<uint32_t>(entries);
+        } else if (arg == "--notify-keyspace-events" && i + 1 < argc) {
+            if (!parse_keyspace_events(argv[++i], notify_expired)) {
+                std::cerr << "--notify-keyspace-events takes Redis event classes, e.g. Ex" << std::endl;
+                return 1;
+            }
+        } else if (positional == 0) {
+            port = std::atoi(argv[i]);
+            positional++;
+        } else if (positional == 1) {
+            bind_address = arg;
+            positional++;
+        }
+    }
+    
+    if (io_threads < 1) {
+        std::cerr << "--io-threads must be at least 1" << std::endl;
+        return 1;
+    }
+    
     Logger::instance().set_level(LogLevel::INFO);
-
+    
     std::cout << "ScuffedRedis Server v1.0.0" << std::endl;
     std::cout << "Server initialized on " << bind_address << ":" << port << std::endl;
-
+    
     signal(SIGINT, signal_handler);
     signal(SIGTERM, signal_handler);
-
+    
     TcpServer server;
     g_server = &server;
-
-    if (!server.init(bind_address, port)) {
+    
+    if (!server.init(bind_address, port, static_cast<size_t>(io_threads))) {
         LOG_FATAL("Failed to initialize server");
         return 1;
     }
-
+    
+    KVStoreManager::instance().set_hash_engine(engine);
+    KVStoreManager::instance().set_zset_options(zset_options);
+    PubSub::instance().set_notify_expired(notify_expired);
+    
+    // Shared-nothing mode: one keyspace shard per I/O thread
+    if (sharded) {
+        std::vector<EventLoop*> loops;
+        for (size_t i = 0; i < server.get_io_thread_count(); i++) {
+            loops.push_back(&server.get_io_loop(i));
+        }
+        KVStoreManager::instance().configure_shards(loops);
+    }
+    
+    // Idle-time housekeeping (incremental rehashing) on the event loops
+    KVStoreManager::instance().schedule_maintenance(server.get_io_loop(0));
+    
     std::cout << "Server listening on " << bind_address << ":" << port << std::endl;
     std::cout << "Supported commands: GET, SET, DEL, EXISTS, KEYS, PING, ECHO, INFO" << std::endl;
     std::cout << "Press Ctrl+C to stop the server" << std::endl;
-
-    server.run_blocking(make_command_handler());
-
+    
+    server.run_event_loop(make_command_handler());
+    
     std::cout << "Server stopped" << std::endl;
     g_server = nullptr;
     return 0;
@@ -0,0 +1,196 @@
+#include "pubsub.hpp"
+#include "event/event_loop.hpp"
+#include "network/tcp_server.hpp"
+#include "utils/logger.hpp"
+#include <algorithm>
+#include <functional>
+#include <memory>
+
+namespace scuffedredis {
+
+namespace {
+
+// Output a subscriber may leave unread before it is disconnected, like
+// the hard limit of Redis' client-output-buffer-limit for pubsub clients
+constexpr size_t SUBSCRIBER_OUTPUT_LIMIT = 32 * 1024 * 1024;
+
+using Encoded = std::shared_ptr<const std::vector<uint8_t>>;
+
+} // namespace
+
+bool parse_keyspace_events(const std::string& flags, bool& expired) {
+    bool keyevent = false;
+    bool expired_class = false;
+    for (char c : flags) {
+        switch (c) {
+            case 'E': keyevent = true; break;
+            case 'x':
+            case 'A': expired_class = true; break;
+            case 'K': case 'g': case '$': case 'l': case 's': case 'h':
+            case 'z': case 'e': case 't': case 'm': case 'd': case 'n':
+                break;  // Known, but never delivered
+            default:
+                return false;
+        }
+    }
+    expired = keyevent && expired_class;
+    return true;
+}
+
+size_t PubSub::subscribe(std::string_view channel, EventLoop* loop, uint64_t conn_id,
+                         protocol::Protocol protocol) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    
+    std::vector<std::string>& subscribed = clients_[ClientKey(loop, conn_id)];
+    if (std::find(subscribed.begin(), subscribed.end(), channel) == subscribed.end()) {
+        subscribed.emplace_back(channel);
+        channels_[std::string(channel)].push_back(Subscriber{loop, conn_id, protocol});
+    }
+    return subscribed.size();
+}
+
+size_t PubSub::unsubscribe(std::string_view channel, EventLoop* loop, uint64_t conn_id) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return remove_subscription(channel, loop, conn_id);
+}
+
+size_t PubSub::remove_subscription(std::string_view channel, EventLoop* loop, uint64_t conn_id) {
+    auto client = clients_.find(ClientKey(loop, conn_id));
+    if (client == clients_.end()) {
+        return 0;
+    }
+    
+    std::vector<std::string>& subscribed = client->second;
+    auto name = std::find(subscribed.begin(), subscribed.end(), channel);
+    if (name == subscribed.end()) {
+        return subscribed.size();
+    }
+    
+    auto it = channels_.find(*name);
+    std::vector<Subscriber>& subscribers = it->second;
+    subscribers.erase(std::find_if(subscribers.begin(), subscribers.end(),
+                                   [&](const Subscriber& subscriber) {
+                                       return subscriber.loop == loop && subscriber.conn_id == conn_id;
+                                   }));
+    if (subscribers.empty()) {
+        channels_.erase(it);
+    }
+    
+    subscribed.erase(name);
+    size_t remaining = subscribed.size();
+    if (remaining == 0) {
+        clients_.erase(client);
+    }
+    return remaining;
+}
+
+std::vector<std::string> PubSub::channels_of(EventLoop* loop, uint64_t conn_id) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    
+    auto it = clients_.find(ClientKey(loop, conn_id));
+    return it != clients_.end() ? it->second : std::vector<std::string>();
+}
+
+bool PubSub::has_subscribers(std::string_view channel) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return channels_.count(std::string(channel)) > 0;
+}
+
+void PubSub::drop_client(EventLoop* loop, uint64_t conn_id) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    
+    auto it = clients_.find(ClientKey(loop, conn_id));
+    if (it == clients_.end()) {
+        return;
+    }
+    
+    // Copied, as removing the last channel erases the entry
+    std::vector<std::string> subscribed = it->second;
+    for (const std::string& channel : subscribed) {
+        remove_subscription(channel, loop, conn_id);
+    }
+}
+
+template<typename MessageAt>
+size_t PubSub::deliver(std::string_view channel, size_t count, MessageAt&& message) {
+    std::vector<Subscriber> targets;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = channels_.find(std::string(channel));
+        if (it != channels_.end()) {
+            targets = it->second;
+        }
+    }
+    
+    // Closing connections leave their channels as they go; this only
+    // catches one that closed since the list was copied
+    targets.erase(std::remove_if(targets.begin(), targets.end(), [](const Subscriber& target) {
+        return !target.loop->get_connections().get_connection(target.conn_id);
+    }), targets.end());
+    if (targets.empty() || count == 0) {
+        return targets.size();
+    }
+    
+    // The same bytes go to every subscriber speaking the same protocol
+    Encoded encoded[2];  // RESP2, RESP3
+    auto encoding = [&](protocol::Protocol version) -> const Encoded& {
+        Encoded& bytes = encoded[version == protocol::Protocol::RESP3 ? 1 : 0];
+        if (!bytes) {
+            auto out = std::make_shared<std::vector<uint8_t>>();
+            protocol::ResponseWriter writer(*out, version);
+            for (size_t i = 0; i < count; i++) {
+                writer.push_header(3);
+                writer.bulk_string("message");
+                writer.bulk_string(channel);
+                writer.bulk_string(message(i));
+            }
+            bytes = std::move(out);
+        }
+        return bytes;
+    };
+    
+    // One task per event loop, which writes to all of its subscribers
+    std::sort(targets.begin(), targets.end(), [](const Subscriber& a, const Subscriber& b) {
+        return std::less<EventLoop*>()(a.loop, b.loop);
+    });
+    for (size_t begin = 0; begin < targets.size();) {
+        EventLoop* loop = targets[begin].loop;
+        std::vector<std::pair<uint64_t, Encoded>> batch;
+        for (; begin < targets.size() && targets[begin].loop == loop; begin++) {
+            batch.emplace_back(targets[begin].conn_id, encoding(targets[begin].protocol));
+        }
+        
+        loop->post([this, loop, batch = std::move(batch)]() {
+            for (const auto& [conn_id, bytes] : batch) {
+                ClientConnection* client = loop->get_connections().get_connection(conn_id);
+                if (!client || !client->is_connected()) {
+                    continue;  // Closed since the publish; it left its channels
+                }
+                
+                if (client->pending_output() + bytes->size() > SUBSCRIBER_OUTPUT_LIMIT) {
+                    LOG_WARN(format_log("Closing subscriber ", client->get_client_info(),
+                                        " for not reading its messages"));
+                    drop_client(loop, conn_id);
+                    loop->notify(client->get_socket().get_fd(), EventType::ERROR_EVENT);
+                    continue;
+                }
+                
+                std::vector<uint8_t>& out = client->output_buffer();
+                out.insert(out.end(), bytes->begin(), bytes->end());
+                loop->notify(client->get_socket().get_fd(), EventType::WRITE);
+            }
+        });
+    }
+    
+    return targets.size();
+}
+
+size_t PubSub::publish(std::string_view channel, std::string_view message) {
+    return deliver(channel, 1, [&](size_t) { return message; });
+}
+
+size_t PubSub::publish(std::string_view channel, const KeyBatch& messages) {
+    return deliver(channel, messages.size(), [&](size_t i) { return messages[i]; });
+}
+
+} // namespace scuffedredis
@@ -0,0 +1,116 @@
+#ifndef SCUFFEDREDIS_PUBSUB_HPP
+#define SCUFFEDREDIS_PUBSUB_HPP
+
+/**
+ * Publish/subscribe channels and keyspace event notifications.
+ * 
+ * Subscribers are connections, named by their event loop and connection
+ * ID, since messages may be published from any thread. A publish encodes
+ * its messages once per protocol in use and posts a single task to each
+ * loop with subscribers, which appends the bytes to their output buffers;
+ * nothing is allocated per message or per subscriber.
+ */
+
+#include "data/expiry_index.hpp"
+#include "protocol/protocol.hpp"
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace scuffedredis {
+
+class EventLoop;
+
+// Where keys removed by active expiry are announced, as in Redis
+constexpr std::string_view EXPIRED_EVENT_CHANNEL = "__keyevent@0__:expired";
+
+/**
+ * Parse a notify-keyspace-events class string ("Ex", "KEA", "" ...), as
+ * Redis spells it. Only keyevent notifications for expired keys are
+ * delivered, so the result is whether those are on (E plus x or A).
+ * Returns false for letters Redis does not know.
+ */
+bool parse_keyspace_events(const std::string& flags, bool& expired);
+
+/**
+ * Channel registry shared by every event loop.
+ */
+class PubSub {
+public:
+    static PubSub& instance() {
+        static PubSub pubsub;
+        return pubsub;
+    }
+    
+    /**
+     * Add or drop one of a connection's subscriptions. Both return the
+     * number of channels the connection is subscribed to afterwards.
+     */
+    size_t subscribe(std::string_view channel, EventLoop* loop, uint64_t conn_id,
+                     protocol::Protocol protocol);
+    size_t unsubscribe(std::string_view channel, EventLoop* loop, uint64_t conn_id);
+    
+    /**
+     * Channels a connection is subscribed to, in no particular order.
+     */
+    std::vector<std::string> channels_of(EventLoop* loop, uint64_t conn_id) const;
+    
+    /**
+     * Forget every subscription of a connection that is closing. Called
+     * by the server as it closes a connection with subscriptions.
+     */
+    void drop_client(EventLoop* loop, uint64_t conn_id);
+    
+    bool has_subscribers(std::string_view channel) const;
+    
+    /**
+     * Send one message, or each key of a batch as a message of its own,
+     * to every subscriber of a channel. Returns the number of
+     * subscribers still connected, each of which gets the messages in
+     * order.
+     */
+    size_t publish(std::string_view channel, std::string_view message);
+    size_t publish(std::string_view channel, const KeyBatch& messages);
+    
+    /**
+     * Whether expired keys are announced on EXPIRED_EVENT_CHANNEL
+     * (--notify-keyspace-events). Off by default, as in Redis.
+     */
+    void set_notify_expired(bool enabled) { notify_expired_ = enabled; }
+    bool notify_expired() const { return notify_expired_; }
+
+private:
+    PubSub() = default;
+    
+    struct Subscriber {
+        EventLoop* loop;
+        uint64_t conn_id;
+        protocol::Protocol protocol;  // As at SUBSCRIBE; RESP2 or RESP3
+    };
+    
+    using ClientKey = std::pair<EventLoop*, uint64_t>;
+    
+    mutable std::mutex mutex_;
+    std::unordered_map<std::string, std::vector<Subscriber>> channels_;
+    std::map<ClientKey, std::vector<std::string>> clients_;  // Channels per connection
+    std::atomic<bool> notify_expired_{false};
+    
+    /**
+     * Encode `count` messages produced by `message(i)` for each protocol
+     * the channel's subscribers use, and hand them to their loops.
+     */
+    template<typename MessageAt>
+    size_t deliver(std::string_view channel, size_t count, MessageAt&& message);
+    
+    size_t remove_subscription(std::string_view channel, EventLoop* loop, uint64_t conn_id);
+};
+
+} // namespace scuffedredis
+
+#endif // SCUFFEDREDIS_PUBSUB_HPP
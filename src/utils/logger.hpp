@@ -41,6 +41,11 @@ public:
         min_level_ = level;
     }
     
+    // Check if messages at this level are written
+    bool enabled(LogLevel level) const {
+        return level >= min_level_;
+    }
+    
     // Enable/disable timestamp
     void set_show_timestamp(bool show) {
         show_timestamp_ = show;
@@ -94,8 +99,13 @@ private:
 
 // Convenience macros for logging
 // These capture file and line information for debugging
+// Debug messages are only built when enabled; they sit on hot paths
 #define LOG_DEBUG(msg) \
-    scuffedredis::Logger::instance().debug(msg)
+    do { \
+        if (scuffedredis::Logger::instance().enabled(scuffedredis::LogLevel::DEBUG)) { \
+            scuffedredis::Logger::instance().debug(msg); \
+        } \
+    } while (0)
 
 #define LOG_INFO(msg) \
     scuffedredis::Logger::instance().info(msg)
@@ -0,0 +1,79 @@
+#ifndef SCUFFEDREDIS_MPSC_QUEUE_HPP
+#define SCUFFEDREDIS_MPSC_QUEUE_HPP
+
+/**
+ * Lock-free multi-producer single-consumer queue.
+ *
+ * Used to pass work between event loop threads: any thread may push,
+ * only the owning loop thread pops. Based on Dmitry Vyukov's intrusive
+ * MPSC node queue - push is a single atomic exchange, pop never blocks.
+ */
+
+#include <atomic>
+#include <utility>
+
+namespace scuffedredis {
+
+template<typename T>
+class MpscQueue {
+public:
+    MpscQueue() : head_(new Node()), tail_(head_.load(std::memory_order_relaxed)) {}
+
+    ~MpscQueue() {
+        // Free the stub and anything still queued
+        Node* node = tail_;
+        while (node) {
+            Node* next = node->next.load(std::memory_order_relaxed);
+            delete node;
+            node = next;
+        }
+    }
+
+    MpscQueue(const MpscQueue&) = delete;
+    MpscQueue& operator=(const MpscQueue&) = delete;
+
+    /**
+     * Push a value. Safe to call from any thread.
+     */
+    void push(T value) {
+        Node* node = new Node(std::move(value));
+        Node* prev = head_.exchange(node, std::memory_order_acq_rel);
+        // Between the exchange and this store the consumer sees the queue
+        // as ending at prev; it just retries on its next pop.
+        prev->next.store(node, std::memory_order_release);
+    }
+
+    /**
+     * Pop a value. Must only be called from the consumer thread.
+     * Returns false if the queue is (momentarily) empty.
+     */
+    bool pop(T& out) {
+        Node* tail = tail_;
+        Node* next = tail->next.load(std::memory_order_acquire);
+        if (!next) {
+            return false;
+        }
+
+        // next becomes the new stub once its value is moved out
+        out = std::move(next->value);
+        tail_ = next;
+        delete tail;
+        return true;
+    }
+
+private:
+    struct Node {
+        std::atomic<Node*> next;
+        T value;
+
+        Node() : next(nullptr), value() {}
+        explicit Node(T v) : next(nullptr), value(std::move(v)) {}
+    };
+
+    std::atomic<Node*> head_;  // Most recently pushed node (producers)
+    Node* tail_;               // Stub node before the oldest item (consumer)
+};
+
+} // namespace scuffedredis
+
+#endif // SCUFFEDREDIS_MPSC_QUEUE_HPP
@@ -0,0 +1,351 @@
+#include "slab_allocator.hpp"
+#include <atomic>
+#include <mutex>
+#include <cstdlib>
+#include <algorithm>
+
+namespace scuffedredis {
+
+namespace {
+
+// ============================================================================
+// Size Classes
+// ============================================================================
+
+// 16..128 in steps of 16, 160..256 in steps of 32, 320..512 in steps of 64
+constexpr size_t NUM_CLASSES = 16;
+
+constexpr size_t CLASS_SIZES[NUM_CLASSES] = {
+    16, 32, 48, 64, 80, 96, 112, 128,
+    160, 192, 224, 256,
+    320, 384, 448, 512
+};
+
+// Objects moved between a thread list and the shared pool at once
+constexpr size_t TRANSFER_BATCH = 64;
+
+// A thread list longer than this gives a batch back
+constexpr size_t MAX_THREAD_LIST = 2 * TRANSFER_BATCH;
+
+inline size_t class_index(size_t size) {
+    if (size <= 128) {
+        return size == 0 ? 0 : (size - 1) / 16;
+    }
+    if (size <= 256) {
+        return 8 + (size - 129) / 32;
+    }
+    return 12 + (size - 257) / 64;
+}
+
+// Free objects are linked through their first word
+struct FreeObject {
+    FreeObject* next;
+};
+
+// ============================================================================
+// Shared Pools
+// ============================================================================
+
+struct CentralList {
+    std::mutex mutex;
+    FreeObject* head = nullptr;
+    size_t length = 0;
+    std::atomic<size_t> slabs{0};
+};
+
+struct ThreadCache;
+
+/**
+ * Process-wide state. Never destroyed, so objects freed during static
+ * destruction still have somewhere to go.
+ */
+struct Arena {
+    CentralList lists[NUM_CLASSES];
+    
+    // Live caches, plus the counters of threads that have exited
+    std::mutex caches_mutex;
+    std::vector<ThreadCache*> caches;
+    int64_t retired_in_use[NUM_CLASSES] = {};
+    int64_t retired_requested = 0;
+    int64_t retired_large = 0;
+    
+    static Arena& instance() {
+        static Arena* arena = new Arena();
+        return *arena;
+    }
+    
+    /**
+     * Take up to TRANSFER_BATCH objects, carving a new slab if the pool
+     * is empty. Returns the chain and its length.
+     */
+    FreeObject* take_batch(size_t cls, size_t& count);
+    
+    /**
+     * Give a chain of `count` objects back to the pool.
+     */
+    void give_back(size_t cls, FreeObject* head, FreeObject* tail, size_t count);
+};
+
+/**
+ * Per-thread free lists and usage counters. Counters are only written by
+ * the owning thread; get_stats() reads them relaxed.
+ */
+struct ThreadCache {
+    FreeObject* lists[NUM_CLASSES] = {};
+    size_t lengths[NUM_CLASSES] = {};
+    
+    // In use may go negative on a thread that frees others' objects
+    std::atomic<int64_t> in_use[NUM_CLASSES] = {};
+    std::atomic<int64_t> requested{0};
+    std::atomic<int64_t> large{0};
+    
+    ThreadCache();
+    ~ThreadCache();
+    
+    void add(std::atomic<int64_t>& counter, int64_t delta) {
+        counter.store(counter.load(std::memory_order_relaxed) + delta,
+                      std::memory_order_relaxed);
+    }
+};
+
+// Set once this thread's cache is destroyed (thread exit); later frees
+// go straight to the shared pools
+thread_local bool cache_destroyed = false;
+thread_local ThreadCache thread_cache;
+
+FreeObject* Arena::take_batch(size_t cls, size_t& count) {
+    CentralList& list = lists[cls];
+    std::lock_guard<std::mutex> lock(list.mutex);
+    
+    if (!list.head) {
+        // Carve a fresh page-aligned slab into a chain of objects
+        size_t object_size = CLASS_SIZES[cls];
+        size_t objects = SlabAllocator::SLAB_SIZE / object_size;
+        char* slab = static_cast<char*>(
+            ::operator new(SlabAllocator::SLAB_SIZE, std::align_val_t{4096}));
+        
+        for (size_t i = 0; i < objects; i++) {
+            auto* object = reinterpret_cast<FreeObject*>(slab + i * object_size);
+            object->next = (i + 1 < objects)
+                ? reinterpret_cast<FreeObject*>(slab + (i + 1) * object_size)
+                : nullptr;
+        }
+        
+        list.head = reinterpret_cast<FreeObject*>(slab);
+        list.length = objects;
+        list.slabs.fetch_add(1, std::memory_order_relaxed);
+    }
+    
+    // Detach up to a batch from the front
+    FreeObject* head = list.head;
+    FreeObject* tail = head;
+    count = 1;
+    while (count < TRANSFER_BATCH && tail->next) {
+        tail = tail->next;
+        count++;
+    }
+    
+    list.head = tail->next;
+    list.length -= count;
+    tail->next = nullptr;
+    return head;
+}
+
+void Arena::give_back(size_t cls, FreeObject* head, FreeObject* tail, size_t count) {
+    CentralList& list = lists[cls];
+    std::lock_guard<std::mutex> lock(list.mutex);
+    
+    tail->next = list.head;
+    list.head = head;
+    list.length += count;
+}
+
+ThreadCache::ThreadCache() {
+    Arena& arena = Arena::instance();
+    std::lock_guard<std::mutex> lock(arena.caches_mutex);
+    arena.caches.push_back(this);
+}
+
+ThreadCache::~ThreadCache() {
+    Arena& arena = Arena::instance();
+    
+    // Hand every cached object back
+    for (size_t cls = 0; cls < NUM_CLASSES; cls++) {
+        if (lists[cls]) {
+            FreeObject* tail = lists[cls];
+            while (tail->next) {
+                tail = tail->next;
+            }
+            arena.give_back(cls, lists[cls], tail, lengths[cls]);
+        }
+    }
+    
+    {
+        std::lock_guard<std::mutex> lock(arena.caches_mutex);
+        for (size_t cls = 0; cls < NUM_CLASSES; cls++) {
+            arena.retired_in_use[cls] += in_use[cls].load(std::memory_order_relaxed);
+        }
+        arena.retired_requested += requested.load(std::memory_order_relaxed);
+        arena.retired_large += large.load(std::memory_order_relaxed);
+        arena.caches.erase(std::remove(arena.caches.begin(), arena.caches.end(), this),
+                           arena.caches.end());
+    }
+    
+    cache_destroyed = true;
+}
+
+} // namespace
+
+// ============================================================================
+// SlabAllocator Implementation
+// ============================================================================
+
+void* SlabAllocator::allocate(size_t size) {
+    if (size > MAX_SLAB_OBJECT) {
+        void* memory = std::malloc(size);
+        if (!memory) {
+            throw std::bad_alloc();
+        }
+        if (!cache_destroyed) {
+            thread_cache.add(thread_cache.large, static_cast<int64_t>(size));
+        }
+        return memory;
+    }
+    
+    size_t cls = class_index(size);
+    
+    if (cache_destroyed) {
+        // Thread is exiting: serve straight from the shared pool
+        size_t count;
+        FreeObject* chain = Arena::instance().take_batch(cls, count);
+        if (count > 1) {
+            FreeObject* tail = chain->next;
+            while (tail->next) {
+                tail = tail->next;
+            }
+            Arena::instance().give_back(cls, chain->next, tail, count - 1);
+        }
+        return chain;
+    }
+    
+    ThreadCache& cache = thread_cache;
+    if (!cache.lists[cls]) {
+        cache.lists[cls] = Arena::instance().take_batch(cls, cache.lengths[cls]);
+    }
+    
+    FreeObject* object = cache.lists[cls];
+    cache.lists[cls] = object->next;
+    cache.lengths[cls]--;
+    
+    cache.add(cache.in_use[cls], 1);
+    cache.add(cache.requested, static_cast<int64_t>(size));
+    return object;
+}
+
+void SlabAllocator::deallocate(void* ptr, size_t size) {
+    if (!ptr) {
+        return;
+    }
+    
+    if (size > MAX_SLAB_OBJECT) {
+        std::free(ptr);
+        if (!cache_destroyed) {
+            thread_cache.add(thread_cache.large, -static_cast<int64_t>(size));
+        }
+        return;
+    }
+    
+    size_t cls = class_index(size);
+    FreeObject* object = static_cast<FreeObject*>(ptr);
+    
+    if (cache_destroyed) {
+        Arena::instance().give_back(cls, object, object, 1);
+        return;
+    }
+    
+    ThreadCache& cache = thread_cache;
+    object->next = cache.lists[cls];
+    cache.lists[cls] = object;
+    cache.lengths[cls]++;
+    
+    cache.add(cache.in_use[cls], -1);
+    cache.add(cache.requested, -static_cast<int64_t>(size));
+    
+    // Keep per-thread hoards bounded: return the oldest batch
+    if (cache.lengths[cls] > MAX_THREAD_LIST) {
+        FreeObject* keep_tail = cache.lists[cls];
+        for (size_t i = 1; i < cache.lengths[cls] - TRANSFER_BATCH; i++) {
+            keep_tail = keep_tail->next;
+        }
+        
+        FreeObject* head = keep_tail->next;
+        FreeObject* tail = head;
+        while (tail->next) {
+            tail = tail->next;
+        }
+        keep_tail->next = nullptr;
+        cache.lengths[cls] -= TRANSFER_BATCH;
+        Arena::instance().give_back(cls, head, tail, TRANSFER_BATCH);
+    }
+}
+
+size_t SlabAllocator::class_size(size_t size) {
+    return size > MAX_SLAB_OBJECT ? size : CLASS_SIZES[class_index(size)];
+}
+
+SlabAllocator::Stats SlabAllocator::get_stats() {
+    Arena& arena = Arena::instance();
+    
+    int64_t in_use[NUM_CLASSES];
+    int64_t requested;
+    int64_t large;
+    {
+        std::lock_guard<std::mutex> lock(arena.caches_mutex);
+        std::copy(std::begin(arena.retired_in_use), std::end(arena.retired_in_use), in_use);
+        requested = arena.retired_requested;
+        large = arena.retired_large;
+        
+        for (const ThreadCache* cache : arena.caches) {
+            for (size_t cls = 0; cls < NUM_CLASSES; cls++) {
+                in_use[cls] += cache->in_use[cls].load(std::memory_order_relaxed);
+            }
+            requested += cache->requested.load(std::memory_order_relaxed);
+            large += cache->large.load(std::memory_order_relaxed);
+        }
+    }
+    
+    Stats stats{};
+    stats.requested_bytes = static_cast<size_t>(std::max<int64_t>(requested, 0));
+    stats.large_bytes = static_cast<size_t>(std::max<int64_t>(large, 0));
+    
+    for (size_t cls = 0; cls < NUM_CLASSES; cls++) {
+        size_t slabs = arena.lists[cls].slabs.load(std::memory_order_relaxed);
+        if (slabs == 0) {
+            continue;
+        }
+        
+        ClassStats class_stats{};
+        class_stats.object_size = CLASS_SIZES[cls];
+        class_stats.slabs = slabs;
+        class_stats.objects_in_use = static_cast<size_t>(std::max<int64_t>(in_use[cls], 0));
+        size_t capacity = slabs * (SLAB_SIZE / CLASS_SIZES[cls]);
+        class_stats.objects_free = capacity - std::min(capacity, class_stats.objects_in_use);
+        
+        stats.slab_bytes += slabs * SLAB_SIZE;
+        stats.used_bytes += class_stats.objects_in_use * CLASS_SIZES[cls];
+        stats.classes.push_back(class_stats);
+    }
+    
+    if (stats.slab_bytes > 0) {
+        stats.utilization = static_cast<double>(stats.used_bytes) / stats.slab_bytes;
+    }
+    if (stats.used_bytes > 0) {
+        size_t slab_requested = stats.requested_bytes;
+        stats.fragmentation = 1.0 - static_cast<double>(std::min(slab_requested, stats.used_bytes)) /
+                                    stats.used_bytes;
+    }
+    
+    return stats;
+}
+
+} // namespace scuffedredis
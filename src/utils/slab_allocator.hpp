@@ -0,0 +1,105 @@
+#ifndef SCUFFEDREDIS_SLAB_ALLOCATOR_HPP
+#define SCUFFEDREDIS_SLAB_ALLOCATOR_HPP
+
+/**
+ * Slab allocator for small, frequently churned objects.
+ *
+ * Requests up to MAX_SLAB_OBJECT bytes are rounded up to a size class and
+ * carved out of page-aligned 64KB slabs. Each thread keeps a free list per
+ * class, so allocate/free is a pointer pop/push with no locking; a list
+ * that grows too long hands a batch back to a shared per-class pool, which
+ * is also where empty thread lists refill from. Objects of one class are
+ * packed together, so churn never fragments the general-purpose heap.
+ * Slabs are kept for reuse rather than returned to the OS.
+ *
+ * Larger requests fall through to malloc.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <new>
+
+namespace scuffedredis {
+
+class SlabAllocator {
+public:
+    static constexpr size_t SLAB_SIZE = 64 * 1024;
+    static constexpr size_t MAX_SLAB_OBJECT = 512;
+    
+    /**
+     * Allocate `size` bytes (16-byte aligned).
+     * Throws std::bad_alloc when out of memory.
+     */
+    static void* allocate(size_t size);
+    
+    /**
+     * Free memory from allocate(). `size` must be the requested size, or
+     * any size that rounds to the same class (see class_size()).
+     */
+    static void deallocate(void* ptr, size_t size);
+    
+    /**
+     * Bytes actually reserved for a request of `size`: its size class,
+     * or size itself when it is too large for a slab.
+     */
+    static size_t class_size(size_t size);
+    
+    /**
+     * Per size class usage.
+     */
+    struct ClassStats {
+        size_t object_size;
+        size_t slabs;
+        size_t objects_in_use;
+        size_t objects_free;
+    };
+    
+    /**
+     * Allocator-wide usage.
+     * utilization: share of slab memory holding live objects.
+     * fragmentation: share of live object memory lost to rounding up
+     *                requests to their size class.
+     */
+    struct Stats {
+        size_t slab_bytes;       // Reserved in slabs
+        size_t used_bytes;       // Live objects, at class size
+        size_t requested_bytes;  // Live objects, at requested size
+        size_t large_bytes;      // Live requests served by malloc
+        double utilization;
+        double fragmentation;
+        std::vector<ClassStats> classes;  // Classes with at least one slab
+    };
+    
+    static Stats get_stats();
+};
+
+/**
+ * Standard allocator adaptor so containers and std::allocate_shared can
+ * draw from the slab pools.
+ */
+template<typename T>
+struct SlabStlAllocator {
+    using value_type = T;
+    
+    SlabStlAllocator() = default;
+    template<typename U>
+    SlabStlAllocator(const SlabStlAllocator<U>&) noexcept {}
+    
+    T* allocate(size_t n) {
+        return static_cast<T*>(SlabAllocator::allocate(n * sizeof(T)));
+    }
+    
+    void deallocate(T* ptr, size_t n) noexcept {
+        SlabAllocator::deallocate(ptr, n * sizeof(T));
+    }
+    
+    template<typename U>
+    bool operator==(const SlabStlAllocator<U>&) const noexcept { return true; }
+    template<typename U>
+    bool operator!=(const SlabStlAllocator<U>&) const noexcept { return false; }
+};
+
+} // namespace scuffedredis
+
+#endif // SCUFFEDREDIS_SLAB_ALLOCATOR_HPP
@@ -0,0 +1,45 @@
+#ifndef SCUFFEDREDIS_VARINT_HPP
+#define SCUFFEDREDIS_VARINT_HPP
+
+/**
+ * LEB128 variable-length integers: 7 bits per byte, low bits first, high
+ * bit set on every byte but the last. Lengths under 128 take one byte.
+ */
+
+#include <cstddef>
+#include <cstdint>
+
+namespace scuffedredis {
+
+inline size_t varint_size(size_t value) {
+    size_t bytes = 1;
+    while (value >= 0x80) {
+        value >>= 7;
+        bytes++;
+    }
+    return bytes;
+}
+
+inline uint8_t* write_varint(uint8_t* out, size_t value) {
+    while (value >= 0x80) {
+        *out++ = static_cast<uint8_t>(value | 0x80);
+        value >>= 7;
+    }
+    *out++ = static_cast<uint8_t>(value);
+    return out;
+}
+
+inline const uint8_t* read_varint(const uint8_t* in, size_t& value) {
+    value = 0;
+    unsigned shift = 0;
+    while (*in & 0x80) {
+        value |= static_cast<size_t>(*in++ & 0x7F) << shift;
+        shift += 7;
+    }
+    value |= static_cast<size_t>(*in++) << shift;
+    return in;
+}
+
+} // namespace scuffedredis
+
+#endif // SCUFFEDREDIS_VARINT_HPP
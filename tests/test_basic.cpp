@@ -2,7 +2,24 @@
 #include <cassert>
 #include "../src/data/hashtable.hpp"
 #include "../src/protocol/protocol.hpp"
-#include "../src/data/ttl_manager.hpp"
+#include "../src/data/avl_tree.hpp"
+#include "../src/data/sorted_set.hpp"
+#include "../src/utils/mpsc_queue.hpp"
+#include "../src/utils/slab_allocator.hpp"
+#include "../src/server/command_table.hpp"
+#include "../src/server/kv_store.hpp"
+#include "../src/server/pubsub.hpp"
+#include "../src/network/tcp_server.hpp"
+#include "../src/network/tcp_client.hpp"
+#include "../src/event/event_loop.hpp"
+#include <thread>
+#include <vector>
+#include <cstring>
+#include <cctype>
+#include <algorithm>
+#include <cmath>
+#include <set>
+#include <chrono>
 
 using namespace scuffedredis;
 
@@ -35,9 +52,164 @@ void test_hashtable() {
     auto keys = table.keys("*");
     assert(keys.size() == 3);
     
+    // Growing migrates buckets incrementally; every key stays reachable
+    HashTable growing;
+    bool saw_rehash = false;
+    for (int i = 0; i < 1000; i++) {
+        growing.set("g" + std::to_string(i), std::to_string(i));
+        if (growing.is_rehashing()) {
+            saw_rehash = true;
+            assert(growing.get("g0").value() == "0");
+            assert(growing.exists("g" + std::to_string(i)));
+        }
+    }
+    assert(saw_rehash);
+    assert(growing.del("g500"));
+    assert(!growing.exists("g500"));
+    
+    size_t iterated = 0;
+    for (auto it = growing.begin(); it != growing.end(); ++it) {
+        iterated++;
+    }
+    assert(iterated == growing.size());
+    assert(growing.keys("*").size() == growing.size());
+    
+    while (growing.rehash_step(100)) {}
+    assert(!growing.is_rehashing());
+    assert(growing.get("g999").value() == "999");
+    assert(growing.size() == 999);
+    
+    // Values are stored inline; updates may shrink in place or reallocate
+    HashTable compact;
+    compact.set("counter", "9");
+    size_t small_usage = compact.memory_usage();
+    compact.set("counter", std::string(300, 'x'));
+    assert(compact.get("counter").value() == std::string(300, 'x'));
+    assert(compact.memory_usage() > small_usage + 290);
+    compact.set("counter", "10");
+    assert(compact.get("counter").value() == "10");
+    compact.set("", "");
+    assert(compact.exists(""));
+    assert(compact.get("").value().empty());
+    auto compact_stats = compact.get_stats();
+    assert(compact_stats.total_entries == 2);
+    assert(compact_stats.bytes_per_key > 0);
+    assert(compact.del("counter"));
+    assert(compact.del(""));
+    
     std::cout << "HashTable tests passed!" << std::endl;
 }
 
+void test_swiss_table() {
+    std::cout << "Testing SwissTable..." << std::endl;
+    
+    SwissTable table;
+    
+    // Same semantics as HashTable
+    assert(table.set("key1", "value1"));
+    assert(table.get("key1").value() == "value1");
+    assert(!table.set("key1", "value2"));
+    assert(table.get("key1").value() == "value2");
+    assert(table.del("key1"));
+    assert(!table.exists("key1"));
+    assert(!table.del("key1"));
+    assert(table.size() == 0);
+    
+    // Grow through several incremental rehashes
+    bool saw_rehash = false;
+    for (int i = 0; i < 5000; i++) {
+        assert(table.set("s" + std::to_string(i), std::to_string(i)));
+        saw_rehash = saw_rehash || table.is_rehashing();
+        assert(table.get("s0").value() == "0");
+    }
+    assert(saw_rehash);
+    assert(table.size() == 5000);
+    
+    // Tombstones must not break probing for keys placed after them
+    for (int i = 0; i < 5000; i += 2) {
+        assert(table.del("s" + std::to_string(i)));
+    }
+    for (int i = 1; i < 5000; i += 2) {
+        assert(table.get("s" + std::to_string(i)).value() == std::to_string(i));
+    }
+    assert(!table.exists("s10"));
+    assert(table.size() == 2500);
+    
+    size_t iterated = 0;
+    for (auto it = table.begin(); it != table.end(); ++it) {
+        assert((*it).second == (*it).first.substr(1));
+        iterated++;
+    }
+    assert(iterated == table.size());
+    assert(table.keys("s1*").size() == 556);
+    
+    auto stats = table.get_stats();
+    assert(stats.total_entries == 2500);
+    assert(stats.max_chain_length >= 1);
+    
+    table.clear();
+    assert(table.empty());
+    assert(!table.exists("s1"));
+    
+    // Both engines behind the concurrent wrapper
+    ConcurrentHashTable swiss(16, 4, HashEngine::SWISS);
+    assert(swiss.engine() == HashEngine::SWISS);
+    swiss.set("a", "1");
+    assert(swiss.get("a").value() == "1");
+    assert(swiss.size() == 1);
+    
+    HashEngine engine;
+    assert(parse_hash_engine("swiss", engine) && engine == HashEngine::SWISS);
+    assert(!parse_hash_engine("cuckoo", engine));
+    
+    std::cout << "SwissTable tests passed!" << std::endl;
+}
+
+void test_concurrent_hashtable() {
+    std::cout << "Testing ConcurrentHashTable..." << std::endl;
+    
+    // Segment count is rounded up to a power of two
+    ConcurrentHashTable single(16, 1);
+    assert(single.segment_count() == 1);
+    ConcurrentHashTable striped(16, 12);
+    assert(striped.segment_count() == 16);
+    
+    // Writers on different keys from several threads
+    const int writers = 8;
+    const int per_writer = 5000;
+    std::vector<std::thread> threads;
+    for (int w = 0; w < writers; w++) {
+        threads.emplace_back([&striped, w]() {
+            for (int i = 0; i < per_writer; i++) {
+                std::string key = "k" + std::to_string(w) + ":" + std::to_string(i);
+                striped.set(key, key);
+            }
+        });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    
+    assert(striped.size() == static_cast<size_t>(writers * per_writer));
+    assert(striped.keys("*").size() == striped.size());
+    assert(striped.get("k3:1234").value() == "k3:1234");
+    assert(striped.del("k3:1234"));
+    assert(!striped.exists("k3:1234"));
+    
+    // Conditional writes, as SET NX / XX use
+    assert(!striped.set_if("k3:1234", "x", true));
+    assert(!striped.exists("k3:1234"));
+    assert(striped.set_if("k3:1234", "x", false));
+    assert(!striped.set_if("k3:1234", "y", false));
+    assert(striped.set_if("k3:1234", "z", true));
+    assert(striped.get("k3:1234").value() == "z");
+    
+    striped.clear();
+    assert(striped.size() == 0);
+    
+    std::cout << "ConcurrentHashTable tests passed!" << std::endl;
+}
+
 void test_protocol() {
     std::cout << "Testing Protocol..." << std::endl;
     
@@ -69,35 +241,1051 @@ void test_protocol() {
     assert(args[1] == "key");
     assert(args[2] == "value");
     
+    // Partial array fed a byte at a time must not lose elements
+    auto cmd_data = cmd->serialize();
+    protocol::Parser partial;
+    for (size_t i = 0; i + 1 < cmd_data.size(); i++) {
+        partial.feed(&cmd_data[i], 1);
+        assert(!partial.has_message());
+        assert(!partial.parse_message());
+    }
+    partial.feed(&cmd_data.back(), 1);
+    auto whole = partial.parse_message();
+    assert(whole && whole->is_array() && whole->as_array()->size() == 3);
+    assert(protocol::utils::parse_command(whole)[2] == "value");
+    assert(partial.buffer_size() == 0);
+    
+    // Deep pipeline, split at an awkward boundary, parsed as views
+    std::vector<uint8_t> pipeline;
+    for (int i = 0; i < 5000; i++) {
+        auto set = protocol::utils::make_command({"SET", "key" + std::to_string(i), "v"})->serialize();
+        pipeline.insert(pipeline.end(), set.begin(), set.end());
+    }
+    protocol::Parser command_parser;
+    protocol::Command views;
+    size_t split = pipeline.size() / 2 + 3;
+    command_parser.feed(pipeline.data(), split);
+    int parsed_commands = 0;
+    while (command_parser.parse_command(views) == protocol::Parser::Result::COMMAND) {
+        assert(views.size() == 3 && views[0] == "SET");
+        assert(views[1] == "key" + std::to_string(parsed_commands));
+        parsed_commands++;
+    }
+    command_parser.feed(pipeline.data() + split, pipeline.size() - split);
+    while (command_parser.parse_command(views) == protocol::Parser::Result::COMMAND) {
+        assert(views[1] == "key" + std::to_string(parsed_commands));
+        parsed_commands++;
+    }
+    assert(parsed_commands == 5000);
+    assert(command_parser.buffer_size() == 0);
+    
+    // Messages that are not commands are skipped whole
+    protocol::MessageArray nested = {protocol::Message::make_bulk_string("GET"),
+                                     protocol::utils::make_command({"a", "b"})};
+    command_parser.feed(protocol::Message::make_array(nested)->serialize());
+    command_parser.feed(protocol::Message::make_integer(7)->serialize());
+    command_parser.feed(protocol::utils::make_command({"PING"})->serialize());
+    assert(command_parser.parse_command(views) == protocol::Parser::Result::INVALID);
+    assert(command_parser.parse_command(views) == protocol::Parser::Result::INVALID);
+    assert(command_parser.parse_command(views) == protocol::Parser::Result::COMMAND);
+    assert(views.size() == 1 && views[0] == "PING");
+    assert(command_parser.parse_command(views) == protocol::Parser::Result::INCOMPLETE);
+    
+    // Unknown type bytes cannot be resynchronised
+    uint8_t garbage[] = {0x7F, 0, 0, 0, 0};
+    command_parser.feed(garbage, sizeof(garbage));
+    assert(command_parser.parse_command(views) == protocol::Parser::Result::PROTOCOL_ERROR);
+    assert(command_parser.buffer_size() == 0);
+    
+    // Commands keep a few arguments inline and spill the rest
+    std::vector<std::string> many;
+    for (int i = 0; i < 20; i++) {
+        many.push_back("arg" + std::to_string(i));
+    }
+    protocol::Command wide(many);
+    assert(wide.argc() == 20);
+    for (int i = 0; i < 20; i++) {
+        assert(wide[i] == many[i]);
+    }
+    assert(wide.to_strings() == many);
+    protocol::Command copy = wide;
+    wide.clear();
+    assert(wide.empty() && copy.size() == 20 && copy[19] == "arg19");
+    command_parser.feed(protocol::utils::make_command(many)->serialize());
+    assert(command_parser.parse_command(views) == protocol::Parser::Result::COMMAND);
+    assert(views.size() == 20 && views[12] == "arg12");
+    
+    // Replies written straight into a buffer read back as messages
+    std::vector<uint8_t> output;
+    protocol::ResponseWriter writer(output);
+    writer.reply(protocol::Reply::OK);
+    writer.bulk_string("hello");
+    writer.integer(-42);
+    writer.reply(protocol::Reply::NIL);
+    writer.array_header(2);
+    writer.bulk_string("a");
+    writer.integer(1);
+    writer.error("ERR boom");
+    size_t mark = writer.size();
+    writer.bulk_string("discarded");
+    writer.truncate(mark);
+    
+    protocol::Parser reply_parser;
+    reply_parser.feed(output);
+    assert(reply_parser.parse_message()->as_string() == "OK");
+    assert(reply_parser.parse_message()->as_string() == "hello");
+    assert(reply_parser.parse_message()->as_integer() == -42);
+    assert(reply_parser.parse_message()->is_null());
+    auto pair = reply_parser.parse_message();
+    assert(pair->as_array()->size() == 2 && (*pair->as_array())[1]->as_integer() == 1);
+    auto err = reply_parser.parse_message();
+    assert(err->is_error() && err->as_string() == "ERR boom");
+    assert(!reply_parser.parse_message());
+    
+    // One-pass serialization matches the wire format byte for byte
+    auto nested_cmd = protocol::Message::make_array({protocol::Message::make_integer(258), nullptr});
+    std::vector<uint8_t> expected = {5, 2, 0, 0, 0,
+                                     3, 8, 0, 0, 0, 2, 1, 0, 0, 0, 0, 0, 0,
+                                     6, 0, 0, 0, 0};
+    assert(nested_cmd->serialize() == expected);
+    assert(nested_cmd->serialized_size() == expected.size());
+    
     std::cout << "Protocol tests passed!" << std::endl;
 }
 
-void test_ttl_manager() {
-    std::cout << "Testing TTL Manager..." << std::endl;
+void test_resp_protocol() {
+    std::cout << "Testing RESP Protocol..." << std::endl;
+    
+    auto feed = [](protocol::Parser& parser, const std::string& data) {
+        parser.feed(reinterpret_cast<const uint8_t*>(data.data()), data.size());
+    };
+    
+    // First byte picks the framing
+    protocol::Parser binary(protocol::Protocol::AUTO);
+    binary.feed(protocol::utils::make_command({"PING"})->serialize());
+    protocol::Command args;
+    assert(binary.parse_command(args) == protocol::Parser::Result::COMMAND);
+    assert(binary.protocol() == protocol::Protocol::BINARY && args[0] == "PING");
+    
+    // Multibulk arrives a byte at a time
+    protocol::Parser parser(protocol::Protocol::AUTO);
+    std::string request = "*3\r\n$3\r\nSET\r\n$3\r\nkey\r\n$12\r\nhello\r\nworld\r\n";
+    for (size_t i = 0; i + 1 < request.size(); i++) {
+        feed(parser, request.substr(i, 1));
+        assert(parser.parse_command(args) == protocol::Parser::Result::INCOMPLETE);
+    }
+    feed(parser, request.substr(request.size() - 1));
+    assert(parser.parse_command(args) == protocol::Parser::Result::COMMAND);
+    assert(parser.protocol() == protocol::Protocol::RESP2);
+    assert(args.size() == 3 && args[1] == "key" && args[2] == "hello\r\nworld");
+    
+    // Inline commands; blank lines and empty arrays are skipped
+    feed(parser, "\r\nget  key\r\n*0\r\nPING\n");
+    assert(parser.parse_command(args) == protocol::Parser::Result::COMMAND);
+    assert(args.size() == 2 && args[0] == "get" && args[1] == "key");
+    assert(parser.parse_command(args) == protocol::Parser::Result::COMMAND);
+    assert(args.size() == 1 && args[0] == "PING");
+    assert(parser.parse_command(args) == protocol::Parser::Result::INCOMPLETE);
+    
+    // Malformed framing
+    feed(parser, "*1\r\n:5\r\n");
+    assert(parser.parse_command(args) == protocol::Parser::Result::PROTOCOL_ERROR);
+    feed(parser, "*1\r\n$3\r\nabcd\r\n");
+    assert(parser.parse_command(args) == protocol::Parser::Result::PROTOCOL_ERROR);
+    feed(parser, "*x\r\n");
+    assert(parser.parse_command(args) == protocol::Parser::Result::PROTOCOL_ERROR);
+    
+    // Replies in each version
+    auto encode = [](protocol::Protocol version, auto&& write) {
+        std::vector<uint8_t> output;
+        protocol::ResponseWriter writer(output, version);
+        write(writer);
+        return std::string(output.begin(), output.end());
+    };
+    auto replies = [](protocol::ResponseWriter& out) {
+        out.reply(protocol::Reply::OK);
+        out.integer(-7);
+        out.bulk_string("hi");
+        out.null();
+        out.error("ERR bad\r\nline");
+        out.map_header(1);
+        out.bulk_string("k");
+        out.reply(protocol::Reply::NIL);
+    };
+    assert(encode(protocol::Protocol::RESP2, replies) ==
+           "+OK\r\n:-7\r\n$2\r\nhi\r\n$-1\r\n-ERR bad  line\r\n*2\r\n$1\r\nk\r\n$-1\r\n");
+    assert(encode(protocol::Protocol::RESP3, replies) ==
+           "+OK\r\n:-7\r\n$2\r\nhi\r\n_\r\n-ERR bad  line\r\n%1\r\n$1\r\nk\r\n_\r\n");
+    
+    auto keys = protocol::Message::make_array({protocol::Message::make_bulk_string("a"),
+                                               protocol::Message::make_integer(1)});
+    assert(encode(protocol::Protocol::RESP2, [&](auto& out) { out.message(*keys); }) ==
+           "*2\r\n$1\r\na\r\n:1\r\n");
+    
+    // Pushes are only marked as such in RESP3
+    auto push = [](auto& out) {
+        out.push_header(2);
+        out.bulk_string("message");
+        out.integer(1);
+    };
+    assert(encode(protocol::Protocol::RESP2, push) == "*2\r\n$7\r\nmessage\r\n:1\r\n");
+    assert(encode(protocol::Protocol::RESP3, push) == ">2\r\n$7\r\nmessage\r\n:1\r\n");
+    
+    std::cout << "RESP Protocol tests passed!" << std::endl;
+}
+
+void test_command_table() {
+    std::cout << "Testing Command Table..." << std::endl;
+    
+    // Resolved at compile time when the name is a constant
+    static_assert(lookup_command("GET") == CommandId::GET, "constexpr lookup");
+    
+    for (const auto& entry : command_table::COMMANDS) {
+        assert(lookup_command(entry.name) == entry.id);
+        
+        std::string lower(entry.name);
+        for (char& c : lower) {
+            c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+        }
+        assert(lookup_command(lower) == entry.id);
+    }
+    
+    assert(lookup_command("sEt") == CommandId::SET);
+    assert(lookup_command("") == CommandId::UNKNOWN);
+    assert(lookup_command("GETX") == CommandId::UNKNOWN);
+    assert(lookup_command("GE") == CommandId::UNKNOWN);
+    assert(lookup_command("FLUSHALL") == CommandId::UNKNOWN);
+    assert(lookup_command(std::string_view("GET\0", 4)) == CommandId::UNKNOWN);
+    
+    std::cout << "Command Table tests passed!" << std::endl;
+}
+
+void test_avl_tree() {
+    std::cout << "Testing AVL Tree..." << std::endl;
+    
+    AVLTree<int, int> tree;
+    std::vector<int> expected;
+    
+    // Interleaved inserts and removals exercise every rotation
+    for (int i = 0; i < 2000; i++) {
+        int key = (i * 7919) % 2003;
+        tree.insert(key, key * 2);
+        expected.push_back(key);
+        if (i % 3 == 0) {
+            int victim = (i * 104729) % 2003;
+            if (tree.remove(victim)) {
+                expected.erase(std::find(expected.begin(), expected.end(), victim));
+            }
+        }
+    }
+    std::sort(expected.begin(), expected.end());
+    assert(tree.size() == expected.size());
+    
+    // rank() and select() agree with the sorted order
+    for (size_t i = 0; i < expected.size(); i++) {
+        assert(tree.rank(expected[i]) == static_cast<int>(i));
+        assert(tree.select(i)->key == expected[i]);
+        assert(tree.select(i)->value == expected[i] * 2);
+    }
+    assert(tree.select(expected.size()) == nullptr);
+    assert(tree.rank(-1) == -1);
+    
+    // Iteration from a rank, both directions
+    size_t start = expected.size() / 3;
+    size_t i = start;
+    for (auto it = tree.begin_at(start); it.valid(); it.next()) {
+        assert(it.key() == expected[i++]);
+    }
+    assert(i == expected.size());
+    
+    i = start;
+    for (auto it = tree.rbegin_at(start); it.valid(); it.next()) {
+        assert(it.key() == expected[i]);
+        if (i-- == 0) {
+            break;
+        }
+    }
+    assert(i == static_cast<size_t>(-1));
+    assert(!tree.begin_at(expected.size()).valid());
+    
+    // Bulk build from sorted keys: balanced, counted, and still updatable
+    AVLTree<int, int> built;
+    int next = 0;
+    built.assign_sorted(1000, [&next]() { return next++ * 2; }, 7);
+    assert(built.size() == 1000 && built.height() == 10);
+    assert(built.rank(500) == 250 && built.select(999)->key == 1998);
+    built.insert(501, 7);
+    assert(built.remove(0));
+    assert(built.rank(502) == 251 && built.find(998) == 7);
+    
+    std::cout << "AVL Tree tests passed!" << std::endl;
+}
+
+void test_sorted_set() {
+    std::cout << "Testing Sorted Set..." << std::endl;
+    
+    using Result = SortedSet::AddResult;
+    
+    // Small sets start as a listpack; a limit of 0 goes straight to the engine
+    ZSetOptions listpack_options;
+    ZSetOptions avl_options;
+    avl_options.engine = ZSetEngine::AVL;
+    avl_options.listpack_max_entries = 0;
+    ZSetOptions skiplist_options;
+    skiplist_options.listpack_max_entries = 0;
+    
+    for (const ZSetOptions& options : {listpack_options, avl_options, skiplist_options}) {
+        SortedSet set(options);
+        
+        assert(set.add("a", 1.0) == Result::ADDED);
+        assert(set.add("b", 2.0) == Result::ADDED);
+        assert(set.add("c", 3.0) == Result::ADDED);
+        assert(set.add("a", 1.0) == Result::UNCHANGED);
+        assert(set.add("d", 4.0, SortedSet::ADD_XX) == Result::SKIPPED);
+        assert(set.add("a", 5.0, SortedSet::ADD_NX) == Result::SKIPPED);
+        assert(set.add("a", 0.5, SortedSet::ADD_GT) == Result::SKIPPED);
+        assert(set.add("a", 0.5, SortedSet::ADD_LT) == Result::UPDATED);
+        assert(set.zscore("a").value() == 0.5);
+        
+        double score = 0.0;
+        assert(set.add("b", 10.0, SortedSet::ADD_INCR, &score) == Result::UPDATED);
+        assert(score == 12.0);
+        assert(set.add("e", 7.0, SortedSet::ADD_INCR, &score) == Result::ADDED);
+        assert(score == 7.0);
+        assert(set.add("e", -INFINITY) == Result::UPDATED);
+        assert(set.add("e", INFINITY, SortedSet::ADD_INCR) == Result::NOT_A_NUMBER);
+        assert(set.zrem("e") == 1);
+        
+        // a=0.5 c=3 b=12
+        assert(set.zcard() == 3);
+        assert(set.zrank("b").value() == 2);
+        assert(set.zrevrank("b").value() == 0);
+        
+        auto range = set.zrange(0, -1);
+        assert(range.size() == 3 && range[0].first == "a" && range[2].first == "b");
+        
+        auto rev = set.zrevrange(0, 1, true);
+        assert(rev.size() == 2);
+        assert(rev[0].first == "b" && rev[0].second == 12.0);
+        assert(rev[1].first == "c" && rev[1].second == 3.0);
+        
+        auto by_score = set.zrangebyscore({1.0, 100.0}, false, 1, 5);
+        assert(by_score.size() == 1 && by_score[0].first == "b");
+        assert(set.zrangebyscore({0.0, 100.0}, false, 0, 2).size() == 2);
+        assert(set.zcount({0.0, 3.0}) == 2);
+        
+        // Exclusive and infinite bounds
+        assert(set.zcount({0.5, 3.0, true, false}) == 1);
+        assert(set.zcount({0.5, 3.0, false, true}) == 1);
+        assert(set.zcount({0.5, 0.5, true, false}) == 0);
+        assert(set.zcount({3.0, 3.0}) == 1);
+        assert(set.zcount({-INFINITY, INFINITY}) == 3);
+        assert(set.zcount({4.0, 1.0}) == 0);
+        auto open = set.zrangebyscore({0.5, INFINITY, true, false}, true);
+        assert(open.size() == 2 && open[0].first == "c" && open[1].second == 12.0);
+        assert(set.zrangebyscore({-INFINITY, 12.0, false, true}, false, 1).size() == 1);
+        assert(set.zrangebyscore({-INFINITY, INFINITY}, false, 3).empty());
+        assert(std::string(set.encoding()) == (options.listpack_max_entries ? "listpack"
+                                               : zset_engine_name(options.engine)));
+    }
+    
+    // Listpacks convert past either limit and keep their members
+    ZSetOptions small_options;
+    small_options.listpack_max_entries = 4;
+    SortedSet small(small_options);
+    for (int i = 0; i < 4; i++) {
+        small.add("m" + std::to_string(i), i);
+    }
+    assert(small.add("m0", 10.0) == Result::UPDATED);
+    assert(small.add("m4", 4.0, SortedSet::ADD_XX) == Result::SKIPPED);
+    assert(std::string(small.encoding()) == "listpack");
+    assert(small.add("m4", 4.0) == Result::ADDED);
+    assert(std::string(small.encoding()) == "skiplist");
+    assert(small.zrange(0, -1).front().first == "m1" && small.zscore("m0").value() == 10.0);
+    
+    SortedSet wide;
+    wide.add("a", 1.0);
+    wide.add(std::string(ZSetOptions::DEFAULT_LISTPACK_VALUE + 1, 'x'), 2.0);
+    assert(std::string(wide.encoding()) == "skiplist" && wide.zrank("a").value() == 0);
+    
+    // The encodings agree under a random mix of updates and removals; the
+    // listpack one converts partway, the unbounded one never does
+    ZSetOptions unbounded_options;
+    unbounded_options.listpack_max_entries = 1000;
+    SortedSet avl(avl_options);
+    SortedSet skiplist(skiplist_options);
+    SortedSet converted(listpack_options);
+    SortedSet listpack(unbounded_options);
+    for (int i = 0; i < 20000; i++) {
+        std::string member = "m" + std::to_string((i * 7919) % 997);
+        double score = static_cast<double>((i * 104729) % 101);
+        if (i % 5 == 0) {
+            int removed = avl.zrem(member);
+            assert(skiplist.zrem(member) == removed);
+            assert(converted.zrem(member) == removed);
+            assert(listpack.zrem(member) == removed);
+        } else {
+            Result result = avl.add(member, score);
+            assert(skiplist.add(member, score) == result);
+            assert(converted.add(member, score) == result);
+            assert(listpack.add(member, score) == result);
+        }
+    }
+    assert(std::string(converted.encoding()) == "skiplist");
+    assert(std::string(listpack.encoding()) == "listpack");
+    for (const SortedSet* other : {&skiplist, &converted, &listpack}) {
+        assert(avl.zcard() == other->zcard());
+        assert(avl.zrange(0, -1, true) == other->zrange(0, -1, true));
+        assert(avl.zrevrange(5, 50, true) == other->zrevrange(5, 50, true));
+        assert(avl.zrangebyscore({10.0, 20.0}, true, 3, 7) == other->zrangebyscore({10.0, 20.0}, true, 3, 7));
+        assert(avl.zrangebyscore({10.0, 20.0, true, true}) == other->zrangebyscore({10.0, 20.0, true, true}));
+        assert(avl.zcount({0.0, 50.0}) == other->zcount({0.0, 50.0}));
+        assert(avl.zcount({0.0, 50.0, true, true}) == other->zcount({0.0, 50.0, true, true}));
+        for (const auto& [member, _] : avl.zrange(0, -1)) {
+            assert(avl.zrank(member) == other->zrank(member));
+            assert(avl.zscore(member) == other->zscore(member));
+        }
+    }
+    
+    // Set operations: weights, aggregates, and Redis's NaN rules
+    using Members = ScoredMembers;
+    Members east = {{"a", 1.0}, {"b", 2.0}, {"c", INFINITY}};
+    Members west = {{"b", 10.0}, {"c", 3.0}, {"d", 4.0}};
+    Members south = {{"c", 5.0}};
+    
+    auto as_members = [](const SortedMemberViews& views) {
+        return Members(views.begin(), views.end());
+    };
+    assert(as_members(combine_sorted_sets(ZSetOperation::UNION, {east, west}, {},
+                                          ZSetAggregate::SUM)) ==
+           (Members{{"a", 1.0}, {"d", 4.0}, {"b", 12.0}, {"c", INFINITY}}));
+    assert(as_members(combine_sorted_sets(ZSetOperation::UNION, {east, west}, {0.0, 2.0},
+                                          ZSetAggregate::MAX)) ==
+           (Members{{"a", 0.0}, {"c", 6.0}, {"d", 8.0}, {"b", 20.0}}));
+    assert(as_members(combine_sorted_sets(ZSetOperation::INTER, {east, west, south}, {1.0, 1.0, -1.0},
+                                          ZSetAggregate::MIN)) == (Members{{"c", -5.0}}));
+    assert(as_members(combine_sorted_sets(ZSetOperation::INTER, {east, west}, {},
+                                          ZSetAggregate::SUM)) ==
+           (Members{{"b", 12.0}, {"c", INFINITY}}));
+    assert(combine_sorted_sets(ZSetOperation::INTER, {east, {}}, {}, ZSetAggregate::SUM).empty());
+    assert(as_members(combine_sorted_sets(ZSetOperation::DIFF, {east, west}, {5.0, 5.0},
+                                          ZSetAggregate::SUM)) == (Members{{"a", 1.0}}));
+    Members negative = {{"c", -INFINITY}};
+    assert(as_members(combine_sorted_sets(ZSetOperation::UNION, {east, negative}, {},
+                                          ZSetAggregate::SUM)).back() == (std::pair<std::string, double>("b", 2.0)));
+    
+    // Partitioned merging matches the single-threaded result
+    std::vector<Members> regions(6);
+    for (size_t r = 0; r < regions.size(); r++) {
+        for (int i = 0; i < 30000; i++) {
+            int id = (i * 7919 + static_cast<int>(r) * 104729) % 60000;
+            regions[r].emplace_back("player:" + std::to_string(id), (id * 31 + r) % 1000);
+        }
+    }
+    for (ZSetOperation operation : {ZSetOperation::UNION, ZSetOperation::INTER, ZSetOperation::DIFF}) {
+        std::vector<double> weights = {1.0, 2.0, 0.5, 1.0, 3.0, 1.0};
+        auto serial = combine_sorted_sets(operation, regions, weights, ZSetAggregate::SUM, 1);
+        auto parallel = combine_sorted_sets(operation, regions, weights, ZSetAggregate::SUM, 4);
+        assert(serial == parallel);
+        assert(std::is_sorted(serial.begin(), serial.end(), [](const auto& a, const auto& b) {
+            return a.second < b.second || (a.second == b.second && a.first < b.first);
+        }));
+    }
+    
+    // Bulk loads pick the encoding up front and leave a working set
+    auto union_all = combine_sorted_sets(ZSetOperation::UNION, regions, {}, ZSetAggregate::MAX);
+    for (const ZSetOptions& options : {listpack_options, avl_options, skiplist_options}) {
+        SortedSet loaded(options);
+        loaded.load(union_all);
+        assert(std::string(loaded.encoding()) == zset_engine_name(options.engine));
+        assert(loaded.zcard() == union_all.size());
+        assert(loaded.zrange(0, -1, true) == as_members(union_all));
+        assert(loaded.zrank(union_all[777].first).value() == 777);
+        assert(loaded.add("zz", -1.0) == Result::ADDED && loaded.zrank("zz").value() == 0);
+        assert(loaded.zrem(union_all[0].first) == 1);
+        assert(loaded.zrange(1, 1)[0].first == union_all[1].first);
+    }
+    SortedSet packed;
+    packed.load(combine_sorted_sets(ZSetOperation::UNION, {east, west}, {}, ZSetAggregate::SUM));
+    assert(std::string(packed.encoding()) == "listpack" && packed.zrank("b").value() == 2);
+    
+    // Manager: sets appear on first write and vanish when emptied
+    SortedSetManager manager(4);
+    assert(!manager.update("z", false, [](SortedSet&) { assert(false); }));
+    assert(manager.update("z", true, [](SortedSet& s) { s.add("m", 1.0); }));
+    assert(manager.exists("z") && manager.size() == 1);
+    
+    size_t card = 0;
+    assert(manager.read("z", [&card](const SortedSet& s) { card = s.zcard(); }));
+    assert(card == 1);
+    
+    manager.update("y", true, [](SortedSet&) {});
+    assert(!manager.exists("y") && manager.size() == 1);
+    
+    assert(manager.update("z", false, [](SortedSet& s) { s.zrem("m"); }));
+    assert(!manager.exists("z") && manager.size() == 0);
+    
+    // store() replaces a set wholesale, or deletes it when given nothing
+    manager.store("s", combine_sorted_sets(ZSetOperation::UNION, {east}, {}, ZSetAggregate::SUM));
+    manager.store("s", combine_sorted_sets(ZSetOperation::UNION, {west}, {}, ZSetAggregate::SUM));
+    assert(manager.size() == 1);
+    assert(manager.read("s", [&card](const SortedSet& s) { card = s.zcard(); }) && card == 3);
+    manager.store("s", {});
+    assert(!manager.exists("s") && manager.size() == 0);
+    
+    std::cout << "Sorted Set tests passed!" << std::endl;
+}
+
+template<typename Table>
+void check_table_expiry() {
+    Table table;
+    int64_t now = unix_time_ms();
+    
+    // Deadlines are set, kept and cleared with the value
+    assert(table.set("a", "1", now + 60000));
+    assert(table.expire_time("a") == now + 60000);
+    assert(table.set("b", "2"));
+    assert(table.expire_time("b") == NO_EXPIRY);
+    assert(!table.expire_time("missing"));
+    assert(table.expires() == 1);
+    assert(!table.set("a", "11", KEEP_EXPIRY));
+    assert(table.expire_time("a") == now + 60000);
+    assert(!table.set("a", std::string(200, 'x'), KEEP_EXPIRY));  // Outgrows its node
+    assert(table.get("a").value() == std::string(200, 'x'));
+    assert(table.expire_time("a") == now + 60000);
+    assert(!table.set("a", "111"));
+    assert(table.expire_time("a") == NO_EXPIRY);
+    assert(table.expires() == 0);
+    
+    // set_expire_time returns the deadline it replaced
+    assert(table.set_expire_time("b", now + 5000) == NO_EXPIRY);
+    assert(table.set_expire_time("b", now + 6000) == now + 5000);
+    assert(table.set_expire_time("b", NO_EXPIRY) == now + 6000);
+    assert(table.get("b").value() == "2");
+    assert(!table.set_expire_time("missing", now + 5000));
+    assert(table.expires() == 0);
+    
+    // An expired key reads as absent until it is removed
+    assert(table.set("c", "3", now - 1));
+    assert(!table.get("c") && !table.exists("c") && !table.expire_time("c"));
+    assert(table.keys("*").size() == 2);
+    assert(table.size() == 3);
+    assert(!table.del("c"));
+    assert(table.size() == 2);
+    assert(table.set("c", "3", now - 1));
+    assert(table.set("c", "4"));  // Replaces it as a new key
+    assert(table.get("c").value() == "4");
+    assert(table.set("d", "5", now - 1));
+    assert(!table.set_expire_time("d", now + 5000));
+    assert(table.size() == 3);
+    
+    // Enough keys to grow the table while half of them carry a deadline
+    const int keys = 1000;
+    for (int i = 0; i < keys; i++) {
+        std::string key = "key" + std::to_string(i);
+        table.set(key, key, i % 4 == 0 ? now - 1 : i % 4 == 1 ? now + 60000 : NO_EXPIRY);
+    }
+    assert(table.expires() == keys / 2);
+    
+    // Sampling every key with a TTL finds the expired half exactly
+    ExpirySample sample = table.sample_expiry(now, keys);
+    assert(sample.sampled == keys / 2 && sample.expired == keys / 4);
+    assert(table.sample_expiry(now, 10).sampled == 10);
+    
+    // Bounded batches remove every expired key and nothing else, and
+    // name each key they remove
+    KeyBatch removed;
+    assert(table.remove_expired(now, 10, &removed) == removed.size());
+    assert(removed.size() <= 10);
+    while (table.remove_expired(now, 100, &removed) > 0) {}
+    assert(removed.size() == keys / 4);
+    std::set<std::string> names;
+    for (size_t i = 0; i < removed.size(); i++) {
+        assert(std::stoi(std::string(removed[i].substr(3))) % 4 == 0);
+        names.emplace(removed[i]);
+    }
+    assert(names.size() == keys / 4);
+    assert(table.expires() == keys / 4);
+    assert(table.sample_expiry(now, keys).expired == 0);
+    assert(table.size() == 3 + keys * 3 / 4);
+    for (int i = 0; i < keys; i++) {
+        std::string key = "key" + std::to_string(i);
+        assert(table.exists(key) == (i % 4 != 0));
+        if (i % 4 == 1) {
+            assert(table.set_expire_time(key, NO_EXPIRY) == now + 60000);
+        }
+    }
+    assert(table.expires() == 0);
+    
+    table.set("e", "6", now + 60000);
+    table.clear();
+    assert(table.expires() == 0 && table.size() == 0);
+}
+
+// A timer for exercising ExpiryIndex on its own
+struct TestTimer {
+    int64_t deadline;
+    uint32_t position;
+};
+
+struct TestTimerDeadline {
+    int64_t operator()(const TestTimer* timer) const { return timer->deadline; }
+};
+
+void test_key_expiry() {
+    std::cout << "Testing key expiry..." << std::endl;
+    
+    using TimerIndex = ExpiryIndex<TestTimer*, TestTimerDeadline>;
+    TimerIndex index;
+    auto remove = [&index](TestTimer* timer) {
+        if (TestTimer** moved = index.remove(timer->position)) {
+            (*moved)->position = timer->position;
+        }
+    };
+    
+    // Removal moves the last element into the gap
+    const int64_t base = 1700000000000;
+    TestTimer a{base + 10, 0}, b{base + 20, 0}, c{base + 30, 0};
+    a.position = index.add(&a);
+    b.position = index.add(&b);
+    c.position = index.add(&c);
+    assert(a.position == 0 && c.position == 2);
+    remove(&a);
+    assert(c.position == 0 && index[0] == &c);
+    assert(index.size() == 2);
+    
+    // Only due timers are handed out, up to the limit, in any order
+    std::vector<TestTimer*> expired;
+    auto collect = [&](TestTimer* timer) {
+        expired.push_back(timer);
+        remove(timer);
+    };
+    assert(index.expire(base + 19, 10, collect) == 0);
+    assert(index.expire(base + 30, 1, collect) == 1);
+    assert(index.expire(base + 30, 10, collect) == 1);
+    assert(expired.size() == 2 && index.empty());
+    
+    // Deadlines from 1 ms to 40 days out cross every level of the wheel
+    // and the overflow bucket; moving the clock forward in uneven steps
+    // expires each timer once, at or after its deadline
+    const size_t count = 5000;
+    std::vector<TestTimer> timers(count);
+    int64_t clock = base + 30;
+    uint64_t spread = 1;
+    for (size_t i = 0; i < count; i++) {
+        spread = spread * 6364136223846793005ull + 1442695040888963407ull;
+        int64_t span = i % 3 == 0 ? 100 : i % 3 == 1 ? 10000000 : 3456000000;
+        timers[i].deadline = clock + 1 + static_cast<int64_t>((spread >> 33) % span);
+        timers[i].position = index.add(&timers[i]);
+    }
+    
+    // A reschedule takes effect at once, earlier or later
+    timers[0].deadline = clock + 3456000000;
+    index.reschedule(timers[0].position);
+    timers[1].deadline = clock + 2;
+    index.reschedule(timers[1].position);
+    
+    expired.clear();
+    int64_t start = clock;
+    size_t step = 1;
+    while (!index.empty()) {
+        clock += static_cast<int64_t>(step);
+        step = step * 3 % 100000007;
+        size_t before = expired.size();
+        while (index.expire(clock, 64, collect) > 0) {}
+        for (size_t i = before; i < expired.size(); i++) {
+            assert(expired[i]->deadline <= clock);
+            expired[i]->deadline = -1;  // Seen
+        }
+        for (const TestTimer& timer : timers) {
+            assert(timer.deadline == -1 || timer.deadline > clock);
+        }
+        if (clock == start + 1) {
+            assert(timers[1].deadline != -1);
+        }
+    }
+    assert(expired.size() == count);
+    
+    // A timer added behind the wheel's time is due at once
+    TestTimer late{base, 0};
+    late.position = index.add(&late);
+    assert(index.expire(clock, 10, collect) == 1);
+    index.clear();
+    assert(index.memory_usage() == 0);
+    
+    // Key names pack into one buffer, empty ones included
+    KeyBatch batch;
+    batch.add("one");
+    batch.add("");
+    batch.add("three");
+    assert(batch.size() == 3);
+    assert(batch[0] == "one" && batch[1].empty() && batch[2] == "three");
+    batch.clear();
+    assert(batch.empty());
+    
+    check_table_expiry<HashTable>();
+    check_table_expiry<SwissTable>();
+    
+    // SET NX / XX with a TTL, as one write
+    int64_t now = unix_time_ms();
+    ConcurrentHashTable striped(16, 4, HashEngine::SWISS);
+    assert(striped.set_if("k", "v", false, now + 60000));
+    assert(striped.expire_time("k") == now + 60000);
+    assert(striped.set_if("k", "w", true, KEEP_EXPIRY));
+    assert(striped.expire_time("k") == now + 60000);
+    assert(striped.set("gone", "v", now - 1));
+    assert(striped.set_if("gone", "v", false));
+    assert(striped.expires() == 1);
+    striped.set("gone", "v", now - 1);
+    assert(striped.sample_expiry(10).expired == 1);
+    batch.clear();
+    assert(striped.remove_expired(100, &batch) == 1);
+    assert(batch.size() == 1 && batch[0] == "gone");
+    assert(striped.expires() == 1);
+    assert(striped.sample_expiry(10).sampled == 1);
+
+    // GETEX reads and sets the deadline as one write
+    std::string seen;
+    auto copy = [&seen](std::string_view value) { seen = value; };
+    assert(striped.read_and_expire("k", now + 120000, copy) && seen == "w");
+    assert(striped.expire_time("k") == now + 120000);
+    assert(striped.read_and_expire("k", NO_EXPIRY, copy));
+    assert(striped.expire_time("k") == NO_EXPIRY);
+    assert(striped.read_and_expire("k", now - 1, copy) && seen == "w");
+    assert(!striped.exists("k"));
+    assert(!striped.read_and_expire("k", NO_EXPIRY, [](std::string_view) { assert(false); }));
+
+    // Sorted sets carry a deadline on their entry
+    SortedSetManager sets(4);
+    sets.update("z", true, [](SortedSet& set) { set.add("m", 1); });
+    assert(sets.expire_time("z") == NO_EXPIRY);
+    assert(sets.set_expire_time("z", now + 60000) == NO_EXPIRY);
+    assert(sets.expires() == 1);
+    assert(sets.set_expire_time("z", now - 1) == now + 60000);
+    assert(!sets.exists("z") && !sets.expire_time("z") && sets.keys("*").empty());
+    assert(!sets.read("z", [](const SortedSet&) { assert(false); }));
+    sets.update("z", true, [](SortedSet& set) {
+        assert(set.empty());  // Recreated, not the expired set
+        set.add("n", 2);
+    });
+    assert(sets.expire_time("z") == NO_EXPIRY);
+    assert(sets.expires() == 0);
+    
+    for (int i = 0; i < 100; i++) {
+        std::string key = "z" + std::to_string(i);
+        sets.update(key, true, [](SortedSet& set) { set.add("m", 1); });
+        sets.set_expire_time(key, i % 2 ? now - 1 : now + 60000);
+    }
+    assert(!sets.del("z1") && sets.del("z2"));
+    assert(sets.sample_expiry(100).expired == 49);
+    batch.clear();
+    while (sets.remove_expired(10, &batch) > 0) {}
+    assert(batch.size() == 49);
+    assert(sets.sample_expiry(100).expired == 0);
+    assert(sets.expires() == 49);
+    assert(sets.size() == 50);
+    
+    // Storing over a set drops its TTL
+    sets.store("z0", {{"m", 1.0}});
+    assert(sets.expire_time("z0") == NO_EXPIRY);
+    assert(sets.expires() == 48);
+    sets.clear();
+    assert(sets.expires() == 0);
+    
+    std::cout << "Key expiry tests passed!" << std::endl;
+}
+
+void test_mpsc_queue() {
+    std::cout << "Testing MPSC Queue..." << std::endl;
+    
+    MpscQueue<int> queue;
+    int value = 0;
+    assert(!queue.pop(value));
+    
+    // Several producers, one consumer
+    const int producers = 4;
+    const int per_producer = 10000;
+    std::vector<std::thread> threads;
+    for (int p = 0; p < producers; p++) {
+        threads.emplace_back([&queue, p]() {
+            for (int i = 0; i < per_producer; i++) {
+                queue.push(p * per_producer + i);
+            }
+        });
+    }
+    
+    std::vector<int> last_seen(producers, -1);
+    int received = 0;
+    while (received < producers * per_producer) {
+        if (queue.pop(value)) {
+            // Items from one producer arrive in the order they were pushed
+            int producer = value / per_producer;
+            assert(value > last_seen[producer]);
+            last_seen[producer] = value;
+            received++;
+        }
+    }
+    
+    for (auto& t : threads) {
+        t.join();
+    }
+    assert(!queue.pop(value));
+    
+    std::cout << "MPSC Queue tests passed!" << std::endl;
+}
+
+void test_slab_allocator() {
+    std::cout << "Testing Slab Allocator..." << std::endl;
+    
+    assert(SlabAllocator::class_size(1) == 16);
+    assert(SlabAllocator::class_size(17) == 32);
+    assert(SlabAllocator::class_size(129) == 160);
+    assert(SlabAllocator::class_size(512) == 512);
+    assert(SlabAllocator::class_size(513) == 513);
+    
+    auto before = SlabAllocator::get_stats();
+    
+    // Objects are distinct, aligned and writable
+    std::vector<std::pair<char*, size_t>> objects;
+    for (size_t i = 0; i < 2000; i++) {
+        size_t size = 1 + (i * 37) % 700;
+        char* ptr = static_cast<char*>(SlabAllocator::allocate(size));
+        assert(reinterpret_cast<uintptr_t>(ptr) % 16 == 0);
+        std::memset(ptr, static_cast<int>(i & 0xFF), size);
+        objects.push_back({ptr, size});
+    }
+    for (size_t i = 0; i < objects.size(); i++) {
+        assert(static_cast<unsigned char>(objects[i].first[objects[i].second - 1]) == (i & 0xFF));
+    }
+    
+    auto during = SlabAllocator::get_stats();
+    assert(during.used_bytes > before.used_bytes);
+    assert(during.large_bytes > before.large_bytes);
+    assert(during.utilization > 0.0 && during.utilization <= 1.0);
+    
+    // Free half on another thread; its cache hands them back on exit
+    std::thread other([&objects]() {
+        for (size_t i = 0; i < objects.size(); i += 2) {
+            SlabAllocator::deallocate(objects[i].first, objects[i].second);
+        }
+    });
+    other.join();
+    for (size_t i = 1; i < objects.size(); i += 2) {
+        SlabAllocator::deallocate(objects[i].first, objects[i].second);
+    }
+    
+    auto after = SlabAllocator::get_stats();
+    assert(after.used_bytes == before.used_bytes);
+    assert(after.requested_bytes == before.requested_bytes);
+    assert(after.large_bytes == before.large_bytes);
+    
+    // AVL nodes come from the slabs too
+    AVLTree<int, int> tree;
+    for (int i = 0; i < 100; i++) {
+        tree.insert(i, i * i);
+    }
+    assert(SlabAllocator::get_stats().used_bytes > after.used_bytes);
+    assert(tree.find(7).value() == 49);
+    
+    std::cout << "Slab Allocator tests passed!" << std::endl;
+}
+
+// Poll until `done` holds, for up to two seconds
+template<typename Condition>
+bool wait_for(Condition&& done) {
+    for (int i = 0; i < 200 && !done(); i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return done();
+}
+
+void test_pubsub() {
+    std::cout << "Testing pub/sub..." << std::endl;
+    
+    PubSub& pubsub = PubSub::instance();
+    const std::string channel = "test-channel";
+    
+    // A server whose clients subscribe with their first request
+    TcpServer server;
+    assert(server.init("127.0.0.1", 16479));
+    std::thread serving([&server, &channel]() {
+        server.run_event_loop([&channel](ClientConnection& client) {
+            protocol::Command args;
+            while (client.get_parser().parse_command(args) != protocol::Parser::Result::INCOMPLETE) {}
+            size_t count = PubSub::instance().subscribe(channel, EventLoop::current(), client.get_id(),
+                                                        protocol::Protocol::RESP2);
+            client.set_subscriptions(count);
+            return true;
+        });
+    });
+    
+    TcpClient client;
+    assert(client.connect("127.0.0.1", 16479, 0));  // Blocking connect
+    assert(client.send_string("PING\r\n"));
+    assert(wait_for([&]() { return pubsub.has_subscribers(channel); }));
+    assert(pubsub.publish(channel, "hello") == 1);
+    
+    // Closing the connection ends its subscriptions at once
+    client.disconnect();
+    assert(wait_for([&]() { return !pubsub.has_subscribers(channel); }));
+    assert(pubsub.publish(channel, "hello") == 0);
+    
+    server.stop();
+    serving.join();
+    
+    std::cout << "Pub/sub tests passed!" << std::endl;
+}
+
+void test_key_sharding() {
+    std::cout << "Testing key sharding..." << std::endl;
+    
+    KVStoreManager& manager = KVStoreManager::instance();
+    manager.configure_shards(std::vector<EventLoop*>(4, nullptr));
+    assert(manager.shard_count() == 4);
+    
+    // Untagged keys spread over the shards
+    std::set<size_t> used;
+    for (int i = 0; i < 100; i++) {
+        used.insert(manager.shard_for_key("key:" + std::to_string(i)));
+    }
+    assert(used.size() == 4);
+    
+    // Only the first non-empty {tag} is hashed
+    size_t tagged = manager.shard_for_key("scores");
+    for (int i = 0; i < 100; i++) {
+        assert(manager.shard_for_key("lb:{scores}:" + std::to_string(i)) == tagged);
+        assert(manager.shard_for_key("{scores}{" + std::to_string(i) + "}") == tagged);
+    }
+    
+    // Empty or unclosed braces leave the whole key hashed
+    used.clear();
+    for (int i = 0; i < 100; i++) {
+        used.insert(manager.shard_for_key("{}" + std::to_string(i)));
+        used.insert(manager.shard_for_key("{" + std::to_string(i)));
+    }
+    assert(used.size() == 4);
+    
+    manager.configure_shards({});
+    assert(manager.shard_count() == 1);
+    
+    std::cout << "Key sharding tests passed!" << std::endl;
+}
+
+// Run a command on a store and return its RESP2 reply
+std::string run_command(KVStore& store, const std::vector<std::string>& args) {
+    std::vector<uint8_t> out;
+    protocol::ResponseWriter writer(out, protocol::Protocol::RESP2);
+    store.execute(protocol::Command(args), writer);
+    return std::string(out.begin(), out.end());
+}
+
+void test_kv_commands() {
+    std::cout << "Testing KV store commands..." << std::endl;
+    
+    KVStore store;
+    const std::string OK = "+OK\r\n";
+    const std::string NIL = "$-1\r\n";
+    const std::string SYNTAX = "-ERR syntax error\r\n";
+    std::string later = std::to_string(unix_time_ms() / 1000 + 1000);
+    std::string later_ms = std::to_string(unix_time_ms() + 1000000);
+    
+    // EXAT is whole seconds, so its TTL rounds to 999 or 1000
+    auto ttl = [&store](const std::string& key) {
+        return std::stoll(run_command(store, {"TTL", key}).substr(1));
+    };
     
-    TTLManager ttl;
+    // SET NX / XX
+    assert(run_command(store, {"SET", "k", "v", "NX"}) == OK);
+    assert(run_command(store, {"SET", "k", "w", "NX"}) == NIL);
+    assert(run_command(store, {"SET", "k", "w", "XX"}) == OK);
+    assert(run_command(store, {"SET", "none", "v", "XX"}) == NIL);
+    assert(run_command(store, {"GET", "k"}) == "$1\r\nw\r\n");
     
-    // Test setting TTL
-    assert(ttl.set_ttl("key1", 5));
-    assert(ttl.has_ttl("key1"));
-    assert(ttl.get_ttl("key1") > 0);
+    // SET EX / PX / EXAT / PXAT, and KEEPTTL
+    assert(run_command(store, {"SET", "k", "v", "EX", "100"}) == OK);
+    assert(run_command(store, {"TTL", "k"}) == ":100\r\n");
+    assert(run_command(store, {"SET", "k", "v", "KEEPTTL"}) == OK);
+    assert(run_command(store, {"TTL", "k"}) == ":100\r\n");
+    assert(run_command(store, {"SET", "k", "v"}) == OK);
+    assert(run_command(store, {"TTL", "k"}) == ":-1\r\n");
+    assert(run_command(store, {"SET", "k", "v", "px", "5000", "xx"}) == OK);
+    assert(run_command(store, {"TTL", "k"}) == ":5\r\n");
+    assert(run_command(store, {"SET", "k", "v", "EXAT", later}) == OK);
+    assert(ttl("k") >= 999 && ttl("k") <= 1000);
+    assert(run_command(store, {"SET", "k", "v", "PXAT", later_ms}) == OK);
+    assert(ttl("k") >= 999 && ttl("k") <= 1000);
     
-    // Test removing TTL
-    assert(ttl.remove_ttl("key1"));
-    assert(!ttl.has_ttl("key1"));
-    assert(ttl.get_ttl("key1") == -1);
+    // Conflicting or malformed SET options
+    assert(run_command(store, {"SET", "k", "v", "NX", "XX"}) == SYNTAX);
+    assert(run_command(store, {"SET", "k", "v", "EX", "5", "PX", "10"}) == SYNTAX);
+    assert(run_command(store, {"SET", "k", "v", "KEEPTTL", "EX", "5"}) == SYNTAX);
+    assert(run_command(store, {"SET", "k", "v", "EX"}) == SYNTAX);
+    assert(run_command(store, {"SET", "k", "v", "EX", "0"}) ==
+           "-ERR invalid expire time in 'SET' command\r\n");
+    assert(run_command(store, {"SET", "k", "v", "PX", "-5"}) ==
+           "-ERR invalid expire time in 'SET' command\r\n");
+    assert(run_command(store, {"SET", "k", "v", "EX", "ten"}) ==
+           "-ERR value is not an integer or out of range\r\n");
+    assert(run_command(store, {"SETEX", "k", "0", "v"}) ==
+           "-ERR invalid expire time in 'SETEX' command\r\n");
+    assert(ttl("k") >= 999 && ttl("k") <= 1000);  // Left as it was
     
-    // Test expiration (with very short TTL)
-    assert(ttl.set_ttl("key2", 1));
+    // GETEX options
+    assert(run_command(store, {"GETEX", "k", "EX", "50"}) == "$1\r\nv\r\n");
+    assert(run_command(store, {"TTL", "k"}) == ":50\r\n");
+    assert(run_command(store, {"GETEX", "k"}) == "$1\r\nv\r\n");
+    assert(run_command(store, {"TTL", "k"}) == ":50\r\n");
+    assert(run_command(store, {"GETEX", "k", "PERSIST"}) == "$1\r\nv\r\n");
+    assert(run_command(store, {"TTL", "k"}) == ":-1\r\n");
+    assert(run_command(store, {"GETEX", "k", "EX", "5", "PERSIST"}) == SYNTAX);
+    assert(run_command(store, {"GETEX", "k", "PX", "0"}) ==
+           "-ERR invalid expire time in 'GETEX' command\r\n");
+    assert(run_command(store, {"GETEX", "k", "PXAT", "1"}) == "$1\r\nv\r\n");
+    assert(run_command(store, {"EXISTS", "k"}) == ":0\r\n");  // A time already past
+    assert(run_command(store, {"GETEX", "k", "EX", "5"}) == NIL);
     
-    // Wait a bit and check expiration
-    std::this_thread::sleep_for(std::chrono::milliseconds(1100));
+    // EXPIRE family
+    assert(run_command(store, {"SET", "k", "v"}) == OK);
+    assert(run_command(store, {"EXPIRE", "k", "100"}) == ":1\r\n");
+    assert(run_command(store, {"TTL", "k"}) == ":100\r\n");
+    assert(run_command(store, {"PEXPIRE", "k", "5000"}) == ":1\r\n");
+    assert(run_command(store, {"TTL", "k"}) == ":5\r\n");
+    assert(run_command(store, {"EXPIREAT", "k", later}) == ":1\r\n");
+    assert(ttl("k") >= 999 && ttl("k") <= 1000);
+    assert(run_command(store, {"PERSIST", "k"}) == ":1\r\n");
+    assert(run_command(store, {"PERSIST", "k"}) == ":0\r\n");
+    assert(run_command(store, {"EXPIRE", "none", "100"}) == ":0\r\n");
+    assert(run_command(store, {"TTL", "none"}) == ":-2\r\n");
+    assert(run_command(store, {"EXPIRE", "k", "soon"}) ==
+           "-ERR value is not an integer or out of range\r\n");
+    assert(run_command(store, {"EXPIRE", "k"}) ==
+           "-ERR wrong number of arguments for 'EXPIRE'\r\n");
+    assert(run_command(store, {"PEXPIREAT", "k", "1"}) == ":1\r\n");  // Past: deleted
+    assert(run_command(store, {"EXISTS", "k"}) == ":0\r\n");
+    assert(run_command(store, {"SET", "k", "v"}) == OK);
+    assert(run_command(store, {"EXPIRE", "k", "0"}) == ":1\r\n");
+    assert(run_command(store, {"GET", "k"}) == NIL);
     
-    size_t expired = ttl.check_expirations();
-    assert(expired == 1);
-    assert(!ttl.has_ttl("key2"));
+    // ZADD flags
+    assert(run_command(store, {"ZADD", "z", "1", "a"}) == ":1\r\n");
+    assert(run_command(store, {"ZADD", "z", "NX", "XX", "1", "a"}) ==
+           "-ERR XX and NX options at the same time are not compatible\r\n");
+    assert(run_command(store, {"ZADD", "z", "GT", "LT", "1", "a"}) ==
+           "-ERR GT, LT, and/or NX options at the same time are not compatible\r\n");
+    assert(run_command(store, {"ZADD", "z", "NX", "GT", "1", "a"}) ==
+           "-ERR GT, LT, and/or NX options at the same time are not compatible\r\n");
+    assert(run_command(store, {"ZADD", "z", "INCR", "1", "a", "2", "b"}) ==
+           "-ERR INCR option supports a single increment-element pair\r\n");
+    assert(run_command(store, {"ZADD", "z", "1", "a", "2"}) == SYNTAX);
+    assert(run_command(store, {"ZADD", "z", "GT", "CH", "0", "a", "3", "b"}) == ":1\r\n");
+    assert(run_command(store, {"ZADD", "z", "GT", "CH", "5", "a"}) == ":1\r\n");
+    assert(run_command(store, {"ZADD", "z", "XX", "1", "c"}) == ":0\r\n");
+    assert(run_command(store, {"ZADD", "z", "INCR", "2", "a"}) == "$1\r\n7\r\n");
+    assert(run_command(store, {"ZADD", "z", "NX", "INCR", "2", "a"}) == NIL);
+    assert(run_command(store, {"GETEX", "z"}) ==
+           "-WRONGTYPE Operation against a key holding the wrong kind of value\r\n");
     
-    std::cout << "TTL Manager tests passed!" << std::endl;
+    std::cout << "KV store command tests passed!" << std::endl;
 }
 
 int main() {
@@ -106,8 +1294,19 @@ int main() {
     
     try {
         test_hashtable();
+        test_swiss_table();
+        test_concurrent_hashtable();
         test_protocol();
-        test_ttl_manager();
+        test_resp_protocol();
+        test_command_table();
+        test_avl_tree();
+        test_sorted_set();
+        test_key_expiry();
+        test_kv_commands();
+        test_mpsc_queue();
+        test_slab_allocator();
+        test_pubsub();
+        test_key_sharding();
         
         std::cout << "==============================" << std::endl;
         std::cout << "All tests passed! ✅" << std::endl;